@@ -0,0 +1,189 @@
+#include <benchmark/benchmark.h>
+#include "attention.hpp"
+
+namespace {
+
+// The previous multi-head layout: every head of every token interleaved into
+// one (seq_len * num_heads, d_k) matrix and attended as a single sequence.
+Eigen::MatrixXf interleave_heads(const Eigen::MatrixXf& input, int num_heads){
+    int seq_len = input.rows();
+    int d_k = input.cols() / num_heads;
+    Eigen::MatrixXf reshaped(seq_len * num_heads, d_k);
+
+    for (int seq = 0; seq < seq_len; ++seq){
+        for (int head = 0; head < num_heads; ++head){
+            reshaped.row(seq * num_heads + head) = input.block(seq, head * d_k, 1, d_k);
+        }
+    }
+    return reshaped;
+}
+
+constexpr int kDModel = 256;
+
+void BM_InterleavedHeads(benchmark::State& state){
+    int seq_len = static_cast<int>(state.range(0));
+    int num_heads = static_cast<int>(state.range(1));
+
+    transformer::ScaledDotProductAttention attention(kDModel / num_heads);
+    Eigen::MatrixXf Q = Eigen::MatrixXf::Random(seq_len, kDModel);
+    Eigen::MatrixXf K = Eigen::MatrixXf::Random(seq_len, kDModel);
+    Eigen::MatrixXf V = Eigen::MatrixXf::Random(seq_len, kDModel);
+
+    for (auto _ : state){
+        Eigen::MatrixXf out = attention.forward(interleave_heads(Q, num_heads),
+                                                interleave_heads(K, num_heads),
+                                                interleave_heads(V, num_heads));
+        benchmark::DoNotOptimize(out.data());
+    }
+}
+
+void BM_PerHeadAttention(benchmark::State& state){
+    int seq_len = static_cast<int>(state.range(0));
+    int num_heads = static_cast<int>(state.range(1));
+
+    transformer::ScaledDotProductAttention attention(kDModel / num_heads);
+    Eigen::MatrixXf Q = Eigen::MatrixXf::Random(seq_len, kDModel);
+    Eigen::MatrixXf K = Eigen::MatrixXf::Random(seq_len, kDModel);
+    Eigen::MatrixXf V = Eigen::MatrixXf::Random(seq_len, kDModel);
+    Eigen::MatrixXf out(seq_len, kDModel);
+
+    for (auto _ : state){
+        attention.forward_heads(Q, K, V, num_heads, out);
+        benchmark::DoNotOptimize(out.data());
+    }
+}
+
+void HeadShapes(benchmark::internal::Benchmark* b){
+    b->ArgNames({"seq_len", "heads"});
+    for (int seq_len : {64, 128, 256, 512}){
+        for (int heads : {2, 4, 8}){
+            b->Args({seq_len, heads});
+        }
+    }
+}
+
+void BM_MultiHeadSelfAttention(benchmark::State& state){
+    int seq_len = static_cast<int>(state.range(0));
+    int d_model = static_cast<int>(state.range(1));
+
+    transformer::MultiHeadAttention mha(8, d_model);
+    Eigen::MatrixXf x = Eigen::MatrixXf::Random(seq_len, d_model);
+
+    for (auto _ : state){
+        Eigen::MatrixXf out = mha.forward(x, x, x);
+        benchmark::DoNotOptimize(out.data());
+    }
+}
+
+// Decoder self-attention: dense (seq_len, seq_len) mask versus the built-in causal path
+void BM_DenseCausalMask(benchmark::State& state){
+    int seq_len = static_cast<int>(state.range(0));
+    constexpr int kHeads = 8;
+
+    transformer::ScaledDotProductAttention attention(kDModel / kHeads);
+    Eigen::MatrixXf Q = Eigen::MatrixXf::Random(seq_len, kDModel);
+    Eigen::MatrixXf out(seq_len, kDModel);
+
+    transformer::BoolArrayXXb allowed(seq_len, seq_len);
+    for (int i = 0; i < seq_len; ++i){
+        for (int j = 0; j < seq_len; ++j){
+            allowed(i, j) = j <= i;
+        }
+    }
+    transformer::AttentionMask mask = transformer::AttentionMask::from_boolean(allowed);
+
+    for (auto _ : state){
+        attention.forward_heads(Q, Q, Q, kHeads, out, mask);
+        benchmark::DoNotOptimize(out.data());
+    }
+}
+
+void BM_BuiltinCausalMask(benchmark::State& state){
+    int seq_len = static_cast<int>(state.range(0));
+    constexpr int kHeads = 8;
+
+    transformer::ScaledDotProductAttention attention(kDModel / kHeads);
+    Eigen::MatrixXf Q = Eigen::MatrixXf::Random(seq_len, kDModel);
+    Eigen::MatrixXf out(seq_len, kDModel);
+
+    for (auto _ : state){
+        attention.forward_heads(Q, Q, Q, kHeads, out, transformer::AttentionMask::causal_mask());
+        benchmark::DoNotOptimize(out.data());
+    }
+}
+
+// Cost of producing one more token with `context` tokens already generated
+void BM_DecodeFullRecompute(benchmark::State& state){
+    int context = static_cast<int>(state.range(0));
+
+    transformer::MultiHeadAttention mha(8, kDModel);
+    Eigen::MatrixXf sequence = Eigen::MatrixXf::Random(context + 1, kDModel);
+
+    for (auto _ : state){
+        Eigen::MatrixXf out = mha.forward(sequence, sequence, sequence, transformer::AttentionMask::causal_mask());
+        benchmark::DoNotOptimize(out.data());
+    }
+}
+
+void BM_DecodeWithKVCache(benchmark::State& state){
+    int context = static_cast<int>(state.range(0));
+
+    transformer::MultiHeadAttention mha(8, kDModel);
+    transformer::KVCache cache(kDModel, context + 1);
+    Eigen::MatrixXf prompt = Eigen::MatrixXf::Random(context, kDModel);
+    Eigen::MatrixXf token = Eigen::MatrixXf::Random(1, kDModel);
+    mha.forward_incremental(prompt, cache);
+
+    for (auto _ : state){
+        Eigen::MatrixXf out = mha.forward_incremental(token, cache);
+        benchmark::DoNotOptimize(out.data());
+        cache.truncate(context);
+    }
+    state.counters["kv_bytes"] = 2.0 * sizeof(float) * cache.capacity() * kDModel;
+}
+
+void run_paged_decode(benchmark::State& state, transformer::KVStorage storage){
+    int context = static_cast<int>(state.range(0));
+    // Every page is one online-softmax tile, so very small pages pay per-tile overhead
+    constexpr int kPageSize = 64;
+
+    transformer::MultiHeadAttention mha(8, kDModel);
+    transformer::PagedKVCache cache(kDModel, kPageSize, context / kPageSize + 2, storage);
+    Eigen::MatrixXf prompt = Eigen::MatrixXf::Random(context, kDModel);
+    Eigen::MatrixXf token = Eigen::MatrixXf::Random(1, kDModel);
+    int seq = cache.create_sequence();
+    mha.forward_incremental(prompt, cache, seq);
+
+    for (auto _ : state){
+        // Each step decodes on a fork of the prompt, which shares all of its pages
+        int step = cache.fork_sequence(seq);
+        Eigen::MatrixXf out = mha.forward_incremental(token, cache, step);
+        benchmark::DoNotOptimize(out.data());
+        cache.free_sequence(step);
+    }
+    state.counters["kv_bytes"] = static_cast<double>(cache.arena_bytes()) / cache.num_pages()
+                                 * (cache.num_pages() - cache.num_free_pages());
+}
+
+void BM_DecodeWithPagedKVCache(benchmark::State& state){
+    run_paged_decode(state, transformer::KVStorage::FP32);
+}
+
+void BM_DecodeWithBf16PagedKVCache(benchmark::State& state){
+    run_paged_decode(state, transformer::KVStorage::BF16);
+}
+
+} // namespace
+
+BENCHMARK(BM_InterleavedHeads)->Apply(HeadShapes)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_PerHeadAttention)->Apply(HeadShapes)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_MultiHeadSelfAttention)
+    ->ArgNames({"seq_len", "d_model"})
+    ->ArgsProduct({{1, 8, 32, 128}, {256, 512}})
+    ->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_DenseCausalMask)->ArgName("seq_len")->RangeMultiplier(2)->Range(256, 2048)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_BuiltinCausalMask)->ArgName("seq_len")->RangeMultiplier(2)->Range(256, 2048)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_DecodeFullRecompute)->ArgName("context")->RangeMultiplier(4)->Range(16, 4096)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_DecodeWithKVCache)->ArgName("context")->RangeMultiplier(4)->Range(16, 4096)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_DecodeWithPagedKVCache)->ArgName("context")->RangeMultiplier(4)->Range(16, 4096)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_DecodeWithBf16PagedKVCache)->ArgName("context")->RangeMultiplier(4)->Range(16, 4096)->Unit(benchmark::kMicrosecond);
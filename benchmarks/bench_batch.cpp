@@ -0,0 +1,53 @@
+#include <benchmark/benchmark.h>
+#include <random>
+#include "attention.hpp"
+#include "batch.hpp"
+#include "feed_forward.hpp"
+
+namespace {
+
+constexpr int kDModel = 512;
+constexpr int kDFF = 2048;
+
+// Request lengths drawn between 1 and 64 tokens, the same set every run
+std::vector<Eigen::MatrixXf> make_requests(int count){
+    std::mt19937 gen(7);
+    std::uniform_int_distribution<int> length(1, 64);
+    std::vector<Eigen::MatrixXf> requests;
+    for (int i = 0; i < count; ++i){
+        requests.push_back(Eigen::MatrixXf::Random(length(gen), kDModel));
+    }
+    return requests;
+}
+
+void BM_PerSequenceLayers(benchmark::State& state){
+    auto requests = make_requests(static_cast<int>(state.range(0)));
+    transformer::MultiHeadAttention attention(8, kDModel);
+    transformer::FeedForward feed_forward(kDModel, kDFF);
+
+    for (auto _ : state){
+        for (const auto& x : requests){
+            Eigen::MatrixXf h = attention.forward(x, x, x, transformer::AttentionMask::causal_mask());
+            Eigen::MatrixXf out = feed_forward.forward(h);
+            benchmark::DoNotOptimize(out.data());
+        }
+    }
+}
+
+void BM_RaggedBatchLayers(benchmark::State& state){
+    auto batch = transformer::RaggedBatch::pack(make_requests(static_cast<int>(state.range(0))));
+    transformer::MultiHeadAttention attention(8, kDModel);
+    transformer::FeedForward feed_forward(kDModel, kDFF);
+
+    for (auto _ : state){
+        auto h = attention.forward_batch(batch, true);
+        auto out = feed_forward.forward_batch(h);
+        benchmark::DoNotOptimize(out.tokens.data());
+    }
+    state.counters["tokens"] = batch.total_tokens();
+}
+
+} // namespace
+
+BENCHMARK(BM_PerSequenceLayers)->ArgName("requests")->RangeMultiplier(4)->Range(4, 64)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_RaggedBatchLayers)->ArgName("requests")->RangeMultiplier(4)->Range(4, 64)->Unit(benchmark::kMillisecond);
@@ -0,0 +1,136 @@
+#include <benchmark/benchmark.h>
+#include <cmath>
+#include <random>
+#include "embedding.hpp"
+
+namespace {
+
+constexpr int kVocab = 100000;
+constexpr int kDModel = 512;
+constexpr int kTokens = 4096;
+
+// Zipf-like ids: a few frequent tokens repeat across the batch, the tail is spread out
+std::vector<int> batch_ids(){
+    std::mt19937 gen(42);
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+    std::vector<int> ids(kTokens);
+    for (int& id : ids){
+        id = static_cast<int>(std::pow(static_cast<double>(kVocab), uniform(gen))) - 1;
+    }
+    return ids;
+}
+
+const transformer::TokenEmbedding& table(transformer::WeightFormat format){
+    static transformer::TokenEmbedding fp32(kVocab, kDModel);
+    static transformer::TokenEmbedding int8 = [] {
+        transformer::TokenEmbedding quantized = fp32;
+        quantized.quantize_weights(transformer::WeightFormat::INT8);
+        return quantized;
+    }();
+    static transformer::TokenEmbedding bf16 = [] {
+        transformer::TokenEmbedding quantized = fp32;
+        quantized.quantize_weights(transformer::WeightFormat::BF16);
+        return quantized;
+    }();
+    switch (format){
+        case transformer::WeightFormat::INT8: return int8;
+        case transformer::WeightFormat::BF16: return bf16;
+        default: return fp32;
+    }
+}
+
+// The lookup before gather existed: one strided column-major row copy per token
+void BM_EmbeddingRowByRow(benchmark::State& state){
+    Eigen::MatrixXf column_major = table(transformer::WeightFormat::FP32).get_embedding_matrix();
+    std::vector<int> ids = batch_ids();
+    Eigen::MatrixXf out(kTokens, kDModel);
+
+    for (auto _ : state){
+        for (int i = 0; i < kTokens; ++i){
+            out.row(i) = column_major.row(ids[i]);
+        }
+        benchmark::DoNotOptimize(out.data());
+    }
+    state.SetItemsProcessed(state.iterations() * kTokens);
+}
+
+void BM_EmbeddingGather(benchmark::State& state){
+    const auto& embedding = table(static_cast<transformer::WeightFormat>(state.range(0)));
+    std::vector<int> ids = batch_ids();
+    Eigen::MatrixXf out(kTokens, kDModel);
+
+    for (auto _ : state){
+        embedding.gather(ids.data(), kTokens, out);
+        benchmark::DoNotOptimize(out.data());
+    }
+    state.SetItemsProcessed(state.iterations() * kTokens);
+    state.counters["table_MB"] = embedding.weight_bytes() / 1e6;
+}
+
+// Table construction the way it was done before the recurrence: pow, sin and cos per element
+void BM_PositionalTableDirect(benchmark::State& state){
+    const int max_seq_len = static_cast<int>(state.range(0));
+    for (auto _ : state){
+        Eigen::MatrixXf table(max_seq_len, kDModel);
+        for (int pos = 0; pos < max_seq_len; ++pos){
+            for (int i = 0; i < kDModel; ++i){
+                float angle = pos / std::pow(10000.0f, 2.0f * i / kDModel);
+                table(pos, i) = i % 2 == 0 ? std::sin(angle) : std::cos(angle);
+            }
+        }
+        benchmark::DoNotOptimize(table.data());
+    }
+}
+
+void BM_PositionalTableRecurrence(benchmark::State& state){
+    const int max_seq_len = static_cast<int>(state.range(0));
+    for (auto _ : state){
+        transformer::PositionalEncoding encoding(max_seq_len, kDModel);
+        benchmark::DoNotOptimize(encoding.get_pos_encoding().data());
+    }
+}
+
+// Adding encodings to a prefill chunk (range 0) or a single decode row (range 1)
+void BM_PositionalAdd(benchmark::State& state){
+    const auto table = static_cast<transformer::EncodingTable>(state.range(0));
+    const int rows = static_cast<int>(state.range(1));
+    transformer::PositionalEncoding encoding(8192, kDModel, table);
+    Eigen::MatrixXf x = Eigen::MatrixXf::Random(rows, kDModel);
+
+    for (auto _ : state){
+        encoding.add_into(x, 8192 - rows);
+        benchmark::DoNotOptimize(x.data());
+    }
+    state.SetItemsProcessed(state.iterations() * rows);
+}
+
+void BM_RotaryQK(benchmark::State& state){
+    const int rows = static_cast<int>(state.range(0));
+    const int num_heads = 8;
+    transformer::RotaryEmbedding rotary(kDModel / num_heads);
+    Eigen::MatrixXf qk = Eigen::MatrixXf::Random(rows, 2 * kDModel);
+
+    for (auto _ : state){
+        rotary.rotate(qk, 2 * num_heads, 1000);
+        benchmark::DoNotOptimize(qk.data());
+    }
+    state.SetItemsProcessed(state.iterations() * rows);
+}
+
+} // namespace
+
+BENCHMARK(BM_EmbeddingRowByRow)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_EmbeddingGather)
+    ->Arg(static_cast<int>(transformer::WeightFormat::FP32))
+    ->Arg(static_cast<int>(transformer::WeightFormat::INT8))
+    ->Arg(static_cast<int>(transformer::WeightFormat::BF16))
+    ->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_PositionalTableDirect)->Arg(2048)->Arg(8192)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_PositionalTableRecurrence)->Arg(2048)->Arg(8192)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_PositionalAdd)
+    ->Args({static_cast<int>(transformer::EncodingTable::Precomputed), 512})
+    ->Args({static_cast<int>(transformer::EncodingTable::OnDemand), 512})
+    ->Args({static_cast<int>(transformer::EncodingTable::Precomputed), 1})
+    ->Args({static_cast<int>(transformer::EncodingTable::OnDemand), 1})
+    ->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_RotaryQK)->Arg(1)->Arg(512)->Unit(benchmark::kMicrosecond);
@@ -0,0 +1,45 @@
+#include <benchmark/benchmark.h>
+#include "bench_metrics.hpp"
+#include "feed_forward.hpp"
+
+namespace {
+
+constexpr int kDModel = 512;
+constexpr int kDFF = 2048;
+
+// hidden_rows 0 means a full (seq_len x d_ff) hidden buffer, otherwise the streamed block size
+void run_feed_forward(benchmark::State& state, int hidden_rows){
+    int seq_len = static_cast<int>(state.range(0));
+    bench::PeakRss rss;
+    const transformer::FeedForward layer(kDModel, kDFF);
+    int rows = hidden_rows > 0 ? hidden_rows : seq_len;
+
+    Eigen::MatrixXf x = Eigen::MatrixXf::Random(seq_len, kDModel);
+    Eigen::MatrixXf hidden(rows, layer.get_hidden_width());
+    Eigen::MatrixXf out(seq_len, kDModel);
+
+    for (auto _ : state){
+        layer.infer(x, out, hidden);
+        benchmark::DoNotOptimize(out.data());
+    }
+
+    state.SetItemsProcessed(state.iterations() * seq_len);
+    // rss_growth is the measured footprint of this case, weights and activations included;
+    // hidden_mb is only the scratch the benchmark handed in
+    state.counters["hidden_mb"] = hidden.size() * sizeof(float) / (1024.0 * 1024.0);
+    rss.report(state);
+}
+
+void BM_StreamedFeedForward(benchmark::State& state){
+    const transformer::FeedForward layer(kDModel, kDFF);
+    run_feed_forward(state, layer.rows_per_block());
+}
+
+void BM_FullHiddenFeedForward(benchmark::State& state){
+    run_feed_forward(state, 0);
+}
+
+} // namespace
+
+BENCHMARK(BM_StreamedFeedForward)->RangeMultiplier(4)->Range(512, 16384)->Iterations(2)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_FullHiddenFeedForward)->RangeMultiplier(4)->Range(512, 16384)->Iterations(2)->Unit(benchmark::kMillisecond);
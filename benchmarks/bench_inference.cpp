@@ -0,0 +1,112 @@
+#include <benchmark/benchmark.h>
+#include "feed_forward.hpp"
+#include "layer_norm.hpp"
+
+namespace {
+
+constexpr int kDModel = 512;
+constexpr int kDFF = 2048;
+
+// cache_bytes counts the activations the training path copies into members per call,
+// traffic the inference path never generates
+
+void BM_FeedForwardForward(benchmark::State& state){
+    int seq_len = static_cast<int>(state.range(0));
+    transformer::FeedForward layer(kDModel, kDFF);
+    Eigen::MatrixXf x = Eigen::MatrixXf::Random(seq_len, kDModel);
+
+    for (auto _ : state){
+        Eigen::MatrixXf out = layer.forward(x);
+        benchmark::DoNotOptimize(out.data());
+    }
+    state.counters["cache_bytes"] = static_cast<double>(seq_len) * (kDModel + kDFF) * sizeof(float);
+}
+
+void BM_FeedForwardInfer(benchmark::State& state){
+    int seq_len = static_cast<int>(state.range(0));
+    const transformer::FeedForward layer(kDModel, kDFF);
+    Eigen::MatrixXf x = Eigen::MatrixXf::Random(seq_len, kDModel);
+    Eigen::MatrixXf hidden(seq_len, kDFF);
+    Eigen::MatrixXf out(seq_len, kDModel);
+
+    for (auto _ : state){
+        layer.infer(x, out, hidden);
+        benchmark::DoNotOptimize(out.data());
+    }
+    state.counters["cache_bytes"] = 0;
+}
+
+void BM_LayerNormForward(benchmark::State& state){
+    int seq_len = static_cast<int>(state.range(0));
+    transformer::LayerNorm layer(kDModel);
+    Eigen::MatrixXf x = Eigen::MatrixXf::Random(seq_len, kDModel);
+
+    for (auto _ : state){
+        Eigen::MatrixXf out = layer.forward(x);
+        benchmark::DoNotOptimize(out.data());
+    }
+    state.counters["cache_bytes"] = static_cast<double>(seq_len) * (2 * kDModel + 2) * sizeof(float);
+}
+
+void BM_LayerNormInfer(benchmark::State& state){
+    int seq_len = static_cast<int>(state.range(0));
+    const transformer::LayerNorm layer(kDModel);
+    Eigen::MatrixXf x = Eigen::MatrixXf::Random(seq_len, kDModel);
+    Eigen::MatrixXf out(seq_len, kDModel);
+
+    for (auto _ : state){
+        layer.infer(x, out);
+        benchmark::DoNotOptimize(out.data());
+    }
+    state.counters["cache_bytes"] = 0;
+}
+
+// One row per Activation value, d_ff held fixed so gated variants do twice the GEMM1 work
+void BM_FeedForwardActivation(benchmark::State& state){
+    auto activation = static_cast<transformer::Activation>(state.range(0));
+    int seq_len = 512;
+    const transformer::FeedForward layer(kDModel, kDFF, activation);
+    Eigen::MatrixXf x = Eigen::MatrixXf::Random(seq_len, kDModel);
+    Eigen::MatrixXf hidden(seq_len, layer.get_hidden_width());
+    Eigen::MatrixXf out(seq_len, kDModel);
+
+    for (auto _ : state){
+        layer.infer(x, out, hidden);
+        benchmark::DoNotOptimize(out.data());
+    }
+}
+
+void BM_LayerNormAddInfer(benchmark::State& state){
+    int seq_len = static_cast<int>(state.range(0));
+    const transformer::LayerNorm layer(kDModel);
+    Eigen::MatrixXf x = Eigen::MatrixXf::Random(seq_len, kDModel);
+    Eigen::MatrixXf residual = Eigen::MatrixXf::Random(seq_len, kDModel);
+    Eigen::MatrixXf out(seq_len, kDModel);
+
+    for (auto _ : state){
+        layer.add_infer(x, residual, out);
+        benchmark::DoNotOptimize(out.data());
+    }
+}
+
+void BM_RMSNormInfer(benchmark::State& state){
+    int seq_len = static_cast<int>(state.range(0));
+    const transformer::RMSNorm layer(kDModel);
+    Eigen::MatrixXf x = Eigen::MatrixXf::Random(seq_len, kDModel);
+    Eigen::MatrixXf out(seq_len, kDModel);
+
+    for (auto _ : state){
+        layer.infer(x, out);
+        benchmark::DoNotOptimize(out.data());
+    }
+}
+
+} // namespace
+
+BENCHMARK(BM_FeedForwardForward)->Arg(64)->Arg(512)->Arg(2048)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_FeedForwardInfer)->Arg(64)->Arg(512)->Arg(2048)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_FeedForwardActivation)->DenseRange(0, 4)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_LayerNormForward)->Arg(64)->Arg(512)->Arg(2048)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_LayerNormInfer)->Arg(64)->Arg(512)->Arg(2048)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_LayerNormAddInfer)->Arg(64)->Arg(512)->Arg(2048)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_RMSNormInfer)->Arg(64)->Arg(512)->Arg(2048)->Unit(benchmark::kMicrosecond);
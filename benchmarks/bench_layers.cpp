@@ -0,0 +1,239 @@
+#include <benchmark/benchmark.h>
+#include <algorithm>
+#include <memory>
+#include <numeric>
+#include "allocation_counter.hpp"
+#include "bench_metrics.hpp"
+#include "thread_pool.hpp"
+#include "transformer.hpp"
+
+// Layer sweeps and end-to-end prefill/decode, each reporting FLOP/s, bytes/token and
+// allocs/iter. Run with --benchmark_out=<file>.json and check against a stored baseline
+// with compare_baseline.py (or the bench_baseline / bench_check targets).
+
+namespace {
+
+// (d_model, heads) pairs from small to large models, 64-wide heads throughout
+constexpr int kModelShapes[][2] = {{256, 4}, {1024, 16}, {4096, 64}};
+constexpr int kSeqLens[] = {1, 128, 1024, 8192};
+// Larger layer calls take minutes per iteration on a few cores
+constexpr long kMaxTokenElements = 8192L * 1024;
+
+constexpr int kVocab = 8000;
+
+double float_bytes(double elements){
+    return elements * sizeof(float);
+}
+
+void layer_shapes(benchmark::internal::Benchmark* bench){
+    bench->ArgNames({"d_model", "heads", "seq_len"});
+    for (const auto& shape : kModelShapes){
+        for (int seq_len : kSeqLens){
+            if (static_cast<long>(seq_len) * shape[0] <= kMaxTokenElements){
+                bench->Args({shape[0], shape[1], seq_len});
+            }
+        }
+    }
+}
+
+struct Shape {
+    int d_model;
+    int heads;
+    int seq_len;
+};
+
+Shape shape_of(const benchmark::State& state){
+    return {static_cast<int>(state.range(0)), static_cast<int>(state.range(1)), static_cast<int>(state.range(2))};
+}
+
+// Causal self-attention: the projections plus QK^T and PV over the visible pairs
+double attention_flops(double n, double kv, double d, bool causal){
+    double pairs = causal ? n * (n + 1) / 2 + n * (kv - n) : n * kv;
+    return 8.0 * n * d * d + 4.0 * pairs * d;
+}
+
+double feed_forward_flops(double n, const transformer::FeedForward& layer){
+    return 2.0 * n * layer.get_d_model() * (layer.get_hidden_width() + layer.get_d_ff());
+}
+
+
+void BM_MultiHeadAttention(benchmark::State& state){
+    Shape s = shape_of(state);
+    const transformer::MultiHeadAttention layer(s.heads, s.d_model);
+    transformer::AttentionContext context;
+    layer.reserve(context, s.seq_len, s.seq_len);
+    transformer::thread_pool().for_each_thread([&](int){layer.reserve_thread(s.seq_len, s.seq_len);});
+    Eigen::MatrixXf x = Eigen::MatrixXf::Random(s.seq_len, s.d_model);
+    Eigen::MatrixXf out(s.seq_len, s.d_model);
+    auto causal = transformer::AttentionMask::causal_mask();
+
+    long allocations = support::allocation_count();
+    for (auto _ : state){
+        layer.forward_into(x, x, x, causal, out, context);
+        benchmark::DoNotOptimize(out.data());
+    }
+    bench::report(state, {attention_flops(s.seq_len, s.seq_len, s.d_model, true),
+                          layer.weight_bytes() + float_bytes(2.0 * x.size()), double(s.seq_len)},
+                  support::allocation_count() - allocations);
+}
+
+void BM_FeedForward(benchmark::State& state){
+    Shape s = shape_of(state);
+    const transformer::FeedForward layer(s.d_model, 4 * s.d_model, transformer::Activation::GELU_Tanh);
+    Eigen::MatrixXf x = Eigen::MatrixXf::Random(s.seq_len, s.d_model);
+    Eigen::MatrixXf out(s.seq_len, s.d_model);
+    Eigen::MatrixXf hidden(std::min(s.seq_len, layer.rows_per_block() * transformer::get_num_threads()),
+                           layer.get_hidden_width());
+
+    long allocations = support::allocation_count();
+    for (auto _ : state){
+        layer.infer(x, out, hidden);
+        benchmark::DoNotOptimize(out.data());
+    }
+    bench::report(state, {feed_forward_flops(s.seq_len, layer),
+                          layer.weight_bytes() + float_bytes(2.0 * x.size()), double(s.seq_len)},
+                  support::allocation_count() - allocations);
+}
+
+void BM_LayerNorm(benchmark::State& state){
+    Shape s = shape_of(state);
+    const transformer::LayerNorm layer(s.d_model);
+    Eigen::MatrixXf x = Eigen::MatrixXf::Random(s.seq_len, s.d_model);
+    Eigen::MatrixXf out(s.seq_len, s.d_model);
+
+    long allocations = support::allocation_count();
+    for (auto _ : state){
+        layer.infer(x, out);
+        benchmark::DoNotOptimize(out.data());
+    }
+    // Mean and variance accumulation plus the affine normalisation, about 7 per element
+    bench::report(state, {7.0 * x.size(), float_bytes(2.0 * x.size() + 2.0 * s.d_model), double(s.seq_len)},
+                  support::allocation_count() - allocations);
+}
+
+void BM_EmbeddingGather(benchmark::State& state){
+    Shape s = shape_of(state);
+    const transformer::TokenEmbedding embedding(kVocab, s.d_model);
+    std::vector<int> ids(s.seq_len);
+    for (int i = 0; i < s.seq_len; ++i){
+        ids[i] = static_cast<int>((i * 7919L) % kVocab);
+    }
+    Eigen::MatrixXf out(s.seq_len, s.d_model);
+
+    long allocations = support::allocation_count();
+    for (auto _ : state){
+        embedding.forward_into(ids, out);
+        benchmark::DoNotOptimize(out.data());
+    }
+    bench::report(state, {0.0, float_bytes(2.0 * out.size()), double(s.seq_len)},
+                  support::allocation_count() - allocations);
+}
+
+
+// End-to-end model: encoder-decoder for prefill, a decoder-only stack for decode
+constexpr int kModelDim = 512;
+constexpr int kModelHeads = 8;
+constexpr int kModelDFF = 2048;
+constexpr int kModelLayers = 2;
+constexpr int kModelMaxSeqLen = 4096;
+
+// Source and target of seq_len tokens through the full model, logits included
+void BM_Prefill(benchmark::State& state){
+    int n = static_cast<int>(state.range(0));
+    transformer::Transformer model(kVocab, kVocab, kModelDim, kModelHeads, kModelDFF, kModelLayers,
+                                   kModelMaxSeqLen, transformer::Activation::GELU_Tanh);
+    transformer::TransformerContext context;
+    model.reserve(context, n);
+    std::vector<int> tokens(n);
+    std::iota(tokens.begin(), tokens.end(), 0);
+    Eigen::MatrixXf logits(n, kVocab);
+
+    double flops = 2.0 * n * kModelDim * kVocab;
+    double weight_bytes = model.get_src_embedding().weight_bytes() + model.get_tgt_embedding().weight_bytes();
+    for (int i = 0; i < model.get_num_layers(); ++i){
+        auto& encoder = model.get_encoder_layer(i);
+        auto& decoder = model.get_decoder_layer(i);
+        flops += attention_flops(n, n, kModelDim, false) + feed_forward_flops(n, encoder.get_feed_forward());
+        flops += attention_flops(n, n, kModelDim, true) + attention_flops(n, n, kModelDim, false) +
+                 feed_forward_flops(n, decoder.get_feed_forward());
+        weight_bytes += encoder.get_self_attention().weight_bytes() + encoder.get_feed_forward().weight_bytes() +
+                        decoder.get_self_attention().weight_bytes() + decoder.get_cross_attention().weight_bytes() +
+                        decoder.get_feed_forward().weight_bytes();
+    }
+
+    model.forward_into(tokens, tokens, logits, context);
+    long allocations = support::allocation_count();
+    for (auto _ : state){
+        model.forward_into(tokens, tokens, logits, context);
+        benchmark::DoNotOptimize(logits.data());
+    }
+    bench::report(state, {flops, weight_bytes + float_bytes(logits.size()), 2.0 * n},
+                  support::allocation_count() - allocations);
+}
+
+// One generated token through kModelLayers decoder layers over context_len cached tokens.
+// Each iteration forks the prompt's cache sequence, so the context length stays fixed
+void BM_Decode(benchmark::State& state){
+    int context_len = static_cast<int>(state.range(0));
+    constexpr int kPageSize = 16;
+    struct Layer {
+        transformer::MultiHeadAttention attention{kModelHeads, kModelDim};
+        transformer::FeedForward feed_forward{kModelDim, kModelDFF, transformer::Activation::GELU_Tanh};
+        transformer::LayerNorm norm1{kModelDim};
+        transformer::LayerNorm norm2{kModelDim};
+        transformer::PagedKVCache cache;
+        int prompt;
+
+        explicit Layer(int num_pages) : cache(kModelDim, kPageSize, num_pages), prompt(cache.create_sequence()){}
+    };
+    std::vector<std::unique_ptr<Layer>> layers;
+    Eigen::MatrixXf prompt = Eigen::MatrixXf::Random(context_len, kModelDim);
+    for (int i = 0; i < kModelLayers; ++i){
+        layers.push_back(std::make_unique<Layer>(context_len / kPageSize + 4));
+        layers.back()->attention.forward_incremental(prompt, layers.back()->cache, layers.back()->prompt);
+    }
+
+    transformer::AttentionContext context;
+    transformer::thread_pool().for_each_thread([&](int){
+        for (const auto& layer : layers){
+            layer->attention.reserve_thread(1, context_len + 1);
+            layer->feed_forward.reserve_thread(1);
+        }
+    });
+    Eigen::MatrixXf x = Eigen::MatrixXf::Random(1, kModelDim);
+    Eigen::MatrixXf token(1, kModelDim), attended(1, kModelDim);
+    Eigen::MatrixXf hidden(1, kModelDim), ff_out(1, kModelDim), ff_hidden(1, layers[0]->feed_forward.get_hidden_width());
+
+    double flops = 0.0;
+    double bytes = 0.0;
+    for (const auto& layer : layers){
+        flops += attention_flops(1, context_len + 1, kModelDim, true) + feed_forward_flops(1, layer->feed_forward);
+        bytes += layer->attention.weight_bytes() + layer->feed_forward.weight_bytes() +
+                 float_bytes(2.0 * (context_len + 1) * kModelDim);
+    }
+
+    long allocations = support::allocation_count();
+    for (auto _ : state){
+        // Buffers are hoisted, so allocs/iter counts only the library's own allocations
+        token = x;
+        for (const auto& layer : layers){
+            int seq = layer->cache.fork_sequence(layer->prompt);
+            layer->attention.forward_incremental_into(token, layer->cache, seq, attended, context);
+            layer->norm1.add_infer(token, attended, hidden);
+            layer->feed_forward.infer(hidden, ff_out, ff_hidden);
+            layer->norm2.add_infer(hidden, ff_out, token);
+            layer->cache.free_sequence(seq);
+        }
+        benchmark::DoNotOptimize(token.data());
+    }
+    bench::report(state, {flops, bytes, 1.0}, support::allocation_count() - allocations);
+}
+
+} // namespace
+
+BENCHMARK(BM_MultiHeadAttention)->Apply(layer_shapes)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_FeedForward)->Apply(layer_shapes)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_LayerNorm)->Apply(layer_shapes)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_EmbeddingGather)->Apply(layer_shapes)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_Prefill)->ArgName("seq_len")->Arg(32)->Arg(256)->Arg(2048)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_Decode)->ArgName("context_len")->Arg(128)->Arg(1024)->Arg(4096)->Unit(benchmark::kMicrosecond);
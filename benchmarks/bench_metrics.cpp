@@ -0,0 +1,65 @@
+#include "bench_metrics.hpp"
+#include <fstream>
+#include <sstream>
+#include <string>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+namespace bench {
+
+void report(benchmark::State& state, const Work& work, long allocations){
+    using benchmark::Counter;
+    double iterations = static_cast<double>(state.iterations());
+    state.counters["FLOP/s"] = Counter(work.flops, Counter::kIsIterationInvariantRate, Counter::kIs1000);
+    state.counters["tokens/s"] = Counter(work.tokens, Counter::kIsIterationInvariantRate);
+    state.counters["bytes/token"] = Counter(work.bytes / work.tokens, Counter::kDefaults, Counter::kIs1024);
+    state.counters["allocs/iter"] = iterations > 0 ? allocations / iterations : 0.0;
+}
+
+
+namespace {
+
+// A /proc/self/status field such as "VmHWM:  1234 kB", in bytes; -1 if it is missing
+double status_bytes(const std::string& field){
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line)){
+        if (line.compare(0, field.size() + 1, field + ":") == 0){
+            std::istringstream value(line.substr(field.size() + 1));
+            double kib = -1.0;
+            value >> kib;
+            return kib < 0.0 ? -1.0 : kib * 1024.0;
+        }
+    }
+    return -1.0;
+}
+
+} // namespace
+
+
+PeakRss::PeakRss(){
+#ifdef __GLIBC__
+    // Hand back heap that earlier cases freed, so it is not counted as this case's baseline
+    malloc_trim(0);
+#endif
+    // "5" resets the peak RSS to the current RSS (Linux 4.0+)
+    std::ofstream clear_refs("/proc/self/clear_refs");
+    clear_refs << "5";
+    clear_refs.close();
+    start_bytes_ = status_bytes("VmRSS");
+    reset_ = clear_refs.good() && start_bytes_ >= 0.0;
+}
+
+
+void PeakRss::report(benchmark::State& state) const{
+    double peak = status_bytes("VmHWM");
+    if (!reset_ || peak < 0.0){
+        return;
+    }
+    using benchmark::Counter;
+    state.counters["peak_rss"] = Counter(peak, Counter::kDefaults, Counter::kIs1024);
+    state.counters["rss_growth"] = Counter(peak - start_bytes_, Counter::kDefaults, Counter::kIs1024);
+}
+
+} // namespace bench
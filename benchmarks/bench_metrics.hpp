@@ -0,0 +1,46 @@
+#pragma once
+
+#include <benchmark/benchmark.h>
+
+namespace bench {
+
+/**
+ * @brief Work done by one benchmark iteration
+ * flops counts the useful arithmetic (a multiply-add is two), bytes the minimum memory
+ * traffic (weights once, activations in and out, KV cache reads) and tokens the tokens
+ * the iteration produces, so per-token figures compare across shapes.
+ */
+struct Work {
+    double flops = 0.0;
+    double bytes = 0.0;
+    double tokens = 1.0;
+};
+
+/**
+ * @brief Set the FLOP/s, bytes/token, allocs/iter and tokens/s counters
+ * @param allocations support::allocation_count() difference across the timed loop
+ */
+void report(benchmark::State& state, const Work& work, long allocations);
+
+/**
+ * @brief Peak resident set size scoped to one benchmark case (Linux)
+ * Construct it before the case allocates anything: it resets the kernel's high-water mark
+ * (VmHWM) to the current RSS through /proc/self/clear_refs, so the peak no longer carries
+ * over from earlier, larger cases. report() sets peak_rss (the case's VmHWM) and
+ * rss_growth (how far the case pushed it above the RSS it started from).
+ */
+class PeakRss {
+    public:
+        PeakRss();
+
+        /**
+         * @brief Set the counters; leaves them out when the peak could not be reset
+         */
+        void report(benchmark::State& state) const;
+
+    private:
+        bool reset_ = false;
+        double start_bytes_ = 0.0;
+};
+
+} // namespace bench
@@ -0,0 +1,67 @@
+#include <benchmark/benchmark.h>
+#include "attention.hpp"
+#include "feed_forward.hpp"
+#include "quantization.hpp"
+
+namespace {
+
+constexpr int kDModel = 1024;
+constexpr int kDFF = 4096;
+constexpr int kNumHeads = 16;
+
+// One decode step's weight traffic: attention projections and the FFN for state.range(0)
+// tokens, which streams every weight once per token block
+void run_decode(benchmark::State& state, transformer::WeightFormat format){
+    int tokens = static_cast<int>(state.range(0));
+    transformer::MultiHeadAttention attention(kNumHeads, kDModel);
+    transformer::FeedForward feed_forward(kDModel, kDFF);
+    attention.quantize_weights(format);
+    feed_forward.quantize_weights(format);
+
+    Eigen::MatrixXf x = Eigen::MatrixXf::Random(tokens, kDModel);
+    Eigen::MatrixXf attended(tokens, kDModel);
+    Eigen::MatrixXf hidden(tokens, feed_forward.get_hidden_width());
+    Eigen::MatrixXf out(tokens, kDModel);
+
+    for (auto _ : state){
+        attention.forward_into(x, x, x, transformer::AttentionMask::causal_mask(), attended);
+        feed_forward.infer(attended, out, hidden);
+        benchmark::DoNotOptimize(out.data());
+    }
+
+    state.SetItemsProcessed(state.iterations() * tokens);
+    state.counters["weight_mb"] = (attention.weight_bytes() + feed_forward.weight_bytes()) / (1024.0 * 1024.0);
+}
+
+void BM_DecodeFP32(benchmark::State& state){
+    run_decode(state, transformer::WeightFormat::FP32);
+}
+
+void BM_DecodeINT8(benchmark::State& state){
+    run_decode(state, transformer::WeightFormat::INT8);
+}
+
+void BM_DecodeFP16(benchmark::State& state){
+    run_decode(state, transformer::WeightFormat::FP16);
+}
+
+void BM_DecodeBF16(benchmark::State& state){
+    run_decode(state, transformer::WeightFormat::BF16);
+}
+
+void BM_DecodeQ4(benchmark::State& state){
+    run_decode(state, transformer::WeightFormat::Q4);
+}
+
+void BM_DecodeQ4_ZP(benchmark::State& state){
+    run_decode(state, transformer::WeightFormat::Q4_ZP);
+}
+
+} // namespace
+
+BENCHMARK(BM_DecodeFP32)->Arg(1)->Arg(4)->Arg(8)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_DecodeINT8)->Arg(1)->Arg(4)->Arg(8)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_DecodeFP16)->Arg(1)->Arg(4)->Arg(8)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_DecodeBF16)->Arg(1)->Arg(4)->Arg(8)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_DecodeQ4)->Arg(1)->Arg(4)->Arg(8)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_DecodeQ4_ZP)->Arg(1)->Arg(4)->Arg(8)->Unit(benchmark::kMicrosecond);
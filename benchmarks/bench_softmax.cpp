@@ -0,0 +1,77 @@
+#include <benchmark/benchmark.h>
+#include <cmath>
+#include "attention.hpp"
+#include "softmax.hpp"
+
+namespace {
+
+constexpr int kRows = 64;
+
+// The previous implementation: copy, scalar std::exp, then separate max and sum passes
+Eigen::MatrixXf reference_softmax(const Eigen::MatrixXf& input){
+    Eigen::MatrixXf result = input;
+
+    for (int i = 0; i < result.rows(); ++i){
+        float max_val = result.row(i).maxCoeff();
+
+        for (int j = 0; j < result.cols(); ++j){
+            result(i, j) = std::exp(result(i, j) - max_val);
+        }
+
+        float sum = result.row(i).sum();
+
+        result.row(i) /= sum;
+    }
+    return result;
+}
+
+void BM_ReferenceSoftmax(benchmark::State& state){
+    int cols = static_cast<int>(state.range(0));
+    Eigen::MatrixXf scores = Eigen::MatrixXf::Random(kRows, cols) * 10.0f;
+
+    for (auto _ : state){
+        Eigen::MatrixXf weights = reference_softmax(scores);
+        benchmark::DoNotOptimize(weights.data());
+    }
+    state.SetItemsProcessed(state.iterations() * kRows * cols);
+}
+
+void run_simd_softmax(benchmark::State& state, transformer::SimdLevel level){
+    if (!transformer::simd_level_supported(level)){
+        state.SkipWithError("SIMD level not supported on this CPU");
+        return;
+    }
+
+    int cols = static_cast<int>(state.range(0));
+    transformer::RowMatrixXf source = transformer::RowMatrixXf::Random(kRows, cols) * 10.0f;
+    transformer::RowMatrixXf scores = source;
+
+    for (auto _ : state){
+        // Restoring the scores is part of the timing so every iteration sees real inputs
+        scores = source;
+        for (int i = 0; i < kRows; ++i){
+            transformer::softmax_inplace(scores.row(i).data(), cols, 1.0f, level);
+        }
+        benchmark::DoNotOptimize(scores.data());
+    }
+    state.SetItemsProcessed(state.iterations() * kRows * cols);
+}
+
+void BM_ScalarSoftmax(benchmark::State& state){
+    run_simd_softmax(state, transformer::SimdLevel::Scalar);
+}
+
+void BM_AVX2Softmax(benchmark::State& state){
+    run_simd_softmax(state, transformer::SimdLevel::AVX2);
+}
+
+void BM_AVX512Softmax(benchmark::State& state){
+    run_simd_softmax(state, transformer::SimdLevel::AVX512);
+}
+
+} // namespace
+
+BENCHMARK(BM_ReferenceSoftmax)->ArgName("cols")->RangeMultiplier(4)->Range(64, 16384);
+BENCHMARK(BM_ScalarSoftmax)->ArgName("cols")->RangeMultiplier(4)->Range(64, 16384);
+BENCHMARK(BM_AVX2Softmax)->ArgName("cols")->RangeMultiplier(4)->Range(64, 16384);
+BENCHMARK(BM_AVX512Softmax)->ArgName("cols")->RangeMultiplier(4)->Range(64, 16384);
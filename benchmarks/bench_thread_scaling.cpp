@@ -0,0 +1,90 @@
+#include <benchmark/benchmark.h>
+#include <numeric>
+#include "thread_pool.hpp"
+#include "transformer.hpp"
+
+namespace {
+
+constexpr int kSeqLen = 512;
+constexpr int kDModel = 512;
+constexpr int kNumHeads = 8;
+constexpr int kDFF = 2048;
+
+// Thread counts 1, 2, 4, ... up to every usable core (and that count itself)
+void thread_counts(benchmark::internal::Benchmark* bench){
+    transformer::set_num_threads(0);
+    int cores = transformer::get_num_threads();
+    for (int threads = 1; threads < cores; threads *= 2){
+        bench->Arg(threads);
+    }
+    bench->Arg(cores);
+}
+
+// Resize the library pool for this run; wall time is what scales, so report real time
+void use_threads(benchmark::State& state){
+    transformer::set_num_threads(static_cast<int>(state.range(0)));
+    state.counters["threads"] = static_cast<double>(state.range(0));
+}
+
+void BM_SelfAttentionScaling(benchmark::State& state){
+    use_threads(state);
+    transformer::MultiHeadAttention layer(kNumHeads, kDModel);
+    Eigen::MatrixXf x = Eigen::MatrixXf::Random(kSeqLen, kDModel);
+    Eigen::MatrixXf out(kSeqLen, kDModel);
+    auto causal = transformer::AttentionMask::causal_mask();
+
+    for (auto _ : state){
+        layer.forward_into(x, x, x, causal, out);
+        benchmark::DoNotOptimize(out.data());
+    }
+    state.SetItemsProcessed(state.iterations() * kSeqLen);
+}
+
+void BM_FeedForwardScaling(benchmark::State& state){
+    use_threads(state);
+    transformer::FeedForward layer(kDModel, kDFF);
+    Eigen::MatrixXf x = Eigen::MatrixXf::Random(kSeqLen, kDModel);
+    Eigen::MatrixXf out(kSeqLen, kDModel);
+    Eigen::MatrixXf hidden(std::min(kSeqLen, layer.rows_per_block() * transformer::get_num_threads()),
+                           layer.get_hidden_width());
+
+    for (auto _ : state){
+        layer.infer(x, out, hidden);
+        benchmark::DoNotOptimize(out.data());
+    }
+    state.SetItemsProcessed(state.iterations() * kSeqLen);
+}
+
+void BM_LayerNormScaling(benchmark::State& state){
+    use_threads(state);
+    transformer::LayerNorm layer(kDModel);
+    Eigen::MatrixXf x = Eigen::MatrixXf::Random(4 * kSeqLen, kDModel);
+    Eigen::MatrixXf out(4 * kSeqLen, kDModel);
+
+    for (auto _ : state){
+        layer.infer(x, out);
+        benchmark::DoNotOptimize(out.data());
+    }
+    state.SetItemsProcessed(state.iterations() * 4 * kSeqLen);
+}
+
+void BM_TransformerForwardScaling(benchmark::State& state){
+    use_threads(state);
+    transformer::Transformer model(4000, 4000, kDModel, kNumHeads, kDFF, 2, 1024);
+    std::vector<int> tokens(kSeqLen);
+    std::iota(tokens.begin(), tokens.end(), 0);
+    Eigen::MatrixXf logits(kSeqLen, 4000);
+
+    for (auto _ : state){
+        model.forward_into(tokens, tokens, logits);
+        benchmark::DoNotOptimize(logits.data());
+    }
+    state.SetItemsProcessed(state.iterations() * 2 * kSeqLen);
+}
+
+} // namespace
+
+BENCHMARK(BM_SelfAttentionScaling)->Apply(thread_counts)->UseRealTime()->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_FeedForwardScaling)->Apply(thread_counts)->UseRealTime()->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_LayerNormScaling)->Apply(thread_counts)->UseRealTime()->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_TransformerForwardScaling)->Apply(thread_counts)->UseRealTime()->Unit(benchmark::kMillisecond);
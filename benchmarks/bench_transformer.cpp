@@ -0,0 +1,100 @@
+#include <benchmark/benchmark.h>
+#include <cstdio>
+#include <numeric>
+#include "transformer.hpp"
+
+namespace {
+
+constexpr int kVocab = 4000;
+constexpr int kDModel = 256;
+constexpr int kNumHeads = 8;
+constexpr int kDFF = 1024;
+constexpr int kLayers = 2;
+constexpr int kMaxSeqLen = 1024;
+
+std::vector<int> make_tokens(int len){
+    std::vector<int> tokens(len);
+    std::iota(tokens.begin(), tokens.end(), 0);
+    for (int& t : tokens){
+        t %= kVocab;
+    }
+    return tokens;
+}
+
+// Full encoder-decoder forward through the block buffers
+void BM_TransformerForward(benchmark::State& state){
+    int len = static_cast<int>(state.range(0));
+    transformer::Transformer model(kVocab, kVocab, kDModel, kNumHeads, kDFF, kLayers, kMaxSeqLen);
+    auto src = make_tokens(len);
+    auto tgt = make_tokens(len);
+    Eigen::MatrixXf logits(len, kVocab);
+
+    for (auto _ : state){
+        model.forward_into(src, tgt, logits);
+        benchmark::DoNotOptimize(logits.data());
+    }
+    state.SetItemsProcessed(state.iterations() * 2 * len);
+}
+
+// The same layers wired by hand, every sublayer returning a fresh matrix
+void BM_HandWiredForward(benchmark::State& state){
+    int len = static_cast<int>(state.range(0));
+    transformer::Transformer model(kVocab, kVocab, kDModel, kNumHeads, kDFF, kLayers, kMaxSeqLen);
+    transformer::TokenEmbedding src_embedding(kVocab, kDModel);
+    transformer::TokenEmbedding tgt_embedding(kVocab, kDModel);
+    transformer::PositionalEncoding positions(kMaxSeqLen, kDModel);
+    auto src = make_tokens(len);
+    auto tgt = make_tokens(len);
+    auto causal = transformer::AttentionMask::causal_mask();
+
+    for (auto _ : state){
+        Eigen::MatrixXf memory = positions.forward(src_embedding.forward(src));
+        for (int i = 0; i < kLayers; ++i){
+            auto& layer = model.get_encoder_layer(i);
+            Eigen::MatrixXf attention = layer.get_self_attention().forward(memory, memory, memory);
+            Eigen::MatrixXf hidden = layer.get_norm1().forward(memory + attention);
+            Eigen::MatrixXf ff = layer.get_feed_forward().forward(hidden);
+            memory = layer.get_norm2().forward(hidden + ff);
+        }
+        Eigen::MatrixXf x = positions.forward(tgt_embedding.forward(tgt));
+        for (int i = 0; i < kLayers; ++i){
+            auto& layer = model.get_decoder_layer(i);
+            Eigen::MatrixXf self = layer.get_self_attention().forward(x, x, x, causal);
+            Eigen::MatrixXf hidden1 = layer.get_norm1().forward(x + self);
+            Eigen::MatrixXf cross = layer.get_cross_attention().forward(hidden1, memory, memory);
+            Eigen::MatrixXf hidden2 = layer.get_norm2().forward(hidden1 + cross);
+            Eigen::MatrixXf ff = layer.get_feed_forward().forward(hidden2);
+            x = layer.get_norm3().forward(hidden2 + ff);
+        }
+        Eigen::MatrixXf logits = x * tgt_embedding.get_embedding_matrix().transpose();
+        benchmark::DoNotOptimize(logits.data());
+    }
+    state.SetItemsProcessed(state.iterations() * 2 * len);
+}
+
+// Constructing the model with freshly sampled weights
+void BM_ColdStartRandomInit(benchmark::State& state){
+    for (auto _ : state){
+        transformer::Transformer model(kVocab, kVocab, kDModel, kNumHeads, kDFF, kLayers, kMaxSeqLen);
+        benchmark::DoNotOptimize(&model);
+    }
+}
+
+// Constructing the same model from a mapped checkpoint: a directory parse, no weight copies
+void BM_ColdStartFromCheckpoint(benchmark::State& state){
+    const std::string path = "bench_transformer_checkpoint.bin";
+    transformer::Transformer(kVocab, kVocab, kDModel, kNumHeads, kDFF, kLayers, kMaxSeqLen).save(path);
+
+    for (auto _ : state){
+        transformer::Transformer model(path);
+        benchmark::DoNotOptimize(&model);
+    }
+    std::remove(path.c_str());
+}
+
+} // namespace
+
+BENCHMARK(BM_TransformerForward)->Arg(32)->Arg(128)->Arg(512)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_HandWiredForward)->Arg(32)->Arg(128)->Arg(512)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_ColdStartRandomInit)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_ColdStartFromCheckpoint)->Unit(benchmark::kMillisecond);
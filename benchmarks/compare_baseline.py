@@ -0,0 +1,101 @@
+#!/usr/bin/env python3
+"""Compare a Google Benchmark JSON run against a stored baseline.
+
+A benchmark regresses when its real time grows by more than the threshold, or when
+its allocs/iter counter grows by half an allocation or more (one-off warm-up
+allocations averaged over the iterations stay below that).
+When repetitions produced aggregates, the median is compared. Exits with status 1 if
+any benchmark regressed, so the check can gate CI, and 2 if there is no baseline yet.
+
+    compare_baseline.py baseline.json current.json [--threshold 0.10]
+"""
+
+import argparse
+import json
+import os
+import sys
+
+TIME_UNITS = {"ns": 1e-9, "us": 1e-6, "ms": 1e-3, "s": 1.0}
+
+
+def load(path):
+    with open(path) as f:
+        runs = json.load(f)["benchmarks"]
+    results = {}
+    for run in runs:
+        if run.get("error_occurred"):
+            continue
+        if run.get("run_type") == "aggregate":
+            if run.get("aggregate_name") != "median":
+                continue
+            name = run["run_name"]
+        elif any(r.get("run_type") == "aggregate" for r in runs):
+            continue
+        else:
+            name = run["name"]
+        results[name] = {
+            "time": run["real_time"] * TIME_UNITS[run.get("time_unit", "ns")],
+            "allocs": run.get("allocs/iter"),
+        }
+    return results
+
+
+def format_time(seconds):
+    for unit in ("s", "ms", "us", "ns"):
+        if seconds >= TIME_UNITS[unit]:
+            return "%.3g %s" % (seconds / TIME_UNITS[unit], unit)
+    return "%.3g ns" % (seconds / TIME_UNITS["ns"])
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("baseline")
+    parser.add_argument("current")
+    parser.add_argument("--threshold", type=float, default=0.10,
+                        help="relative real-time slowdown that counts as a regression (default 0.10)")
+    args = parser.parse_args()
+
+    if not os.path.exists(args.baseline):
+        print("No baseline at %s; record one on this machine first (make bench_baseline)" % args.baseline,
+              file=sys.stderr)
+        return 2
+
+    baseline = load(args.baseline)
+    current = load(args.current)
+
+    regressions = 0
+    print("%-60s %12s %12s %8s  %s" % ("benchmark", "baseline", "current", "change", "allocs/iter"))
+    for name, now in current.items():
+        before = baseline.get(name)
+        if before is None:
+            print("%-60s %12s %12s %8s" % (name, "-", format_time(now["time"]), "new"))
+            continue
+
+        change = now["time"] / before["time"] - 1.0 if before["time"] > 0 else 0.0
+        flags = []
+        if change > args.threshold:
+            flags.append("SLOWER")
+        allocs = ""
+        if now["allocs"] is not None and before["allocs"] is not None:
+            allocs = "%g -> %g" % (before["allocs"], now["allocs"])
+            if now["allocs"] >= before["allocs"] + 0.5:
+                flags.append("MORE ALLOCS")
+        if flags:
+            regressions += 1
+
+        print("%-60s %12s %12s %+7.1f%%  %s %s" % (name, format_time(before["time"]), format_time(now["time"]),
+                                                   100.0 * change, allocs, " ".join(flags)))
+
+    for name in baseline:
+        if name not in current:
+            print("%-60s %12s %12s %8s" % (name, format_time(baseline[name]["time"]), "-", "missing"))
+
+    if regressions:
+        print("%d benchmark(s) regressed beyond %.0f%%" % (regressions, 100.0 * args.threshold))
+        return 1
+    print("No regressions beyond %.0f%%" % (100.0 * args.threshold))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,118 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include "scheduler.hpp"
+
+// Load generator for InferenceScheduler: requests arrive as a Poisson process with random
+// prompt and output lengths, and the run reports generated-token throughput and
+// time-to-first-token percentiles for continuous and static batching.
+//
+// Usage: scheduler_loadgen [requests] [arrivals_per_second]
+
+namespace {
+
+constexpr int kVocabSize = 1000;
+constexpr int kDModel = 256;
+constexpr int kNumHeads = 8;
+constexpr int kDFF = 1024;
+constexpr int kMaxSeqLen = 512;
+
+struct Request {
+    double arrival_ms;
+    std::vector<int> prompt;
+    int max_new_tokens;
+};
+
+std::vector<Request> make_requests(int count, double rate){
+    std::mt19937 gen(42);
+    std::exponential_distribution<double> gap(rate / 1000.0);
+    std::uniform_int_distribution<int> prompt_len(16, 192);
+    std::uniform_int_distribution<int> output_len(8, 96);
+    std::uniform_int_distribution<int> token(0, kVocabSize - 1);
+
+    std::vector<Request> requests;
+    double t = 0.0;
+    for (int i = 0; i < count; ++i){
+        t += gap(gen);
+        Request r{t, std::vector<int>(prompt_len(gen)), output_len(gen)};
+        for (int& id : r.prompt){
+            id = token(gen);
+        }
+        requests.push_back(std::move(r));
+    }
+    return requests;
+}
+
+double percentile(std::vector<double> values, double p){
+    std::sort(values.begin(), values.end());
+    size_t index = static_cast<size_t>(p * (values.size() - 1) + 0.5);
+    return values[index];
+}
+
+void run(const std::string& name, const std::vector<Request>& requests, bool continuous){
+    transformer::TokenEmbedding embedding(kVocabSize, kDModel);
+    transformer::PositionalEncoding positions(kMaxSeqLen, kDModel);
+    transformer::MultiHeadAttention attention(kNumHeads, kDModel);
+    transformer::FeedForward feed_forward(kDModel, kDFF);
+    transformer::LayerNorm norm(kDModel);
+
+    transformer::SchedulerConfig config;
+    config.continuous_batching = continuous;
+    config.max_running = 16;
+    transformer::InferenceScheduler scheduler(embedding, positions, attention, feed_forward, norm, config);
+
+    auto start = std::chrono::steady_clock::now();
+    auto now_ms = [&start](){
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    };
+
+    std::vector<double> ttft;
+    std::vector<double> latency;
+    long generated = 0;
+    size_t next = 0;
+    while (ttft.size() < requests.size()){
+        //Requests that arrived during the last step are submitted with their arrival time,
+        //so their wait for the step to finish counts towards TTFT
+        while (next < requests.size() && requests[next].arrival_ms <= now_ms()){
+            auto arrival = start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                                       std::chrono::duration<double, std::milli>(requests[next].arrival_ms));
+            scheduler.submit(requests[next].prompt, requests[next].max_new_tokens, arrival);
+            ++next;
+        }
+        if (scheduler.step() == 0 && next < requests.size()){
+            //Idle until the next arrival
+            double wait_ms = requests[next].arrival_ms - now_ms();
+            if (wait_ms > 0.0){
+                std::this_thread::sleep_for(std::chrono::duration<double, std::milli>(wait_ms));
+            }
+        }
+        for (const auto& done : scheduler.take_completed()){
+            ttft.push_back(done.time_to_first_token_ms);
+            latency.push_back(done.latency_ms);
+            generated += static_cast<long>(done.output_tokens.size());
+        }
+    }
+    double seconds = now_ms() / 1000.0;
+
+    std::cout << name << ": " << requests.size() << " requests in " << seconds << " s, "
+              << generated / seconds << " generated tokens/s\n"
+              << "  TTFT p50 " << percentile(ttft, 0.5) << " ms, p99 " << percentile(ttft, 0.99) << " ms\n"
+              << "  latency p50 " << percentile(latency, 0.5) << " ms, p99 " << percentile(latency, 0.99) << " ms\n";
+}
+
+} // namespace
+
+int main(int argc, char** argv){
+    int count = argc > 1 ? std::atoi(argv[1]) : 64;
+    double rate = argc > 2 ? std::atof(argv[2]) : 20.0;
+    auto requests = make_requests(count, rate);
+
+    run("continuous batching", requests, true);
+    run("static batching", requests, false);
+    return 0;
+}
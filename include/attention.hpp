@@ -2,15 +2,171 @@
 
 #include <Eigen/Dense>
 #include <cmath>
+#include <vector>
+#include "kv_cache.hpp"
+#include "paged_kv_cache.hpp"
+#include "batch.hpp"
+#include "checkpoint.hpp"
+#include "embedding.hpp"
+#include "quantization.hpp"
+#include "workspace.hpp"
 
 namespace transformer {
 
+using RowMatrixXf = Eigen::Matrix<float, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>;
+using BoolArrayXXb = Eigen::Array<bool, Eigen::Dynamic, Eigen::Dynamic>;
+using BoolArrayXb = Eigen::Array<bool, Eigen::Dynamic, 1>;
+
+/**
+ * @brief Masking options for attention
+ * All parts are optional and combine. Query i is taken to sit at absolute position
+ * i + (seq_len_k - seq_len_q), so causal masking also works when the keys include
+ * earlier context (incremental decoding).
+ */
+struct AttentionMask {
+    bool causal = false;            // Query i may only attend keys up to its own position
+    Eigen::MatrixXf additive;       // (seq_len_q, seq_len_k) added to the scaled scores, -inf blocks
+    BoolArrayXb key_padding;        // (seq_len_k) true marks a padded key that is never attended
+
+    /**
+     * @brief Built-in causal mask, no dense matrix is stored
+     */
+    static AttentionMask causal_mask();
+
+    /**
+     * @brief Build an additive mask from a boolean one
+     * @param allowed (seq_len_q, seq_len_k), true where the query may attend the key
+     */
+    static AttentionMask from_boolean(const BoolArrayXXb& allowed);
+
+    /**
+     * @brief Mask padded key positions
+     * @param padded (seq_len_k), true where the key is padding
+     */
+    static AttentionMask from_key_padding(const BoolArrayXb& padded);
+
+    bool empty() const {return !causal && additive.size() == 0 && key_padding.size() == 0;}
+};
+
+
+/**
+ * @brief Attention kernel used for each head
+ * Standard materialises the (seq_len_q, seq_len_k) score matrix. Tiled streams K/V in
+ * cache-sized tiles with a running max and sum (online softmax), so memory stays
+ * O(seq_len) and the full score matrix never exists.
+ */
+enum class AttentionKernel {
+    Standard,
+    Tiled
+};
+
 class ScaledDotProductAttention{
     private:
         float scale_factor_;
 
-        Eigen::MatrixXf softmax(const Eigen::MatrixXf& input);
-        
+        AttentionKernel kernel_ = AttentionKernel::Standard;
+        int tile_size_ = 0; // Keys per tile for the tiled kernel, 0 = sized from the L2 cache
+
+        // Online softmax state of one block of queries, held in the kernel workspace
+        struct OnlineBlock {
+            Eigen::Map<RowMatrixXf> acc;         // Unnormalised output
+            Eigen::Map<Eigen::VectorXf> row_max; // Running max per query
+            Eigen::Map<Eigen::VectorXf> row_sum; // Running softmax denominator per query
+        };
+
+        /**
+         * @brief The calling thread's kernel workspace, shared by every instance
+         * Heads run concurrently on the thread pool and each thread takes its scores, tiles
+         * and widened bf16 pages from its own arena, so the layer keeps no mutable state and
+         * one instance can serve concurrent callers.
+         */
+        static Workspace& thread_workspace();
+
+        /**
+         * @brief Softmax of one row of raw scores, written in place by the SIMD kernel
+         * @param row scores to normalise, exp(scale * (x - max)) / sum
+         * @param scale multiplier applied inside the exponent
+         */
+        void softmax_row(Eigen::Ref<Eigen::RowVectorXf> row, float scale) const;
+
+        /**
+         * @brief Floats of the kernel workspace one head draws on (see head_scratch_bytes)
+         */
+        std::size_t head_workspace_floats(int q_len, int kv_len, int d_k, int d_v, bool causal) const;
+
+        /**
+         * @brief One head with the selected kernel
+         */
+        void attend(Workspace& workspace,
+                    const Eigen::Ref<const Eigen::MatrixXf>& Q,
+                    const Eigen::Ref<const Eigen::MatrixXf>& K,
+                    const Eigen::Ref<const Eigen::MatrixXf>& V,
+                    const AttentionMask& mask,
+                    Eigen::Ref<Eigen::MatrixXf> output) const;
+
+        /**
+         * @brief Attention for one head with masking applied
+         * With a causal mask, query rows are processed in blocks and each block only
+         * multiplies against the keys it can see, so the upper triangle is never computed.
+         */
+        void attend_head(Workspace& workspace,
+                         const Eigen::Ref<const Eigen::MatrixXf>& Q,
+                         const Eigen::Ref<const Eigen::MatrixXf>& K,
+                         const Eigen::Ref<const Eigen::MatrixXf>& V,
+                         const AttentionMask& mask,
+                         Eigen::Ref<Eigen::MatrixXf> output) const;
+
+        /**
+         * @brief Online-softmax attention for one head, K/V consumed one tile at a time
+         */
+        void attend_head_tiled(Workspace& workspace,
+                               const Eigen::Ref<const Eigen::MatrixXf>& Q,
+                               const Eigen::Ref<const Eigen::MatrixXf>& K,
+                               const Eigen::Ref<const Eigen::MatrixXf>& V,
+                               const AttentionMask& mask,
+                               Eigen::Ref<Eigen::MatrixXf> output) const;
+
+        /**
+         * @brief Causal attention of one head's queries over a paged sequence
+         */
+        void attend_head_paged(Workspace& workspace,
+                               const Eigen::Ref<const Eigen::MatrixXf>& Q_head,
+                               const PagedKVCache& cache,
+                               int seq,
+                               int head,
+                               Eigen::Ref<Eigen::MatrixXf> output) const;
+
+        /**
+         * @brief Online softmax building blocks shared by the tiled and paged kernels
+         * begin_block resets the running max, sum and output for a block of queries,
+         * accumulate_tile folds in keys [c0, c0 + K_tile.rows()) for queries starting at r0,
+         * and finish_block writes the normalised result.
+         */
+        OnlineBlock begin_block(Workspace& workspace, int rows, int d_v) const;
+        void accumulate_tile(Workspace& workspace, OnlineBlock& block,
+                             const Eigen::Ref<const Eigen::MatrixXf>& Q_block,
+                             const Eigen::Ref<const Eigen::MatrixXf>& K_tile,
+                             const Eigen::Ref<const Eigen::MatrixXf>& V_tile,
+                             const AttentionMask& mask,
+                             int r0, int c0, int offset) const;
+        void finish_block(OnlineBlock& block, Eigen::Ref<Eigen::MatrixXf> output) const;
+
+        /**
+         * @brief Scale the scores of one row and apply the explicit parts of the mask
+         * @param row scores for keys [key_start, key_start + row.size())
+         * @param query index of the query within the current call
+         */
+        void apply_mask_row(Eigen::Ref<Eigen::RowVectorXf> row, const AttentionMask& mask,
+                            int query, int key_start) const;
+
+        /**
+         * @brief Shape checks shared by forward_heads and forward_sequences
+         */
+        static void check_heads(const Eigen::Ref<const Eigen::MatrixXf>& Q,
+                                const Eigen::Ref<const Eigen::MatrixXf>& K,
+                                const Eigen::Ref<const Eigen::MatrixXf>& V,
+                                int num_heads, const AttentionMask& mask);
+
     public:
         /**
          * @brief Constructor
@@ -27,7 +183,96 @@ class ScaledDotProductAttention{
          */
         Eigen::MatrixXf forward(const Eigen::MatrixXf& Q,
                                 const Eigen::MatrixXf& K,
-                                const Eigen::MatrixXf& V);
+                                const Eigen::MatrixXf& V) const;
+
+        /**
+         * @brief Compute attention independently for each head
+         * Head h reads columns [h * d_k, (h + 1) * d_k) of Q and K and
+         * [h * d_v, (h + 1) * d_v) of V in place, so no reshape copies are made.
+         * Heads run in parallel on the library thread pool.
+         * @param Q: Projected queries of shape (seq_len_q, num_heads * d_k)
+         * @param K: Projected keys of shape (seq_len_k, num_heads * d_k)
+         * @param V: Projected values of shape (seq_len_k, num_heads * d_v)
+         * @param num_heads: Number of heads packed side by side in the columns
+         * @param output: Output of shape (seq_len_q, num_heads * d_v)
+         * @param mask: Optional mask shared by all heads
+         */
+        void forward_heads(const Eigen::Ref<const Eigen::MatrixXf>& Q,
+                           const Eigen::Ref<const Eigen::MatrixXf>& K,
+                           const Eigen::Ref<const Eigen::MatrixXf>& V,
+                           int num_heads,
+                           Eigen::Ref<Eigen::MatrixXf> output,
+                           const AttentionMask& mask = AttentionMask()) const;
+
+        /**
+         * @brief Self-attention over sequences packed by rows, each attending only to itself
+         * Every (sequence, head) pair is one task on the thread pool, so a batch of short
+         * sequences keeps all threads busy even with few heads.
+         * @param offsets: Start row of each sequence followed by the total row count
+         * @param mask: Causal or empty; explicit masks are per sequence and not supported
+         */
+        void forward_sequences(const Eigen::Ref<const Eigen::MatrixXf>& Q,
+                               const Eigen::Ref<const Eigen::MatrixXf>& K,
+                               const Eigen::Ref<const Eigen::MatrixXf>& V,
+                               const std::vector<int>& offsets,
+                               int num_heads,
+                               Eigen::Ref<Eigen::MatrixXf> output,
+                               const AttentionMask& mask = AttentionMask()) const;
+
+        /**
+         * @brief Causal attention of new queries over a sequence in a paged KV cache
+         * Each page is read in place through the sequence's page table and treated as one
+         * tile of the online softmax, so the cached keys are never gathered.
+         * @param Q: Projected queries of shape (seq_len_q, d_model), the last tokens of seq
+         * @param cache: Paged cache already holding the keys/values of those tokens
+         * @param seq: Sequence id in the cache
+         * @param output: Output of shape (seq_len_q, d_model)
+         */
+        void forward_paged(const Eigen::Ref<const Eigen::MatrixXf>& Q,
+                           const PagedKVCache& cache,
+                           int seq,
+                           int num_heads,
+                           Eigen::Ref<Eigen::MatrixXf> output) const;
+
+        /**
+         * @brief forward_paged for several sequences, parallel over (sequence, head) pairs
+         * @param Q: New queries of every sequence packed by rows as given by offsets
+         * @param seqs: Cache sequence id of each packed sequence
+         */
+        void forward_paged_batch(const Eigen::Ref<const Eigen::MatrixXf>& Q,
+                                 const PagedKVCache& cache,
+                                 const std::vector<int>& seqs,
+                                 const std::vector<int>& offsets,
+                                 int num_heads,
+                                 Eigen::Ref<Eigen::MatrixXf> output) const;
+
+        /**
+         * @brief Select the per-head attention kernel
+         * @param kernel: Standard or Tiled
+         * @param tile_size: Keys per tile for the tiled kernel, 0 picks a size that keeps
+         *                   the K/V tiles and the score tile resident in L2
+         */
+        void set_kernel(AttentionKernel kernel, int tile_size = 0);
+
+        AttentionKernel get_kernel() const {return kernel_;}
+
+        /**
+         * @brief Keys per tile the tiled kernel uses for a given head size
+         */
+        int tile_size_for(int d_k, int d_v) const;
+
+        /**
+         * @brief Kernel workspace bytes one head of this shape takes with the current kernel
+         * Standard: one block of scores, every query (64 with a causal mask) by kv_len keys.
+         * Tiled: one query block's accumulator, softmax state and score tile, whatever kv_len.
+         */
+        std::size_t head_scratch_bytes(int q_len, int kv_len, int d_k, int d_v, bool causal) const;
+
+        /**
+         * @brief Size the calling thread's kernel workspace and GEMM panels for heads of up
+         *        to max_queries x max_keys with the current kernel
+         */
+        void reserve_thread(int max_queries, int max_keys, int d_k, int d_v) const;
 
         /**
          * @brief Get the scale factor
@@ -37,6 +282,17 @@ class ScaledDotProductAttention{
 
 
 
+/**
+ * @brief Activation buffers of one MultiHeadAttention call
+ * The const overloads only read the layer, so threads sharing one layer each pass their
+ * own context. Each call takes its projections ([Q | K | V], or Q and [K | V] for
+ * cross-attention) and the concatenated head outputs from the workspace.
+ */
+struct AttentionContext {
+    Workspace workspace;
+};
+
+
 class MultiHeadAttention{
     private:
         int num_heads_;
@@ -44,27 +300,48 @@ class MultiHeadAttention{
         int d_k_;
         int d_v_;
 
-        Eigen::MatrixXf W_q_; // (d_model, d_model)
-        Eigen::MatrixXf W_k_; // (d_model, d_model)
-        Eigen::MatrixXf W_v_; // (d_model, d_model)
-        Eigen::MatrixXf W_o_; // (d_model, d_model)
+        // Q, K and V projections packed side by side so self-attention runs one GEMM:
+        // W_qkv_ = [W_q^T | W_k^T | W_v^T], and x * W_qkv_ yields [Q | K | V]
+        WeightMatrix W_qkv_; // (d_model, 3 * d_model)
+        WeightMatrix W_o_;   // (d_model, d_model)
+
+        WeightVector b_qkv_; // (3 * d_model)
+        WeightVector b_o_;   // (d_model)
 
-        Eigen::VectorXf b_q_; // (d_model)
-        Eigen::VectorXf b_k_; // (d_model)
-        Eigen::VectorXf b_v_; // (d_model)
-        Eigen::VectorXf b_o_; // (d_model)
+        // Compressed copies used instead of W_qkv_ / W_o_^T once quantize_weights() has run
+        WeightFormat weight_format_ = WeightFormat::FP32;
+        QuantizedMatrix W_qkv_quantized_; // (d_model, 3 * d_model)
+        QuantizedMatrix W_o_quantized_;   // (d_model, d_model) holding W_o^T
+
+        // Buffers of the overloads that take no context, reused so steady-state forward does not reallocate
+        AttentionContext context_;
 
         ScaledDotProductAttention attention_;
 
+        // Applied to Q and K after projection when enabled, see set_rotary_embedding
+        RotaryEmbedding rotary_;
+        bool use_rotary_ = false;
+
     public:
         MultiHeadAttention(int num_heads, int d_model);
 
+        /**
+         * @brief Build the layer around weights in a checkpoint, without copying them
+         * d_model comes from prefix + "W_o"; the head count is not stored.
+         */
+        MultiHeadAttention(int num_heads, const std::shared_ptr<const Checkpoint>& checkpoint,
+                           const std::string& prefix);
+
         /**
          * @brief Forward pass of multi-head attention
+         * Self-attention (query, key and value are the same matrix) projects Q, K and V
+         * with a single GEMM against W_qkv. Otherwise Q is projected on its own and K/V
+         * share one GEMM when key and value are the same matrix.
          * @param query: Query matrix of shape (seq_len, d_model)
          * @param key: Key matrix of shape (seq_len, d_model)
          * @param value: Value matrix of shape (seq_len, d_model)
-         * @param mask: Optional attention mask of shape (seq_len, seq_len)
+         * @param mask: Optional additive attention mask of shape (seq_len, seq_len),
+         *              added to the scaled scores (use -inf to block a position)
          * @return Attention output of shape (seq_len, d_model)
          */
         Eigen::MatrixXf forward(const Eigen::MatrixXf& query,
@@ -72,32 +349,212 @@ class MultiHeadAttention{
                                 const Eigen::MatrixXf& value,
                                 const Eigen::MatrixXf& mask = Eigen::MatrixXf());
 
+        /**
+         * @brief Forward pass with causal, boolean, additive or key-padding masking
+         * @param mask: See AttentionMask; AttentionMask::causal_mask() for decoders
+         * @return Attention output of shape (seq_len, d_model)
+         */
+        Eigen::MatrixXf forward(const Eigen::MatrixXf& query,
+                                const Eigen::MatrixXf& key,
+                                const Eigen::MatrixXf& value,
+                                const AttentionMask& mask);
+
+        /**
+         * @brief Forward pass written into a caller buffer instead of a returned matrix
+         * Inputs that view the same memory take the fused self-attention or shared K/V
+         * projection paths, as in forward.
+         * @param output: Buffer of shape (seq_len_q, d_model), must not alias the inputs
+         */
+        void forward_into(const Eigen::Ref<const Eigen::MatrixXf>& query,
+                          const Eigen::Ref<const Eigen::MatrixXf>& key,
+                          const Eigen::Ref<const Eigen::MatrixXf>& value,
+                          const AttentionMask& mask,
+                          Eigen::Ref<Eigen::MatrixXf> output);
+
+        /**
+         * @brief forward_into with caller-owned buffers; reads the layer only, so threads
+         *        sharing this layer may call it concurrently with their own contexts
+         */
+        void forward_into(const Eigen::Ref<const Eigen::MatrixXf>& query,
+                          const Eigen::Ref<const Eigen::MatrixXf>& key,
+                          const Eigen::Ref<const Eigen::MatrixXf>& value,
+                          const AttentionMask& mask,
+                          Eigen::Ref<Eigen::MatrixXf> output,
+                          AttentionContext& context) const;
+
+        /**
+         * @brief Self-attention over a packed batch of variable-length sequences
+         * Q, K and V for every token come from one GEMM and the output projection is one
+         * GEMM; attention itself runs per sequence, so no token sees another sequence
+         * and no padding is needed.
+         * @param batch: Packed sequences of shape (total_tokens, d_model)
+         * @param causal: Apply a causal mask within each sequence
+         * @return Batch of shape (total_tokens, d_model) with the same offsets
+         */
+        RaggedBatch forward_batch(const RaggedBatch& batch, bool causal = false);
+        RaggedBatch forward_batch(const RaggedBatch& batch, bool causal, AttentionContext& context) const;
+
+        /**
+         * @brief Causal self-attention over new tokens plus everything already cached
+         * Only the new rows are projected. Their keys and values are appended to the cache
+         * and the new queries attend to the whole cache, so per-token decode cost does not
+         * include re-projecting the context.
+         * @param new_tokens: Matrix of shape (new_len, d_model), e.g. one row per decode step
+         * @param cache: The sequence's cache, updated in place
+         * @return Attention output of shape (new_len, d_model)
+         */
+        Eigen::MatrixXf forward_incremental(const Eigen::MatrixXf& new_tokens, KVCache& cache);
+        Eigen::MatrixXf forward_incremental(const Eigen::MatrixXf& new_tokens, KVCache& cache,
+                                            AttentionContext& context) const;
+
+        /**
+         * @brief Incremental causal self-attention for one sequence of a paged KV cache
+         * @param new_tokens: Matrix of shape (new_len, d_model)
+         * @param cache: Paged cache shared by many sequences, updated in place
+         * @param seq: Sequence id in the cache
+         * @return Attention output of shape (new_len, d_model)
+         */
+        Eigen::MatrixXf forward_incremental(const Eigen::MatrixXf& new_tokens, PagedKVCache& cache, int seq);
+        Eigen::MatrixXf forward_incremental(const Eigen::MatrixXf& new_tokens, PagedKVCache& cache, int seq,
+                                            AttentionContext& context) const;
+
+        /**
+         * @brief Paged forward_incremental written into a caller buffer instead of a returned matrix
+         * @param output: Buffer of shape (new_len, d_model), must not alias new_tokens
+         */
+        void forward_incremental_into(const Eigen::Ref<const Eigen::MatrixXf>& new_tokens, PagedKVCache& cache,
+                                      int seq, Eigen::Ref<Eigen::MatrixXf> output, AttentionContext& context) const;
+
+        /**
+         * @brief Incremental causal self-attention for several sequences of a paged KV cache
+         * New tokens of every sequence are projected with one GEMM, appended to their own
+         * sequence in the cache, and attend only to that sequence.
+         * @param batch: New tokens packed per sequence, shape (total_new_tokens, d_model)
+         * @param cache: Paged cache shared by the sequences, updated in place
+         * @param seqs: Cache sequence id for each sequence in the batch
+         * @return Batch of shape (total_new_tokens, d_model) with the same offsets
+         */
+        RaggedBatch forward_incremental_batch(const RaggedBatch& batch, PagedKVCache& cache,
+                                              const std::vector<int>& seqs);
+        RaggedBatch forward_incremental_batch(const RaggedBatch& batch, PagedKVCache& cache,
+                                              const std::vector<int>& seqs, AttentionContext& context) const;
+
+        /**
+         * @brief Size a context for forward_into calls of up to max_queries queries and max_keys keys
+         * Covers self- and cross-attention, so the first call does not grow the workspace.
+         */
+        void reserve(AttentionContext& context, int max_queries, int max_keys) const;
+
+        /**
+         * @brief Size the calling thread's scratch for the same calls
+         * The context holds the per-call buffers; the heads and projections also draw on
+         * per-thread workspaces, so run this on every pool thread (ThreadPool::for_each_thread)
+         * to keep the first calls off the heap. Repeat after changing the kernel.
+         */
+        void reserve_thread(int max_queries, int max_keys) const;
+
         /**
          * @brief Initialize weights with Xavior/Glorot initialization
          */
         void initialize_weights();
 
+        /**
+         * @brief Store the projection weights in a compressed format for inference
+         * The float weights are released, so get_W_* return empty matrices afterwards;
+         * initialize_weights() returns the layer to FP32.
+         */
+        void quantize_weights(WeightFormat format);
+
+        WeightFormat get_weight_format() const {return weight_format_;}
+
+        /**
+         * @brief Write W_qkv, b_qkv, W_o and b_o under prefix; std::logic_error once quantized
+         */
+        void save(CheckpointWriter& writer, const std::string& prefix) const;
+
+        /**
+         * @brief Replace the weights with views of a checkpoint's tensors, returning to FP32
+         * Throws std::invalid_argument if a shape does not match this layer.
+         */
+        void load(const std::shared_ptr<const Checkpoint>& checkpoint, const std::string& prefix);
+
+        /**
+         * @brief Bytes held by the projection weights in their current format
+         */
+        std::size_t weight_bytes() const;
+
         /**
          * @brief Get the scale factor used by attention head
          */
         float get_scale_factor() const {return attention_.get_scale_factor();};
-    
+
+        /**
+         * @brief Rotate self-attention queries and keys by their positions (RoPE)
+         * Positions start at 0 for forward and at every sequence of forward_batch, and
+         * continue from the cached length in the incremental paths. Cross-attention is
+         * not rotated, since query and memory positions are unrelated.
+         * @param base Frequency base, the head width must be even
+         */
+        void set_rotary_embedding(bool enabled, double base = 10000.0);
+        bool uses_rotary_embedding() const {return use_rotary_;}
+
+        /**
+         * @brief Select the attention kernel used by every head
+         */
+        void set_attention_kernel(AttentionKernel kernel, int tile_size = 0) {attention_.set_kernel(kernel, tile_size);}
+
+        /**
+         * @brief Getter for testing
+         */
+        int get_num_heads() const {return num_heads_;}
+        int get_d_model() const {return d_model_;}
+        const WeightMatrix& get_W_qkv() const {return W_qkv_;}
+        const WeightVector& get_b_qkv() const {return b_qkv_;}
+        Eigen::MatrixXf get_W_q() const {return projection_weights(0);}
+        Eigen::MatrixXf get_W_k() const {return projection_weights(1);}
+        Eigen::MatrixXf get_W_v() const {return projection_weights(2);}
+        const WeightMatrix& get_W_o() const {return W_o_;}
+
     private:
         /**
-         * @brief Reshape maxtrix for multi-head processing
+         * @brief Per-head width d_model / num_heads, checked before any member is built from it
+         * @throws std::invalid_argument unless num_heads is positive and divides d_model
+         */
+        static int head_dim(int num_heads, int d_model);
+
+        /**
+         * @brief Project input onto columns [col_offset, col_offset + cols) of W_qkv
          * @param input matrix of shape (seq_len, d_model)
-         * @return Reshaped matrix of shape (seq_len * num_heads, d_k)
+         * @param output written in place with shape (seq_len, cols), bias broadcast per row
+         */
+        template <typename Output>
+        void project_qkv(const Eigen::Ref<const Eigen::MatrixXf>& input, int col_offset, int cols, Output&& output) const;
+
+        /**
+         * @brief Apply RoPE, if enabled, to the Q and K columns of qkv rows [row, row + rows)
          */
-        Eigen::MatrixXf reshape_for_heads(const Eigen::MatrixXf& input);
+        void rotate_qk(Eigen::Ref<Eigen::MatrixXf> qkv, int row, int rows, int start_pos) const;
 
         /**
-         * @brief Reshape back from multi-head format to original shape
-         * @param input matrix of shape (seq_len * num_heads, d_k)
-         * @return Reshaped matrix of shape (seq_len, d_model)
+         * @brief Output projection of the concatenated head outputs
+         * @return Matrix of shape (seq_len, d_model)
          */
-        Eigen::MatrixXf reshape_from_heads(const Eigen::MatrixXf& input);
+        Eigen::MatrixXf project_output(const Eigen::Ref<const Eigen::MatrixXf>& concat) const;
 
+        /**
+         * @brief Output projection written into a caller buffer of shape (seq_len, d_model)
+         */
+        void project_output_into(const Eigen::Ref<const Eigen::MatrixXf>& concat, Eigen::Ref<Eigen::MatrixXf> output) const;
 
+        /**
+         * @brief Context workspace a call with seq_len queries and kv_len keys draws from
+         */
+        std::size_t workspace_floats(int seq_len, int kv_len) const;
+
+        /**
+         * @brief W_q, W_k or W_v (index 0, 1, 2) as (d_model, d_model), empty once quantized
+         */
+        Eigen::MatrixXf projection_weights(int index) const;
 };
 
 
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <Eigen/Dense>
+#include <vector>
+
+namespace transformer {
+
+/**
+ * @brief Several variable-length sequences packed into one token-major buffer
+ * Sequence i occupies rows [offsets[i], offsets[i + 1]) of tokens, with no padding.
+ * Position-wise layers run one GEMM over every row; attention uses the offsets to
+ * keep each sequence to itself.
+ */
+struct RaggedBatch {
+    Eigen::MatrixXf tokens;    // (total_tokens, d_model)
+    std::vector<int> offsets;  // (num_sequences + 1), offsets[0] = 0, offsets.back() = total_tokens
+
+    /**
+     * @brief Pack sequences of shape (seq_len_i, d_model) into one batch
+     */
+    static RaggedBatch pack(const std::vector<Eigen::MatrixXf>& sequences);
+
+    /**
+     * @brief Throws std::invalid_argument unless offsets start at 0, never decrease and end at total_tokens
+     */
+    void validate() const;
+
+    int num_sequences() const {return static_cast<int>(offsets.size()) - 1;}
+    int total_tokens() const {return static_cast<int>(tokens.rows());}
+    int length(int i) const {return offsets[i + 1] - offsets[i];}
+
+    /**
+     * @brief Rows of sequence i, shape (length(i), d_model)
+     */
+    auto sequence(int i) {return tokens.middleRows(offsets[i], length(i));}
+    auto sequence(int i) const {return tokens.middleRows(offsets[i], length(i));}
+};
+
+} // namespace transformer
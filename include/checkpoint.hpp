@@ -0,0 +1,149 @@
+#pragma once
+
+#include <Eigen/Dense>
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include "weights.hpp"
+
+namespace transformer {
+
+/**
+ * @brief Binary weight checkpoint, format version 2 (native little-endian)
+ *
+ *   header     64 bytes: magic "TFMRCKPT", uint32 version, uint32 tensor count,
+ *              uint64 directory offset, uint64 directory bytes, zero padding
+ *   blobs      one per tensor, each starting on a 64-byte boundary
+ *   directory  per tensor: uint32 name length, name, uint32 dtype, uint32 rank,
+ *              int64 rows, int64 cols, uint64 blob offset, uint64 blob bytes
+ *
+ * Float tensors are column-major, so a blob maps straight onto an Eigen matrix. The
+ * directory comes last so the writer streams each blob as it is added.
+ *
+ * Version 2 stores token embedding tables as (embedding_dim, vocab_size), the bytes of
+ * the row-major table. Version 1 files, with (vocab_size, embedding_dim) tables, still
+ * open; their tables are transposed into memory on load instead of mapped.
+ */
+enum class TensorType : uint32_t {
+    Float32 = 0,
+    Int64 = 1
+};
+
+
+/**
+ * @brief Streams tensors into a new checkpoint file
+ * Throws std::runtime_error on I/O failure and std::invalid_argument on a duplicate name.
+ */
+class CheckpointWriter {
+    private:
+        struct Entry {
+            std::string name;
+            TensorType type;
+            uint32_t rank;
+            int64_t rows;
+            int64_t cols;
+            uint64_t offset;
+            uint64_t bytes;
+        };
+
+        std::string path_;
+        std::ofstream file_;
+        std::vector<Entry> entries_;
+        bool finished_ = false;
+
+        void write_blob(const std::string& name, TensorType type, uint32_t rank,
+                        int64_t rows, int64_t cols, const void* data, uint64_t bytes);
+
+    public:
+        explicit CheckpointWriter(const std::string& path);
+        ~CheckpointWriter();
+
+        CheckpointWriter(const CheckpointWriter&) = delete;
+        CheckpointWriter& operator=(const CheckpointWriter&) = delete;
+
+        void add_matrix(const std::string& name, const Eigen::Ref<const Eigen::MatrixXf>& matrix);
+        void add_vector(const std::string& name, const Eigen::Ref<const Eigen::VectorXf>& vector);
+        void add_int64(const std::string& name, const std::vector<int64_t>& values);
+
+        /**
+         * @brief Write the directory and header; the file is incomplete until this runs
+         */
+        void finish();
+};
+
+
+/**
+ * @brief Read-only view of a checkpoint file mapped into memory
+ * The file is mapped privately, so pages come from the shared page cache and are only
+ * read from disk when first touched: opening a multi-gigabyte checkpoint costs a
+ * directory parse, and processes mapping the same file share one copy. Writes through
+ * a view (in-place parameter updates) copy the touched pages and never reach the file.
+ */
+class Checkpoint {
+    public:
+        struct Tensor {
+            TensorType type;
+            uint32_t rank;
+            int64_t rows;
+            int64_t cols;    // 1 for rank-1 tensors
+            uint64_t offset;
+            uint64_t bytes;
+        };
+
+        /**
+         * @brief Map a checkpoint file
+         * Throws std::runtime_error if the file cannot be mapped or is not a valid checkpoint.
+         */
+        static std::shared_ptr<const Checkpoint> open(const std::string& path);
+
+        ~Checkpoint();
+        Checkpoint(const Checkpoint&) = delete;
+        Checkpoint& operator=(const Checkpoint&) = delete;
+
+        bool contains(const std::string& name) const {return tensors_.count(name) > 0;}
+
+        /**
+         * @brief Directory entry of a tensor, std::out_of_range if it is missing
+         */
+        const Tensor& tensor(const std::string& name) const;
+
+        /**
+         * @brief Float data of a tensor that must have shape (rows, cols)
+         * Throws std::invalid_argument on a type or shape mismatch.
+         */
+        float* floats(const std::string& name, int64_t rows, int64_t cols) const;
+
+        std::vector<int64_t> int64s(const std::string& name) const;
+        std::vector<std::string> names() const;
+
+        uint32_t version() const {return version_;}
+        std::size_t file_bytes() const {return size_;}
+
+        static constexpr uint32_t kVersion = 2;
+        static constexpr uint32_t kMinVersion = 1; // Oldest version open() accepts
+        static constexpr std::size_t kAlignment = 64;
+
+    private:
+        Checkpoint() = default;
+
+        void* mapping_ = nullptr;
+        std::size_t size_ = 0;
+        uint32_t version_ = 0;
+        std::map<std::string, Tensor> tensors_;
+};
+
+
+/**
+ * @brief Point a weight at checkpoint tensor name of shape (rows, cols) without copying
+ * The weight holds a reference to the checkpoint, keeping it mapped while in use.
+ */
+template <typename Dense>
+void load_weights(Weights<Dense>& weights, const std::shared_ptr<const Checkpoint>& checkpoint,
+                  const std::string& name, Eigen::Index rows, Eigen::Index cols = 1){
+    weights.view(checkpoint->floats(name, rows, cols), rows, cols, checkpoint);
+}
+
+} // namespace transformer
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstddef>
+
+namespace transformer {
+
+/**
+ * @brief Widest vector instruction set the kernels may use
+ */
+enum class SimdLevel {
+    Scalar,
+    AVX2,   // AVX2 + FMA + F16C
+    AVX512  // AVX-512F + F16C
+};
+
+/**
+ * @brief Best SimdLevel supported by the running CPU, detected once via CPUID
+ */
+SimdLevel simd_level();
+
+/**
+ * @brief Whether the running CPU supports the given level
+ */
+bool simd_level_supported(SimdLevel level);
+
+/**
+ * @brief Whether the running CPU has the AVX-512 BF16 conversion instructions
+ */
+bool avx512_bf16_supported();
+
+/**
+ * @brief Size of the per-core L1 data cache in bytes (32 KiB if unknown)
+ */
+std::size_t l1_data_cache_bytes();
+
+/**
+ * @brief Size of the per-core L2 cache in bytes (1 MiB if unknown)
+ */
+std::size_t l2_cache_bytes();
+
+} // namespace transformer
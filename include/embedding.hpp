@@ -3,39 +3,192 @@
 #include <Eigen/Dense>
 #include <vector>
 #include <cmath>
+#include <memory>
 #include <random>
+#include <string>
+#include "batch.hpp"
+#include "checkpoint.hpp"
+#include "cpu_info.hpp"
+#include "quantization.hpp"
 
 namespace transformer {
 
 
+/**
+ * @brief Token id -> vector lookup table
+ * The table is row-major, so a token's vector is one contiguous run of embedding_dim
+ * floats and a batch lookup is a gather of whole rows. In a checkpoint it is stored as
+ * the column-major (embedding_dim, vocab_size) transpose, which is the same bytes, so a
+ * memory-mapped table only pages in the rows that are actually looked up.
+ */
 class TokenEmbedding {
     private:
-        Eigen::MatrixXf embedding_matrix_;
+        WeightRowMatrix embedding_matrix_; // (vocab_size, embedding_dim)
         int vocab_size_;
         int embedding_dim_;
 
+        // Compressed table used instead of embedding_matrix_ once quantize_weights() has run.
+        // It holds the transpose, one channel per token, so each token's row stays contiguous
+        // and the tied output projection is a plain quantized matmul.
+        WeightFormat weight_format_ = WeightFormat::FP32;
+        QuantizedMatrix table_quantized_; // (embedding_dim, vocab_size)
+
+        void check_ids(const int* ids, int count) const;
+
     public:
         TokenEmbedding(int vocab_size, int embedding_dim);
 
+        /**
+         * @brief Build the table around prefix + "embedding" in a checkpoint, without copying it
+         */
+        TokenEmbedding(const std::shared_ptr<const Checkpoint>& checkpoint, const std::string& prefix);
+
         Eigen::MatrixXf forward(const std::vector<int>& token_indices);
 
-        const Eigen::MatrixXf& get_embedding_matrix() const {return embedding_matrix_;}
+        /**
+         * @brief Embed tokens into a caller buffer of shape (num_tokens, embedding_dim)
+         */
+        void forward_into(const std::vector<int>& token_indices, Eigen::Ref<Eigen::MatrixXf> output) const;
+
+        /**
+         * @brief Batched lookup of count token ids into rows of output
+         * Ids are range-checked in one pass before any row is read (std::out_of_range).
+         * Table rows are prefetched a few tokens ahead of the copy, so the cache misses of a
+         * random gather over a large vocabulary overlap instead of stalling one by one.
+         * For a quantized or memory-mapped table, repeated ids are decoded once: the distinct
+         * ids are visited in ascending order (sequential page access) into a small row-major
+         * block, which is then copied out in token order.
+         * @param output Buffer of shape (count, embedding_dim)
+         */
+        void gather(const int* ids, int count, Eigen::Ref<Eigen::MatrixXf> output) const;
+
+        /**
+         * @brief Embed several token sequences into one packed batch
+         * @param token_sequences One vector of token ids per sequence
+         * @return Batch of shape (total_tokens, embedding_dim) with per-sequence offsets
+         */
+        RaggedBatch forward_batch(const std::vector<std::vector<int>>& token_sequences);
+
+        /**
+         * @brief Tied output projection, logits = hidden * table^T
+         * @param hidden Matrix of shape (rows, embedding_dim)
+         * @param logits Buffer of shape (rows, vocab_size)
+         */
+        void project_into(const Eigen::Ref<const Eigen::MatrixXf>& hidden, Eigen::Ref<Eigen::MatrixXf> logits) const;
+
+        /**
+         * @brief Size the calling thread's scratch for project_into on up to max_rows rows;
+         *        run it on every pool thread
+         */
+        void reserve_thread(int max_rows) const;
+
+        /**
+         * @brief Store the table in a compressed format (INT8 keeps one scale per token)
+         * The float table is released, so get_embedding_matrix() is empty afterwards.
+         */
+        void quantize_weights(WeightFormat format);
+
+        WeightFormat get_weight_format() const {return weight_format_;}
+
+        /**
+         * @brief Bytes held by the table in its current format
+         */
+        std::size_t weight_bytes() const;
+
+        int get_vocab_size() const {return vocab_size_;}
+        int get_embedding_dim() const {return embedding_dim_;}
+        const WeightRowMatrix& get_embedding_matrix() const {return embedding_matrix_;}
+
+        /**
+         * @brief Write the table under prefix; std::logic_error once quantized
+         */
+        void save(CheckpointWriter& writer, const std::string& prefix) const;
+        void load(const std::shared_ptr<const Checkpoint>& checkpoint, const std::string& prefix);
 
         void update_embedding_matrix(const Eigen::MatrixXf& gradients);
 
 };
 
 
+/**
+ * @brief Where PositionalEncoding takes its values from
+ */
+enum class EncodingTable {
+    Precomputed, // A (max_seq_len, embedding_dim) table built once and read by every call
+    OnDemand     // No table: the values for the positions in a call are generated as they are added
+};
+
+
+/**
+ * @brief Sinusoidal positional encoding
+ * Dimension i of position p is sin (i even) or cos (i odd) of p * 10000^(-2i / embedding_dim).
+ * Only the per-dimension frequencies are computed up front; positions are generated with
+ * the angle-addition recurrence, so a table costs a few multiply-adds per element instead
+ * of a pow, a sin and a cos. OnDemand keeps no table at all, for long max_seq_len or decode
+ * where each step needs one position.
+ */
 class PositionalEncoding {
     private:
-        Eigen::MatrixXf pos_encoding_;
+        Eigen::MatrixXf pos_encoding_; // Empty in OnDemand mode
+        Eigen::VectorXd inv_freq_;     // (embedding_dim)
         int max_seq_len_;
         int embedding_dim_;
+        EncodingTable table_;
 
     public: 
-        PositionalEncoding(int max_seq_len, int embedding_dim);
+        PositionalEncoding(int max_seq_len, int embedding_dim, EncodingTable table = EncodingTable::Precomputed);
         Eigen::MatrixXf forward(const Eigen::MatrixXf& token_embeddings);
-        const Eigen::MatrixXf& get_pos_encoding() const {return pos_encoding_;};
+
+        /**
+         * @brief Add positional encodings to token embeddings in place
+         * @param start_pos Position of the first row, e.g. the cached length during decode
+         */
+        void add_into(Eigen::Ref<Eigen::MatrixXf> token_embeddings, int start_pos = 0) const;
+
+        /**
+         * @brief Add positional encodings to a packed batch, positions restart at every sequence
+         */
+        RaggedBatch forward_batch(const RaggedBatch& batch);
+
+        /**
+         * @brief The precomputed table, std::logic_error in OnDemand mode
+         */
+        const Eigen::MatrixXf& get_pos_encoding() const;
+        int get_max_seq_len() const {return max_seq_len_;}
+        int get_embedding_dim() const {return embedding_dim_;}
+        EncodingTable get_table() const {return table_;}
+};
+
+
+/**
+ * @brief Rotary position embedding (RoPE) for attention queries and keys
+ * In every head, dimensions i and i + head_dim / 2 are rotated by position * base^(-2i / head_dim),
+ * so q . k depends only on how far apart the two positions are. Only the head_dim / 2
+ * frequencies are stored; the cos/sin columns for the positions of a call are generated
+ * with the same recurrence as PositionalEncoding and shared by all heads, so decode needs
+ * no position table.
+ */
+class RotaryEmbedding {
+    private:
+        Eigen::VectorXd inv_freq_; // (head_dim / 2)
+        int head_dim_ = 0;
+
+    public:
+        RotaryEmbedding() = default;
+
+        /**
+         * @param head_dim Width of one head, must be even
+         */
+        explicit RotaryEmbedding(int head_dim, double base = 10000.0);
+
+        /**
+         * @brief Rotate every head in place, row r sitting at position start_pos + r
+         * @param x Matrix of shape (rows, num_heads * head_dim), heads side by side
+         */
+        void rotate(Eigen::Ref<Eigen::MatrixXf> x, int num_heads, int start_pos) const;
+        void rotate(Eigen::Ref<Eigen::MatrixXf> x, int num_heads, int start_pos, SimdLevel level) const;
+
+        int get_head_dim() const {return head_dim_;}
 };
 
 }
\ No newline at end of file
@@ -2,22 +2,45 @@
 
 #include <Eigen/Dense>
 #include <functional>
+#include <memory>
+#include <string>
+#include "batch.hpp"
+#include "checkpoint.hpp"
+#include "quantization.hpp"
 
 namespace transformer {
 
+/**
+ * @brief Hidden-layer activation of the feed-forward network
+ * The gated variants compute act(x * W_gate + b_gate) * (x * W_up + b_up).
+ */
+enum class Activation {
+    ReLU,
+    GELU_Tanh, // 0.5x(1 + tanh(sqrt(2/pi)(x + 0.044715x^3)))
+    GELU_Erf,  // 0.5x(1 + erf(x / sqrt(2)))
+    SwiGLU,    // SiLU gate
+    GeGLU      // GELU (tanh) gate
+};
+
 class FeedForward{
     private:
         int d_model_;
         int d_ff_;
+        Activation activation_;
     
-        Eigen::MatrixXf W1_; // (d_model, d_ff)
-        Eigen::MatrixXf W2_; // (d_ff, d_model_)
+        WeightMatrix W1_; // (d_model, d_ff), gated: (d_model, 2 * d_ff) = [W_gate | W_up]
+        WeightMatrix W2_; // (d_ff, d_model_)
+
+        WeightVector b1_; // (d_ff), gated: (2 * d_ff)
+        WeightVector b2_; // (d_model_)
 
-        Eigen::VectorXf b1_; // (d_ff)
-        Eigen::VectorXf b2_; // (d_model_)
+        // Compressed copies used instead of W1_ / W2_ once quantize_weights() has run
+        WeightFormat weight_format_ = WeightFormat::FP32;
+        QuantizedMatrix W1_quantized_;
+        QuantizedMatrix W2_quantized_;
 
         Eigen::MatrixXf last_input_;
-        Eigen::MatrixXf last_hidden_;
+        Eigen::MatrixXf last_hidden_; // (seq_len, get_hidden_width()), activations in the first d_ff columns
 
         /**
          * @brief Initialize weight matrices with Xavier initialization
@@ -31,8 +54,29 @@ class FeedForward{
          */
         Eigen::MatrixXf relu(const Eigen::MatrixXf& x);
 
+        /**
+         * @brief GEMM1, fused bias + activation epilogue, GEMM2
+         * @param hidden Scratch of shape (seq_len, get_hidden_width()); its first d_ff
+         *               columns hold the activated hidden layer afterwards
+         */
+        void compute(const Eigen::Ref<const Eigen::MatrixXf>& x,
+                     Eigen::Ref<Eigen::MatrixXf> output,
+                     Eigen::Ref<Eigen::MatrixXf> hidden) const;
+
+        /**
+         * @brief Token rows per thread-pool task in forward_into, an L2-sized block at most
+         */
+        int rows_per_task(int seq_len) const;
+
     public:
-        FeedForward(int d_model, int d_ff);
+        FeedForward(int d_model, int d_ff, Activation activation = Activation::ReLU);
+
+        /**
+         * @brief Build the layer around weights in a checkpoint, without copying them
+         * Shapes come from prefix + "W1" / "W2"; the activation is not stored.
+         */
+        FeedForward(const std::shared_ptr<const Checkpoint>& checkpoint, const std::string& prefix,
+                    Activation activation = Activation::ReLU);
 
         /**
          * @brief Forward pass of the feed-forward network
@@ -41,6 +85,35 @@ class FeedForward{
          */
         Eigen::MatrixXf forward(const Eigen::MatrixXf& x);
 
+        /**
+         * @brief Forward pass written into a caller buffer, row blocks in parallel
+         * @param x Input matrix (seq_len, d_model)
+         * @param output Buffer of shape (seq_len, d_model), must not alias x
+         */
+        void forward_into(const Eigen::Ref<const Eigen::MatrixXf>& x, Eigen::Ref<Eigen::MatrixXf> output);
+
+        /**
+         * @brief Inference-only forward pass: caches nothing and touches no member state,
+         *        so one FeedForward can serve several threads that bring their own buffers
+         * When hidden has fewer rows than x, tokens are streamed through it in row blocks
+         * (GEMM1, epilogue, GEMM2 into the matching output rows), so activation memory is
+         * bounded by the scratch size instead of growing with seq_len. The scratch rows are
+         * split between the thread-pool threads, each streaming its own blocks, so size it
+         * with rows_per_block() * get_num_threads() rows to give every thread a full block.
+         * @param x Input matrix (seq_len, d_model)
+         * @param output Buffer of shape (seq_len, d_model), must not alias x
+         * @param hidden Scratch buffer of shape (block_rows, get_hidden_width()), any
+         *               block_rows >= 1; rows_per_block() gives an L2-sized choice
+         */
+        void infer(const Eigen::Ref<const Eigen::MatrixXf>& x,
+                   Eigen::Ref<Eigen::MatrixXf> output,
+                   Eigen::Ref<Eigen::MatrixXf> hidden) const;
+
+        /**
+         * @brief Forward pass over a packed batch, one GEMM per weight for every token
+         */
+        RaggedBatch forward_batch(const RaggedBatch& batch);
+
         /**
          * @brief Update parameters (for training)
          * @param d_W1 Gradient for W1_
@@ -51,18 +124,58 @@ class FeedForward{
         void update_parameters(const Eigen::MatrixXf& d_W1, const Eigen::VectorXf& d_b1,
         const Eigen::MatrixXf& d_W2, const Eigen::VectorXf& d_b2);
 
+        /**
+         * @brief Store W1 and W2 in a compressed format for inference
+         * The float weights are released (get_W1/get_W2 become empty) and
+         * update_parameters is no longer allowed.
+         */
+        void quantize_weights(WeightFormat format);
+
+        WeightFormat get_weight_format() const {return weight_format_;}
+
+        /**
+         * @brief Write W1, b1, W2 and b2 under prefix; std::logic_error once quantized
+         */
+        void save(CheckpointWriter& writer, const std::string& prefix) const;
+
+        /**
+         * @brief Replace the weights with views of a checkpoint's tensors
+         * Throws std::invalid_argument if a shape does not match this layer.
+         */
+        void load(const std::shared_ptr<const Checkpoint>& checkpoint, const std::string& prefix);
+
+        /**
+         * @brief Bytes held by W1 and W2 in their current format
+         */
+        std::size_t weight_bytes() const;
+
         
         /**
          * @brief Getter for testing
          */
         int get_d_model() const {return d_model_;}
         int get_d_ff() const {return d_ff_;}
-        const Eigen::MatrixXf& get_W1() const {return W1_;}
-        const Eigen::MatrixXf& get_W2() const {return W2_;}
-        const Eigen::VectorXf& get_b1() const {return b1_;}
-        const Eigen::VectorXf& get_b2() const {return b2_;}
+        Activation get_activation() const {return activation_;}
+        bool is_gated() const {return activation_ == Activation::SwiGLU || activation_ == Activation::GeGLU;}
+        int get_hidden_width() const {return is_gated() ? 2 * d_ff_ : d_ff_;}
+
+        /**
+         * @brief Token rows per streamed block so one block's input, hidden and output rows
+         *        fit in half of L2
+         */
+        int rows_per_block() const;
+
+        /**
+         * @brief Size the calling thread's GEMM panels or quantized token blocks for infer()
+         *        on up to max_tokens rows; run it on every pool thread
+         */
+        void reserve_thread(int max_tokens) const;
+        const WeightMatrix& get_W1() const {return W1_;}
+        const WeightMatrix& get_W2() const {return W2_;}
+        const WeightVector& get_b1() const {return b1_;}
+        const WeightVector& get_b2() const {return b2_;}
         const Eigen::MatrixXf& get_last_input() const {return last_input_;}
-        const Eigen::MatrixXf& get_last_hidden() const {return last_hidden_;}
+        Eigen::Block<const Eigen::MatrixXf, Eigen::Dynamic, Eigen::Dynamic, true> get_last_hidden() const {return last_hidden_.leftCols(d_ff_);}
 };
 
 } //namespace transformer
\ No newline at end of file
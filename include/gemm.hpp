@@ -0,0 +1,62 @@
+#pragma once
+
+#include <Eigen/Dense>
+#include <type_traits>
+
+namespace transformer {
+
+/**
+ * @brief c (+)= a * b on raw column- or row-major operands with unit inner stride
+ * a is (rows x depth), b is (depth x cols) and c is (rows x cols); each stride is the
+ * distance between consecutive columns, or rows when that operand is row-major. The
+ * product runs Eigen's GEMM kernel on packing panels from the calling thread's
+ * workspace, so it does not touch the heap. On Eigen versions whose kernel interface
+ * this has not been checked against it falls back to a plain noalias() product, which
+ * may allocate.
+ */
+void gemm(Eigen::Index rows, Eigen::Index cols, Eigen::Index depth,
+          const float* a, Eigen::Index a_stride, bool a_row_major,
+          const float* b, Eigen::Index b_stride, bool b_row_major,
+          float* c, Eigen::Index c_stride, bool c_row_major, bool accumulate);
+
+/**
+ * @brief Size the calling thread's panels for products up to this shape
+ * Call on every thread that runs products (see ThreadPool::for_each_thread); later
+ * products of any shape shrink their blocks to the reserved panels instead of growing.
+ */
+void reserve_gemm(Eigen::Index rows, Eigen::Index cols, Eigen::Index depth);
+
+/**
+ * @brief dst = lhs * rhs, or dst += lhs * rhs with accumulate, without heap allocation
+ * Blocked products go through gemm(). Single rows, single columns and tiny products take
+ * Eigen's own GEMV / coefficient paths, which keep their temporaries on the stack.
+ * Operands must be plain float blocks, maps or their transposes.
+ */
+template <typename Lhs, typename Rhs, typename Dst>
+void gemm_into(const Eigen::MatrixBase<Lhs>& lhs_expr, const Eigen::MatrixBase<Rhs>& rhs_expr, Dst&& dst,
+               bool accumulate = false){
+    // Through MatrixBase, wrappers of a Map (WeightMatrix) resolve to the Map itself
+    const Lhs& lhs = lhs_expr.derived();
+    const Rhs& rhs = rhs_expr.derived();
+    using Out = std::remove_reference_t<Dst>;
+    static_assert((Lhs::Flags & Eigen::DirectAccessBit) && Lhs::InnerStrideAtCompileTime == 1 &&
+                  (Rhs::Flags & Eigen::DirectAccessBit) && Rhs::InnerStrideAtCompileTime == 1 &&
+                  Out::InnerStrideAtCompileTime == 1,
+                  "gemm_into needs operands with direct, unit-stride access");
+
+    const Eigen::Index rows = dst.rows();
+    const Eigen::Index cols = dst.cols();
+    const Eigen::Index depth = lhs.cols();
+    if (rows == 1 || cols == 1 || depth == 0 || depth + rows + cols < EIGEN_GEMM_TO_COEFFBASED_THRESHOLD){
+        if (accumulate){
+            dst.noalias() += lhs * rhs;
+        } else {
+            dst.noalias() = lhs * rhs;
+        }
+        return;
+    }
+    gemm(rows, cols, depth, lhs.data(), lhs.outerStride(), Lhs::IsRowMajor, rhs.data(), rhs.outerStride(),
+         Rhs::IsRowMajor, dst.data(), dst.outerStride(), Out::IsRowMajor, accumulate);
+}
+
+} // namespace transformer
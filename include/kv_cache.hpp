@@ -0,0 +1,64 @@
+#pragma once
+
+#include <Eigen/Dense>
+
+namespace transformer {
+
+/**
+ * @brief Key/value cache for one sequence during incremental decoding
+ * Keys and values are stored as (capacity, d_model) matrices. Head h owns columns
+ * [h * d_k, (h + 1) * d_k), which Eigen reads as a strided per-head view, so attention
+ * runs directly on the cache without gathering. Capacity doubles when an append does
+ * not fit, so appends are amortised O(1) per token.
+ */
+class KVCache {
+    private:
+        int d_model_;
+        int length_;
+
+        Eigen::MatrixXf keys_;   // (capacity, d_model)
+        Eigen::MatrixXf values_; // (capacity, d_model)
+
+    public:
+        /**
+         * @brief Constructor
+         * @param d_model: Width of the projected keys and values
+         * @param initial_capacity: Tokens to preallocate
+         */
+        KVCache(int d_model, int initial_capacity = 256);
+
+        /**
+         * @brief Append projected keys and values for new tokens
+         * @param keys: Matrix of shape (new_tokens, d_model)
+         * @param values: Matrix of shape (new_tokens, d_model)
+         */
+        void append(const Eigen::Ref<const Eigen::MatrixXf>& keys,
+                    const Eigen::Ref<const Eigen::MatrixXf>& values);
+
+        /**
+         * @brief Grow the buffers to hold at least capacity tokens
+         */
+        void reserve(int capacity);
+
+        /**
+         * @brief Drop every token after the first length (e.g. rejected draft tokens)
+         */
+        void truncate(int length);
+
+        /**
+         * @brief Forget every cached token but keep the buffers
+         */
+        void clear() {length_ = 0;}
+
+        /**
+         * @brief Cached keys and values of shape (length, d_model)
+         */
+        auto keys() const {return keys_.topRows(length_);}
+        auto values() const {return values_.topRows(length_);}
+
+        int length() const {return length_;}
+        int capacity() const {return static_cast<int>(keys_.rows());}
+        int get_d_model() const {return d_model_;}
+};
+
+} // namespace transformer
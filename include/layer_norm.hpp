@@ -1,5 +1,9 @@
 #pragma once
 #include <Eigen/Dense>
+#include <memory>
+#include <string>
+#include "batch.hpp"
+#include "checkpoint.hpp"
 
 namespace transformer {
 
@@ -12,8 +16,8 @@ private:
     int d_model_;
     float epsilon_;
 
-    Eigen::VectorXf gamma_; // Scale parameter (initialized to 1)
-    Eigen::VectorXf beta_;  // Shift parameter (initialized to 0)
+    WeightVector gamma_; // Scale parameter (initialized to 1)
+    WeightVector beta_;  // Shift parameter (initialized to 0)
 
     // For storing intermediate values (useful for backpropagation later)
     Eigen::MatrixXf last_input_;
@@ -21,9 +25,19 @@ private:
     Eigen::VectorXf last_mean_;      // ✅ Fixed: VectorXf with underscore
     Eigen::VectorXf last_variance_;  // ✅ Fixed: VectorXf with underscore
 
+    /**
+     * @brief Normalize last_input_ into output, filling the other caches
+     */
+    void normalize_cached_input(Eigen::Ref<Eigen::MatrixXf> output);
+
 public:
     LayerNorm(int d_model, float epsilon = 1e-6f);
 
+    /**
+     * @brief Build the layer around prefix + "gamma" / "beta" in a checkpoint, without copying them
+     */
+    LayerNorm(const std::shared_ptr<const Checkpoint>& checkpoint, const std::string& prefix, float epsilon = 1e-6f);
+
     /**
      * @brief Forward pass through layer normalization
      * @param x Input matrix of shape (seq_len, d_model)
@@ -31,6 +45,39 @@ public:
      */
     Eigen::MatrixXf forward(const Eigen::MatrixXf& x);
 
+    /**
+     * @brief Forward pass written into a caller buffer of shape (seq_len, d_model)
+     */
+    void forward_into(const Eigen::Ref<const Eigen::MatrixXf>& x, Eigen::Ref<Eigen::MatrixXf> output);
+
+    /**
+     * @brief Residual add fused with normalization: output = LayerNorm(x + residual)
+     * The sum is formed directly in the cached input, so no separate residual matrix is built.
+     */
+    void add_forward_into(const Eigen::Ref<const Eigen::MatrixXf>& x,
+                          const Eigen::Ref<const Eigen::MatrixXf>& residual,
+                          Eigen::Ref<Eigen::MatrixXf> output);
+
+    /**
+     * @brief Inference-only normalization: caches nothing, so it is const and thread-safe
+     * @param output Buffer of shape (seq_len, d_model), may alias x
+     */
+    void infer(const Eigen::Ref<const Eigen::MatrixXf>& x, Eigen::Ref<Eigen::MatrixXf> output) const;
+
+    /**
+     * @brief Inference-only output = LayerNorm(x + residual) in a single buffer
+     * The sum is written once and normalized while that block of tokens is still in cache.
+     * @param output Buffer of shape (seq_len, d_model), may alias x or residual
+     */
+    void add_infer(const Eigen::Ref<const Eigen::MatrixXf>& x,
+                   const Eigen::Ref<const Eigen::MatrixXf>& residual,
+                   Eigen::Ref<Eigen::MatrixXf> output) const;
+
+    /**
+     * @brief Forward pass over a packed batch, every token normalised in one call
+     */
+    RaggedBatch forward_batch(const RaggedBatch& batch);
+
     /**
      * @brief Initialize parameters (gamma = 1, beta = 0)
      */
@@ -39,8 +86,18 @@ public:
     /**
      * @brief Get learnable parameters
      */
-    const Eigen::VectorXf& get_gamma() const { return gamma_; }  // ✅ Fixed: const reference
-    const Eigen::VectorXf& get_beta() const { return beta_; }   // ✅ Fixed: const reference
+    const WeightVector& get_gamma() const { return gamma_; }  // ✅ Fixed: const reference
+    const WeightVector& get_beta() const { return beta_; }   // ✅ Fixed: const reference
+
+    /**
+     * @brief Write gamma and beta under prefix
+     */
+    void save(CheckpointWriter& writer, const std::string& prefix) const;
+
+    /**
+     * @brief Replace gamma and beta with views of a checkpoint's tensors
+     */
+    void load(const std::shared_ptr<const Checkpoint>& checkpoint, const std::string& prefix);
 
     /** 
      * @brief Update parameters  // ✅ Fixed: typo
@@ -71,4 +128,53 @@ public:
     int get_d_model() const { return d_model_; }
 };  // ✅ Fixed: Added semicolon
 
+
+/**
+ * @brief Root-mean-square normalization: x / sqrt(mean(x^2) + epsilon) * gamma
+ * No centering and no shift; runs on the same blocked kernel as LayerNorm.
+ */
+class RMSNorm {
+private:
+    int d_model_;
+    float epsilon_;
+
+    WeightVector gamma_; // Scale parameter (initialized to 1)
+
+public:
+    RMSNorm(int d_model, float epsilon = 1e-6f);
+
+    /**
+     * @brief Build the layer around prefix + "gamma" in a checkpoint, without copying it
+     */
+    RMSNorm(const std::shared_ptr<const Checkpoint>& checkpoint, const std::string& prefix, float epsilon = 1e-6f);
+
+    /**
+     * @brief Normalize every token of x
+     * @param x Input matrix of shape (seq_len, d_model)
+     * @return Normalized output of shape (seq_len, d_model)
+     */
+    Eigen::MatrixXf forward(const Eigen::MatrixXf& x) const;
+
+    /**
+     * @brief Normalize into a caller buffer of shape (seq_len, d_model), may alias x
+     */
+    void infer(const Eigen::Ref<const Eigen::MatrixXf>& x, Eigen::Ref<Eigen::MatrixXf> output) const;
+
+    /**
+     * @brief output = RMSNorm(x + residual), output may alias x or residual
+     */
+    void add_infer(const Eigen::Ref<const Eigen::MatrixXf>& x,
+                   const Eigen::Ref<const Eigen::MatrixXf>& residual,
+                   Eigen::Ref<Eigen::MatrixXf> output) const;
+
+    void update_parameters(const Eigen::VectorXf& d_gamma);
+
+    void save(CheckpointWriter& writer, const std::string& prefix) const;
+    void load(const std::shared_ptr<const Checkpoint>& checkpoint, const std::string& prefix);
+
+    const WeightVector& get_gamma() const { return gamma_; }
+    float get_epsilon() const { return epsilon_; }
+    int get_d_model() const { return d_model_; }
+};
+
 } // namespace transformer
\ No newline at end of file
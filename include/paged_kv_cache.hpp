@@ -0,0 +1,137 @@
+#pragma once
+
+#include <Eigen/Dense>
+#include <cstdint>
+#include <vector>
+
+namespace transformer {
+
+/**
+ * @brief Element type of cached keys and values
+ * BF16 halves the cache's memory and bandwidth; attention widens each page back to fp32.
+ */
+enum class KVStorage {
+    FP32,
+    BF16
+};
+
+/**
+ * @brief Block-paged key/value store shared by many concurrent sequences
+ * Keys and values live in fixed-size pages of page_size tokens carved from one arena
+ * allocated up front. Each sequence owns a page table listing its pages in order, so
+ * memory grows with the tokens actually cached rather than with max_seq_len per
+ * sequence. Forked sequences share their parent's pages; a shared page is copied only
+ * when one of the sequences appends into it (copy-on-write).
+ *
+ * A page stores keys and values as (page_size, d_model) column-major blocks, so the
+ * attention kernel reads each head's columns of a page as a strided view. With BF16
+ * storage the blocks hold bfloat16 and are read through load_page instead.
+ */
+class PagedKVCache {
+    private:
+        struct Sequence {
+            std::vector<int> pages; // Page table, in token order
+            int length = 0;
+            bool active = false;
+        };
+
+        int d_model_;
+        int page_size_;
+        int num_pages_;
+        KVStorage storage_;
+
+        std::vector<float> arena_;         // FP32: num_pages * 2 * page_size * d_model floats
+        std::vector<uint16_t> bf16_arena_; // BF16: the same layout in bfloat16
+        std::vector<int> ref_counts_; // Sequences referencing each page
+        std::vector<int> free_pages_;
+
+        std::vector<Sequence> sequences_;
+        std::vector<int> free_sequences_;
+
+        float* page_data(int page) {return arena_.data() + static_cast<std::size_t>(page) * page_floats();}
+        const float* page_data(int page) const {return arena_.data() + static_cast<std::size_t>(page) * page_floats();}
+        uint16_t* page_bf16(int page) {return bf16_arena_.data() + static_cast<std::size_t>(page) * page_floats();}
+        const uint16_t* page_bf16(int page) const {return bf16_arena_.data() + static_cast<std::size_t>(page) * page_floats();}
+        std::size_t page_floats() const {return 2 * static_cast<std::size_t>(page_size_) * d_model_;}
+
+        int allocate_page();
+        void release_page(int page);
+        Sequence& sequence(int seq);
+        const Sequence& sequence(int seq) const;
+
+    public:
+        /**
+         * @brief Constructor
+         * @param d_model: Width of the projected keys and values
+         * @param page_size: Tokens per page
+         * @param num_pages: Pages in the arena, shared by every sequence
+         * @param storage: Element type of the arena
+         */
+        PagedKVCache(int d_model, int page_size, int num_pages, KVStorage storage = KVStorage::FP32);
+
+        /**
+         * @brief Start an empty sequence
+         * @return Sequence id
+         */
+        int create_sequence();
+
+        /**
+         * @brief Start a sequence that shares every cached token of parent
+         * @return Sequence id of the fork
+         */
+        int fork_sequence(int parent);
+
+        /**
+         * @brief Release a sequence and every page no other sequence references
+         */
+        void free_sequence(int seq);
+
+        /**
+         * @brief Append projected keys and values for new tokens of a sequence
+         * Throws std::runtime_error when the arena has no free page left.
+         * @param keys: Matrix of shape (new_tokens, d_model)
+         * @param values: Matrix of shape (new_tokens, d_model)
+         */
+        void append(int seq,
+                    const Eigen::Ref<const Eigen::MatrixXf>& keys,
+                    const Eigen::Ref<const Eigen::MatrixXf>& values);
+
+        /**
+         * @brief Keys and values of one page, shape (page_size, d_model)
+         * Only the first tokens_in_page(seq, i) rows of a sequence's i-th page are valid.
+         * FP32 storage only; throws std::logic_error for BF16.
+         */
+        Eigen::Map<const Eigen::MatrixXf> page_keys(int page) const;
+        Eigen::Map<const Eigen::MatrixXf> page_values(int page) const;
+
+        /**
+         * @brief Copy rows [0, rows) of columns [col, col + cols) of a page's keys and values as fp32
+         * @param keys: Output of shape (rows, cols)
+         * @param values: Output of shape (rows, cols)
+         */
+        void load_page(int page, int rows, int col, int cols,
+                       Eigen::Ref<Eigen::MatrixXf> keys, Eigen::Ref<Eigen::MatrixXf> values) const;
+
+        const std::vector<int>& page_table(int seq) const {return sequence(seq).pages;}
+        int tokens_in_page(int seq, int index) const;
+        int length(int seq) const {return sequence(seq).length;}
+
+        /**
+         * @brief Pages needed to append new_tokens to a sequence, counting a copy-on-write
+         */
+        int pages_needed(int seq, int new_tokens) const;
+
+        int ref_count(int page) const {return ref_counts_[page];}
+        int num_free_pages() const {return static_cast<int>(free_pages_.size());}
+        int num_pages() const {return num_pages_;}
+        int page_size() const {return page_size_;}
+        int get_d_model() const {return d_model_;}
+        KVStorage storage() const {return storage_;}
+
+        /**
+         * @brief Bytes of the key/value arena
+         */
+        std::size_t arena_bytes() const;
+};
+
+} // namespace transformer
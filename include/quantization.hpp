@@ -0,0 +1,131 @@
+#pragma once
+
+#include <Eigen/Dense>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include "cpu_info.hpp"
+
+namespace transformer {
+
+/**
+ * @brief Storage format of a layer's weight matrices
+ */
+enum class WeightFormat {
+    FP32,  // Dense Eigen::MatrixXf, the default
+    INT8,  // Per-output-channel symmetric int8: w = scale[channel] * q, q in [-127, 127]
+    Q4,    // 4-bit groups of 32 weights along the input, fp16 scale: w = scale * (q - 8)
+    Q4_ZP, // As Q4 with a per-group zero point: w = scale * (q - zero), zero in [0, 15]
+    FP16,  // IEEE half precision, no scales
+    BF16   // bfloat16 (fp32 with the low 16 mantissa bits rounded off), no scales
+};
+
+/**
+ * @brief IEEE half precision conversions, round to nearest even
+ */
+uint16_t float_to_fp16(float value);
+float fp16_to_float(uint16_t bits);
+
+/**
+ * @brief bfloat16 conversions, round to nearest even; NaN stays NaN
+ */
+uint16_t float_to_bf16(float value);
+inline float bf16_to_float(uint16_t bits){
+    uint32_t widened = static_cast<uint32_t>(bits) << 16;
+    float value;
+    std::memcpy(&value, &widened, sizeof(value));
+    return value;
+}
+
+/**
+ * @brief Convert count values to or from bfloat16, with AVX-512 BF16 when the CPU has it
+ */
+void float_to_bf16(const float* src, uint16_t* dst, std::size_t count);
+void bf16_to_float(const uint16_t* src, float* dst, std::size_t count);
+
+/**
+ * @brief Compressed weight matrix W of shape (in_features, out_features), applied as y = x * W
+ * Weights are stored one output channel per row, so a channel's weights are contiguous and
+ * streamed once per block of tokens. Kernels widen them to fp32 in registers and multiply
+ * with fp32 activations (AVX-512, AVX2 or scalar, chosen by simd_level()); the float matrix
+ * is never rebuilt. Tokens are processed a few at a time, which suits decode and small
+ * batches where streaming the weights dominates.
+ *
+ * Q4 formats pack each group of 32 weights into 16 bytes: byte i holds weight i in its low
+ * nibble and weight i + 16 in its high nibble, so one 16-byte load yields two vectors.
+ */
+class QuantizedMatrix {
+    private:
+        WeightFormat format_ = WeightFormat::INT8;
+        int in_features_ = 0;
+        int out_features_ = 0;
+        int stride_ = 0;              // Packed elements per channel, in_features rounded up to 64
+
+        std::vector<int8_t> int8_;    // INT8: (out_features, stride) quantized weights, zero padded
+        std::vector<float> scales_;   // INT8: (out_features)
+
+        std::vector<uint8_t> q4_;            // Q4: (out_features, stride / 2) packed nibbles
+        std::vector<uint16_t> group_scales_; // Q4: (out_features, stride / 32) fp16 scales
+        std::vector<uint8_t> group_zeros_;   // Q4: (out_features, stride / 32) zero points
+
+        std::vector<uint16_t> half_;         // FP16, BF16: (out_features, stride) 16-bit weights
+
+        void quantize_int8(const Eigen::Ref<const Eigen::MatrixXf>& W);
+        void quantize_q4(const Eigen::Ref<const Eigen::MatrixXf>& W);
+        void convert_half(const Eigen::Ref<const Eigen::MatrixXf>& W);
+
+    public:
+        QuantizedMatrix() = default;
+
+        /**
+         * @brief Quantize a float matrix
+         * @param W Matrix of shape (in_features, out_features)
+         * @param format Any format except FP32
+         */
+        QuantizedMatrix(const Eigen::Ref<const Eigen::MatrixXf>& W, WeightFormat format);
+
+        /**
+         * @brief y = x * W[:, col_offset : col_offset + cols]
+         * @param x Input of shape (seq_len, in_features)
+         * @param y Output of shape (seq_len, cols), overwritten
+         * @param cols Number of output channels, -1 for every channel after col_offset
+         */
+        void matmul(const Eigen::Ref<const Eigen::MatrixXf>& x, Eigen::Ref<Eigen::MatrixXf> y,
+                    int col_offset = 0, int cols = -1) const;
+
+        /**
+         * @brief Size the calling thread's token-block buffer so matmul does not allocate
+         */
+        void reserve_thread() const;
+        void matmul(const Eigen::Ref<const Eigen::MatrixXf>& x, Eigen::Ref<Eigen::MatrixXf> y,
+                    int col_offset, int cols, SimdLevel level) const;
+
+        /**
+         * @brief Float matrix of shape (in_features, out_features) holding the stored values
+         */
+        Eigen::MatrixXf dequantize() const;
+
+        /**
+         * @brief Widen one output channel (column of W) into out[0, in_features)
+         */
+        void dequantize_channel(int channel, float* out) const;
+
+        /**
+         * @brief Packed bytes of one channel, contiguous from channel_data(channel)
+         * Lets a gather of scattered channels prefetch them ahead of dequantize_channel.
+         */
+        const void* channel_data(int channel) const;
+        std::size_t channel_bytes() const;
+
+        WeightFormat format() const {return format_;}
+        int rows() const {return in_features_;}
+        int cols() const {return out_features_;}
+        bool empty() const {return out_features_ == 0;}
+
+        /**
+         * @brief Bytes of packed weights, scales and zero points
+         */
+        std::size_t bytes() const;
+};
+
+} // namespace transformer
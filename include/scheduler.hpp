@@ -0,0 +1,128 @@
+#pragma once
+
+#include <Eigen/Dense>
+#include <chrono>
+#include <deque>
+#include <vector>
+#include "embedding.hpp"
+#include "attention.hpp"
+#include "feed_forward.hpp"
+#include "layer_norm.hpp"
+#include "paged_kv_cache.hpp"
+
+namespace transformer {
+
+/**
+ * @brief Limits for InferenceScheduler
+ */
+struct SchedulerConfig {
+    int max_batch_tokens = 512;     // Tokens processed per step, decode and prefill together
+    int max_prefill_tokens = 256;   // Share of a step's budget that prompt chunks may use
+    int max_running = 64;           // Sequences admitted at once
+    int page_size = 16;             // KV cache tokens per page
+    int num_pages = 4096;           // KV cache pages shared by all running sequences
+    KVStorage kv_storage = KVStorage::FP32; // Element type of the KV cache
+    int eos_token = -1;             // Generation stops early on this token, -1 for none
+    bool continuous_batching = true; // false admits new requests only once the batch has drained
+};
+
+/**
+ * @brief A finished generation request
+ */
+struct CompletedRequest {
+    int id;
+    std::vector<int> output_tokens;
+    double time_to_first_token_ms;
+    double latency_ms;
+};
+
+/**
+ * @brief Continuous-batching scheduler driving one decoder layer
+ * Every step() admits waiting prompts and retires finished sequences, so the batch is
+ * refilled as soon as capacity frees up instead of waiting for the slowest request.
+ * A step first schedules one decode token for every running sequence (decode phase),
+ * then fills the remaining budget with prompt chunks, continuing partially prefilled
+ * prompts before admitting new ones (prefill phase). All scheduled tokens go through
+ * the layers as one packed batch, with keys and values kept in a shared paged cache.
+ *
+ * The model is x = embedding + position, h = x + attention(x), y = norm(h + ffn(h)),
+ * with logits y * embedding^T (tied weights) and greedy sampling.
+ */
+class InferenceScheduler {
+    public:
+        using Clock = std::chrono::steady_clock;
+
+    private:
+        struct Sequence {
+            int id;
+            std::vector<int> tokens; // Prompt followed by generated tokens
+            int prompt_len;
+            int max_new_tokens;
+            int cache_seq = -1;
+            int processed = 0;       // Tokens whose keys/values are in the cache
+            int reserved_pages = 0;
+            Clock::time_point arrival;
+            double time_to_first_token_ms = -1.0;
+        };
+
+        TokenEmbedding& embedding_;
+        PositionalEncoding& positions_;
+        MultiHeadAttention& attention_;
+        FeedForward& feed_forward_;
+        LayerNorm& norm_;
+        SchedulerConfig config_;
+
+        PagedKVCache cache_;
+        int reserved_pages_ = 0;
+        int next_id_ = 0;
+
+        std::deque<Sequence> waiting_;
+        std::vector<Sequence> running_;
+        std::vector<CompletedRequest> completed_;
+
+        int pages_for(int tokens) const {return (tokens + config_.page_size - 1) / config_.page_size;}
+        bool admit_next();
+
+    public:
+        InferenceScheduler(TokenEmbedding& embedding, PositionalEncoding& positions,
+                           MultiHeadAttention& attention, FeedForward& feed_forward,
+                           LayerNorm& norm, const SchedulerConfig& config = SchedulerConfig());
+
+        /**
+         * @brief Queue a prompt for generation
+         * @param prompt: Token ids, non-empty
+         * @param max_new_tokens: Tokens to generate (fewer if eos_token is produced)
+         * @return Request id reported back in CompletedRequest
+         */
+        int submit(const std::vector<int>& prompt, int max_new_tokens);
+
+        /**
+         * @brief Queue a prompt that arrived earlier, e.g. while a step was running
+         * @param arrival: When the request arrived; TTFT and latency are measured from it,
+         *                 so time spent waiting for the caller to submit is included
+         */
+        int submit(const std::vector<int>& prompt, int max_new_tokens, Clock::time_point arrival);
+
+        /**
+         * @brief Run one scheduling step and one forward pass
+         * @return Tokens processed in this step (0 when there is nothing to do)
+         */
+        int step();
+
+        /**
+         * @brief Step until every submitted request has completed
+         */
+        void run_until_idle();
+
+        /**
+         * @brief Hand over requests completed since the last call
+         */
+        std::vector<CompletedRequest> take_completed();
+
+        bool idle() const {return waiting_.empty() && running_.empty();}
+        int num_waiting() const {return static_cast<int>(waiting_.size());}
+        int num_running() const {return static_cast<int>(running_.size());}
+        const PagedKVCache& get_cache() const {return cache_;}
+};
+
+} // namespace transformer
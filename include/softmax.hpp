@@ -0,0 +1,45 @@
+#pragma once
+
+#include "cpu_info.hpp"
+
+namespace transformer {
+
+/**
+ * Vectorised softmax kernels working in place on contiguous float rows.
+ *
+ * The exponential is a Cephes-style polynomial: range reduction x = n * ln2 + r with
+ * |r| <= ln2 / 2, a degree-6 polynomial for exp(r), and 2^n built in the exponent bits.
+ * For inputs in [-87, 88] the relative error against std::exp is below 2.5e-7 (about 2 ulp).
+ * Inputs below -87, including -inf, return exactly 0 (absolute error < 1.7e-38), so masked
+ * scores never produce denormals. Inputs above 88 are clamped to 88.
+ *
+ * Every entry point picks AVX-512, AVX2 or scalar code from simd_level() unless a level
+ * is passed explicitly (which must be supported by the CPU).
+ */
+
+/**
+ * @brief exp(x) with the error bound documented above
+ */
+float fast_exp(float x);
+
+/**
+ * @brief Largest element of x[0, n), -inf for n == 0
+ */
+float max_value(const float* x, int n);
+float max_value(const float* x, int n, SimdLevel level);
+
+/**
+ * @brief x[i] = exp(scale * (x[i] - shift)) in place
+ * @return Sum of the exponentials
+ */
+float exp_shift_sum(float* x, int n, float shift, float scale);
+float exp_shift_sum(float* x, int n, float shift, float scale, SimdLevel level);
+
+/**
+ * @brief x = softmax(scale * x) in place
+ * A row whose elements are all -inf (fully masked) becomes all zeros.
+ */
+void softmax_inplace(float* x, int n, float scale);
+void softmax_inplace(float* x, int n, float scale, SimdLevel level);
+
+} // namespace transformer
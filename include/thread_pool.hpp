@@ -0,0 +1,126 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace transformer {
+
+struct ThreadPoolOptions {
+    int num_threads = 0;      // Threads including the caller, 0 = one per core this process may use
+    bool pin_threads = false; // Pin each worker to one core, filling a NUMA node before the next
+};
+
+
+/**
+ * @brief Work-stealing pool behind the library's parallel loops
+ * parallel_for splits [begin, end) into one contiguous range per thread. Each thread
+ * takes grain-sized chunks from the front of its own range and, once it runs dry,
+ * steals half of what is left at the back of another thread's range, so uneven chunks
+ * (causal heads, ragged sequences) balance without a shared queue. The calling thread
+ * is slot 0 and works too; a pool of size 1 starts no threads.
+ *
+ * Nested parallel_for calls (from inside a chunk) run inline on the calling thread, so
+ * nothing is oversubscribed. Eigen is limited to one thread per GEMM for the same
+ * reason: parallelism comes from the pool, not from inside each product.
+ */
+class ThreadPool {
+    public:
+        explicit ThreadPool(const ThreadPoolOptions& options = ThreadPoolOptions());
+        ~ThreadPool();
+
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        /**
+         * @brief Threads taking part in a parallel_for, the caller included
+         */
+        int size() const {return static_cast<int>(workers_.size()) + 1;}
+
+        /**
+         * @brief Core each worker is pinned to (worker i runs slot i + 1), empty if unpinned
+         */
+        const std::vector<int>& pinned_cpus() const {return pinned_cpus_;}
+
+        /**
+         * @brief Run fn(chunk_begin, chunk_end, slot) over [begin, end) and wait for it
+         * Chunks hold at least grain indices (except the last). slot is unique among the
+         * chunks running at the same time and lies in [0, min(size(), ceil((end - begin) /
+         * grain))), so it can index per-thread scratch. The first exception thrown by fn is rethrown here once every chunk is done.
+         */
+        template <typename Fn>
+        void parallel_for(int begin, int end, int grain, Fn&& fn){
+            using Callable = std::remove_reference_t<Fn>;
+            run(begin, end, grain, const_cast<void*>(static_cast<const void*>(&fn)),
+                [](void* callable, int chunk_begin, int chunk_end, int slot){
+                    (*static_cast<Callable*>(callable))(chunk_begin, chunk_end, slot);
+                });
+        }
+
+        /**
+         * @brief Run fn(slot) once on every thread of the pool, the caller as slot 0, and wait
+         * Each thread holds until all have run, so no thread serves two slots; use it to
+         * size thread-local scratch before a latency-critical call. Calls from inside a
+         * parallel_for chunk run fn(0) on the calling thread only.
+         */
+        template <typename Fn>
+        void for_each_thread(Fn&& fn){
+            using Callable = std::remove_reference_t<Fn>;
+            run_each(const_cast<void*>(static_cast<const void*>(&fn)), [](void* callable, int, int, int slot){
+                (*static_cast<Callable*>(callable))(slot);
+            });
+        }
+
+        /**
+         * @brief Whether the current thread is running a parallel_for chunk
+         */
+        static bool in_parallel_region();
+
+    private:
+        using ChunkFn = void (*)(void*, int, int, int);
+        struct Job;
+
+        std::vector<std::thread> workers_;
+        std::vector<int> pinned_cpus_;
+
+        std::mutex mutex_;
+        std::condition_variable wake_;
+        std::vector<Job*> jobs_; // Jobs that still have slots for workers to join
+        bool stop_ = false;
+
+        // Two concurrent for_each_thread calls could each hold workers the other waits for
+        std::mutex each_mutex_;
+
+        void run(int begin, int end, int grain, void* callable, ChunkFn call);
+        void run_each(void* callable, ChunkFn call);
+        void worker_loop(int worker);
+};
+
+
+/**
+ * @brief Pool used by the layers, sized by set_num_threads (default: every usable core)
+ */
+ThreadPool& thread_pool();
+
+/**
+ * @brief Replace the library pool
+ * Must not be called while a forward pass is running on another thread.
+ */
+void set_thread_pool_options(const ThreadPoolOptions& options);
+void set_num_threads(int num_threads);
+int get_num_threads();
+
+/**
+ * @brief parallel_for on the library pool
+ */
+template <typename Fn>
+void parallel_for(int begin, int end, int grain, Fn&& fn){
+    thread_pool().parallel_for(begin, end, grain, std::forward<Fn>(fn));
+}
+
+} // namespace transformer
@@ -0,0 +1,157 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#ifndef TRANSFORMER_ENABLE_TRACING
+#define TRANSFORMER_ENABLE_TRACING 0
+#endif
+
+namespace transformer {
+
+/**
+ * @brief Whether the layers were compiled with their trace scopes
+ * Set with the TRANSFORMER_ENABLE_TRACING CMake option. Without it every
+ * TRANSFORMER_TRACE_SCOPE expands to nothing and the hot paths carry no timing code;
+ * the recording and export functions below still exist but see no stages.
+ */
+constexpr bool kTracingEnabled = TRANSFORMER_ENABLE_TRACING != 0;
+
+
+/**
+ * @brief Latency distribution in HDR-style log-linear nanosecond buckets
+ * Values below 8 ns get a bucket each; above that every power of two is split into 8
+ * equal buckets, so a percentile is within 12.5% of the true value at any magnitude.
+ * Values from 2^48 ns (about 3 days) up share the last bucket.
+ */
+class LatencyHistogram {
+    public:
+        static constexpr int kSubBucketBits = 3;
+        static constexpr int kSubBuckets = 1 << kSubBucketBits;
+        static constexpr int kMaxExponent = 48;
+        static constexpr int kBuckets = (kMaxExponent - kSubBucketBits + 1) * kSubBuckets;
+
+        /**
+         * @brief Bucket holding a value and the range [lower, upper] a bucket covers
+         */
+        static int bucket_of(uint64_t ns);
+        static uint64_t bucket_lower(int bucket);
+        static uint64_t bucket_upper(int bucket);
+
+        void record(uint64_t ns);
+        void add_bucket(int bucket, uint64_t count) {counts_[bucket] += count;}
+        void add_totals(uint64_t count, uint64_t total_ns, uint64_t max_ns);
+        void merge(const LatencyHistogram& other);
+
+        uint64_t count() const {return count_;}
+        uint64_t total_ns() const {return total_ns_;}
+        uint64_t max_ns() const {return max_ns_;}
+        double mean_ns() const {return count_ ? static_cast<double>(total_ns_) / count_ : 0.0;}
+
+        /**
+         * @brief Smallest bucket bound at or above fraction p of the values (0 when empty)
+         */
+        uint64_t percentile_ns(double p) const;
+
+    private:
+        std::array<uint64_t, kBuckets> counts_{};
+        uint64_t count_ = 0;
+        uint64_t total_ns_ = 0;
+        uint64_t max_ns_ = 0;
+};
+
+
+/**
+ * @brief One traced stage with its latencies merged over every thread
+ */
+struct TraceStageSummary {
+    std::string name;
+    LatencyHistogram latency;
+};
+
+
+/**
+ * @brief Id of a named stage, registering it on first use
+ * The name must outlive the process (a string literal). Throws std::logic_error once
+ * more than kMaxTraceStages distinct stages exist.
+ */
+constexpr int kMaxTraceStages = 64;
+int trace_stage_id(const char* name);
+
+/**
+ * @brief Monotonic clock used by the trace, in nanoseconds
+ */
+uint64_t trace_now_ns();
+
+/**
+ * @brief Record one [start, end) interval of a stage on the calling thread
+ * Each thread writes only its own counters and event ring, so recording takes no lock
+ * and no read-modify-write. A thread takes a log on its first record, reusing one an
+ * exited thread handed back before allocating, so thread churn does not grow memory.
+ */
+void trace_record(int stage, uint64_t start_ns, uint64_t end_ns);
+
+/**
+ * @brief Times the enclosing scope as one interval of a stage
+ */
+class TraceScope {
+    private:
+        int stage_;
+        uint64_t start_ns_;
+
+    public:
+        explicit TraceScope(int stage) : stage_(stage), start_ns_(trace_now_ns()) {}
+        ~TraceScope() {trace_record(stage_, start_ns_, trace_now_ns());}
+
+        TraceScope(const TraceScope&) = delete;
+        TraceScope& operator=(const TraceScope&) = delete;
+};
+
+
+/**
+ * @brief Every stage recorded so far, merged over threads, in registration order
+ * Safe to call while other threads record; their in-flight intervals may be missed.
+ */
+std::vector<TraceStageSummary> trace_summary();
+
+/**
+ * @brief Table of calls, total time and p50/p90/p99/max latency per stage, slowest first
+ */
+void write_trace_summary(std::ostream& out);
+
+/**
+ * @brief Recent intervals of every thread as Chrome trace JSON (chrome://tracing, Perfetto)
+ * Each log keeps its last kTraceEventsPerThread intervals; older ones only count towards
+ * the summary. Intervals being overwritten while the export runs are left out rather than
+ * torn. A log reused after its thread exited keeps its tid.
+ */
+constexpr int kTraceEventsPerThread = 1 << 14;
+void write_chrome_trace(std::ostream& out);
+
+/**
+ * @brief Drop every recorded interval; stages stay registered
+ * Call while no traced code runs, otherwise concurrent records may survive the reset.
+ */
+void reset_trace();
+
+} // namespace transformer
+
+
+#define TRANSFORMER_TRACE_CONCAT_IMPL(a, b) a##b
+#define TRANSFORMER_TRACE_CONCAT(a, b) TRANSFORMER_TRACE_CONCAT_IMPL(a, b)
+
+/**
+ * Time the rest of the enclosing scope as stage `name` (a string literal). The stage
+ * is registered once per call site; disabled builds compile this to nothing.
+ */
+#if TRANSFORMER_ENABLE_TRACING
+#define TRANSFORMER_TRACE_SCOPE(name)                                                                    \
+    static const int TRANSFORMER_TRACE_CONCAT(trace_stage_, __LINE__) = ::transformer::trace_stage_id(name); \
+    ::transformer::TraceScope TRANSFORMER_TRACE_CONCAT(trace_scope_, __LINE__)(                          \
+        TRANSFORMER_TRACE_CONCAT(trace_stage_, __LINE__))
+#else
+#define TRANSFORMER_TRACE_SCOPE(name) static_cast<void>(0)
+#endif
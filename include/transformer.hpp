@@ -0,0 +1,135 @@
+#pragma once
+
+#include <Eigen/Dense>
+#include <memory>
+#include <string>
+#include <vector>
+#include "checkpoint.hpp"
+#include "embedding.hpp"
+#include "transformer_block.hpp"
+
+namespace transformer {
+
+/**
+ * @brief Activations of one Transformer call; each thread serving a shared model brings its own
+ */
+struct TransformerContext {
+    Eigen::MatrixXf encoder_buffers[2]; // (capacity, d_model)
+    Eigen::MatrixXf decoder_buffers[2]; // (capacity, d_model)
+    int memory_buffer = 0;              // Encoder buffer holding the last encode() result
+    int memory_len = 0;
+    BlockContext layers;                // Shared by every encoder and decoder layer
+};
+
+
+/**
+ * @brief Encoder-decoder transformer
+ * Embeddings, encoder layers and decoder layers pass activations through two ping-pong
+ * buffers per stack, so no intermediate matrix is returned between layers. The output
+ * projection is tied to the target embedding matrix.
+ *
+ * save() writes every weight and the model dimensions to one checkpoint file; the
+ * path constructor maps it and builds the model around the mapped weights.
+ *
+ * The overloads taking a TransformerContext never modify the model, so one model (e.g. a
+ * std::shared_ptr<const Transformer>) serves any number of threads with a single copy of
+ * the weights. The others use a context owned by the model and are not thread-safe.
+ */
+class Transformer {
+    private:
+        int d_model_;
+        int num_heads_;
+        int d_ff_;
+        Activation activation_;
+
+        TokenEmbedding src_embedding_;
+        TokenEmbedding tgt_embedding_;
+        PositionalEncoding positional_;
+
+        std::vector<EncoderBlock> encoder_;
+        std::vector<DecoderBlock> decoder_;
+
+        TransformerContext context_;
+
+        void reserve_encoder(TransformerContext& context, int max_tokens) const;
+        void reserve_decoder(TransformerContext& context, int max_tokens) const;
+
+        Transformer(const std::shared_ptr<const Checkpoint>& checkpoint, const std::vector<int64_t>& config);
+
+    public:
+        Transformer(int src_vocab_size, int tgt_vocab_size, int d_model, int num_heads,
+                    int d_ff, int num_layers, int max_seq_len,
+                    Activation activation = Activation::ReLU);
+
+        /**
+         * @brief Map a checkpoint written by save() and use its weights without copying
+         * Throws std::runtime_error for an unreadable file and std::invalid_argument for
+         * tensors whose shapes disagree with the stored dimensions.
+         */
+        explicit Transformer(const std::string& path);
+        explicit Transformer(const std::shared_ptr<const Checkpoint>& checkpoint);
+
+        /**
+         * @brief Write dimensions and every weight to a checkpoint file
+         * Throws std::logic_error if a layer holds quantized weights.
+         */
+        void save(const std::string& path) const;
+
+        /**
+         * @brief Size every activation buffer for sequences up to max_tokens
+         * Also sizes the per-thread kernel scratch on every thread of the library pool, so
+         * forward_into allocates nothing once the calling thread has run it once. Repeat
+         * after changing the pool, an attention kernel or a weight format.
+         */
+        void reserve(int max_tokens);
+        void reserve(TransformerContext& context, int max_tokens) const;
+
+        /**
+         * @brief Run the encoder stack
+         * @param src_tokens Source token ids
+         * @param src_mask Encoder self-attention mask, e.g. key padding
+         * @return View of the encoder output (src_len, d_model), valid until the next encode
+         */
+        Eigen::Ref<const Eigen::MatrixXf> encode(const std::vector<int>& src_tokens,
+                                                 const AttentionMask& src_mask = AttentionMask());
+        Eigen::Ref<const Eigen::MatrixXf> encode(const std::vector<int>& src_tokens, TransformerContext& context,
+                                                 const AttentionMask& src_mask = AttentionMask()) const;
+
+        /**
+         * @brief Run the decoder stack against the output of the last encode call
+         * @param tgt_tokens Target token ids
+         * @param memory_mask Cross-attention mask over the source positions
+         * @return View of the decoder output (tgt_len, d_model), valid until the next decode
+         */
+        Eigen::Ref<const Eigen::MatrixXf> decode(const std::vector<int>& tgt_tokens,
+                                                 const AttentionMask& memory_mask = AttentionMask());
+        Eigen::Ref<const Eigen::MatrixXf> decode(const std::vector<int>& tgt_tokens, TransformerContext& context,
+                                                 const AttentionMask& memory_mask = AttentionMask()) const;
+
+        /**
+         * @brief Encode, decode and project onto the target vocabulary
+         * @param logits Buffer of shape (tgt_len, tgt_vocab_size)
+         */
+        void forward_into(const std::vector<int>& src_tokens, const std::vector<int>& tgt_tokens,
+                          Eigen::Ref<Eigen::MatrixXf> logits);
+        void forward_into(const std::vector<int>& src_tokens, const std::vector<int>& tgt_tokens,
+                          Eigen::Ref<Eigen::MatrixXf> logits, TransformerContext& context) const;
+
+        /**
+         * @brief Encode, decode and project onto the target vocabulary
+         * @return Logits of shape (tgt_len, tgt_vocab_size)
+         */
+        Eigen::MatrixXf forward(const std::vector<int>& src_tokens, const std::vector<int>& tgt_tokens);
+
+        EncoderBlock& get_encoder_layer(int i) {return encoder_.at(i);}
+        DecoderBlock& get_decoder_layer(int i) {return decoder_.at(i);}
+        const EncoderBlock& get_encoder_layer(int i) const {return encoder_.at(i);}
+        const DecoderBlock& get_decoder_layer(int i) const {return decoder_.at(i);}
+        const TokenEmbedding& get_src_embedding() const {return src_embedding_;}
+        const TokenEmbedding& get_tgt_embedding() const {return tgt_embedding_;}
+        const PositionalEncoding& get_positional_encoding() const {return positional_;}
+        int get_num_layers() const {return static_cast<int>(encoder_.size());}
+        int get_d_model() const {return d_model_;}
+};
+
+} // namespace transformer
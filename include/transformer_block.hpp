@@ -0,0 +1,162 @@
+#pragma once
+
+#include <Eigen/Dense>
+#include "attention.hpp"
+#include "feed_forward.hpp"
+#include "layer_norm.hpp"
+
+namespace transformer {
+
+/**
+ * @brief Activation buffers of one EncoderBlock or DecoderBlock call
+ * Layers of a stack run one after another, so one context serves all of them. Buffers
+ * grow to the longest sequence seen and are then reused.
+ */
+struct BlockContext {
+    Eigen::MatrixXf sublayer_out; // (capacity, d_model) output of each sublayer in turn
+    Eigen::MatrixXf hidden1;      // (capacity, d_model) after the first sublayer
+    Eigen::MatrixXf hidden2;      // (capacity, d_model) after cross-attention, decoder only
+    Eigen::MatrixXf ff_hidden;    // (row block per thread, feed-forward hidden width) streamed scratch
+    AttentionContext attention;
+};
+
+
+/**
+ * @brief Encoder layer: self-attention and feed-forward, each followed by residual add + LayerNorm
+ * Sublayers write into the buffers of a BlockContext, so a steady-state forward pass does
+ * not allocate between sublayers. Feed-forward and LayerNorm run their inference paths,
+ * which keep no activations for backpropagation. The overloads taking a context only read
+ * the block, so threads can share one block and bring their own contexts; the others use
+ * a context owned by the block.
+ */
+class EncoderBlock {
+    private:
+        int d_model_;
+
+        MultiHeadAttention self_attention_;
+        FeedForward feed_forward_;
+        LayerNorm norm1_;
+        LayerNorm norm2_;
+
+        BlockContext context_;
+
+    public:
+        EncoderBlock(int d_model, int num_heads, int d_ff, Activation activation = Activation::ReLU);
+
+        /**
+         * @brief Build the layer around weights in a checkpoint, without copying them
+         * Sublayers are read from prefix + "self_attention.", "feed_forward.", "norm1." and "norm2.".
+         */
+        EncoderBlock(int num_heads, const std::shared_ptr<const Checkpoint>& checkpoint, const std::string& prefix,
+                     Activation activation = Activation::ReLU);
+
+        void save(CheckpointWriter& writer, const std::string& prefix) const;
+
+        /**
+         * @brief Size the activation buffers for sequences up to max_tokens
+         */
+        void reserve(int max_tokens);
+        void reserve(BlockContext& context, int max_tokens) const;
+
+        /**
+         * @brief Size the calling thread's sublayer scratch; run it on every pool thread
+         */
+        void reserve_thread(int max_tokens) const;
+
+        /**
+         * @brief Forward pass written into a caller buffer
+         * @param x Input of shape (seq_len, d_model)
+         * @param output Buffer of shape (seq_len, d_model), must not alias x
+         * @param mask Self-attention mask, e.g. key padding
+         */
+        void forward_into(const Eigen::Ref<const Eigen::MatrixXf>& x,
+                          Eigen::Ref<Eigen::MatrixXf> output,
+                          const AttentionMask& mask = AttentionMask());
+        void forward_into(const Eigen::Ref<const Eigen::MatrixXf>& x,
+                          Eigen::Ref<Eigen::MatrixXf> output,
+                          const AttentionMask& mask,
+                          BlockContext& context) const;
+
+        Eigen::MatrixXf forward(const Eigen::MatrixXf& x, const AttentionMask& mask = AttentionMask());
+
+        MultiHeadAttention& get_self_attention() {return self_attention_;}
+        FeedForward& get_feed_forward() {return feed_forward_;}
+        LayerNorm& get_norm1() {return norm1_;}
+        LayerNorm& get_norm2() {return norm2_;}
+        int get_d_model() const {return d_model_;}
+};
+
+
+/**
+ * @brief Decoder layer: masked self-attention, cross-attention over the encoder output
+ * and feed-forward, each followed by residual add + LayerNorm
+ * Buffers and sharing work as in EncoderBlock.
+ */
+class DecoderBlock {
+    private:
+        int d_model_;
+
+        MultiHeadAttention self_attention_;
+        MultiHeadAttention cross_attention_;
+        FeedForward feed_forward_;
+        LayerNorm norm1_;
+        LayerNorm norm2_;
+        LayerNorm norm3_;
+
+        BlockContext context_;
+
+    public:
+        DecoderBlock(int d_model, int num_heads, int d_ff, Activation activation = Activation::ReLU);
+
+        /**
+         * @brief Build the layer around weights in a checkpoint, without copying them
+         * Sublayers are read from prefix + "self_attention.", "cross_attention.",
+         * "feed_forward." and "norm1." .. "norm3.".
+         */
+        DecoderBlock(int num_heads, const std::shared_ptr<const Checkpoint>& checkpoint, const std::string& prefix,
+                     Activation activation = Activation::ReLU);
+
+        void save(CheckpointWriter& writer, const std::string& prefix) const;
+
+        void reserve(int max_tokens);
+        void reserve(BlockContext& context, int max_tokens) const;
+
+        /**
+         * @brief Size the calling thread's sublayer scratch; run it on every pool thread
+         */
+        void reserve_thread(int max_tokens) const;
+
+        /**
+         * @brief Forward pass written into a caller buffer
+         * @param x Target-side input of shape (tgt_len, d_model)
+         * @param memory Encoder output of shape (src_len, d_model)
+         * @param output Buffer of shape (tgt_len, d_model), must not alias x or memory
+         * @param self_mask Mask for self-attention, causal by default
+         * @param memory_mask Mask for cross-attention, e.g. source key padding
+         */
+        void forward_into(const Eigen::Ref<const Eigen::MatrixXf>& x,
+                          const Eigen::Ref<const Eigen::MatrixXf>& memory,
+                          Eigen::Ref<Eigen::MatrixXf> output,
+                          const AttentionMask& self_mask = AttentionMask::causal_mask(),
+                          const AttentionMask& memory_mask = AttentionMask());
+        void forward_into(const Eigen::Ref<const Eigen::MatrixXf>& x,
+                          const Eigen::Ref<const Eigen::MatrixXf>& memory,
+                          Eigen::Ref<Eigen::MatrixXf> output,
+                          const AttentionMask& self_mask,
+                          const AttentionMask& memory_mask,
+                          BlockContext& context) const;
+
+        Eigen::MatrixXf forward(const Eigen::MatrixXf& x, const Eigen::MatrixXf& memory,
+                                const AttentionMask& self_mask = AttentionMask::causal_mask(),
+                                const AttentionMask& memory_mask = AttentionMask());
+
+        MultiHeadAttention& get_self_attention() {return self_attention_;}
+        MultiHeadAttention& get_cross_attention() {return cross_attention_;}
+        FeedForward& get_feed_forward() {return feed_forward_;}
+        LayerNorm& get_norm1() {return norm1_;}
+        LayerNorm& get_norm2() {return norm2_;}
+        LayerNorm& get_norm3() {return norm3_;}
+        int get_d_model() const {return d_model_;}
+};
+
+} // namespace transformer
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <Eigen/Dense>
+#include <memory>
+#include <new>
+#include <utility>
+
+namespace transformer {
+
+/**
+ * @brief Float parameter that either owns its values or views memory owned elsewhere
+ * It is an Eigen::Map, so layers use it exactly like the matrix it replaces: in
+ * expressions, through Eigen::Ref and with in-place updates. Assigning a dense value
+ * makes it own a copy; view() points it at external floats (a mapped checkpoint) kept
+ * alive by the given handle. Copies always own their values, like Eigen matrices.
+ */
+template <typename Dense>
+class Weights : public Eigen::Map<Dense> {
+    public:
+        using MapType = Eigen::Map<Dense>;
+
+        Weights() : MapType(nullptr, 0, empty_cols()) {}
+        Weights(const Weights& other) : MapType(nullptr, 0, empty_cols()) {copy_from(other);}
+        Weights(Weights&& other) noexcept : MapType(nullptr, 0, empty_cols()) {take(std::move(other));}
+
+        Weights& operator=(const Weights& other){
+            if (this != &other){
+                copy_from(other);
+            }
+            return *this;
+        }
+
+        Weights& operator=(Weights&& other) noexcept{
+            if (this != &other){
+                take(std::move(other));
+            }
+            return *this;
+        }
+
+        /**
+         * @brief Own a copy of value, dropping any view
+         */
+        template <typename Derived>
+        Weights& operator=(const Eigen::DenseBase<Derived>& value){
+            owned_ = value;
+            owner_.reset();
+            reseat(owned_.data(), owned_.rows(), owned_.cols());
+            return *this;
+        }
+
+        /**
+         * @brief View rows x cols column-major floats at data, valid while owner lives
+         */
+        void view(float* data, Eigen::Index rows, Eigen::Index cols, std::shared_ptr<const void> owner){
+            owned_ = Dense();
+            owner_ = std::move(owner);
+            reseat(data, rows, cols);
+        }
+
+        bool is_view() const {return owner_ != nullptr;}
+
+    private:
+        Dense owned_;
+        std::shared_ptr<const void> owner_;
+
+        static constexpr Eigen::Index empty_cols() {return Dense::ColsAtCompileTime == 1 ? 1 : 0;}
+
+        // Re-seating a Map with placement new is the documented Eigen idiom
+        void reseat(float* data, Eigen::Index rows, Eigen::Index cols){
+            new (static_cast<MapType*>(this)) MapType(data, rows, cols);
+        }
+
+        void copy_from(const Weights& other){
+            owned_ = static_cast<const MapType&>(other);
+            owner_.reset();
+            reseat(owned_.data(), owned_.rows(), owned_.cols());
+        }
+
+        void take(Weights&& other){
+            Eigen::Index rows = other.rows();
+            Eigen::Index cols = other.cols();
+            float* data = other.data();
+            owner_ = std::move(other.owner_);
+            owned_ = std::move(other.owned_);
+            reseat(owner_ ? data : owned_.data(), rows, cols);
+            other.owner_.reset();
+            other.reseat(nullptr, 0, empty_cols());
+        }
+};
+
+using WeightMatrix = Weights<Eigen::MatrixXf>;
+using WeightVector = Weights<Eigen::VectorXf>;
+using WeightRowMatrix = Weights<Eigen::Matrix<float, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>>;
+
+} // namespace transformer
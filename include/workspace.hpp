@@ -0,0 +1,66 @@
+#pragma once
+
+#include <Eigen/Dense>
+#include <cstddef>
+#include <stdexcept>
+
+namespace transformer {
+
+/**
+ * @brief Grow-only float arena that hands out Eigen::Map views
+ * A call first makes room with reset() for everything it will take (sized from its
+ * shapes), then carves views off the front. Capacity is kept across reset(), so once the
+ * largest call has run, later calls draw the same memory again without touching the heap.
+ * Views stay valid until the next reset() that grows the arena.
+ */
+class Workspace {
+    public:
+        // Views start on a 64-byte boundary relative to the arena, so cache lines are not split
+        static constexpr std::size_t kAlignFloats = 16;
+
+        /**
+         * @brief Floats a rows x cols view occupies, padding included
+         */
+        static constexpr std::size_t floats(Eigen::Index rows, Eigen::Index cols){
+            std::size_t size = static_cast<std::size_t>(rows) * static_cast<std::size_t>(cols);
+            return (size + kAlignFloats - 1) / kAlignFloats * kAlignFloats;
+        }
+
+        /**
+         * @brief Release every view and make room for floats values in total
+         */
+        void reset(std::size_t floats = 0){
+            used_ = 0;
+            if (floats > static_cast<std::size_t>(storage_.size())){
+                storage_.resize(static_cast<Eigen::Index>(floats));
+            }
+        }
+
+        /**
+         * @brief Next rows x cols view, uninitialised; throws std::logic_error past the reserved size
+         */
+        template <typename Dense = Eigen::MatrixXf>
+        Eigen::Map<Dense> take(Eigen::Index rows, Eigen::Index cols = 1){
+            std::size_t size = floats(rows, cols);
+            if (used_ + size > static_cast<std::size_t>(storage_.size())){
+                throw std::logic_error("Workspace view exceeds the reserved size");
+            }
+            float* data = storage_.data() + used_;
+            used_ += size;
+            return Eigen::Map<Dense>(data, rows, cols);
+        }
+
+        /**
+         * @brief Position to return to with release(), dropping the views taken after it
+         */
+        std::size_t mark() const {return used_;}
+        void release(std::size_t mark) {used_ = mark;}
+
+        std::size_t capacity() const {return static_cast<std::size_t>(storage_.size());}
+
+    private:
+        Eigen::VectorXf storage_;
+        std::size_t used_ = 0;
+};
+
+} // namespace transformer
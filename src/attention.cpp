@@ -1,29 +1,116 @@
 #include "attention.hpp"
+#include "cpu_info.hpp"
+#include "gemm.hpp"
+#include "softmax.hpp"
+#include "thread_pool.hpp"
+#include "trace.hpp"
 #include <iostream>
 #include <random>
 #include <stdexcept>
+#include <algorithm>
+#include <limits>
 
 namespace transformer {
 
+namespace {
+
+// Query rows handled together by the causal and tiled kernels
+constexpr int kQueryBlockRows = 64;
+
+// Token rows per thread-pool task in the projection GEMMs
+constexpr int kProjectionBlockRows = 64;
+
+// Workspace for one online-softmax block of queries and one tile of its scores
+std::size_t online_block_floats(int d_v, int tile){
+    return Workspace::floats(kQueryBlockRows, d_v) + 2 * Workspace::floats(kQueryBlockRows, 1) +
+           Workspace::floats(kQueryBlockRows, tile);
+}
+
+// Head width of queries attending a paged cache, after checking their shape
+int paged_head_dim(const Eigen::Ref<const Eigen::MatrixXf>& Q, const PagedKVCache& cache, int num_heads){
+    const int d_model = cache.get_d_model();
+    if (Q.cols() != d_model || d_model % num_heads != 0){
+        throw std::invalid_argument("Q must have shape (seq_len_q, d_model) with d_model divisible by num_heads");
+    }
+    return d_model / num_heads;
+}
+
+} // namespace
+
+
 ScaledDotProductAttention::ScaledDotProductAttention(int d_k): scale_factor_(1.0f / std::sqrt(d_k)){
 }
 
 
-Eigen::MatrixXf ScaledDotProductAttention::softmax(const Eigen::MatrixXf& input){
-    Eigen::MatrixXf result = input;
+Workspace& ScaledDotProductAttention::thread_workspace(){
+    thread_local Workspace workspace;
+    return workspace;
+}
 
-    for (int i = 0; i < result.rows(); ++i){
-        float max_val = result.row(i).maxCoeff();
 
-        for (int j = 0; j < result.cols(); ++j){
-            result(i, j) = std::exp(result(i, j) - max_val);
-        }
+void ScaledDotProductAttention::softmax_row(Eigen::Ref<Eigen::RowVectorXf> row, float scale) const{
+    softmax_inplace(row.data(), static_cast<int>(row.size()), scale);
+}
 
-        float sum = result.row(i).sum();
 
-        result.row(i) /= sum;
+void ScaledDotProductAttention::apply_mask_row(Eigen::Ref<Eigen::RowVectorXf> row, const AttentionMask& mask,
+                                               int query, int key_start) const{
+    const int keys = row.size();
+    row *= scale_factor_;
+    if (mask.additive.size() != 0){
+        row += mask.additive.row(query).segment(key_start, keys);
+    }
+    if (mask.key_padding.size() != 0){
+        row.array() = mask.key_padding.segment(key_start, keys).transpose()
+                          .select(-std::numeric_limits<float>::infinity(), row.array());
+    }
+}
+
+
+void ScaledDotProductAttention::set_kernel(AttentionKernel kernel, int tile_size){
+    if (tile_size < 0){
+        throw std::invalid_argument("tile_size must be non-negative");
+    }
+    kernel_ = kernel;
+    tile_size_ = tile_size;
+}
+
+
+int ScaledDotProductAttention::tile_size_for(int d_k, int d_v) const{
+    if (tile_size_ > 0){
+        return tile_size_;
+    }
+    // Keep a K tile, a V tile and the (query block x tile) scores within half of L2
+    std::size_t bytes_per_key = sizeof(float) * static_cast<std::size_t>(d_k + d_v + kQueryBlockRows);
+    int tile = static_cast<int>(l2_cache_bytes() / 2 / bytes_per_key);
+    return std::clamp(tile / 16 * 16, 16, 2048);
+}
+
+
+std::size_t ScaledDotProductAttention::head_workspace_floats(int q_len, int kv_len, int d_k, int d_v, bool causal) const{
+    if (kernel_ == AttentionKernel::Tiled){
+        return online_block_floats(d_v, tile_size_for(d_k, d_v));
+    }
+    return Workspace::floats(causal ? std::min(q_len, kQueryBlockRows) : q_len, kv_len);
+}
+
+
+std::size_t ScaledDotProductAttention::head_scratch_bytes(int q_len, int kv_len, int d_k, int d_v, bool causal) const{
+    return head_workspace_floats(q_len, kv_len, d_k, d_v, causal) * sizeof(float);
+}
+
+
+void ScaledDotProductAttention::reserve_thread(int max_queries, int max_keys, int d_k, int d_v) const{
+    // Without a causal mask every query shares one score block, the larger case
+    thread_workspace().reset(head_workspace_floats(max_queries, max_keys, d_k, d_v, false));
+    if (kernel_ == AttentionKernel::Tiled){
+        int tile = tile_size_for(d_k, d_v);
+        reserve_gemm(std::min(max_queries, kQueryBlockRows), std::min(max_keys, tile), d_k);
+        reserve_gemm(std::min(max_queries, kQueryBlockRows), d_v, std::min(max_keys, tile));
+    } else {
+        reserve_gemm(max_queries, max_keys, d_k);
+        reserve_gemm(max_queries, d_v, max_keys);
     }
-    return result;
 }
 
 
@@ -31,21 +118,409 @@ Eigen::MatrixXf ScaledDotProductAttention::forward(
     const Eigen::MatrixXf& Q,
     const Eigen::MatrixXf& K,
     const Eigen::MatrixXf& V 
-){
-    Eigen::MatrixXf scores = Q * K.transpose();
-    scores *= scale_factor_;
-    Eigen::MatrixXf attention_weights = softmax(scores);
+) const{
+    Workspace& workspace = thread_workspace();
+    workspace.reset(Workspace::floats(Q.rows(), K.rows()));
+    auto scores = workspace.take<RowMatrixXf>(Q.rows(), K.rows());
+    scores.noalias() = Q * K.transpose();
+    for (int i = 0; i < scores.rows(); ++i){
+        softmax_row(scores.row(i), scale_factor_);
+    }
 
-    Eigen::MatrixXf output = attention_weights * V;
+    Eigen::MatrixXf output = scores * V;
     return output;
 }
 
 
-MultiHeadAttention::MultiHeadAttention(int num_heads, int d_model): num_heads_(num_heads), d_model_(d_model), attention_(d_model / num_heads){
+AttentionMask AttentionMask::causal_mask(){
+    AttentionMask mask;
+    mask.causal = true;
+    return mask;
+}
+
+
+AttentionMask AttentionMask::from_boolean(const BoolArrayXXb& allowed){
+    AttentionMask mask;
+    mask.additive = allowed.select(Eigen::ArrayXXf::Zero(allowed.rows(), allowed.cols()),
+                                   -std::numeric_limits<float>::infinity()).matrix();
+    return mask;
+}
+
+
+AttentionMask AttentionMask::from_key_padding(const BoolArrayXb& padded){
+    AttentionMask mask;
+    mask.key_padding = padded;
+    return mask;
+}
+
+
+void ScaledDotProductAttention::attend(
+    Workspace& workspace,
+    const Eigen::Ref<const Eigen::MatrixXf>& Q,
+    const Eigen::Ref<const Eigen::MatrixXf>& K,
+    const Eigen::Ref<const Eigen::MatrixXf>& V,
+    const AttentionMask& mask,
+    Eigen::Ref<Eigen::MatrixXf> output
+) const{
+    if (kernel_ == AttentionKernel::Tiled){
+        attend_head_tiled(workspace, Q, K, V, mask, output);
+    } else {
+        attend_head(workspace, Q, K, V, mask, output);
+    }
+}
+
+
+void ScaledDotProductAttention::attend_head(
+    Workspace& workspace,
+    const Eigen::Ref<const Eigen::MatrixXf>& Q,
+    const Eigen::Ref<const Eigen::MatrixXf>& K,
+    const Eigen::Ref<const Eigen::MatrixXf>& V,
+    const AttentionMask& mask,
+    Eigen::Ref<Eigen::MatrixXf> output
+) const{
+    const int q_len = Q.rows();
+    const int kv_len = K.rows();
+    const int offset = kv_len - q_len;
+    const bool explicit_mask = mask.additive.size() != 0 || mask.key_padding.size() != 0;
+
+    // Causal rows are processed in blocks so each block only sees keys up to its last row
+    const int block_rows = mask.causal ? kQueryBlockRows : std::max(q_len, 1);
+    workspace.reset(head_workspace_floats(q_len, kv_len, Q.cols(), V.cols(), mask.causal));
+
+    for (int r0 = 0; r0 < q_len; r0 += block_rows){
+        int rows = std::min(block_rows, q_len - r0);
+        int keys = mask.causal ? std::clamp(r0 + rows + offset, 0, kv_len) : kv_len;
+
+        workspace.release(0);
+        auto scores = workspace.take<RowMatrixXf>(rows, keys);
+        if (keys == 0){
+            output.middleRows(r0, rows).setZero();
+            continue;
+        }
+        {
+            TRANSFORMER_TRACE_SCOPE("attention.scores");
+            gemm_into(Q.middleRows(r0, rows), K.topRows(keys).transpose(), scores);
+        }
+
+        {
+            TRANSFORMER_TRACE_SCOPE("attention.softmax");
+            for (int i = 0; i < rows; ++i){
+                int visible = mask.causal ? std::clamp(r0 + i + offset + 1, 0, keys) : keys;
+                auto row = scores.row(i);
+
+                if (explicit_mask){
+                    auto head = row.head(visible);
+                    apply_mask_row(head, mask, r0 + i, 0);
+                    softmax_row(head, 1.0f);
+                } else {
+                    softmax_row(row.head(visible), scale_factor_);
+                }
+                row.tail(keys - visible).setZero();
+            }
+        }
+
+        TRANSFORMER_TRACE_SCOPE("attention.weighted_sum");
+        gemm_into(scores, V.topRows(keys), output.middleRows(r0, rows));
+    }
+}
+
+
+ScaledDotProductAttention::OnlineBlock ScaledDotProductAttention::begin_block(Workspace& workspace, int rows, int d_v) const{
+    OnlineBlock block{workspace.take<RowMatrixXf>(rows, d_v),
+                      workspace.take<Eigen::VectorXf>(rows),
+                      workspace.take<Eigen::VectorXf>(rows)};
+    block.acc.setZero();
+    block.row_max.setConstant(-std::numeric_limits<float>::infinity());
+    block.row_sum.setZero();
+    return block;
+}
+
+
+void ScaledDotProductAttention::accumulate_tile(
+    Workspace& workspace,
+    OnlineBlock& block,
+    const Eigen::Ref<const Eigen::MatrixXf>& Q_block,
+    const Eigen::Ref<const Eigen::MatrixXf>& K_tile,
+    const Eigen::Ref<const Eigen::MatrixXf>& V_tile,
+    const AttentionMask& mask,
+    int r0, int c0, int offset
+) const{
+    const int rows = Q_block.rows();
+    const int cols = K_tile.rows();
+    const float neg_inf = -std::numeric_limits<float>::infinity();
+
+    std::size_t mark = workspace.mark();
+    auto scores = workspace.take<RowMatrixXf>(rows, cols);
+    gemm_into(Q_block, K_tile.transpose(), scores);
+
+    for (int i = 0; i < rows; ++i){
+        int visible = mask.causal ? std::clamp(r0 + i + offset + 1 - c0, 0, cols) : cols;
+        auto row = scores.row(i);
+        row.tail(cols - visible).setZero();
+        if (visible == 0){
+            continue;
+        }
+
+        auto head = row.head(visible);
+        apply_mask_row(head, mask, r0 + i, c0);
+
+        float new_max = std::max(block.row_max(i), max_value(head.data(), visible));
+        if (new_max == neg_inf){
+            head.setZero();
+            continue;
+        }
+
+        // Rescale what has been accumulated so far to the new running max
+        float tile_sum = exp_shift_sum(head.data(), visible, new_max, 1.0f);
+        float correction = std::exp(block.row_max(i) - new_max);
+        block.row_sum(i) = block.row_sum(i) * correction + tile_sum;
+        block.acc.row(i) *= correction;
+        block.row_max(i) = new_max;
+    }
+
+    gemm_into(scores, V_tile, block.acc, true);
+    workspace.release(mark);
+}
+
+
+void ScaledDotProductAttention::finish_block(OnlineBlock& block, Eigen::Ref<Eigen::MatrixXf> output) const{
+    // Queries that could see no key produce zeros, as in the standard kernel
+    auto& row_sum = block.row_sum;
+    row_sum = (row_sum.array() > 0.0f).select(row_sum.cwiseInverse(), 0.0f);
+    output.noalias() = row_sum.asDiagonal() * block.acc;
+}
+
+
+void ScaledDotProductAttention::attend_head_tiled(
+    Workspace& workspace,
+    const Eigen::Ref<const Eigen::MatrixXf>& Q,
+    const Eigen::Ref<const Eigen::MatrixXf>& K,
+    const Eigen::Ref<const Eigen::MatrixXf>& V,
+    const AttentionMask& mask,
+    Eigen::Ref<Eigen::MatrixXf> output
+) const{
+    const int q_len = Q.rows();
+    const int kv_len = K.rows();
+    const int offset = kv_len - q_len;
+    const int tile = tile_size_for(Q.cols(), V.cols());
+    workspace.reset(head_workspace_floats(q_len, kv_len, Q.cols(), V.cols(), mask.causal));
+    TRANSFORMER_TRACE_SCOPE("attention.tiled_head");
+
+    for (int r0 = 0; r0 < q_len; r0 += kQueryBlockRows){
+        int rows = std::min(kQueryBlockRows, q_len - r0);
+        int keys = mask.causal ? std::clamp(r0 + rows + offset, 0, kv_len) : kv_len;
+
+        workspace.release(0);
+        OnlineBlock block = begin_block(workspace, rows, V.cols());
+        for (int c0 = 0; c0 < keys; c0 += tile){
+            int cols = std::min(tile, keys - c0);
+            accumulate_tile(workspace, block, Q.middleRows(r0, rows), K.middleRows(c0, cols), V.middleRows(c0, cols),
+                            mask, r0, c0, offset);
+        }
+        finish_block(block, output.middleRows(r0, rows));
+    }
+}
+
+
+void ScaledDotProductAttention::attend_head_paged(
+    Workspace& workspace,
+    const Eigen::Ref<const Eigen::MatrixXf>& Q_head,
+    const PagedKVCache& cache,
+    int seq,
+    int head,
+    Eigen::Ref<Eigen::MatrixXf> output
+) const{
+    const int d_k = Q_head.cols();
+    const int q_len = Q_head.rows();
+    const int kv_len = cache.length(seq);
+    const int offset = kv_len - q_len;
+    const int page_size = cache.page_size();
+    const std::vector<int>& pages = cache.page_table(seq);
+    const AttentionMask causal = AttentionMask::causal_mask();
+    const bool widen = cache.storage() != KVStorage::FP32;
+    workspace.reset(online_block_floats(d_k, page_size) + (widen ? 2 * Workspace::floats(page_size, d_k) : 0));
+    TRANSFORMER_TRACE_SCOPE("attention.paged_head");
+
+    // Every page is one tile of the online softmax, read in place through the page table
+    for (int r0 = 0; r0 < q_len; r0 += kQueryBlockRows){
+        int rows = std::min(kQueryBlockRows, q_len - r0);
+        int keys = std::clamp(r0 + rows + offset, 0, kv_len);
+
+        workspace.release(0);
+        OnlineBlock block = begin_block(workspace, rows, d_k);
+        for (int index = 0; index * page_size < keys; ++index){
+            int c0 = index * page_size;
+            int cols = std::min(page_size, keys - c0);
+            int page = pages[index];
+
+            if (!widen){
+                accumulate_tile(workspace, block, Q_head.middleRows(r0, rows),
+                                cache.page_keys(page).block(0, head * d_k, cols, d_k),
+                                cache.page_values(page).block(0, head * d_k, cols, d_k),
+                                causal, r0, c0, offset);
+            } else {
+                std::size_t mark = workspace.mark();
+                auto keys_page = workspace.take(cols, d_k);
+                auto values_page = workspace.take(cols, d_k);
+                cache.load_page(page, cols, head * d_k, d_k, keys_page, values_page);
+                accumulate_tile(workspace, block, Q_head.middleRows(r0, rows), keys_page, values_page,
+                                causal, r0, c0, offset);
+                workspace.release(mark);
+            }
+        }
+        finish_block(block, output.middleRows(r0, rows));
+    }
+}
+
+
+void ScaledDotProductAttention::forward_paged(
+    const Eigen::Ref<const Eigen::MatrixXf>& Q,
+    const PagedKVCache& cache,
+    int seq,
+    int num_heads,
+    Eigen::Ref<Eigen::MatrixXf> output
+) const{
+    const int d_k = paged_head_dim(Q, cache, num_heads);
+    TRANSFORMER_TRACE_SCOPE("attention.heads");
+    parallel_for(0, num_heads, 1, [&](int begin, int end, int){
+        for (int head = begin; head < end; ++head){
+            attend_head_paged(thread_workspace(), Q.middleCols(head * d_k, d_k), cache, seq, head,
+                              output.middleCols(head * d_k, d_k));
+        }
+    });
+}
+
+
+void ScaledDotProductAttention::forward_paged_batch(
+    const Eigen::Ref<const Eigen::MatrixXf>& Q,
+    const PagedKVCache& cache,
+    const std::vector<int>& seqs,
+    const std::vector<int>& offsets,
+    int num_heads,
+    Eigen::Ref<Eigen::MatrixXf> output
+) const{
+    const int d_k = paged_head_dim(Q, cache, num_heads);
+    if (offsets.size() != seqs.size() + 1){
+        throw std::invalid_argument("Need one offset per sequence plus the total row count");
+    }
+
+    const int num_seqs = static_cast<int>(seqs.size());
+
+    TRANSFORMER_TRACE_SCOPE("attention.heads");
+    parallel_for(0, num_seqs * num_heads, 1, [&](int begin, int end, int){
+        for (int task = begin; task < end; ++task){
+            int i = task / num_heads;
+            int head = task % num_heads;
+            int start = offsets[i];
+            int len = offsets[i + 1] - start;
+            attend_head_paged(thread_workspace(), Q.block(start, head * d_k, len, d_k), cache, seqs[i], head,
+                              output.block(start, head * d_k, len, d_k));
+        }
+    });
+}
+
+
+void ScaledDotProductAttention::check_heads(
+    const Eigen::Ref<const Eigen::MatrixXf>& Q,
+    const Eigen::Ref<const Eigen::MatrixXf>& K,
+    const Eigen::Ref<const Eigen::MatrixXf>& V,
+    int num_heads,
+    const AttentionMask& mask
+){
+    if (Q.cols() != K.cols() || Q.cols() % num_heads != 0 || V.cols() % num_heads != 0){
+        throw std::invalid_argument("Q, K and V columns must split evenly into num_heads");
+    }
+    if (K.rows() != V.rows()){
+        throw std::invalid_argument("K and V must have the same number of rows");
+    }
+    if (mask.additive.size() != 0 && (mask.additive.rows() != Q.rows() || mask.additive.cols() != K.rows())){
+        throw std::invalid_argument("Attention mask must have shape (seq_len_q, seq_len_k)");
+    }
+    if (mask.key_padding.size() != 0 && mask.key_padding.size() != K.rows()){
+        throw std::invalid_argument("Key padding mask must have length seq_len_k");
+    }
+}
+
+
+void ScaledDotProductAttention::forward_heads(
+    const Eigen::Ref<const Eigen::MatrixXf>& Q,
+    const Eigen::Ref<const Eigen::MatrixXf>& K,
+    const Eigen::Ref<const Eigen::MatrixXf>& V,
+    int num_heads,
+    Eigen::Ref<Eigen::MatrixXf> output,
+    const AttentionMask& mask
+) const{
+    check_heads(Q, K, V, num_heads, mask);
+
+    int d_k = static_cast<int>(Q.cols()) / num_heads;
+    int d_v = static_cast<int>(V.cols()) / num_heads;
+
+    TRANSFORMER_TRACE_SCOPE("attention.heads");
+    parallel_for(0, num_heads, 1, [&](int begin, int end, int){
+        for (int head = begin; head < end; ++head){
+            attend(thread_workspace(),
+                   Q.middleCols(head * d_k, d_k),
+                   K.middleCols(head * d_k, d_k),
+                   V.middleCols(head * d_v, d_v),
+                   mask,
+                   output.middleCols(head * d_v, d_v));
+        }
+    });
+}
+
+
+void ScaledDotProductAttention::forward_sequences(
+    const Eigen::Ref<const Eigen::MatrixXf>& Q,
+    const Eigen::Ref<const Eigen::MatrixXf>& K,
+    const Eigen::Ref<const Eigen::MatrixXf>& V,
+    const std::vector<int>& offsets,
+    int num_heads,
+    Eigen::Ref<Eigen::MatrixXf> output,
+    const AttentionMask& mask
+) const{
+    check_heads(Q, K, V, num_heads, AttentionMask());
+    if (mask.additive.size() != 0 || mask.key_padding.size() != 0){
+        throw std::invalid_argument("Packed sequences support only a causal mask");
+    }
+    if (offsets.empty() || offsets.back() != Q.rows() || Q.rows() != K.rows()){
+        throw std::invalid_argument("Offsets must end at the packed row count of Q and K");
+    }
+
+    const int d_k = static_cast<int>(Q.cols()) / num_heads;
+    const int d_v = static_cast<int>(V.cols()) / num_heads;
+    const int num_seqs = static_cast<int>(offsets.size()) - 1;
+
+    TRANSFORMER_TRACE_SCOPE("attention.heads");
+    parallel_for(0, num_seqs * num_heads, 1, [&](int begin, int end, int){
+        for (int task = begin; task < end; ++task){
+            int i = task / num_heads;
+            int head = task % num_heads;
+            int start = offsets[i];
+            int len = offsets[i + 1] - start;
+            attend(thread_workspace(),
+                   Q.block(start, head * d_k, len, d_k),
+                   K.block(start, head * d_k, len, d_k),
+                   V.block(start, head * d_v, len, d_v),
+                   mask,
+                   output.block(start, head * d_v, len, d_v));
+        }
+    });
+}
+
+
+int MultiHeadAttention::head_dim(int num_heads, int d_model){
+    if (num_heads <= 0){
+        throw std::invalid_argument("num_heads must be positive");
+    }
     if (d_model % num_heads != 0){
         throw std::invalid_argument("d_model must be divisible by num_heads");
     }
+    return d_model / num_heads;
+}
+
 
+MultiHeadAttention::MultiHeadAttention(int num_heads, int d_model)
+    : num_heads_(num_heads), d_model_(d_model), attention_(head_dim(num_heads, d_model)){
     d_k_ = d_model / num_heads;
     d_v_ = d_model / num_heads;
 
@@ -53,6 +528,18 @@ MultiHeadAttention::MultiHeadAttention(int num_heads, int d_model): num_heads_(n
 }
 
 
+MultiHeadAttention::MultiHeadAttention(int num_heads, const std::shared_ptr<const Checkpoint>& checkpoint,
+                                       const std::string& prefix)
+    : num_heads_(num_heads),
+      d_model_(static_cast<int>(checkpoint->tensor(prefix + "W_o").rows)),
+      attention_(head_dim(num_heads, d_model_)){
+    d_k_ = d_model_ / num_heads;
+    d_v_ = d_model_ / num_heads;
+
+    load(checkpoint, prefix);
+}
+
+
 void MultiHeadAttention::initialize_weights(){
     float limit = std::sqrt(6.0f / (d_model_ + d_k_));
 
@@ -60,57 +547,96 @@ void MultiHeadAttention::initialize_weights(){
     std::mt19937 gen(rd());
     std::uniform_real_distribution<float> dist(-limit, limit);
 
-    W_q_ = Eigen::MatrixXf(d_model_, d_model_);
-    W_k_ = Eigen::MatrixXf(d_model_, d_model_);
-    W_v_ = Eigen::MatrixXf(d_model_, d_model_);
+    W_qkv_ = Eigen::MatrixXf(d_model_, 3 * d_model_);
     W_o_ = Eigen::MatrixXf(d_model_, d_model_);
 
     for (int i = 0; i < d_model_; ++i){
+        for (int j = 0; j < 3 * d_model_; ++j){
+            W_qkv_(i, j) = dist(gen);
+        }
         for (int j = 0; j < d_model_; ++j){
-            W_q_(i, j) = dist(gen);
-            W_k_(i, j) = dist(gen);
-            W_v_(i, j) = dist(gen);
             W_o_(i, j) = dist(gen);
         }
     }
 
-    b_q_ = Eigen::VectorXf::Zero(d_model_);
-    b_k_ = Eigen::VectorXf::Zero(d_model_);
-    b_v_ = Eigen::VectorXf::Zero(d_model_);
+    b_qkv_ = Eigen::VectorXf::Zero(3 * d_model_);
     b_o_ = Eigen::VectorXf::Zero(d_model_);
+
+    weight_format_ = WeightFormat::FP32;
+    W_qkv_quantized_ = QuantizedMatrix();
+    W_o_quantized_ = QuantizedMatrix();
 }
 
 
-Eigen::MatrixXf MultiHeadAttention::reshape_for_heads(const Eigen::MatrixXf& input){
-    int seq_len = input.rows();
+void MultiHeadAttention::quantize_weights(WeightFormat format){
+    if (format == weight_format_){
+        return;
+    }
+    if (weight_format_ != WeightFormat::FP32){
+        throw std::logic_error("Weights are already quantized, call initialize_weights() first");
+    }
+    W_qkv_quantized_ = QuantizedMatrix(W_qkv_, format);
+    W_o_quantized_ = QuantizedMatrix(W_o_.transpose(), format);
+    weight_format_ = format;
+
+    W_qkv_ = Eigen::MatrixXf();
+    W_o_ = Eigen::MatrixXf();
+}
 
-    Eigen::MatrixXf reshaped(seq_len * num_heads_, d_k_);
 
-    for (int seq = 0; seq < seq_len; ++seq){
-        for (int head = 0; head < num_heads_; ++head){
-            int output_row = seq * num_heads_ + head;
-            int input_start_col = head * d_k_;
+Eigen::MatrixXf MultiHeadAttention::projection_weights(int index) const{
+    // Quantizing released W_qkv, so there is nothing left to slice
+    if (weight_format_ != WeightFormat::FP32){
+        return Eigen::MatrixXf();
+    }
+    return W_qkv_.middleCols(index * d_model_, d_model_).transpose();
+}
 
-            reshaped.row(output_row) = input.block(seq, input_start_col, 1, d_k_);
-        }
+
+void MultiHeadAttention::save(CheckpointWriter& writer, const std::string& prefix) const{
+    if (weight_format_ != WeightFormat::FP32){
+        throw std::logic_error("Quantized attention weights cannot be saved");
     }
-    return reshaped;
+    writer.add_matrix(prefix + "W_qkv", W_qkv_);
+    writer.add_vector(prefix + "b_qkv", b_qkv_);
+    writer.add_matrix(prefix + "W_o", W_o_);
+    writer.add_vector(prefix + "b_o", b_o_);
+}
+
 
+void MultiHeadAttention::load(const std::shared_ptr<const Checkpoint>& checkpoint, const std::string& prefix){
+    load_weights(W_qkv_, checkpoint, prefix + "W_qkv", d_model_, 3 * d_model_);
+    load_weights(b_qkv_, checkpoint, prefix + "b_qkv", 3 * d_model_);
+    load_weights(W_o_, checkpoint, prefix + "W_o", d_model_, d_model_);
+    load_weights(b_o_, checkpoint, prefix + "b_o", d_model_);
+
+    weight_format_ = WeightFormat::FP32;
+    W_qkv_quantized_ = QuantizedMatrix();
+    W_o_quantized_ = QuantizedMatrix();
 }
 
 
-Eigen::MatrixXf MultiHeadAttention::reshape_from_heads(const Eigen::MatrixXf& input){
-    Eigen::MatrixXf reshaped(input.rows() / num_heads_, d_model_);
+std::size_t MultiHeadAttention::weight_bytes() const{
+    if (weight_format_ != WeightFormat::FP32){
+        return W_qkv_quantized_.bytes() + W_o_quantized_.bytes();
+    }
+    return (W_qkv_.size() + W_o_.size()) * sizeof(float);
+}
 
-    for (int seq = 0; seq < input.rows() / num_heads_; ++seq){
-        for (int head = 0; head < num_heads_; ++head){
-            int input_row = seq * num_heads_ + head;
-            int output_start_col = head * d_v_;
 
-            reshaped.block(seq, output_start_col, 1, d_v_) = input.row(input_row);
+template <typename Output>
+void MultiHeadAttention::project_qkv(const Eigen::Ref<const Eigen::MatrixXf>& input, int col_offset, int cols, Output&& output) const{
+    // Row blocks of the GEMM run on the thread pool; a single decode token stays inline
+    TRANSFORMER_TRACE_SCOPE("attention.qkv_projection");
+    parallel_for(0, static_cast<int>(input.rows()), kProjectionBlockRows, [&](int r0, int r1, int){
+        auto rows = output.middleRows(r0, r1 - r0);
+        if (weight_format_ != WeightFormat::FP32){
+            W_qkv_quantized_.matmul(input.middleRows(r0, r1 - r0), rows, col_offset, cols);
+        } else {
+            gemm_into(input.middleRows(r0, r1 - r0), W_qkv_.middleCols(col_offset, cols), rows);
         }
-    }
-    return reshaped;
+        rows.rowwise() += b_qkv_.segment(col_offset, cols).transpose();
+    });
 }
 
 
@@ -118,24 +644,280 @@ Eigen::MatrixXf MultiHeadAttention::forward(const Eigen::MatrixXf& query,
                                             const Eigen::MatrixXf& key, 
                                             const Eigen::MatrixXf& value,
                                             const Eigen::MatrixXf& mask){
-    int seq_len = query.rows();                                       
-    
-    //Linear projection for all heads
-    Eigen::MatrixXf Q = query * W_q_.transpose() + b_q_.transpose().replicate(seq_len, 1);
-    Eigen::MatrixXf K = key * W_k_.transpose() + b_k_.transpose().replicate(seq_len, 1);
-    Eigen::MatrixXf V = value * W_v_.transpose() + b_v_.transpose().replicate(seq_len, 1);
+    AttentionMask attention_mask;
+    attention_mask.additive = mask;
+    return forward(query, key, value, attention_mask);
+}
 
-    //Reshape for multihead processing
-    Eigen::MatrixXf Q_heads = reshape_for_heads(Q);
-    Eigen::MatrixXf K_heads = reshape_for_heads(K);
-    Eigen::MatrixXf V_heads = reshape_for_heads(V);
 
-    Eigen::MatrixXf attention_output = attention_.forward(Q_heads, K_heads, V_heads);
+Eigen::MatrixXf MultiHeadAttention::forward(const Eigen::MatrixXf& query,
+                                            const Eigen::MatrixXf& key,
+                                            const Eigen::MatrixXf& value,
+                                            const AttentionMask& mask){
+    Eigen::MatrixXf output(query.rows(), d_model_);
+    forward_into(query, key, value, mask, output);
+    return output;
+}
+
+
+void MultiHeadAttention::forward_into(const Eigen::Ref<const Eigen::MatrixXf>& query,
+                                      const Eigen::Ref<const Eigen::MatrixXf>& key,
+                                      const Eigen::Ref<const Eigen::MatrixXf>& value,
+                                      const AttentionMask& mask,
+                                      Eigen::Ref<Eigen::MatrixXf> output){
+    forward_into(query, key, value, mask, output, context_);
+}
+
+
+void MultiHeadAttention::forward_into(const Eigen::Ref<const Eigen::MatrixXf>& query,
+                                      const Eigen::Ref<const Eigen::MatrixXf>& key,
+                                      const Eigen::Ref<const Eigen::MatrixXf>& value,
+                                      const AttentionMask& mask,
+                                      Eigen::Ref<Eigen::MatrixXf> output,
+                                      AttentionContext& context) const{
+    TRANSFORMER_TRACE_SCOPE("attention.forward");
+    int seq_len = query.rows();
+    int kv_len = key.rows();
+
+    auto same = [](const Eigen::Ref<const Eigen::MatrixXf>& a, const Eigen::Ref<const Eigen::MatrixXf>& b){
+        return a.data() == b.data() && a.rows() == b.rows();
+    };
+
+    Workspace& workspace = context.workspace;
+    workspace.reset(workspace_floats(seq_len, kv_len));
+    auto concat = workspace.take(seq_len, d_model_);
+
+    if (same(query, key) && same(key, value)){
+        //Self-attention: one GEMM produces [Q | K | V]
+        auto qkv = workspace.take(seq_len, 3 * d_model_);
+        project_qkv(query, 0, 3 * d_model_, qkv);
+        rotate_qk(qkv, 0, seq_len, 0);
+
+        attention_.forward_heads(qkv.leftCols(d_model_), qkv.middleCols(d_model_, d_model_), qkv.rightCols(d_model_),
+                                 num_heads_, concat, mask);
+    } else {
+        //Cross-attention: Q from the query source, K/V from the key/value source
+        auto q = workspace.take(seq_len, d_model_);
+        auto kv = workspace.take(kv_len, 2 * d_model_);
+        project_qkv(query, 0, d_model_, q);
+
+        if (same(key, value)){
+            project_qkv(key, d_model_, 2 * d_model_, kv);
+        } else {
+            project_qkv(key, d_model_, d_model_, kv.leftCols(d_model_));
+            project_qkv(value, 2 * d_model_, d_model_, kv.rightCols(d_model_));
+        }
+
+        attention_.forward_heads(q, kv.leftCols(d_model_), kv.rightCols(d_model_), num_heads_, concat, mask);
+    }
+
+    project_output_into(concat, output);
+}
+
+
+void MultiHeadAttention::reserve(AttentionContext& context, int max_queries, int max_keys) const{
+    context.workspace.reset(std::max(workspace_floats(max_queries, max_queries), workspace_floats(max_queries, max_keys)));
+}
+
+
+void MultiHeadAttention::reserve_thread(int max_queries, int max_keys) const{
+    attention_.reserve_thread(max_queries, std::max(max_queries, max_keys), d_k_, d_k_);
+    int rows = std::min(std::max(max_queries, max_keys), kProjectionBlockRows);
+    if (weight_format_ != WeightFormat::FP32){
+        W_qkv_quantized_.reserve_thread();
+        W_o_quantized_.reserve_thread();
+    } else {
+        reserve_gemm(rows, 3 * d_model_, d_model_);
+        reserve_gemm(rows, d_model_, d_model_);
+    }
+}
+
+
+std::size_t MultiHeadAttention::workspace_floats(int seq_len, int kv_len) const{
+    //concat, then [Q | K | V] for self-attention or Q and [K | V] for cross-attention
+    return Workspace::floats(seq_len, d_model_) +
+           std::max(Workspace::floats(seq_len, 3 * d_model_),
+                    Workspace::floats(seq_len, d_model_) + Workspace::floats(kv_len, 2 * d_model_));
+}
+
+
+RaggedBatch MultiHeadAttention::forward_batch(const RaggedBatch& batch, bool causal){
+    return forward_batch(batch, causal, context_);
+}
+
 
-    Eigen::MatrixXf concatenated = reshape_from_heads(attention_output);
-    Eigen::MatrixXf output = concatenated * W_o_.transpose() + b_o_.transpose().replicate(seq_len, 1);
+RaggedBatch MultiHeadAttention::forward_batch(const RaggedBatch& batch, bool causal, AttentionContext& context) const{
+    TRANSFORMER_TRACE_SCOPE("attention.forward");
+    batch.validate();
+    int total = batch.total_tokens();
 
+    //One projection GEMM for every token of every sequence
+    Workspace& workspace = context.workspace;
+    workspace.reset(workspace_floats(total, total));
+    auto qkv = workspace.take(total, 3 * d_model_);
+    project_qkv(batch.tokens, 0, 3 * d_model_, qkv);
+    for (int i = 0; i < batch.num_sequences(); ++i){
+        rotate_qk(qkv, batch.offsets[i], batch.length(i), 0);
+    }
+
+    const AttentionMask mask = causal ? AttentionMask::causal_mask() : AttentionMask();
+    auto concat = workspace.take(total, d_model_);
+    attention_.forward_sequences(qkv.leftCols(d_model_), qkv.middleCols(d_model_, d_model_),
+                                 qkv.rightCols(d_model_), batch.offsets, num_heads_, concat, mask);
+
+    RaggedBatch result;
+    result.offsets = batch.offsets;
+    result.tokens = project_output(concat);
+    return result;
+}
+
+
+Eigen::MatrixXf MultiHeadAttention::forward_incremental(const Eigen::MatrixXf& new_tokens, KVCache& cache){
+    return forward_incremental(new_tokens, cache, context_);
+}
+
+
+Eigen::MatrixXf MultiHeadAttention::forward_incremental(const Eigen::MatrixXf& new_tokens, KVCache& cache,
+                                                        AttentionContext& context) const{
+    TRANSFORMER_TRACE_SCOPE("attention.forward");
+    if (cache.get_d_model() != d_model_){
+        throw std::invalid_argument("KVCache d_model does not match the attention layer");
+    }
+    int new_len = new_tokens.rows();
+
+    //Project only the new tokens, then extend the cache with their keys and values
+    Workspace& workspace = context.workspace;
+    workspace.reset(workspace_floats(new_len, new_len));
+    auto qkv = workspace.take(new_len, 3 * d_model_);
+    project_qkv(new_tokens, 0, 3 * d_model_, qkv);
+    rotate_qk(qkv, 0, new_len, cache.length());
+    cache.append(qkv.middleCols(d_model_, d_model_), qkv.rightCols(d_model_));
+
+    //New queries sit at the end of the cached sequence, so the causal mask lines up
+    auto concat = workspace.take(new_len, d_model_);
+    attention_.forward_heads(qkv.leftCols(d_model_), cache.keys(), cache.values(),
+                             num_heads_, concat, AttentionMask::causal_mask());
+
+    return project_output(concat);
+}
+
+
+Eigen::MatrixXf MultiHeadAttention::forward_incremental(const Eigen::MatrixXf& new_tokens, PagedKVCache& cache, int seq){
+    return forward_incremental(new_tokens, cache, seq, context_);
+}
+
+
+Eigen::MatrixXf MultiHeadAttention::forward_incremental(const Eigen::MatrixXf& new_tokens, PagedKVCache& cache, int seq,
+                                                        AttentionContext& context) const{
+    Eigen::MatrixXf output(new_tokens.rows(), d_model_);
+    forward_incremental_into(new_tokens, cache, seq, output, context);
     return output;
+}
+
+
+void MultiHeadAttention::forward_incremental_into(const Eigen::Ref<const Eigen::MatrixXf>& new_tokens,
+                                                  PagedKVCache& cache, int seq, Eigen::Ref<Eigen::MatrixXf> output,
+                                                  AttentionContext& context) const{
+    TRANSFORMER_TRACE_SCOPE("attention.forward");
+    if (cache.get_d_model() != d_model_){
+        throw std::invalid_argument("PagedKVCache d_model does not match the attention layer");
+    }
+    int new_len = new_tokens.rows();
+
+    Workspace& workspace = context.workspace;
+    workspace.reset(workspace_floats(new_len, new_len));
+    auto qkv = workspace.take(new_len, 3 * d_model_);
+    project_qkv(new_tokens, 0, 3 * d_model_, qkv);
+    rotate_qk(qkv, 0, new_len, cache.length(seq));
+    cache.append(seq, qkv.middleCols(d_model_, d_model_), qkv.rightCols(d_model_));
+
+    auto concat = workspace.take(new_len, d_model_);
+    attention_.forward_paged(qkv.leftCols(d_model_), cache, seq, num_heads_, concat);
+
+    project_output_into(concat, output);
+}
+
+
+RaggedBatch MultiHeadAttention::forward_incremental_batch(const RaggedBatch& batch, PagedKVCache& cache,
+                                                          const std::vector<int>& seqs){
+    return forward_incremental_batch(batch, cache, seqs, context_);
+}
+
+
+RaggedBatch MultiHeadAttention::forward_incremental_batch(const RaggedBatch& batch, PagedKVCache& cache,
+                                                          const std::vector<int>& seqs, AttentionContext& context) const{
+    TRANSFORMER_TRACE_SCOPE("attention.forward");
+    batch.validate();
+    if (cache.get_d_model() != d_model_){
+        throw std::invalid_argument("PagedKVCache d_model does not match the attention layer");
+    }
+    if (static_cast<int>(seqs.size()) != batch.num_sequences()){
+        throw std::invalid_argument("Need one cache sequence id per sequence in the batch");
+    }
+    for (int i = 0; i < batch.num_sequences(); ++i){
+        if (std::find(seqs.begin(), seqs.begin() + i, seqs[i]) != seqs.begin() + i){
+            throw std::invalid_argument("A cache sequence may appear only once per batch");
+        }
+    }
+    int total = batch.total_tokens();
+
+    Workspace& workspace = context.workspace;
+    workspace.reset(workspace_floats(total, total));
+    auto qkv = workspace.take(total, 3 * d_model_);
+    project_qkv(batch.tokens, 0, 3 * d_model_, qkv);
+
+    for (int i = 0; i < batch.num_sequences(); ++i){
+        int start = batch.offsets[i];
+        int len = batch.length(i);
+        rotate_qk(qkv, start, len, cache.length(seqs[i]));
+        cache.append(seqs[i], qkv.block(start, d_model_, len, d_model_), qkv.block(start, 2 * d_model_, len, d_model_));
+    }
+
+    auto concat = workspace.take(total, d_model_);
+    attention_.forward_paged_batch(qkv.leftCols(d_model_), cache, seqs, batch.offsets, num_heads_, concat);
+
+    RaggedBatch result;
+    result.offsets = batch.offsets;
+    result.tokens = project_output(concat);
+    return result;
+}
+
+
+void MultiHeadAttention::set_rotary_embedding(bool enabled, double base){
+    if (enabled){
+        rotary_ = RotaryEmbedding(d_k_, base);
     }
+    use_rotary_ = enabled;
+}
+
+
+void MultiHeadAttention::rotate_qk(Eigen::Ref<Eigen::MatrixXf> qkv, int row, int rows, int start_pos) const{
+    if (use_rotary_){
+        TRANSFORMER_TRACE_SCOPE("attention.rotary");
+        //Q and K are adjacent in qkv, so both rotate as 2 * num_heads heads in one call
+        rotary_.rotate(qkv.block(row, 0, rows, 2 * d_model_), 2 * num_heads_, start_pos);
+    }
+}
+
+
+Eigen::MatrixXf MultiHeadAttention::project_output(const Eigen::Ref<const Eigen::MatrixXf>& concat) const{
+    Eigen::MatrixXf output(concat.rows(), d_model_);
+    project_output_into(concat, output);
+    return output;
+}
+
+
+void MultiHeadAttention::project_output_into(const Eigen::Ref<const Eigen::MatrixXf>& concat, Eigen::Ref<Eigen::MatrixXf> output) const{
+    TRANSFORMER_TRACE_SCOPE("attention.output_projection");
+    parallel_for(0, static_cast<int>(concat.rows()), kProjectionBlockRows, [&](int r0, int r1, int){
+        auto rows = output.middleRows(r0, r1 - r0);
+        if (weight_format_ != WeightFormat::FP32){
+            W_o_quantized_.matmul(concat.middleRows(r0, r1 - r0), rows);
+        } else {
+            gemm_into(concat.middleRows(r0, r1 - r0), W_o_.transpose(), rows);
+        }
+        rows.rowwise() += b_o_.transpose();
+    });
+}
 
 }
\ No newline at end of file
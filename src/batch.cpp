@@ -0,0 +1,38 @@
+#include "batch.hpp"
+#include <stdexcept>
+
+namespace transformer {
+
+RaggedBatch RaggedBatch::pack(const std::vector<Eigen::MatrixXf>& sequences){
+    RaggedBatch batch;
+    batch.offsets.reserve(sequences.size() + 1);
+    batch.offsets.push_back(0);
+
+    int cols = sequences.empty() ? 0 : static_cast<int>(sequences.front().cols());
+    for (const auto& seq : sequences){
+        if (seq.cols() != cols){
+            throw std::invalid_argument("All sequences in a batch must have the same width");
+        }
+        batch.offsets.push_back(batch.offsets.back() + static_cast<int>(seq.rows()));
+    }
+
+    batch.tokens.resize(batch.offsets.back(), cols);
+    for (size_t i = 0; i < sequences.size(); ++i){
+        batch.tokens.middleRows(batch.offsets[i], sequences[i].rows()) = sequences[i];
+    }
+    return batch;
+}
+
+
+void RaggedBatch::validate() const{
+    if (offsets.empty() || offsets.front() != 0 || offsets.back() != total_tokens()){
+        throw std::invalid_argument("Batch offsets must start at 0 and end at the number of tokens");
+    }
+    for (size_t i = 1; i < offsets.size(); ++i){
+        if (offsets[i] < offsets[i - 1]){
+            throw std::invalid_argument("Batch offsets must be non-decreasing");
+        }
+    }
+}
+
+} // namespace transformer
@@ -0,0 +1,285 @@
+#include "checkpoint.hpp"
+#include <cstring>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace transformer {
+
+namespace {
+
+constexpr char kMagic[8] = {'T', 'F', 'M', 'R', 'C', 'K', 'P', 'T'};
+
+struct FileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t tensor_count;
+    uint64_t directory_offset;
+    uint64_t directory_bytes;
+    char padding[32];
+};
+static_assert(sizeof(FileHeader) == Checkpoint::kAlignment, "Checkpoint header must fill one aligned block");
+
+// Bounds-checked reader over the directory bytes
+class DirectoryReader {
+    private:
+        const char* data_;
+        std::size_t size_;
+        std::size_t pos_ = 0;
+
+    public:
+        DirectoryReader(const char* data, std::size_t size) : data_(data), size_(size) {}
+
+        void read(void* out, std::size_t bytes){
+            if (bytes > size_ - pos_){
+                throw std::runtime_error("Checkpoint directory is truncated");
+            }
+            std::memcpy(out, data_ + pos_, bytes);
+            pos_ += bytes;
+        }
+
+        template <typename T>
+        T read(){
+            T value;
+            read(&value, sizeof(value));
+            return value;
+        }
+};
+
+// Whether rows x cols elements make exactly `bytes` and fit in `limit`, without overflowing
+bool tensor_size_matches(int64_t rows, int64_t cols, std::size_t element, uint64_t bytes, std::size_t limit){
+    if (rows < 0 || cols < 0){
+        return false;
+    }
+    if (rows == 0 || cols == 0){
+        return bytes == 0;
+    }
+    uint64_t max_elements = limit / element;
+    if (static_cast<uint64_t>(rows) > max_elements / static_cast<uint64_t>(cols)){
+        return false;
+    }
+    return bytes == static_cast<uint64_t>(rows) * static_cast<uint64_t>(cols) * element;
+}
+
+} // namespace
+
+
+CheckpointWriter::CheckpointWriter(const std::string& path)
+    : path_(path), file_(path, std::ios::binary | std::ios::trunc){
+    if (!file_){
+        throw std::runtime_error("Cannot open checkpoint for writing: " + path);
+    }
+    // Placeholder header, rewritten by finish()
+    FileHeader header{};
+    file_.write(reinterpret_cast<const char*>(&header), sizeof(header));
+}
+
+
+CheckpointWriter::~CheckpointWriter(){
+    if (!finished_){
+        try {
+            finish();
+        } catch (...) {
+            // A destructor must not throw; call finish() to see write errors
+        }
+    }
+}
+
+
+void CheckpointWriter::write_blob(const std::string& name, TensorType type, uint32_t rank,
+                                  int64_t rows, int64_t cols, const void* data, uint64_t bytes){
+    if (finished_){
+        throw std::logic_error("CheckpointWriter is already finished");
+    }
+    for (const Entry& entry : entries_){
+        if (entry.name == name){
+            throw std::invalid_argument("Duplicate checkpoint tensor: " + name);
+        }
+    }
+
+    uint64_t offset = static_cast<uint64_t>(file_.tellp());
+    uint64_t aligned = (offset + Checkpoint::kAlignment - 1) / Checkpoint::kAlignment * Checkpoint::kAlignment;
+    static const char zeros[Checkpoint::kAlignment] = {};
+    file_.write(zeros, static_cast<std::streamsize>(aligned - offset));
+    file_.write(static_cast<const char*>(data), static_cast<std::streamsize>(bytes));
+    if (!file_){
+        throw std::runtime_error("Failed writing checkpoint: " + path_);
+    }
+    entries_.push_back({name, type, rank, rows, cols, aligned, bytes});
+}
+
+
+void CheckpointWriter::add_matrix(const std::string& name, const Eigen::Ref<const Eigen::MatrixXf>& matrix){
+    if (matrix.outerStride() == matrix.rows()){
+        write_blob(name, TensorType::Float32, 2, matrix.rows(), matrix.cols(),
+                   matrix.data(), static_cast<uint64_t>(matrix.size()) * sizeof(float));
+        return;
+    }
+    // A strided block is packed first so the blob stays column-major and contiguous
+    Eigen::MatrixXf packed = matrix;
+    write_blob(name, TensorType::Float32, 2, packed.rows(), packed.cols(),
+               packed.data(), static_cast<uint64_t>(packed.size()) * sizeof(float));
+}
+
+
+void CheckpointWriter::add_vector(const std::string& name, const Eigen::Ref<const Eigen::VectorXf>& vector){
+    write_blob(name, TensorType::Float32, 1, vector.size(), 1,
+               vector.data(), static_cast<uint64_t>(vector.size()) * sizeof(float));
+}
+
+
+void CheckpointWriter::add_int64(const std::string& name, const std::vector<int64_t>& values){
+    write_blob(name, TensorType::Int64, 1, static_cast<int64_t>(values.size()), 1,
+               values.data(), values.size() * sizeof(int64_t));
+}
+
+
+void CheckpointWriter::finish(){
+    if (finished_){
+        return;
+    }
+    finished_ = true;
+
+    uint64_t directory_offset = static_cast<uint64_t>(file_.tellp());
+    for (const Entry& entry : entries_){
+        uint32_t name_length = static_cast<uint32_t>(entry.name.size());
+        uint32_t type = static_cast<uint32_t>(entry.type);
+        file_.write(reinterpret_cast<const char*>(&name_length), sizeof(name_length));
+        file_.write(entry.name.data(), name_length);
+        file_.write(reinterpret_cast<const char*>(&type), sizeof(type));
+        file_.write(reinterpret_cast<const char*>(&entry.rank), sizeof(entry.rank));
+        file_.write(reinterpret_cast<const char*>(&entry.rows), sizeof(entry.rows));
+        file_.write(reinterpret_cast<const char*>(&entry.cols), sizeof(entry.cols));
+        file_.write(reinterpret_cast<const char*>(&entry.offset), sizeof(entry.offset));
+        file_.write(reinterpret_cast<const char*>(&entry.bytes), sizeof(entry.bytes));
+    }
+
+    FileHeader header{};
+    std::memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version = Checkpoint::kVersion;
+    header.tensor_count = static_cast<uint32_t>(entries_.size());
+    header.directory_offset = directory_offset;
+    header.directory_bytes = static_cast<uint64_t>(file_.tellp()) - directory_offset;
+
+    file_.seekp(0);
+    file_.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file_.close();
+    if (!file_){
+        throw std::runtime_error("Failed writing checkpoint: " + path_);
+    }
+}
+
+
+std::shared_ptr<const Checkpoint> Checkpoint::open(const std::string& path){
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0){
+        throw std::runtime_error("Cannot open checkpoint: " + path);
+    }
+    struct stat info;
+    if (::fstat(fd, &info) != 0 || static_cast<std::size_t>(info.st_size) < sizeof(FileHeader)){
+        ::close(fd);
+        throw std::runtime_error("Checkpoint is too small: " + path);
+    }
+
+    std::shared_ptr<Checkpoint> checkpoint(new Checkpoint());
+    checkpoint->size_ = static_cast<std::size_t>(info.st_size);
+    // Private and writable: shares the page cache until a page is written
+    void* mapping = ::mmap(nullptr, checkpoint->size_, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED){
+        throw std::runtime_error("Cannot map checkpoint: " + path);
+    }
+    checkpoint->mapping_ = mapping;
+
+    const char* base = static_cast<const char*>(mapping);
+    FileHeader header;
+    std::memcpy(&header, base, sizeof(header));
+    if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0){
+        throw std::runtime_error("Not a checkpoint file: " + path);
+    }
+    if (header.version < kMinVersion || header.version > kVersion){
+        throw std::runtime_error("Unsupported checkpoint version " + std::to_string(header.version));
+    }
+    if (header.directory_offset > checkpoint->size_ ||
+        header.directory_bytes > checkpoint->size_ - header.directory_offset){
+        throw std::runtime_error("Checkpoint directory out of bounds: " + path);
+    }
+    checkpoint->version_ = header.version;
+
+    DirectoryReader reader(base + header.directory_offset, header.directory_bytes);
+    for (uint32_t i = 0; i < header.tensor_count; ++i){
+        std::string name(reader.read<uint32_t>(), '\0');
+        reader.read(&name[0], name.size());
+
+        Tensor tensor;
+        tensor.type = static_cast<TensorType>(reader.read<uint32_t>());
+        tensor.rank = reader.read<uint32_t>();
+        tensor.rows = reader.read<int64_t>();
+        tensor.cols = reader.read<int64_t>();
+        tensor.offset = reader.read<uint64_t>();
+        tensor.bytes = reader.read<uint64_t>();
+
+        std::size_t element = tensor.type == TensorType::Int64 ? sizeof(int64_t) : sizeof(float);
+        bool valid = (tensor.type == TensorType::Float32 || tensor.type == TensorType::Int64)
+                     && tensor_size_matches(tensor.rows, tensor.cols, element, tensor.bytes, checkpoint->size_)
+                     && tensor.offset % kAlignment == 0
+                     && tensor.offset <= checkpoint->size_ && tensor.bytes <= checkpoint->size_ - tensor.offset;
+        if (!valid){
+            throw std::runtime_error("Corrupt checkpoint tensor " + name + " in " + path);
+        }
+        checkpoint->tensors_[name] = tensor;
+    }
+    return checkpoint;
+}
+
+
+Checkpoint::~Checkpoint(){
+    if (mapping_){
+        ::munmap(mapping_, size_);
+    }
+}
+
+
+const Checkpoint::Tensor& Checkpoint::tensor(const std::string& name) const{
+    auto it = tensors_.find(name);
+    if (it == tensors_.end()){
+        throw std::out_of_range("Checkpoint has no tensor " + name);
+    }
+    return it->second;
+}
+
+
+float* Checkpoint::floats(const std::string& name, int64_t rows, int64_t cols) const{
+    const Tensor& entry = tensor(name);
+    if (entry.type != TensorType::Float32 || entry.rows != rows || entry.cols != cols){
+        throw std::invalid_argument("Checkpoint tensor " + name + " has shape (" + std::to_string(entry.rows) + ", "
+                                    + std::to_string(entry.cols) + "), expected (" + std::to_string(rows) + ", "
+                                    + std::to_string(cols) + ")");
+    }
+    return reinterpret_cast<float*>(static_cast<char*>(mapping_) + entry.offset);
+}
+
+
+std::vector<int64_t> Checkpoint::int64s(const std::string& name) const{
+    const Tensor& entry = tensor(name);
+    if (entry.type != TensorType::Int64){
+        throw std::invalid_argument("Checkpoint tensor " + name + " is not int64");
+    }
+    std::vector<int64_t> values(entry.rows);
+    std::memcpy(values.data(), static_cast<const char*>(mapping_) + entry.offset, entry.bytes);
+    return values;
+}
+
+
+std::vector<std::string> Checkpoint::names() const{
+    std::vector<std::string> result;
+    result.reserve(tensors_.size());
+    for (const auto& entry : tensors_){
+        result.push_back(entry.first);
+    }
+    return result;
+}
+
+} // namespace transformer
@@ -0,0 +1,63 @@
+#include "cpu_info.hpp"
+#include <unistd.h>
+
+namespace transformer {
+
+namespace {
+
+std::size_t query_cache_bytes(int name, std::size_t fallback){
+    long bytes = sysconf(name);
+    return bytes > 0 ? static_cast<std::size_t>(bytes) : fallback;
+}
+
+} // namespace
+
+
+std::size_t l1_data_cache_bytes(){
+    static const std::size_t bytes = query_cache_bytes(_SC_LEVEL1_DCACHE_SIZE, 32 * 1024);
+    return bytes;
+}
+
+
+std::size_t l2_cache_bytes(){
+    static const std::size_t bytes = query_cache_bytes(_SC_LEVEL2_CACHE_SIZE, 1024 * 1024);
+    return bytes;
+}
+
+
+bool simd_level_supported(SimdLevel level){
+#if defined(__x86_64__) || defined(__i386__)
+    switch (level){
+        case SimdLevel::Scalar:
+            return true;
+        case SimdLevel::AVX2:
+            return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma") &&
+                   __builtin_cpu_supports("f16c");
+        case SimdLevel::AVX512:
+            return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("f16c");
+    }
+    return false;
+#else
+    return level == SimdLevel::Scalar;
+#endif
+}
+
+
+SimdLevel simd_level(){
+    static const SimdLevel level = simd_level_supported(SimdLevel::AVX512) ? SimdLevel::AVX512
+                                 : simd_level_supported(SimdLevel::AVX2) ? SimdLevel::AVX2
+                                 : SimdLevel::Scalar;
+    return level;
+}
+
+
+bool avx512_bf16_supported(){
+#if defined(__x86_64__) || defined(__i386__)
+    static const bool supported = __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bf16");
+    return supported;
+#else
+    return false;
+#endif
+}
+
+} // namespace transformer
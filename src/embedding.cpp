@@ -1,10 +1,217 @@
 #include "embedding.hpp"
+#include "gemm.hpp"
+#include "thread_pool.hpp"
+#include "trace.hpp"
+#include "workspace.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
 #include <random>
 #include <stdexcept>
 
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define TRANSFORMER_X86_KERNELS 1
+#endif
+
 
 namespace transformer {
 
+namespace {
+
+// Rows between issuing a table row's prefetch and copying it
+constexpr int kPrefetchDistance = 8;
+
+// Tokens staged row-major before a column-wise store: 16 floats is one cache line per column
+constexpr int kTileTokens = 16;
+
+// Vocabulary entries per thread-pool task in the output projection
+constexpr int kProjectionBlockCols = 1024;
+
+// Hint every cache line of [data, data + bytes) into cache
+void prefetch_bytes(const void* data, std::size_t bytes){
+    const char* line = static_cast<const char*>(data);
+    for (std::size_t offset = 0; offset < bytes; offset += 64){
+        __builtin_prefetch(line + offset);
+    }
+}
+
+// Checkpoints from this version on store the table as (embedding_dim, vocab_size)
+constexpr uint32_t kTransposedTableVersion = 2;
+
+bool stores_table_transposed(const Checkpoint& checkpoint){
+    return checkpoint.version() >= kTransposedTableVersion;
+}
+
+// Vocabulary size (vocab) or embedding width of a stored table, in either layout
+int stored_table_size(const Checkpoint& checkpoint, const std::string& name, bool vocab){
+    const Checkpoint::Tensor& table = checkpoint.tensor(name);
+    return static_cast<int>(vocab == stores_table_transposed(checkpoint) ? table.cols : table.rows);
+}
+
+// Deduplicating gather buffers, one set per thread and reused across calls
+struct GatherScratch {
+    std::vector<uint64_t> keys;   // id << 32 | position
+    std::vector<int> slots;       // Distinct-row index of each position
+    std::vector<int> distinct;    // Distinct ids, ascending
+    Workspace rows;               // Their decoded rows, (distinct, embedding_dim) row-major
+    Eigen::Matrix<float, kTileTokens, Eigen::Dynamic, Eigen::RowMajor> tile;     // Output rows being staged
+};
+
+GatherScratch& gather_scratch(){
+    thread_local GatherScratch scratch;
+    return scratch;
+}
+
+
+// Positions advanced together by the sinusoid recurrence, and how often it is reseeded
+constexpr int kSinusoidLanes = 8;
+constexpr int kSinusoidAnchorRows = 256;
+static_assert((kSinusoidLanes & (kSinusoidLanes - 1)) == 0, "lane step is built by doubling");
+
+/**
+ * @brief Call emit(r, sin, cos) of the angle (start_pos + r) * freq for r in [0, rows)
+ * Lane l holds position p + l. Rotating every lane by kSinusoidLanes * freq
+ * (sin(a + b) = sin a cos b + cos a sin b, cos(a + b) = cos a cos b - sin a sin b) moves it
+ * kSinusoidLanes positions on with four multiply-adds. Lane 0 is reseeded exactly every
+ * kSinusoidAnchorRows rows, so rounding does not grow with the position; the other lanes
+ * follow it one single-position rotation apart. A few rows (a decode step) are evaluated
+ * directly.
+ */
+template <typename Emit>
+void for_each_sinusoid(double freq, int start_pos, int rows, Emit&& emit){
+    if (rows <= kSinusoidLanes){
+        for (int r = 0; r < rows; ++r){
+            double angle = static_cast<double>(start_pos + r) * freq;
+            emit(r, std::sin(angle), std::cos(angle));
+        }
+        return;
+    }
+
+    const double one_sin = std::sin(freq);
+    const double one_cos = std::cos(freq);
+    double step_sin = one_sin;
+    double step_cos = one_cos;
+    for (int n = 1; n < kSinusoidLanes; n *= 2){
+        double doubled = 2.0 * step_sin * step_cos;
+        step_cos = step_cos * step_cos - step_sin * step_sin;
+        step_sin = doubled;
+    }
+
+    double s[kSinusoidLanes];
+    double c[kSinusoidLanes];
+    for (int r0 = 0; r0 < rows; r0 += kSinusoidAnchorRows){
+        int block = std::min(kSinusoidAnchorRows, rows - r0);
+        double angle = static_cast<double>(start_pos + r0) * freq;
+        s[0] = std::sin(angle);
+        c[0] = std::cos(angle);
+        for (int l = 1; l < kSinusoidLanes; ++l){
+            s[l] = s[l - 1] * one_cos + c[l - 1] * one_sin;
+            c[l] = c[l - 1] * one_cos - s[l - 1] * one_sin;
+        }
+        for (int r = 0; r < block; r += kSinusoidLanes){
+            int lanes = std::min(kSinusoidLanes, block - r);
+            for (int l = 0; l < lanes; ++l){
+                emit(r0 + r + l, s[l], c[l]);
+            }
+            for (int l = 0; l < kSinusoidLanes; ++l){
+                double next = s[l] * step_cos + c[l] * step_sin;
+                c[l] = c[l] * step_cos - s[l] * step_sin;
+                s[l] = next;
+            }
+        }
+    }
+}
+
+/**
+ * @brief x(r, i) += sin (i even) or cos (i odd) of (start_pos + r) * inv_freq(i)
+ */
+void add_sinusoids(Eigen::Ref<Eigen::MatrixXf> x, const Eigen::VectorXd& inv_freq, int start_pos){
+    for (int i = 0; i < x.cols(); ++i){
+        float* column = x.col(i).data();
+        bool odd = i % 2 != 0;
+        for_each_sinusoid(inv_freq(i), start_pos, static_cast<int>(x.rows()), [&](int r, double s, double c){
+            column[r] += static_cast<float>(odd ? c : s);
+        });
+    }
+}
+
+
+// Rotary cos/sin columns for the rows of one call, reused per thread
+// Holds the (rows, head_dim / 2) cos and sin tables of the current rotate call
+Workspace& rotary_workspace(){
+    thread_local Workspace workspace;
+    return workspace;
+}
+
+// Fewer (row, frequency) pairs per head group are not worth a thread-pool task
+constexpr int kMinRotateElements = 4096;
+
+
+// (a, b) = (a cos - b sin, a sin + b cos), elementwise over n tokens
+
+using RotatePairFn = void (*)(float*, float*, const float*, const float*, int);
+
+void rotate_pair_scalar(float* a, float* b, const float* c, const float* s, int n){
+    for (int r = 0; r < n; ++r){
+        float x0 = a[r];
+        float x1 = b[r];
+        a[r] = x0 * c[r] - x1 * s[r];
+        b[r] = x0 * s[r] + x1 * c[r];
+    }
+}
+
+#ifdef TRANSFORMER_X86_KERNELS
+
+__attribute__((target("avx2,fma")))
+void rotate_pair_avx2(float* a, float* b, const float* c, const float* s, int n){
+    int r = 0;
+    for (; r + 8 <= n; r += 8){
+        __m256 x0 = _mm256_loadu_ps(a + r);
+        __m256 x1 = _mm256_loadu_ps(b + r);
+        __m256 vc = _mm256_loadu_ps(c + r);
+        __m256 vs = _mm256_loadu_ps(s + r);
+        _mm256_storeu_ps(a + r, _mm256_fmsub_ps(x0, vc, _mm256_mul_ps(x1, vs)));
+        _mm256_storeu_ps(b + r, _mm256_fmadd_ps(x0, vs, _mm256_mul_ps(x1, vc)));
+    }
+    rotate_pair_scalar(a + r, b + r, c + r, s + r, n - r);
+}
+
+__attribute__((target("avx512f")))
+void rotate_pair_avx512(float* a, float* b, const float* c, const float* s, int n){
+    for (int r = 0; r < n; r += 16){
+        __mmask16 m = n - r >= 16 ? static_cast<__mmask16>(0xFFFF)
+                                  : static_cast<__mmask16>((1u << (n - r)) - 1);
+        __m512 x0 = _mm512_maskz_loadu_ps(m, a + r);
+        __m512 x1 = _mm512_maskz_loadu_ps(m, b + r);
+        __m512 vc = _mm512_maskz_loadu_ps(m, c + r);
+        __m512 vs = _mm512_maskz_loadu_ps(m, s + r);
+        _mm512_mask_storeu_ps(a + r, m, _mm512_fmsub_ps(x0, vc, _mm512_mul_ps(x1, vs)));
+        _mm512_mask_storeu_ps(b + r, m, _mm512_fmadd_ps(x0, vs, _mm512_mul_ps(x1, vc)));
+    }
+}
+
+#endif
+
+RotatePairFn rotate_pair_for(SimdLevel level){
+    if (!simd_level_supported(level)){
+        throw std::invalid_argument("SIMD level not supported by this CPU");
+    }
+    switch (level){
+#ifdef TRANSFORMER_X86_KERNELS
+        case SimdLevel::AVX2:
+            return rotate_pair_avx2;
+        case SimdLevel::AVX512:
+            return rotate_pair_avx512;
+#endif
+        default:
+            return rotate_pair_scalar;
+    }
+}
+
+} // namespace
+
+
 TokenEmbedding::TokenEmbedding(int vocab_size, int embedding_dim): vocab_size_(vocab_size), embedding_dim_(embedding_dim){
     std::random_device rd;
     std::mt19937 gen(rd());
@@ -19,50 +226,316 @@ TokenEmbedding::TokenEmbedding(int vocab_size, int embedding_dim): vocab_size_(v
     }
 }
 
-Eigen::MatrixXf TokenEmbedding::forward(const std::vector<int>& token_indices){
-    int seq_len = static_cast<int>(token_indices.size());
-    Eigen::MatrixXf output(seq_len, embedding_dim_);
-    for (int i = 0; i < seq_len; ++i){
-        int idx = token_indices[i];
-        if (idx < 0 || idx >= vocab_size_){
-            throw std::out_of_range("Token index out of vocabulary range");
-        }
-        output.row(i) = embedding_matrix_.row(idx);    
+TokenEmbedding::TokenEmbedding(const std::shared_ptr<const Checkpoint>& checkpoint, const std::string& prefix)
+    : vocab_size_(stored_table_size(*checkpoint, prefix + "embedding", true)),
+      embedding_dim_(stored_table_size(*checkpoint, prefix + "embedding", false)){
+    load(checkpoint, prefix);
+}
+
+
+void TokenEmbedding::save(CheckpointWriter& writer, const std::string& prefix) const{
+    if (weight_format_ != WeightFormat::FP32){
+        throw std::logic_error("A quantized embedding table cannot be saved");
+    }
+    // The column-major transpose of a row-major table is the same bytes, written as is
+    writer.add_matrix(prefix + "embedding", embedding_matrix_.transpose());
+}
+
+
+void TokenEmbedding::load(const std::shared_ptr<const Checkpoint>& checkpoint, const std::string& prefix){
+    if (stores_table_transposed(*checkpoint)){
+        embedding_matrix_.view(checkpoint->floats(prefix + "embedding", embedding_dim_, vocab_size_),
+                               vocab_size_, embedding_dim_, checkpoint);
+    } else {
+        // A version 1 table is column-major (vocab_size, embedding_dim), so copy it row-major
+        embedding_matrix_ = Eigen::Map<const Eigen::MatrixXf>(
+            checkpoint->floats(prefix + "embedding", vocab_size_, embedding_dim_), vocab_size_, embedding_dim_);
     }
+    weight_format_ = WeightFormat::FP32;
+    table_quantized_ = QuantizedMatrix();
+}
+
+
+void TokenEmbedding::quantize_weights(WeightFormat format){
+    if (format == weight_format_){
+        return;
+    }
+    if (weight_format_ != WeightFormat::FP32){
+        throw std::logic_error("Embedding table is already quantized");
+    }
+    table_quantized_ = QuantizedMatrix(embedding_matrix_.transpose(), format);
+    weight_format_ = format;
+
+    embedding_matrix_ = Eigen::MatrixXf();
+}
+
+
+std::size_t TokenEmbedding::weight_bytes() const{
+    if (weight_format_ != WeightFormat::FP32){
+        return table_quantized_.bytes();
+    }
+    return embedding_matrix_.size() * sizeof(float);
+}
+
+
+Eigen::MatrixXf TokenEmbedding::forward(const std::vector<int>& token_indices){
+    Eigen::MatrixXf output(token_indices.size(), embedding_dim_);
+    forward_into(token_indices, output);
     return output;
 }
 
 
-void TokenEmbedding::update_embedding_matrix(const Eigen::MatrixXf& gradients){
+void TokenEmbedding::forward_into(const std::vector<int>& token_indices, Eigen::Ref<Eigen::MatrixXf> output) const{
+    gather(token_indices.data(), static_cast<int>(token_indices.size()), output);
+}
+
 
+void TokenEmbedding::check_ids(const int* ids, int count) const{
+    if (count == 0){
+        return;
+    }
+    auto range = std::minmax_element(ids, ids + count);
+    if (*range.first < 0 || *range.second >= vocab_size_){
+        throw std::out_of_range("Token index out of vocabulary range");
+    }
 }
 
 
-PositionalEncoding::PositionalEncoding(int max_seq_len, int embedding_dim): max_seq_len_(max_seq_len), embedding_dim_(embedding_dim){
+void TokenEmbedding::gather(const int* ids, int count, Eigen::Ref<Eigen::MatrixXf> output) const{
+    if (output.rows() != count || output.cols() != embedding_dim_){
+        throw std::invalid_argument("Embedding output must have shape (num_tokens, embedding_dim)");
+    }
+    check_ids(ids, count);
+    TRANSFORMER_TRACE_SCOPE("embedding.gather");
 
-    pos_encoding_ = Eigen::MatrixXf(max_seq_len_, embedding_dim_);
+    const bool quantized = weight_format_ != WeightFormat::FP32;
+    const std::size_t row_bytes = quantized ? table_quantized_.channel_bytes()
+                                            : static_cast<std::size_t>(embedding_dim_) * sizeof(float);
+    auto row_data = [&](int id) -> const void* {
+        return quantized ? table_quantized_.channel_data(id) : embedding_matrix_.row(id).data();
+    };
+
+    // Output rows are strided in a column-major matrix, so tokens are staged a tile at a
+    // time and each column of the tile is stored as one contiguous run
+    GatherScratch& scratch = gather_scratch();
+    scratch.tile.resize(kTileTokens, embedding_dim_);
+    auto store_tiles = [&](auto&& source_row){
+        for (int t0 = 0; t0 < count; t0 += kTileTokens){
+            int rows = std::min(kTileTokens, count - t0);
+            for (int i = 0; i < rows; ++i){
+                source_row(t0 + i, scratch.tile.row(i));
+            }
+            output.middleRows(t0, rows) = scratch.tile.topRows(rows);
+        }
+    };
 
-    for (int pos = 0; pos < max_seq_len_; ++pos){
-        for (int i = 0;  i < embedding_dim_; i++){
-            float denominator = std::pow(10000.0f, (2.0f * i / embedding_dim_));
-            float angle = pos / denominator;
-            if (i % 2 == 0){
-                pos_encoding_(pos, i) = std::sin(angle);
-            } else {
-                pos_encoding_(pos, i) = std::cos(angle);
+    if (!quantized && !embedding_matrix_.is_view()){
+        // Resident float table: a repeated row is a cache hit anyway, so copy in token order
+        store_tiles([&](int i, auto&& row){
+            if (i + kPrefetchDistance < count){
+                prefetch_bytes(row_data(ids[i + kPrefetchDistance]), row_bytes);
             }
+            row = embedding_matrix_.row(ids[i]);
+        });
+        return;
+    }
+
+    // Sorting (id, position) pairs groups repeated ids and orders the distinct ones
+    scratch.keys.resize(count);
+    for (int i = 0; i < count; ++i){
+        scratch.keys[i] = static_cast<uint64_t>(ids[i]) << 32 | static_cast<uint32_t>(i);
+    }
+    std::sort(scratch.keys.begin(), scratch.keys.end());
+
+    scratch.slots.resize(count);
+    scratch.distinct.clear();
+    for (int k = 0; k < count; ++k){
+        int id = static_cast<int>(scratch.keys[k] >> 32);
+        if (scratch.distinct.empty() || scratch.distinct.back() != id){
+            scratch.distinct.push_back(id);
         }
+        scratch.slots[static_cast<uint32_t>(scratch.keys[k])] = static_cast<int>(scratch.distinct.size()) - 1;
+    }
+
+    // Each distinct row is decoded (or faulted in from the mapping) once, in table order
+    const int distinct = static_cast<int>(scratch.distinct.size());
+    scratch.rows.reset(Workspace::floats(distinct, embedding_dim_));
+    auto rows = scratch.rows.take<Eigen::Matrix<float, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>>(distinct, embedding_dim_);
+    for (int u = 0; u < distinct; ++u){
+        if (u + kPrefetchDistance < distinct){
+            prefetch_bytes(row_data(scratch.distinct[u + kPrefetchDistance]), row_bytes);
+        }
+        if (quantized){
+            table_quantized_.dequantize_channel(scratch.distinct[u], rows.row(u).data());
+        } else {
+            rows.row(u) = embedding_matrix_.row(scratch.distinct[u]);
+        }
+    }
+
+    store_tiles([&](int i, auto&& row){
+        row = rows.row(scratch.slots[i]);
+    });
+}
+
+
+RaggedBatch TokenEmbedding::forward_batch(const std::vector<std::vector<int>>& token_sequences){
+    RaggedBatch batch;
+    batch.offsets.reserve(token_sequences.size() + 1);
+    batch.offsets.push_back(0);
+    for (const auto& tokens : token_sequences){
+        batch.offsets.push_back(batch.offsets.back() + static_cast<int>(tokens.size()));
+    }
+
+    // One gather over the whole batch, so ids repeated across sequences are decoded once
+    std::vector<int> ids;
+    ids.reserve(batch.offsets.back());
+    for (const auto& tokens : token_sequences){
+        ids.insert(ids.end(), tokens.begin(), tokens.end());
+    }
+    batch.tokens.resize(batch.offsets.back(), embedding_dim_);
+    gather(ids.data(), static_cast<int>(ids.size()), batch.tokens);
+    return batch;
+}
+
+
+void TokenEmbedding::reserve_thread(int max_rows) const{
+    if (weight_format_ != WeightFormat::FP32){
+        table_quantized_.reserve_thread();
+    } else {
+        reserve_gemm(max_rows, std::min(vocab_size_, kProjectionBlockCols), embedding_dim_);
+    }
+}
+
+
+void TokenEmbedding::project_into(const Eigen::Ref<const Eigen::MatrixXf>& hidden,
+                                  Eigen::Ref<Eigen::MatrixXf> logits) const{
+    if (hidden.cols() != embedding_dim_ || logits.rows() != hidden.rows() || logits.cols() != vocab_size_){
+        throw std::invalid_argument("Output projection needs hidden (rows, embedding_dim) and logits (rows, vocab_size)");
+    }
+    TRANSFORMER_TRACE_SCOPE("embedding.output_projection");
+    // Vocabulary blocks run on the thread pool, so even a single decode row is split
+    parallel_for(0, vocab_size_, kProjectionBlockCols, [&](int c0, int c1, int){
+        if (weight_format_ != WeightFormat::FP32){
+            table_quantized_.matmul(hidden, logits.middleCols(c0, c1 - c0), c0, c1 - c0);
+        } else {
+            gemm_into(hidden, embedding_matrix_.middleRows(c0, c1 - c0).transpose(), logits.middleCols(c0, c1 - c0));
+        }
+    });
+}
+
+
+void TokenEmbedding::update_embedding_matrix(const Eigen::MatrixXf& gradients){
+
+}
+
+
+PositionalEncoding::PositionalEncoding(int max_seq_len, int embedding_dim, EncodingTable table)
+    : max_seq_len_(max_seq_len), embedding_dim_(embedding_dim), table_(table){
+    inv_freq_.resize(embedding_dim_);
+    for (int i = 0; i < embedding_dim_; ++i){
+        inv_freq_(i) = std::exp(-2.0 * i / embedding_dim_ * std::log(10000.0));
+    }
+
+    if (table_ == EncodingTable::Precomputed){
+        pos_encoding_ = Eigen::MatrixXf::Zero(max_seq_len_, embedding_dim_);
+        add_sinusoids(pos_encoding_, inv_freq_, 0);
     }
 }
 
 Eigen::MatrixXf PositionalEncoding::forward(const Eigen::MatrixXf& token_embeddings){
+    Eigen::MatrixXf output = token_embeddings;
+    add_into(output);
+    return output;
+}
+
+
+void PositionalEncoding::add_into(Eigen::Ref<Eigen::MatrixXf> token_embeddings, int start_pos) const{
     int seq_len = token_embeddings.rows();
-    if (seq_len > max_seq_len_){
+    if (start_pos < 0 || start_pos + seq_len > max_seq_len_){
         throw std::out_of_range("Sequence length exceeds maximum sequence length");
     }
-    return token_embeddings + pos_encoding_.block(0, 0, seq_len, embedding_dim_);
+    TRANSFORMER_TRACE_SCOPE("embedding.positional");
+    if (table_ == EncodingTable::Precomputed){
+        token_embeddings += pos_encoding_.middleRows(start_pos, seq_len);
+    } else {
+        add_sinusoids(token_embeddings, inv_freq_, start_pos);
+    }
+}
+
+
+RaggedBatch PositionalEncoding::forward_batch(const RaggedBatch& batch){
+    batch.validate();
+
+    RaggedBatch result;
+    result.offsets = batch.offsets;
+    result.tokens = batch.tokens;
+    for (int i = 0; i < batch.num_sequences(); ++i){
+        add_into(result.sequence(i));
+    }
+    return result;
+}
+
+
+const Eigen::MatrixXf& PositionalEncoding::get_pos_encoding() const{
+    if (table_ != EncodingTable::Precomputed){
+        throw std::logic_error("An on-demand positional encoding keeps no table");
+    }
+    return pos_encoding_;
+}
+
+
+RotaryEmbedding::RotaryEmbedding(int head_dim, double base): head_dim_(head_dim){
+    if (head_dim <= 0 || head_dim % 2 != 0){
+        throw std::invalid_argument("Rotary embedding needs a positive, even head_dim");
+    }
+    inv_freq_.resize(head_dim / 2);
+    for (int i = 0; i < head_dim / 2; ++i){
+        inv_freq_(i) = std::pow(base, -2.0 * i / head_dim);
+    }
+}
+
+
+void RotaryEmbedding::rotate(Eigen::Ref<Eigen::MatrixXf> x, int num_heads, int start_pos) const{
+    rotate(x, num_heads, start_pos, simd_level());
 }
 
 
+void RotaryEmbedding::rotate(Eigen::Ref<Eigen::MatrixXf> x, int num_heads, int start_pos, SimdLevel level) const{
+    if (x.cols() != static_cast<Eigen::Index>(num_heads) * head_dim_ || start_pos < 0){
+        throw std::invalid_argument("Rotary input must have shape (rows, num_heads * head_dim)");
+    }
+    const RotatePairFn rotate_pair = rotate_pair_for(level);
+    const int rows = static_cast<int>(x.rows());
+    const int half = head_dim_ / 2;
+    if (rows == 0){
+        return;
+    }
+
+    // One cos/sin column per frequency for the rows of this call, shared by every head
+    Workspace& workspace = rotary_workspace();
+    workspace.reset(2 * Workspace::floats(rows, half));
+    auto cos = workspace.take(rows, half);
+    auto sin = workspace.take(rows, half);
+    for (int i = 0; i < half; ++i){
+        float* c = cos.col(i).data();
+        float* s = sin.col(i).data();
+        for_each_sinusoid(inv_freq_(i), start_pos, rows, [&](int r, double sin_value, double cos_value){
+            s[r] = static_cast<float>(sin_value);
+            c[r] = static_cast<float>(cos_value);
+        });
+    }
+
+    // Columns are contiguous over tokens, so each rotated pair is two streaming vectors
+    int grain = std::max(1, kMinRotateElements / (rows * half));
+    parallel_for(0, num_heads, grain, [&](int h0, int h1, int){
+        for (int h = h0; h < h1; ++h){
+            for (int i = 0; i < half; ++i){
+                rotate_pair(x.col(h * head_dim_ + i).data(), x.col(h * head_dim_ + half + i).data(),
+                            cos.col(i).data(), sin.col(i).data(), rows);
+            }
+        }
+    });
+}
+
 
 }
\ No newline at end of file
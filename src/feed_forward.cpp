@@ -1,15 +1,92 @@
 #include "feed_forward.hpp"
+#include "cpu_info.hpp"
+#include "gemm.hpp"
+#include "thread_pool.hpp"
+#include "trace.hpp"
+#include <unsupported/Eigen/SpecialFunctions>
 #include <random>
 #include <cmath>
 #include <algorithm>
+#include <stdexcept>
 
 namespace transformer {
 
-FeedForward::FeedForward(int d_model, int d_ff) : d_model_(d_model), d_ff_(d_ff){
+namespace {
+
+constexpr float kSqrt2OverPi = 0.7978845608f;
+constexpr float kInvSqrt2 = 0.7071067812f;
+
+// Fewer token rows per task would leave the GEMMs too thin to be efficient
+constexpr int kMinRowsPerTask = 16;
+
+template <typename T>
+auto gelu_tanh(const T& v){
+    return 0.5f * v * (1.0f + (kSqrt2OverPi * (v + 0.044715f * v.cube())).tanh());
+}
+
+/**
+ * @brief Add b1 and apply the activation, one column at a time
+ * A column is contiguous and is read and written once, while it is in cache. Gated
+ * variants combine gate column j with up column d_ff + j into column j.
+ */
+void bias_activation(Eigen::Ref<Eigen::MatrixXf> hidden, const Eigen::Ref<const Eigen::VectorXf>& bias,
+                     Activation activation, int d_ff){
+    switch (activation){
+        case Activation::ReLU:
+            for (int j = 0; j < d_ff; ++j){
+                auto h = hidden.col(j).array();
+                h = (h + bias(j)).max(0.0f);
+            }
+            break;
+        case Activation::GELU_Tanh:
+            for (int j = 0; j < d_ff; ++j){
+                auto h = hidden.col(j).array();
+                h = gelu_tanh(h + bias(j));
+            }
+            break;
+        case Activation::GELU_Erf:
+            for (int j = 0; j < d_ff; ++j){
+                auto h = hidden.col(j).array();
+                h += bias(j);
+                h = 0.5f * h * (1.0f + (kInvSqrt2 * h).erf());
+            }
+            break;
+        case Activation::SwiGLU:
+            for (int j = 0; j < d_ff; ++j){
+                auto gate = hidden.col(j).array();
+                auto up = hidden.col(d_ff + j).array();
+                gate += bias(j);
+                gate = gate / (1.0f + (-gate).exp()) * (up + bias(d_ff + j));
+            }
+            break;
+        case Activation::GeGLU:
+            for (int j = 0; j < d_ff; ++j){
+                auto gate = hidden.col(j).array();
+                auto up = hidden.col(d_ff + j).array();
+                gate = gelu_tanh(gate + bias(j)) * (up + bias(d_ff + j));
+            }
+            break;
+    }
+}
+
+} // namespace
+
+
+FeedForward::FeedForward(int d_model, int d_ff, Activation activation)
+    : d_model_(d_model), d_ff_(d_ff), activation_(activation){
     initialize_parameters();
 }
 
 
+FeedForward::FeedForward(const std::shared_ptr<const Checkpoint>& checkpoint, const std::string& prefix,
+                         Activation activation)
+    : d_model_(static_cast<int>(checkpoint->tensor(prefix + "W2").cols)),
+      d_ff_(static_cast<int>(checkpoint->tensor(prefix + "W2").rows)),
+      activation_(activation){
+    load(checkpoint, prefix);
+}
+
+
 void FeedForward::initialize_parameters(){
     std::random_device rd;
     std::mt19937 gen(rd());
@@ -17,10 +94,11 @@ void FeedForward::initialize_parameters(){
     float limit1 = std::sqrt(6.0f / (d_model_ + d_ff_));
     std::uniform_real_distribution<float> dist1(-limit1, limit1);
 
-    W1_ = Eigen::MatrixXf(d_model_, d_ff_);
+    int width = get_hidden_width();
+    W1_ = Eigen::MatrixXf(d_model_, width);
 
     for (int i = 0; i < d_model_; ++i){
-        for (int j = 0; j < d_ff_; ++j){
+        for (int j = 0; j < width; ++j){
             W1_(i, j) = dist1(gen);
         }
     }
@@ -36,7 +114,7 @@ void FeedForward::initialize_parameters(){
         }
     }
 
-    b1_ = Eigen::VectorXf::Zero(d_ff_);
+    b1_ = Eigen::VectorXf::Zero(width);
     b2_ = Eigen::VectorXf::Zero(d_model_);
 
 }
@@ -47,30 +125,119 @@ Eigen::MatrixXf FeedForward::relu(const Eigen::MatrixXf& x){
 }
 
 Eigen::MatrixXf FeedForward::forward(const Eigen::MatrixXf& x){
+    Eigen::MatrixXf output(x.rows(), d_model_);
+    forward_into(x, output);
+    return output;
+}
+
+
+void FeedForward::forward_into(const Eigen::Ref<const Eigen::MatrixXf>& x, Eigen::Ref<Eigen::MatrixXf> output){
+    TRANSFORMER_TRACE_SCOPE("feed_forward.forward");
     last_input_ = x;
 
-    Eigen::MatrixXf hidden = x * W1_;
+    //The hidden activations are computed in the cached buffer, no separate temporary. It keeps
+    //the full gated width, so a call with the same token count reuses it as is.
+    //Token rows are independent, so row blocks run on the thread pool
+    last_hidden_.resize(x.rows(), get_hidden_width());
+    parallel_for(0, static_cast<int>(x.rows()), rows_per_task(x.rows()), [&](int r0, int r1, int){
+        compute(x.middleRows(r0, r1 - r0), output.middleRows(r0, r1 - r0), last_hidden_.middleRows(r0, r1 - r0));
+    });
+}
+
+
+void FeedForward::compute(const Eigen::Ref<const Eigen::MatrixXf>& x,
+                          Eigen::Ref<Eigen::MatrixXf> output,
+                          Eigen::Ref<Eigen::MatrixXf> hidden) const{
+    {
+        TRANSFORMER_TRACE_SCOPE("feed_forward.up_projection");
+        if (weight_format_ != WeightFormat::FP32){
+            W1_quantized_.matmul(x, hidden);
+        } else {
+            gemm_into(x, W1_, hidden);
+        }
+    }
+    {
+        TRANSFORMER_TRACE_SCOPE("feed_forward.activation");
+        bias_activation(hidden, b1_, activation_, d_ff_);
+    }
+
+    TRANSFORMER_TRACE_SCOPE("feed_forward.down_projection");
+    if (weight_format_ != WeightFormat::FP32){
+        W2_quantized_.matmul(hidden.leftCols(d_ff_), output);
+    } else {
+        gemm_into(hidden.leftCols(d_ff_), W2_, output);
+    }
+    output.rowwise() += b2_.transpose();
+}
 
-    for (int i = 0; i < hidden.rows(); ++i){
-        hidden.row(i) += b1_.transpose();
+
+void FeedForward::infer(const Eigen::Ref<const Eigen::MatrixXf>& x,
+                        Eigen::Ref<Eigen::MatrixXf> output,
+                        Eigen::Ref<Eigen::MatrixXf> hidden) const{
+    if (x.cols() != d_model_ || hidden.rows() < 1 || hidden.cols() != get_hidden_width() ||
+        output.rows() != x.rows() || output.cols() != d_model_){
+        throw std::invalid_argument("FeedForward::infer buffer shapes do not match the input");
     }
+    int seq_len = x.rows();
+    TRANSFORMER_TRACE_SCOPE("feed_forward.forward");
+
+    //Each pool slot streams its blocks through its own slice of the scratch rows. Grouping
+    //the blocks into at most `slots` chunks keeps every slot index within the scratch
+    int slots = std::min(ThreadPool::in_parallel_region() ? 1 : thread_pool().size(),
+                         std::max(static_cast<int>(hidden.rows()) / kMinRowsPerTask, 1));
+    int block = static_cast<int>(hidden.rows()) / slots;
+    int blocks = (seq_len + block - 1) / block;
+    parallel_for(0, blocks, (blocks + slots - 1) / slots, [&](int first, int last, int slot){
+        auto scratch = hidden.middleRows(slot * block, block);
+        for (int r0 = first * block; r0 < std::min(last * block, seq_len); r0 += block){
+            int rows = std::min(block, seq_len - r0);
+            compute(x.middleRows(r0, rows), output.middleRows(r0, rows), scratch.topRows(rows));
+        }
+    });
+}
 
-    hidden = relu(hidden);
 
-    last_hidden_ = hidden;
+int FeedForward::rows_per_task(int seq_len) const{
+    int threads = thread_pool().size();
+    int rows = std::min(rows_per_block(), (seq_len + threads - 1) / threads);
+    return std::max(rows, kMinRowsPerTask);
+}
 
-    Eigen::MatrixXf output = last_hidden_ * W2_;
 
-    for (int i = 0; i < output.rows(); ++i){
-        output.row(i) += b2_.transpose();
+void FeedForward::reserve_thread(int max_tokens) const{
+    if (weight_format_ != WeightFormat::FP32){
+        W1_quantized_.reserve_thread();
+        W2_quantized_.reserve_thread();
+        return;
     }
+    int rows = std::min(max_tokens, rows_per_block());
+    reserve_gemm(rows, get_hidden_width(), d_model_);
+    reserve_gemm(rows, d_model_, d_ff_);
+}
 
-    return output;
+
+int FeedForward::rows_per_block() const{
+    std::size_t bytes_per_row = sizeof(float) * static_cast<std::size_t>(2 * d_model_ + get_hidden_width());
+    int rows = static_cast<int>(l2_cache_bytes() / 2 / bytes_per_row);
+    return std::clamp(rows / 16 * 16, 16, 1024);
+}
+
+
+RaggedBatch FeedForward::forward_batch(const RaggedBatch& batch){
+    batch.validate();
+
+    RaggedBatch result;
+    result.offsets = batch.offsets;
+    result.tokens = forward(batch.tokens);
+    return result;
 }
 
 
 void FeedForward::update_parameters(const Eigen::MatrixXf& d_W1, const Eigen::VectorXf& d_b1,
 const Eigen::MatrixXf& d_W2, const Eigen::VectorXf& d_b2){
+    if (weight_format_ != WeightFormat::FP32){
+        throw std::logic_error("Quantized FeedForward weights cannot be updated");
+    }
     W1_ -= d_W1;
     b1_ -= d_b1;
     W2_ -= d_W2;
@@ -78,4 +245,52 @@ const Eigen::MatrixXf& d_W2, const Eigen::VectorXf& d_b2){
 }
 
 
-}
\ No newline at end of file
+void FeedForward::quantize_weights(WeightFormat format){
+    if (format == weight_format_){
+        return;
+    }
+    if (weight_format_ != WeightFormat::FP32){
+        throw std::logic_error("FeedForward weights are already quantized");
+    }
+    W1_quantized_ = QuantizedMatrix(W1_, format);
+    W2_quantized_ = QuantizedMatrix(W2_, format);
+    weight_format_ = format;
+
+    W1_ = Eigen::MatrixXf();
+    W2_ = Eigen::MatrixXf();
+}
+
+
+void FeedForward::save(CheckpointWriter& writer, const std::string& prefix) const{
+    if (weight_format_ != WeightFormat::FP32){
+        throw std::logic_error("Quantized FeedForward weights cannot be saved");
+    }
+    writer.add_matrix(prefix + "W1", W1_);
+    writer.add_vector(prefix + "b1", b1_);
+    writer.add_matrix(prefix + "W2", W2_);
+    writer.add_vector(prefix + "b2", b2_);
+}
+
+
+void FeedForward::load(const std::shared_ptr<const Checkpoint>& checkpoint, const std::string& prefix){
+    int width = get_hidden_width();
+    load_weights(W1_, checkpoint, prefix + "W1", d_model_, width);
+    load_weights(b1_, checkpoint, prefix + "b1", width);
+    load_weights(W2_, checkpoint, prefix + "W2", d_ff_, d_model_);
+    load_weights(b2_, checkpoint, prefix + "b2", d_model_);
+
+    weight_format_ = WeightFormat::FP32;
+    W1_quantized_ = QuantizedMatrix();
+    W2_quantized_ = QuantizedMatrix();
+}
+
+
+std::size_t FeedForward::weight_bytes() const{
+    if (weight_format_ != WeightFormat::FP32){
+        return W1_quantized_.bytes() + W2_quantized_.bytes();
+    }
+    return (W1_.size() + W2_.size()) * sizeof(float);
+}
+
+
+}
@@ -0,0 +1,145 @@
+#include "gemm.hpp"
+#include "workspace.hpp"
+#include <algorithm>
+#include <utility>
+
+// The allocation-free path drives Eigen's internal GEMM kernel, whose interface (the
+// destination inner-stride argument in particular) is specific to the 3.4 series. Any
+// other version takes the public noalias() product instead of failing to build.
+#if EIGEN_VERSION_AT_LEAST(3, 4, 0) && !EIGEN_VERSION_AT_LEAST(3, 4, 90)
+#define TRANSFORMER_EIGEN_GEMM_KERNEL 1
+#else
+#define TRANSFORMER_EIGEN_GEMM_KERNEL 0
+#endif
+
+namespace transformer {
+
+namespace {
+
+using Eigen::Index;
+
+#if TRANSFORMER_EIGEN_GEMM_KERNEL
+
+// Smallest panel edge worth shrinking to; below it the kernel's register blocks go unfilled
+constexpr Index kMinPanel = 16;
+
+struct GemmScratch {
+    Workspace workspace;
+    bool reserved = false;
+};
+
+GemmScratch& gemm_scratch(){
+    thread_local GemmScratch scratch;
+    return scratch;
+}
+
+std::size_t panel_floats(Index mc, Index nc, Index kc){
+    return Workspace::floats(kc, mc) + Workspace::floats(kc, nc);
+}
+
+// Hands the thread's panels to Eigen's GEMM, which otherwise heap-allocates them once
+// they pass EIGEN_STACK_ALLOCATION_LIMIT (from d_model of a few hundred up)
+class WorkspaceBlocking : public Eigen::internal::level3_blocking<float, float> {
+    public:
+        // Eigen's cache-based block sizes for an (m x depth) * (depth x n) product. An
+        // unreserved thread grows its workspace to fit them; after reserve_gemm() the
+        // blocks shrink to the reserved size instead, so the thread never allocates again.
+        WorkspaceBlocking(Index m, Index n, Index depth){
+            Index kc = depth, mc = m, nc = n;
+            Eigen::internal::computeProductBlockingSizes<float, float, 1>(kc, mc, nc, Index(1));
+
+            GemmScratch& scratch = gemm_scratch();
+            Workspace& workspace = scratch.workspace;
+            if (scratch.reserved){
+                // Halve the panels (rows of A first, then columns of B, then depth) until they fit
+                while (panel_floats(mc, nc, kc) > workspace.capacity()){
+                    if (mc > kMinPanel){
+                        mc = std::max(kMinPanel, mc / 2);
+                    } else if (nc > kMinPanel){
+                        nc = std::max(kMinPanel, nc / 2);
+                    } else if (kc > kMinPanel){
+                        kc = std::max(kMinPanel, kc / 2);
+                    } else {
+                        break;
+                    }
+                }
+            }
+            workspace.reset(panel_floats(mc, nc, kc));
+            m_blockA = workspace.take(kc, mc).data();
+            m_blockB = workspace.take(kc, nc).data();
+            m_mc = mc;
+            m_nc = nc;
+            m_kc = kc;
+        }
+};
+
+#endif
+
+// c += a * b with a column-major destination
+template <int LhsOrder, int RhsOrder>
+void accumulate_product(Index rows, Index cols, Index depth, const float* a, Index a_stride,
+                        const float* b, Index b_stride, float* c, Index c_stride){
+#if TRANSFORMER_EIGEN_GEMM_KERNEL
+    WorkspaceBlocking blocking(rows, cols, depth);
+    Eigen::internal::general_matrix_matrix_product<Index, float, LhsOrder, false, float, RhsOrder, false,
+                                                   Eigen::ColMajor, 1>::run(
+        rows, cols, depth, a, a_stride, b, b_stride, c, 1, c_stride, 1.0f, blocking);
+#else
+    using Stride = Eigen::OuterStride<>;
+    using LhsMap = Eigen::Map<const Eigen::Matrix<float, Eigen::Dynamic, Eigen::Dynamic, LhsOrder>, 0, Stride>;
+    using RhsMap = Eigen::Map<const Eigen::Matrix<float, Eigen::Dynamic, Eigen::Dynamic, RhsOrder>, 0, Stride>;
+    Eigen::Map<Eigen::MatrixXf, 0, Stride> dst(c, rows, cols, Stride(c_stride));
+    dst.noalias() += LhsMap(a, rows, depth, Stride(a_stride)) * RhsMap(b, depth, cols, Stride(b_stride));
+#endif
+}
+
+} // namespace
+
+
+void gemm(Index rows, Index cols, Index depth,
+          const float* a, Index a_stride, bool a_row_major,
+          const float* b, Index b_stride, bool b_row_major,
+          float* c, Index c_stride, bool c_row_major, bool accumulate){
+    // A row-major destination is the column-major c^T = b^T * a^T; transposing an operand
+    // only flips its storage order
+    if (c_row_major){
+        std::swap(rows, cols);
+        std::swap(a, b);
+        std::swap(a_stride, b_stride);
+        std::swap(a_row_major, b_row_major);
+        a_row_major = !a_row_major;
+        b_row_major = !b_row_major;
+    }
+    if (!accumulate){
+        Eigen::Map<Eigen::MatrixXf, 0, Eigen::OuterStride<>>(c, rows, cols, Eigen::OuterStride<>(c_stride)).setZero();
+    }
+
+    if (a_row_major && b_row_major){
+        accumulate_product<Eigen::RowMajor, Eigen::RowMajor>(rows, cols, depth, a, a_stride, b, b_stride, c, c_stride);
+    } else if (a_row_major){
+        accumulate_product<Eigen::RowMajor, Eigen::ColMajor>(rows, cols, depth, a, a_stride, b, b_stride, c, c_stride);
+    } else if (b_row_major){
+        accumulate_product<Eigen::ColMajor, Eigen::RowMajor>(rows, cols, depth, a, a_stride, b, b_stride, c, c_stride);
+    } else {
+        accumulate_product<Eigen::ColMajor, Eigen::ColMajor>(rows, cols, depth, a, a_stride, b, b_stride, c, c_stride);
+    }
+}
+
+
+void reserve_gemm(Index rows, Index cols, Index depth){
+#if TRANSFORMER_EIGEN_GEMM_KERNEL
+    Index kc = depth, mc = rows, nc = cols;
+    Eigen::internal::computeProductBlockingSizes<float, float, 1>(kc, mc, nc, Index(1));
+
+    GemmScratch& scratch = gemm_scratch();
+    scratch.workspace.reset(std::max(panel_floats(mc, nc, kc), panel_floats(kMinPanel, kMinPanel, kMinPanel)));
+    scratch.reserved = true;
+#else
+    // The noalias() fallback sizes its own temporaries
+    (void)rows;
+    (void)cols;
+    (void)depth;
+#endif
+}
+
+} // namespace transformer
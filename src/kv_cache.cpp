@@ -0,0 +1,49 @@
+#include "kv_cache.hpp"
+#include <algorithm>
+#include <stdexcept>
+
+namespace transformer {
+
+KVCache::KVCache(int d_model, int initial_capacity): d_model_(d_model), length_(0){
+    if (d_model <= 0 || initial_capacity < 0){
+        throw std::invalid_argument("KVCache needs a positive d_model and non-negative capacity");
+    }
+    keys_ = Eigen::MatrixXf(initial_capacity, d_model_);
+    values_ = Eigen::MatrixXf(initial_capacity, d_model_);
+}
+
+
+void KVCache::reserve(int capacity){
+    if (capacity <= this->capacity()){
+        return;
+    }
+    keys_.conservativeResize(capacity, Eigen::NoChange);
+    values_.conservativeResize(capacity, Eigen::NoChange);
+}
+
+
+void KVCache::append(const Eigen::Ref<const Eigen::MatrixXf>& keys,
+                     const Eigen::Ref<const Eigen::MatrixXf>& values){
+    if (keys.cols() != d_model_ || values.cols() != d_model_ || keys.rows() != values.rows()){
+        throw std::invalid_argument("Keys and values must both have shape (new_tokens, d_model)");
+    }
+
+    int new_tokens = static_cast<int>(keys.rows());
+    if (length_ + new_tokens > capacity()){
+        reserve(std::max(length_ + new_tokens, 2 * capacity()));
+    }
+
+    keys_.middleRows(length_, new_tokens) = keys;
+    values_.middleRows(length_, new_tokens) = values;
+    length_ += new_tokens;
+}
+
+
+void KVCache::truncate(int length){
+    if (length < 0 || length > length_){
+        throw std::out_of_range("Cannot truncate KVCache beyond its current length");
+    }
+    length_ = length;
+}
+
+} // namespace transformer
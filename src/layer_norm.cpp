@@ -1,13 +1,116 @@
 #include "layer_norm.hpp"
+#include "cpu_info.hpp"
+#include "thread_pool.hpp"
+#include "trace.hpp"
 #include <cmath>
 #include <Eigen/Dense>
+#include <algorithm>
+#include <stdexcept>
 
 namespace transformer {
 
+namespace {
+
+// Tokens normalized together: the block's rows of one column form a short contiguous
+// vector, so the statistics of every token in the block update with one vector operation
+constexpr int kMaxNormBlockRows = 256;
+using BlockArray = Eigen::Array<float, Eigen::Dynamic, 1, 0, kMaxNormBlockRows, 1>;
+
+// Largest block (multiple of 16) whose d_model columns stay within half of L2 between passes
+int norm_block_rows(int d_model){
+    int rows = static_cast<int>(l2_cache_bytes() / 2 / (sizeof(float) * static_cast<std::size_t>(d_model)));
+    return std::clamp(rows / 16 * 16, 16, kMaxNormBlockRows);
+}
+
+struct NormParams {
+    const float* gamma; // nullptr: no scale
+    const float* beta;  // nullptr: no shift
+    float epsilon;
+    bool center;                  // LayerNorm subtracts the mean, RMSNorm does not
+};
+
+/**
+ * @brief Shared LayerNorm/RMSNorm kernel
+ * For each block of tokens the first pass forms x (+ residual) in output while updating
+ * Welford mean/M2 (or the sum of squares), one column at a time; the second pass
+ * normalizes, scales and shifts the block in place while it is still in cache.
+ * @param mean_out, variance_out Optional per-token statistics (seq_len entries)
+ */
+void normalize_rows(const Eigen::Ref<const Eigen::MatrixXf>& x,
+                    const Eigen::Ref<const Eigen::MatrixXf>* residual,
+                    Eigen::Ref<Eigen::MatrixXf> output,
+                    const NormParams& params,
+                    float* mean_out = nullptr,
+                    float* variance_out = nullptr){
+    const int seq_len = x.rows();
+    const int d_model = x.cols();
+    const bool in_place = output.data() == x.data() && residual == nullptr;
+
+    // Cache-sized blocks, but small enough that every thread gets one
+    const int per_thread = (seq_len + thread_pool().size() - 1) / thread_pool().size();
+    const int block = std::min(norm_block_rows(d_model), std::max(16, (per_thread + 15) / 16 * 16));
+    const int blocks = (seq_len + block - 1) / block;
+
+    // Token blocks are independent and run on the thread pool; the block arrays have a
+    // fixed capacity, so each task keeps them on its own stack
+    parallel_for(0, blocks, 1, [&](int first, int last, int){
+        BlockArray mean, m2, delta, scale;
+        for (int r0 = first * block; r0 < std::min(last * block, seq_len); r0 += block){
+            const int rows = std::min(block, seq_len - r0);
+            mean.setZero(rows);
+            m2.setZero(rows);
+            delta.resize(rows);
+
+            for (int j = 0; j < d_model; ++j){
+                auto v = output.col(j).segment(r0, rows).array();
+                if (residual){
+                    v = x.col(j).segment(r0, rows).array() + residual->col(j).segment(r0, rows).array();
+                } else if (!in_place){
+                    v = x.col(j).segment(r0, rows).array();
+                }
+                if (params.center){
+                    delta = v - mean;
+                    mean += delta * (1.0f / (j + 1));
+                    m2 += delta * (v - mean);
+                } else {
+                    m2 += v.square();
+                }
+            }
+
+            scale = (m2 / static_cast<float>(d_model) + params.epsilon).rsqrt();
+            for (int j = 0; j < d_model; ++j){
+                auto v = output.col(j).segment(r0, rows).array();
+                float g = params.gamma ? params.gamma[j] : 1.0f;
+                float b = params.beta ? params.beta[j] : 0.0f;
+                if (params.center){
+                    v = (v - mean) * scale * g + b;
+                } else {
+                    v = v * scale * g + b;
+                }
+            }
+
+            if (mean_out){
+                Eigen::Map<Eigen::ArrayXf>(mean_out + r0, rows) = mean;
+            }
+            if (variance_out){
+                Eigen::Map<Eigen::ArrayXf>(variance_out + r0, rows) = m2 / static_cast<float>(d_model);
+            }
+        }
+    });
+}
+
+} // namespace
+
+
 LayerNorm::LayerNorm(int d_model, float epsilon) : d_model_(d_model), epsilon_(epsilon) {
     initialize_parameters();
 }
 
+LayerNorm::LayerNorm(const std::shared_ptr<const Checkpoint>& checkpoint, const std::string& prefix, float epsilon)
+    : d_model_(static_cast<int>(checkpoint->tensor(prefix + "gamma").rows)), epsilon_(epsilon) {
+    load(checkpoint, prefix);
+}
+
 void LayerNorm::initialize_parameters(){
     gamma_ = Eigen::VectorXf::Ones(d_model_);
     beta_ = Eigen::VectorXf::Zero(d_model_);
@@ -16,35 +119,86 @@ void LayerNorm::initialize_parameters(){
 
 
 Eigen::MatrixXf LayerNorm::forward(const Eigen::MatrixXf& x) {
-    int seq_len = x.rows();
+    Eigen::MatrixXf output(x.rows(), d_model_);
+    forward_into(x, output);
+    return output;
+}
+
 
+void LayerNorm::forward_into(const Eigen::Ref<const Eigen::MatrixXf>& x, Eigen::Ref<Eigen::MatrixXf> output) {
     last_input_ = x;
-    last_mean_ = Eigen::VectorXf(seq_len);
-    last_variance_ = Eigen::VectorXf(seq_len);
-    last_normalized_ = Eigen::MatrixXf(seq_len, d_model_);
-
-    for (int i = 0; i < seq_len; ++i) {
-        // Calculate mean
-        float mean = x.row(i).mean();
-        last_mean_(i) = mean;
-
-        // Calculate variance
-        Eigen::RowVectorXf row = x.row(i);
-        float variance = (row.array() - mean).square().mean();
-        last_variance_(i) = variance;
-
-        // Normalize: (x - mean) / sqrt(variance + epsilon)
-        float std_dev = std::sqrt(variance + epsilon_);
-        last_normalized_.row(i) = (row.array() - mean) / std_dev;
-    }
+    normalize_cached_input(output);
+}
+
+
+void LayerNorm::add_forward_into(const Eigen::Ref<const Eigen::MatrixXf>& x,
+                                 const Eigen::Ref<const Eigen::MatrixXf>& residual,
+                                 Eigen::Ref<Eigen::MatrixXf> output) {
+    last_input_.resize(x.rows(), d_model_);
+    last_input_.noalias() = x + residual;
+    normalize_cached_input(output);
+}
+
+
+void LayerNorm::normalize_cached_input(Eigen::Ref<Eigen::MatrixXf> output) {
+    TRANSFORMER_TRACE_SCOPE("layer_norm.forward");
+    int seq_len = last_input_.rows();
+
+    last_mean_.resize(seq_len);
+    last_variance_.resize(seq_len);
+    last_normalized_.resize(seq_len, d_model_);
+
+    // Normalize: (x - mean) / sqrt(variance + epsilon), keeping the statistics for backprop
+    normalize_rows(last_input_, nullptr, last_normalized_, {nullptr, nullptr, epsilon_, true},
+                   last_mean_.data(), last_variance_.data());
 
     // Apply gamma and beta element-wise along the feature dimension
-    Eigen::MatrixXf output(seq_len, d_model_);
-    for (int i = 0; i < seq_len; ++i) {
-        output.row(i) = last_normalized_.row(i).cwiseProduct(gamma_.transpose()) + beta_.transpose();
+    output = last_normalized_;
+    output.array().rowwise() *= gamma_.transpose().array();
+    output.rowwise() += beta_.transpose();
+}
+
+
+void LayerNorm::infer(const Eigen::Ref<const Eigen::MatrixXf>& x, Eigen::Ref<Eigen::MatrixXf> output) const {
+    if (x.cols() != d_model_ || output.rows() != x.rows() || output.cols() != d_model_) {
+        throw std::invalid_argument("LayerNorm::infer output shape does not match the input");
     }
+    TRANSFORMER_TRACE_SCOPE("layer_norm.forward");
+    normalize_rows(x, nullptr, output, {gamma_.data(), beta_.data(), epsilon_, true});
+}
 
-    return output;
+
+void LayerNorm::add_infer(const Eigen::Ref<const Eigen::MatrixXf>& x,
+                          const Eigen::Ref<const Eigen::MatrixXf>& residual,
+                          Eigen::Ref<Eigen::MatrixXf> output) const {
+    if (x.cols() != d_model_ || residual.rows() != x.rows() || residual.cols() != d_model_ ||
+        output.rows() != x.rows() || output.cols() != d_model_) {
+        throw std::invalid_argument("LayerNorm::add_infer shapes do not match the input");
+    }
+    TRANSFORMER_TRACE_SCOPE("layer_norm.forward");
+    normalize_rows(x, &residual, output, {gamma_.data(), beta_.data(), epsilon_, true});
+}
+
+
+RaggedBatch LayerNorm::forward_batch(const RaggedBatch& batch){
+    batch.validate();
+
+    RaggedBatch result;
+    result.offsets = batch.offsets;
+    result.tokens = forward(batch.tokens);
+    return result;
+}
+
+
+void LayerNorm::save(CheckpointWriter& writer, const std::string& prefix) const{
+    writer.add_vector(prefix + "gamma", gamma_);
+    writer.add_vector(prefix + "beta", beta_);
+}
+
+
+void LayerNorm::load(const std::shared_ptr<const Checkpoint>& checkpoint, const std::string& prefix){
+    load_weights(gamma_, checkpoint, prefix + "gamma", d_model_);
+    load_weights(beta_, checkpoint, prefix + "beta", d_model_);
 }
 
 
@@ -53,4 +207,57 @@ void LayerNorm::update_parameters(const Eigen::VectorXf& d_gamma, const Eigen::V
     beta_ +=  d_beta;
 }
 
-} //namespace transformer
\ No newline at end of file
+RMSNorm::RMSNorm(int d_model, float epsilon) : d_model_(d_model), epsilon_(epsilon) {
+    gamma_ = Eigen::VectorXf::Ones(d_model_);
+}
+
+
+RMSNorm::RMSNorm(const std::shared_ptr<const Checkpoint>& checkpoint, const std::string& prefix, float epsilon)
+    : d_model_(static_cast<int>(checkpoint->tensor(prefix + "gamma").rows)), epsilon_(epsilon) {
+    load(checkpoint, prefix);
+}
+
+
+void RMSNorm::save(CheckpointWriter& writer, const std::string& prefix) const{
+    writer.add_vector(prefix + "gamma", gamma_);
+}
+
+
+void RMSNorm::load(const std::shared_ptr<const Checkpoint>& checkpoint, const std::string& prefix){
+    load_weights(gamma_, checkpoint, prefix + "gamma", d_model_);
+}
+
+
+Eigen::MatrixXf RMSNorm::forward(const Eigen::MatrixXf& x) const {
+    Eigen::MatrixXf output(x.rows(), d_model_);
+    infer(x, output);
+    return output;
+}
+
+
+void RMSNorm::infer(const Eigen::Ref<const Eigen::MatrixXf>& x, Eigen::Ref<Eigen::MatrixXf> output) const {
+    if (x.cols() != d_model_ || output.rows() != x.rows() || output.cols() != d_model_) {
+        throw std::invalid_argument("RMSNorm output shape does not match the input");
+    }
+    TRANSFORMER_TRACE_SCOPE("rms_norm.forward");
+    normalize_rows(x, nullptr, output, {gamma_.data(), nullptr, epsilon_, false});
+}
+
+
+void RMSNorm::add_infer(const Eigen::Ref<const Eigen::MatrixXf>& x,
+                        const Eigen::Ref<const Eigen::MatrixXf>& residual,
+                        Eigen::Ref<Eigen::MatrixXf> output) const {
+    if (x.cols() != d_model_ || residual.rows() != x.rows() || residual.cols() != d_model_ ||
+        output.rows() != x.rows() || output.cols() != d_model_) {
+        throw std::invalid_argument("RMSNorm::add_infer shapes do not match the input");
+    }
+    TRANSFORMER_TRACE_SCOPE("rms_norm.forward");
+    normalize_rows(x, &residual, output, {gamma_.data(), nullptr, epsilon_, false});
+}
+
+
+void RMSNorm::update_parameters(const Eigen::VectorXf& d_gamma){
+    gamma_ += d_gamma;
+}
+
+} //namespace transformer
@@ -0,0 +1,229 @@
+#include "paged_kv_cache.hpp"
+#include "quantization.hpp"
+#include <algorithm>
+#include <stdexcept>
+
+namespace transformer {
+
+PagedKVCache::PagedKVCache(int d_model, int page_size, int num_pages, KVStorage storage)
+    : d_model_(d_model), page_size_(page_size), num_pages_(num_pages), storage_(storage){
+    if (d_model <= 0 || page_size <= 0 || num_pages <= 0){
+        throw std::invalid_argument("PagedKVCache needs positive d_model, page_size and num_pages");
+    }
+
+    if (storage_ == KVStorage::BF16){
+        bf16_arena_.resize(static_cast<std::size_t>(num_pages_) * page_floats());
+    } else {
+        arena_.resize(static_cast<std::size_t>(num_pages_) * page_floats());
+    }
+    ref_counts_.assign(num_pages_, 0);
+
+    // Hand out low page ids first
+    free_pages_.reserve(num_pages_);
+    for (int page = num_pages_ - 1; page >= 0; --page){
+        free_pages_.push_back(page);
+    }
+}
+
+
+int PagedKVCache::allocate_page(){
+    if (free_pages_.empty()){
+        throw std::runtime_error("PagedKVCache is out of pages");
+    }
+    int page = free_pages_.back();
+    free_pages_.pop_back();
+    ref_counts_[page] = 1;
+    return page;
+}
+
+
+void PagedKVCache::release_page(int page){
+    if (--ref_counts_[page] == 0){
+        free_pages_.push_back(page);
+    }
+}
+
+
+PagedKVCache::Sequence& PagedKVCache::sequence(int seq){
+    if (seq < 0 || seq >= static_cast<int>(sequences_.size()) || !sequences_[seq].active){
+        throw std::out_of_range("Unknown sequence id");
+    }
+    return sequences_[seq];
+}
+
+
+const PagedKVCache::Sequence& PagedKVCache::sequence(int seq) const{
+    if (seq < 0 || seq >= static_cast<int>(sequences_.size()) || !sequences_[seq].active){
+        throw std::out_of_range("Unknown sequence id");
+    }
+    return sequences_[seq];
+}
+
+
+int PagedKVCache::create_sequence(){
+    int seq;
+    if (!free_sequences_.empty()){
+        seq = free_sequences_.back();
+        free_sequences_.pop_back();
+    } else {
+        seq = static_cast<int>(sequences_.size());
+        sequences_.emplace_back();
+    }
+    sequences_[seq].pages.clear();
+    sequences_[seq].length = 0;
+    sequences_[seq].active = true;
+    return seq;
+}
+
+
+int PagedKVCache::fork_sequence(int parent){
+    // Copy the parent's table before create_sequence can reallocate sequences_
+    std::vector<int> pages = sequence(parent).pages;
+    int length = sequence(parent).length;
+
+    int child = create_sequence();
+    for (int page : pages){
+        ++ref_counts_[page];
+    }
+    sequences_[child].pages = std::move(pages);
+    sequences_[child].length = length;
+    return child;
+}
+
+
+void PagedKVCache::free_sequence(int seq){
+    Sequence& s = sequence(seq);
+    for (int page : s.pages){
+        release_page(page);
+    }
+    s.pages.clear();
+    s.length = 0;
+    s.active = false;
+    free_sequences_.push_back(seq);
+}
+
+
+int PagedKVCache::pages_needed(int seq, int new_tokens) const{
+    const Sequence& s = sequence(seq);
+    int used_in_last = s.length % page_size_;
+    int free_in_last = used_in_last == 0 ? 0 : page_size_ - used_in_last;
+    int needed = (std::max(new_tokens - free_in_last, 0) + page_size_ - 1) / page_size_;
+
+    // Writing into a shared partial page first copies it
+    if (new_tokens > 0 && free_in_last > 0 && ref_counts_[s.pages.back()] > 1){
+        ++needed;
+    }
+    return needed;
+}
+
+
+void PagedKVCache::append(int seq,
+                          const Eigen::Ref<const Eigen::MatrixXf>& keys,
+                          const Eigen::Ref<const Eigen::MatrixXf>& values){
+    if (keys.cols() != d_model_ || values.cols() != d_model_ || keys.rows() != values.rows()){
+        throw std::invalid_argument("Keys and values must both have shape (new_tokens, d_model)");
+    }
+    if (pages_needed(seq, static_cast<int>(keys.rows())) > num_free_pages()){
+        throw std::runtime_error("PagedKVCache is out of pages");
+    }
+
+    Sequence& s = sequence(seq);
+    int written = 0;
+    int new_tokens = static_cast<int>(keys.rows());
+
+    while (written < new_tokens){
+        int slot = s.length % page_size_;
+        if (slot == 0){
+            s.pages.push_back(allocate_page());
+        } else if (ref_counts_[s.pages.back()] > 1){
+            // Copy-on-write: this sequence gets a private copy of the shared partial page
+            int shared = s.pages.back();
+            int copy = allocate_page();
+            if (storage_ == KVStorage::BF16){
+                std::copy(page_bf16(shared), page_bf16(shared) + page_floats(), page_bf16(copy));
+            } else {
+                std::copy(page_data(shared), page_data(shared) + page_floats(), page_data(copy));
+            }
+            release_page(shared);
+            s.pages.back() = copy;
+        }
+
+        int count = std::min(page_size_ - slot, new_tokens - written);
+        if (storage_ == KVStorage::BF16){
+            // Column c of the page's keys starts at c * page_size, values follow the keys
+            uint16_t* data = page_bf16(s.pages.back());
+            uint16_t* data_v = data + page_floats() / 2;
+            for (int c = 0; c < d_model_; ++c){
+                std::size_t dst = static_cast<std::size_t>(c) * page_size_ + slot;
+                float_to_bf16(keys.col(c).data() + written, data + dst, count);
+                float_to_bf16(values.col(c).data() + written, data_v + dst, count);
+            }
+        } else {
+            float* data = page_data(s.pages.back());
+            Eigen::Map<Eigen::MatrixXf> page_k(data, page_size_, d_model_);
+            Eigen::Map<Eigen::MatrixXf> page_v(data + page_floats() / 2, page_size_, d_model_);
+
+            page_k.middleRows(slot, count) = keys.middleRows(written, count);
+            page_v.middleRows(slot, count) = values.middleRows(written, count);
+        }
+
+        written += count;
+        s.length += count;
+    }
+}
+
+
+Eigen::Map<const Eigen::MatrixXf> PagedKVCache::page_keys(int page) const{
+    if (storage_ != KVStorage::FP32){
+        throw std::logic_error("page_keys needs FP32 storage, use load_page");
+    }
+    return Eigen::Map<const Eigen::MatrixXf>(page_data(page), page_size_, d_model_);
+}
+
+
+Eigen::Map<const Eigen::MatrixXf> PagedKVCache::page_values(int page) const{
+    if (storage_ != KVStorage::FP32){
+        throw std::logic_error("page_values needs FP32 storage, use load_page");
+    }
+    return Eigen::Map<const Eigen::MatrixXf>(page_data(page) + page_floats() / 2, page_size_, d_model_);
+}
+
+
+void PagedKVCache::load_page(int page, int rows, int col, int cols,
+                             Eigen::Ref<Eigen::MatrixXf> keys, Eigen::Ref<Eigen::MatrixXf> values) const{
+    if (page < 0 || page >= num_pages_ || rows < 0 || rows > page_size_ || col < 0 || col + cols > d_model_){
+        throw std::out_of_range("load_page range out of bounds");
+    }
+    if (keys.rows() != rows || keys.cols() != cols || values.rows() != rows || values.cols() != cols){
+        throw std::invalid_argument("load_page outputs must have shape (rows, cols)");
+    }
+    if (storage_ == KVStorage::FP32){
+        keys = page_keys(page).block(0, col, rows, cols);
+        values = page_values(page).block(0, col, rows, cols);
+        return;
+    }
+
+    const uint16_t* data = page_bf16(page);
+    const uint16_t* data_v = data + page_floats() / 2;
+    for (int c = 0; c < cols; ++c){
+        std::size_t src = static_cast<std::size_t>(col + c) * page_size_;
+        bf16_to_float(data + src, keys.col(c).data(), rows);
+        bf16_to_float(data_v + src, values.col(c).data(), rows);
+    }
+}
+
+
+std::size_t PagedKVCache::arena_bytes() const{
+    return arena_.size() * sizeof(float) + bf16_arena_.size() * sizeof(uint16_t);
+}
+
+
+int PagedKVCache::tokens_in_page(int seq, int index) const{
+    const Sequence& s = sequence(seq);
+    if (index < 0 || index >= static_cast<int>(s.pages.size())){
+        throw std::out_of_range("Page index out of range");
+    }
+    return std::min(page_size_, s.length - index * page_size_);
+}
+
+} // namespace transformer
@@ -0,0 +1,799 @@
+#include "quantization.hpp"
+#include "workspace.hpp"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define TRANSFORMER_X86_KERNELS 1
+#endif
+
+namespace transformer {
+
+namespace {
+
+// Tokens multiplied against each streamed channel; every kernel is instantiated for 1..8
+constexpr int kTokenBlock = 8;
+// Channel rows are padded to a multiple of this many weights, so vector loops have no tails
+constexpr int kChannelAlign = 64;
+
+constexpr int kGroupSize = 32;
+
+// Zero-padded token rows of the current matmul call, reused per thread
+Workspace& token_block_workspace(){
+    thread_local Workspace workspace;
+    return workspace;
+}
+
+// Packed weights of the channels a kernel call covers, starting at the first of them
+struct PackedWeights {
+    const int8_t* int8;
+    const float* scales;
+    const uint8_t* q4;
+    const uint16_t* group_scales;
+    const uint8_t* group_zeros;
+    const uint16_t* half;
+    int stride;
+};
+
+/**
+ * @brief y[t + o * ld] = dot(x[t * stride, ...], W channel o) for NT tokens and each channel
+ * x holds NT token rows of stride floats, zero padded like the weights.
+ */
+using BlockKernel = void (*)(const float* x, const PackedWeights& w, int channels, float* y, int ld);
+
+// Independent accumulators per token, enough to hide FMA latency when few tokens are in flight
+constexpr int unroll_for(int tokens){
+    return tokens >= 4 ? 1 : 4 / tokens;
+}
+
+
+template <int NT>
+struct Int8Scalar {
+    static void run(const float* x, const PackedWeights& w, int channels, float* y, int ld){
+        const int stride = w.stride;
+        for (int o = 0; o < channels; ++o){
+            const int8_t* wo = w.int8 + static_cast<std::size_t>(o) * stride;
+            float acc[NT] = {};
+            for (int k = 0; k < stride; ++k){
+                float wk = static_cast<float>(wo[k]);
+                for (int t = 0; t < NT; ++t){
+                    acc[t] += wk * x[t * stride + k];
+                }
+            }
+            for (int t = 0; t < NT; ++t){
+                y[t + static_cast<std::size_t>(o) * ld] = acc[t] * w.scales[o];
+            }
+        }
+    }
+};
+
+template <int NT>
+struct Q4Scalar {
+    static void run(const float* x, const PackedWeights& w, int channels, float* y, int ld){
+        const int stride = w.stride;
+        const int groups = stride / kGroupSize;
+        for (int o = 0; o < channels; ++o){
+            const uint8_t* qo = w.q4 + static_cast<std::size_t>(o) * stride / 2;
+            const uint16_t* so = w.group_scales + static_cast<std::size_t>(o) * groups;
+            const uint8_t* zo = w.group_zeros + static_cast<std::size_t>(o) * groups;
+            float acc[NT] = {};
+            for (int g = 0; g < groups; ++g){
+                float scale = fp16_to_float(so[g]);
+                float zero = zo[g];
+                const uint8_t* bytes = qo + g * kGroupSize / 2;
+                const float* xg = x + g * kGroupSize;
+                for (int i = 0; i < kGroupSize / 2; ++i){
+                    float lo = ((bytes[i] & 0xF) - zero) * scale;
+                    float hi = ((bytes[i] >> 4) - zero) * scale;
+                    for (int t = 0; t < NT; ++t){
+                        acc[t] += lo * xg[t * stride + i] + hi * xg[t * stride + i + kGroupSize / 2];
+                    }
+                }
+            }
+            for (int t = 0; t < NT; ++t){
+                y[t + static_cast<std::size_t>(o) * ld] = acc[t];
+            }
+        }
+    }
+};
+
+
+struct Fp16Format {
+    static float to_float(uint16_t bits) {return fp16_to_float(bits);}
+};
+
+struct Bf16Format {
+    static float to_float(uint16_t bits) {return bf16_to_float(bits);}
+};
+
+template <int NT, class Format>
+struct HalfScalar {
+    static void run(const float* x, const PackedWeights& w, int channels, float* y, int ld){
+        const int stride = w.stride;
+        for (int o = 0; o < channels; ++o){
+            const uint16_t* wo = w.half + static_cast<std::size_t>(o) * stride;
+            float acc[NT] = {};
+            for (int k = 0; k < stride; ++k){
+                float wk = Format::to_float(wo[k]);
+                for (int t = 0; t < NT; ++t){
+                    acc[t] += wk * x[t * stride + k];
+                }
+            }
+            for (int t = 0; t < NT; ++t){
+                y[t + static_cast<std::size_t>(o) * ld] = acc[t];
+            }
+        }
+    }
+};
+
+template <int NT> using Fp16Scalar = HalfScalar<NT, Fp16Format>;
+template <int NT> using Bf16Scalar = HalfScalar<NT, Bf16Format>;
+
+#ifdef TRANSFORMER_X86_KERNELS
+
+__attribute__((target("avx2,fma,f16c")))
+inline float hsum_avx2(__m256 v){
+    __m128 s = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+    s = _mm_add_ss(s, _mm_movehdup_ps(s));
+    return _mm_cvtss_f32(s);
+}
+
+template <int NT>
+struct Int8Avx2 {
+    __attribute__((target("avx2,fma,f16c")))
+    static void run(const float* x, const PackedWeights& w, int channels, float* y, int ld){
+        constexpr int U = unroll_for(NT);
+        const int stride = w.stride;
+        for (int o = 0; o < channels; ++o){
+            const int8_t* wo = w.int8 + static_cast<std::size_t>(o) * stride;
+            __m256 acc[NT][U];
+            for (int t = 0; t < NT; ++t){
+                for (int u = 0; u < U; ++u){
+                    acc[t][u] = _mm256_setzero_ps();
+                }
+            }
+            for (int k = 0; k < stride; k += 8 * U){
+                for (int u = 0; u < U; ++u){
+                    __m128i q = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(wo + k + 8 * u));
+                    __m256 wv = _mm256_cvtepi32_ps(_mm256_cvtepi8_epi32(q));
+                    for (int t = 0; t < NT; ++t){
+                        acc[t][u] = _mm256_fmadd_ps(wv, _mm256_loadu_ps(x + t * stride + k + 8 * u), acc[t][u]);
+                    }
+                }
+            }
+            for (int t = 0; t < NT; ++t){
+                for (int u = 1; u < U; ++u){
+                    acc[t][0] = _mm256_add_ps(acc[t][0], acc[t][u]);
+                }
+                y[t + static_cast<std::size_t>(o) * ld] = hsum_avx2(acc[t][0]) * w.scales[o];
+            }
+        }
+    }
+};
+
+// Nibbles widened to float and dequantized in registers: (q - zero) * scale = q * scale - zero * scale
+template <int NT>
+struct Q4Avx2 {
+    __attribute__((target("avx2,fma,f16c")))
+    static void run(const float* x, const PackedWeights& w, int channels, float* y, int ld){
+        const int stride = w.stride;
+        const int groups = stride / kGroupSize;
+        const __m256i low_nibble = _mm256_set1_epi32(0xF);
+        for (int o = 0; o < channels; ++o){
+            const uint8_t* qo = w.q4 + static_cast<std::size_t>(o) * stride / 2;
+            const uint16_t* so = w.group_scales + static_cast<std::size_t>(o) * groups;
+            const uint8_t* zo = w.group_zeros + static_cast<std::size_t>(o) * groups;
+            // One accumulator per (half, nibble) pair keeps four independent FMA chains per token
+            __m256 acc[NT][4];
+            for (int t = 0; t < NT; ++t){
+                for (int a = 0; a < 4; ++a){
+                    acc[t][a] = _mm256_setzero_ps();
+                }
+            }
+            for (int g = 0; g < groups; ++g){
+                float scale = _cvtsh_ss(so[g]);
+                __m256 vscale = _mm256_set1_ps(scale);
+                __m256 voffset = _mm256_set1_ps(zo[g] * scale);
+                const float* xg = x + g * kGroupSize;
+                for (int half = 0; half < 2; ++half){
+                    // Bytes 8 * half .. 8 * half + 7 hold weights i (low) and i + 16 (high)
+                    __m128i b = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(qo + g * kGroupSize / 2 + 8 * half));
+                    __m256i q = _mm256_cvtepu8_epi32(b);
+                    __m256 lo = _mm256_fmsub_ps(_mm256_cvtepi32_ps(_mm256_and_si256(q, low_nibble)), vscale, voffset);
+                    __m256 hi = _mm256_fmsub_ps(_mm256_cvtepi32_ps(_mm256_srli_epi32(q, 4)), vscale, voffset);
+                    for (int t = 0; t < NT; ++t){
+                        const float* xt = xg + t * stride + 8 * half;
+                        acc[t][2 * half] = _mm256_fmadd_ps(lo, _mm256_loadu_ps(xt), acc[t][2 * half]);
+                        acc[t][2 * half + 1] = _mm256_fmadd_ps(hi, _mm256_loadu_ps(xt + kGroupSize / 2), acc[t][2 * half + 1]);
+                    }
+                }
+            }
+            for (int t = 0; t < NT; ++t){
+                __m256 sum = _mm256_add_ps(_mm256_add_ps(acc[t][0], acc[t][1]), _mm256_add_ps(acc[t][2], acc[t][3]));
+                y[t + static_cast<std::size_t>(o) * ld] = hsum_avx2(sum);
+            }
+        }
+    }
+};
+
+// 16-bit weights widen exactly to fp32: F16C for fp16, a 16-bit shift for bf16
+template <int NT, bool BF16>
+struct HalfAvx2 {
+    __attribute__((target("avx2,fma,f16c")))
+    static __m256 load(const uint16_t* w){
+        __m128i h = _mm_loadu_si128(reinterpret_cast<const __m128i*>(w));
+        if (BF16){
+            return _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_cvtepu16_epi32(h), 16));
+        }
+        return _mm256_cvtph_ps(h);
+    }
+
+    __attribute__((target("avx2,fma,f16c")))
+    static void run(const float* x, const PackedWeights& w, int channels, float* y, int ld){
+        constexpr int U = unroll_for(NT);
+        const int stride = w.stride;
+        for (int o = 0; o < channels; ++o){
+            const uint16_t* wo = w.half + static_cast<std::size_t>(o) * stride;
+            __m256 acc[NT][U];
+            for (int t = 0; t < NT; ++t){
+                for (int u = 0; u < U; ++u){
+                    acc[t][u] = _mm256_setzero_ps();
+                }
+            }
+            for (int k = 0; k < stride; k += 8 * U){
+                for (int u = 0; u < U; ++u){
+                    __m256 wv = load(wo + k + 8 * u);
+                    for (int t = 0; t < NT; ++t){
+                        acc[t][u] = _mm256_fmadd_ps(wv, _mm256_loadu_ps(x + t * stride + k + 8 * u), acc[t][u]);
+                    }
+                }
+            }
+            for (int t = 0; t < NT; ++t){
+                for (int u = 1; u < U; ++u){
+                    acc[t][0] = _mm256_add_ps(acc[t][0], acc[t][u]);
+                }
+                y[t + static_cast<std::size_t>(o) * ld] = hsum_avx2(acc[t][0]);
+            }
+        }
+    }
+};
+
+template <int NT> using Fp16Avx2 = HalfAvx2<NT, false>;
+template <int NT> using Bf16Avx2 = HalfAvx2<NT, true>;
+
+template <int NT>
+struct Int8Avx512 {
+    __attribute__((target("avx512f,f16c")))
+    static void run(const float* x, const PackedWeights& w, int channels, float* y, int ld){
+        constexpr int U = unroll_for(NT);
+        const int stride = w.stride;
+        for (int o = 0; o < channels; ++o){
+            const int8_t* wo = w.int8 + static_cast<std::size_t>(o) * stride;
+            __m512 acc[NT][U];
+            for (int t = 0; t < NT; ++t){
+                for (int u = 0; u < U; ++u){
+                    acc[t][u] = _mm512_setzero_ps();
+                }
+            }
+            for (int k = 0; k < stride; k += 16 * U){
+                for (int u = 0; u < U; ++u){
+                    __m128i q = _mm_loadu_si128(reinterpret_cast<const __m128i*>(wo + k + 16 * u));
+                    __m512 wv = _mm512_cvtepi32_ps(_mm512_cvtepi8_epi32(q));
+                    for (int t = 0; t < NT; ++t){
+                        acc[t][u] = _mm512_fmadd_ps(wv, _mm512_loadu_ps(x + t * stride + k + 16 * u), acc[t][u]);
+                    }
+                }
+            }
+            for (int t = 0; t < NT; ++t){
+                for (int u = 1; u < U; ++u){
+                    acc[t][0] = _mm512_add_ps(acc[t][0], acc[t][u]);
+                }
+                y[t + static_cast<std::size_t>(o) * ld] = _mm512_reduce_add_ps(acc[t][0]) * w.scales[o];
+            }
+        }
+    }
+};
+
+template <int NT, bool BF16>
+struct HalfAvx512 {
+    __attribute__((target("avx512f,f16c")))
+    static __m512 load(const uint16_t* w){
+        __m256i h = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(w));
+        if (BF16){
+            return _mm512_castsi512_ps(_mm512_slli_epi32(_mm512_cvtepu16_epi32(h), 16));
+        }
+        return _mm512_cvtph_ps(h);
+    }
+
+    __attribute__((target("avx512f,f16c")))
+    static void run(const float* x, const PackedWeights& w, int channels, float* y, int ld){
+        constexpr int U = unroll_for(NT);
+        const int stride = w.stride;
+        for (int o = 0; o < channels; ++o){
+            const uint16_t* wo = w.half + static_cast<std::size_t>(o) * stride;
+            __m512 acc[NT][U];
+            for (int t = 0; t < NT; ++t){
+                for (int u = 0; u < U; ++u){
+                    acc[t][u] = _mm512_setzero_ps();
+                }
+            }
+            for (int k = 0; k < stride; k += 16 * U){
+                for (int u = 0; u < U; ++u){
+                    __m512 wv = load(wo + k + 16 * u);
+                    for (int t = 0; t < NT; ++t){
+                        acc[t][u] = _mm512_fmadd_ps(wv, _mm512_loadu_ps(x + t * stride + k + 16 * u), acc[t][u]);
+                    }
+                }
+            }
+            for (int t = 0; t < NT; ++t){
+                for (int u = 1; u < U; ++u){
+                    acc[t][0] = _mm512_add_ps(acc[t][0], acc[t][u]);
+                }
+                y[t + static_cast<std::size_t>(o) * ld] = _mm512_reduce_add_ps(acc[t][0]);
+            }
+        }
+    }
+};
+
+template <int NT> using Fp16Avx512 = HalfAvx512<NT, false>;
+template <int NT> using Bf16Avx512 = HalfAvx512<NT, true>;
+
+// Round to nearest even in hardware; NaN inputs become quiet NaNs
+__attribute__((target("avx512f,avx512bf16")))
+void float_to_bf16_avx512(const float* src, uint16_t* dst, std::size_t count){
+    std::size_t i = 0;
+    for (; i + 16 <= count; i += 16){
+        __m256bh packed = _mm512_cvtneps_pbh(_mm512_loadu_ps(src + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), reinterpret_cast<__m256i&>(packed));
+    }
+    for (; i < count; ++i){
+        dst[i] = float_to_bf16(src[i]);
+    }
+}
+
+template <int NT>
+struct Q4Avx512 {
+    __attribute__((target("avx512f,f16c")))
+    static void run(const float* x, const PackedWeights& w, int channels, float* y, int ld){
+        // Groups per channel is a multiple of two since channels are padded to 64 weights
+        constexpr int U = NT >= 4 ? 1 : 2;
+        const int stride = w.stride;
+        const int groups = stride / kGroupSize;
+        const __m512i low_nibble = _mm512_set1_epi32(0xF);
+        for (int o = 0; o < channels; ++o){
+            const uint8_t* qo = w.q4 + static_cast<std::size_t>(o) * stride / 2;
+            const uint16_t* so = w.group_scales + static_cast<std::size_t>(o) * groups;
+            const uint8_t* zo = w.group_zeros + static_cast<std::size_t>(o) * groups;
+            __m512 acc[NT][2 * U];
+            for (int t = 0; t < NT; ++t){
+                for (int a = 0; a < 2 * U; ++a){
+                    acc[t][a] = _mm512_setzero_ps();
+                }
+            }
+            for (int g0 = 0; g0 < groups; g0 += U){
+                for (int u = 0; u < U; ++u){
+                    const int g = g0 + u;
+                    float scale = _cvtsh_ss(so[g]);
+                    __m512 vscale = _mm512_set1_ps(scale);
+                    __m512 voffset = _mm512_set1_ps(zo[g] * scale);
+                    __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(qo + g * kGroupSize / 2));
+                    __m512i q = _mm512_cvtepu8_epi32(b);
+                    __m512 lo = _mm512_fmsub_ps(_mm512_cvtepi32_ps(_mm512_and_si512(q, low_nibble)), vscale, voffset);
+                    __m512 hi = _mm512_fmsub_ps(_mm512_cvtepi32_ps(_mm512_srli_epi32(q, 4)), vscale, voffset);
+                    const float* xg = x + g * kGroupSize;
+                    for (int t = 0; t < NT; ++t){
+                        acc[t][2 * u] = _mm512_fmadd_ps(lo, _mm512_loadu_ps(xg + t * stride), acc[t][2 * u]);
+                        acc[t][2 * u + 1] = _mm512_fmadd_ps(hi, _mm512_loadu_ps(xg + t * stride + kGroupSize / 2), acc[t][2 * u + 1]);
+                    }
+                }
+            }
+            for (int t = 0; t < NT; ++t){
+                __m512 sum = acc[t][0];
+                for (int a = 1; a < 2 * U; ++a){
+                    sum = _mm512_add_ps(sum, acc[t][a]);
+                }
+                y[t + static_cast<std::size_t>(o) * ld] = _mm512_reduce_add_ps(sum);
+            }
+        }
+    }
+};
+
+#endif // TRANSFORMER_X86_KERNELS
+
+
+using KernelTable = std::array<BlockKernel, kTokenBlock>;
+
+template <template <int> class Kernel>
+KernelTable make_table(){
+    return {Kernel<1>::run, Kernel<2>::run, Kernel<3>::run, Kernel<4>::run,
+            Kernel<5>::run, Kernel<6>::run, Kernel<7>::run, Kernel<8>::run};
+}
+
+// Kernels for every SIMD level of one weight format
+struct FormatKernels {
+    KernelTable scalar;
+    KernelTable avx2;
+    KernelTable avx512;
+};
+
+template <template <int> class Scalar, template <int> class Avx2, template <int> class Avx512>
+FormatKernels make_format_kernels(){
+    return {make_table<Scalar>(), make_table<Avx2>(), make_table<Avx512>()};
+}
+
+const KernelTable& kernels_for(WeightFormat format, SimdLevel level){
+#ifdef TRANSFORMER_X86_KERNELS
+    static const FormatKernels int8 = make_format_kernels<Int8Scalar, Int8Avx2, Int8Avx512>();
+    static const FormatKernels q4 = make_format_kernels<Q4Scalar, Q4Avx2, Q4Avx512>();
+    static const FormatKernels fp16 = make_format_kernels<Fp16Scalar, Fp16Avx2, Fp16Avx512>();
+    static const FormatKernels bf16 = make_format_kernels<Bf16Scalar, Bf16Avx2, Bf16Avx512>();
+#else
+    static const FormatKernels int8 = make_format_kernels<Int8Scalar, Int8Scalar, Int8Scalar>();
+    static const FormatKernels q4 = make_format_kernels<Q4Scalar, Q4Scalar, Q4Scalar>();
+    static const FormatKernels fp16 = make_format_kernels<Fp16Scalar, Fp16Scalar, Fp16Scalar>();
+    static const FormatKernels bf16 = make_format_kernels<Bf16Scalar, Bf16Scalar, Bf16Scalar>();
+#endif
+
+    if (!simd_level_supported(level)){
+        throw std::invalid_argument("SIMD level not supported by this CPU");
+    }
+    const FormatKernels& kernels = format == WeightFormat::INT8 ? int8
+                                 : format == WeightFormat::FP16 ? fp16
+                                 : format == WeightFormat::BF16 ? bf16
+                                 : q4;
+    switch (level){
+        case SimdLevel::AVX2:
+            return kernels.avx2;
+        case SimdLevel::AVX512:
+            return kernels.avx512;
+        default:
+            return kernels.scalar;
+    }
+}
+
+} // namespace
+
+
+uint16_t float_to_fp16(float value){
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    const uint32_t sign = (bits >> 16) & 0x8000u;
+    const uint32_t magnitude = bits & 0x7fffffffu;
+
+    if (magnitude >= 0x7f800000u){
+        // Infinity stays infinity, NaN stays a quiet NaN
+        return static_cast<uint16_t>(sign | 0x7c00u | (magnitude > 0x7f800000u ? 0x200u : 0u));
+    }
+    if (magnitude >= 0x477ff000u){
+        // Rounds past the largest half (65504)
+        return static_cast<uint16_t>(sign | 0x7c00u);
+    }
+    if (magnitude < 0x38800000u){
+        // Below 2^-14: subnormal half, or zero under 2^-25
+        if (magnitude < 0x33000000u){
+            return static_cast<uint16_t>(sign);
+        }
+        const uint32_t mantissa = (magnitude & 0x7fffffu) | 0x800000u;
+        const uint32_t shift = 126u - (magnitude >> 23);
+        uint32_t half = mantissa >> shift;
+        const uint32_t remainder = mantissa & ((1u << shift) - 1u);
+        const uint32_t midpoint = 1u << (shift - 1u);
+        if (remainder > midpoint || (remainder == midpoint && (half & 1u))){
+            ++half;
+        }
+        return static_cast<uint16_t>(sign | half);
+    }
+    // Normal: rebias the exponent from 127 to 15 and round the dropped 13 mantissa bits
+    uint32_t half = (magnitude >> 13) - (112u << 10);
+    const uint32_t remainder = magnitude & 0x1fffu;
+    if (remainder > 0x1000u || (remainder == 0x1000u && (half & 1u))){
+        ++half;
+    }
+    return static_cast<uint16_t>(sign | half);
+}
+
+
+float fp16_to_float(uint16_t value){
+    const uint32_t sign = static_cast<uint32_t>(value & 0x8000u) << 16;
+    const uint32_t exponent = (value >> 10) & 0x1fu;
+    const uint32_t mantissa = value & 0x3ffu;
+
+    uint32_t bits;
+    if (exponent == 0){
+        float magnitude = std::ldexp(static_cast<float>(mantissa), -24);
+        return sign ? -magnitude : magnitude;
+    }
+    if (exponent == 0x1fu){
+        bits = sign | 0x7f800000u | (mantissa << 13);
+    } else {
+        bits = sign | ((exponent + 112u) << 23) | (mantissa << 13);
+    }
+    float result;
+    std::memcpy(&result, &bits, sizeof(result));
+    return result;
+}
+
+
+uint16_t float_to_bf16(float value){
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    if ((bits & 0x7fffffffu) > 0x7f800000u){
+        return static_cast<uint16_t>((bits >> 16) | 0x40u);
+    }
+    // Adding 0x7fff plus the kept lowest bit rounds to nearest, ties to even
+    bits += 0x7fffu + ((bits >> 16) & 1u);
+    return static_cast<uint16_t>(bits >> 16);
+}
+
+
+void float_to_bf16(const float* src, uint16_t* dst, std::size_t count){
+#ifdef TRANSFORMER_X86_KERNELS
+    if (avx512_bf16_supported()){
+        float_to_bf16_avx512(src, dst, count);
+        return;
+    }
+#endif
+    for (std::size_t i = 0; i < count; ++i){
+        dst[i] = float_to_bf16(src[i]);
+    }
+}
+
+
+void bf16_to_float(const uint16_t* src, float* dst, std::size_t count){
+    // A shift per element; compilers vectorize this loop without help
+    for (std::size_t i = 0; i < count; ++i){
+        dst[i] = bf16_to_float(src[i]);
+    }
+}
+
+
+QuantizedMatrix::QuantizedMatrix(const Eigen::Ref<const Eigen::MatrixXf>& W, WeightFormat format)
+    : format_(format),
+      in_features_(static_cast<int>(W.rows())),
+      out_features_(static_cast<int>(W.cols())),
+      stride_((static_cast<int>(W.rows()) + kChannelAlign - 1) / kChannelAlign * kChannelAlign){
+    switch (format){
+        case WeightFormat::INT8:
+            quantize_int8(W);
+            break;
+        case WeightFormat::Q4:
+        case WeightFormat::Q4_ZP:
+            quantize_q4(W);
+            break;
+        case WeightFormat::FP16:
+        case WeightFormat::BF16:
+            convert_half(W);
+            break;
+        default:
+            throw std::invalid_argument("QuantizedMatrix needs a quantized weight format");
+    }
+}
+
+
+void QuantizedMatrix::quantize_int8(const Eigen::Ref<const Eigen::MatrixXf>& W){
+    int8_.assign(static_cast<std::size_t>(out_features_) * stride_, 0);
+    scales_.resize(out_features_);
+
+    for (int o = 0; o < out_features_; ++o){
+        float max_abs = W.col(o).cwiseAbs().maxCoeff();
+        float scale = max_abs / 127.0f;
+        scales_[o] = scale;
+        if (scale == 0.0f){
+            continue;
+        }
+        int8_t* row = int8_.data() + static_cast<std::size_t>(o) * stride_;
+        for (int k = 0; k < in_features_; ++k){
+            float q = std::nearbyint(W(k, o) / scale);
+            row[k] = static_cast<int8_t>(std::clamp(q, -127.0f, 127.0f));
+        }
+    }
+}
+
+
+void QuantizedMatrix::quantize_q4(const Eigen::Ref<const Eigen::MatrixXf>& W){
+    const int groups = stride_ / kGroupSize;
+    const bool zero_point = format_ == WeightFormat::Q4_ZP;
+    // Padding weights quantize to the group zero, so they dequantize to exactly 0
+    q4_.assign(static_cast<std::size_t>(out_features_) * stride_ / 2, 0);
+    group_scales_.assign(static_cast<std::size_t>(out_features_) * groups, 0);
+    group_zeros_.assign(static_cast<std::size_t>(out_features_) * groups, 8);
+
+    std::array<float, kGroupSize> values;
+    std::array<uint8_t, kGroupSize> codes;
+    for (int o = 0; o < out_features_; ++o){
+        for (int g = 0; g < groups; ++g){
+            const int k0 = g * kGroupSize;
+            const int count = std::max(0, std::min(kGroupSize, in_features_ - k0));
+            values.fill(0.0f);
+            for (int i = 0; i < count; ++i){
+                values[i] = W(k0 + i, o);
+            }
+
+            float scale;
+            int zero;
+            if (zero_point){
+                // Asymmetric range [min, max] including zero, so padding stays exact
+                float lo = std::min(0.0f, *std::min_element(values.begin(), values.end()));
+                float hi = std::max(0.0f, *std::max_element(values.begin(), values.end()));
+                scale = (hi - lo) / 15.0f;
+                scale = fp16_to_float(float_to_fp16(scale));
+                zero = scale > 0.0f ? static_cast<int>(std::clamp(std::nearbyint(-lo / scale), 0.0f, 15.0f)) : 0;
+            } else {
+                float max_abs = 0.0f;
+                for (float v : values){
+                    max_abs = std::max(max_abs, std::abs(v));
+                }
+                scale = fp16_to_float(float_to_fp16(max_abs / 7.0f));
+                zero = 8;
+            }
+
+            for (int i = 0; i < kGroupSize; ++i){
+                float q = scale > 0.0f ? std::nearbyint(values[i] / scale) + zero : zero;
+                codes[i] = static_cast<uint8_t>(std::clamp(q, 0.0f, 15.0f));
+            }
+
+            const std::size_t group = static_cast<std::size_t>(o) * groups + g;
+            group_scales_[group] = float_to_fp16(scale);
+            group_zeros_[group] = static_cast<uint8_t>(zero);
+            uint8_t* bytes = q4_.data() + group * kGroupSize / 2;
+            for (int i = 0; i < kGroupSize / 2; ++i){
+                bytes[i] = static_cast<uint8_t>(codes[i] | (codes[i + kGroupSize / 2] << 4));
+            }
+        }
+    }
+}
+
+
+void QuantizedMatrix::convert_half(const Eigen::Ref<const Eigen::MatrixXf>& W){
+    half_.assign(static_cast<std::size_t>(out_features_) * stride_, 0);
+    std::vector<float> column(in_features_);
+    for (int o = 0; o < out_features_; ++o){
+        uint16_t* row = half_.data() + static_cast<std::size_t>(o) * stride_;
+        if (format_ == WeightFormat::BF16){
+            Eigen::Map<Eigen::VectorXf>(column.data(), in_features_) = W.col(o);
+            float_to_bf16(column.data(), row, in_features_);
+        } else {
+            for (int k = 0; k < in_features_; ++k){
+                row[k] = float_to_fp16(W(k, o));
+            }
+        }
+    }
+}
+
+
+void QuantizedMatrix::reserve_thread() const{
+    token_block_workspace().reset(Workspace::floats(kTokenBlock, stride_));
+}
+
+
+void QuantizedMatrix::matmul(const Eigen::Ref<const Eigen::MatrixXf>& x, Eigen::Ref<Eigen::MatrixXf> y,
+                             int col_offset, int cols) const{
+    matmul(x, y, col_offset, cols, simd_level());
+}
+
+
+void QuantizedMatrix::matmul(const Eigen::Ref<const Eigen::MatrixXf>& x, Eigen::Ref<Eigen::MatrixXf> y,
+                             int col_offset, int cols, SimdLevel level) const{
+    if (cols < 0){
+        cols = out_features_ - col_offset;
+    }
+    if (col_offset < 0 || col_offset + cols > out_features_){
+        throw std::out_of_range("QuantizedMatrix column range out of bounds");
+    }
+    if (x.cols() != in_features_ || y.rows() != x.rows() || y.cols() != cols){
+        throw std::invalid_argument("QuantizedMatrix::matmul shapes do not match");
+    }
+    const KernelTable& kernels = kernels_for(format_, level);
+
+    // Gather each block of token rows into contiguous zero-padded rows, drawn from the
+    // calling thread's workspace so steady-state calls do not allocate
+    Workspace& workspace = token_block_workspace();
+    workspace.reset(Workspace::floats(kTokenBlock, stride_));
+    auto block = workspace.take<Eigen::VectorXf>(static_cast<Eigen::Index>(kTokenBlock) * stride_);
+    block.setZero();
+    const std::size_t groups_per_channel = stride_ / kGroupSize;
+    PackedWeights weights{};
+    weights.stride = stride_;
+    if (format_ == WeightFormat::INT8){
+        weights.int8 = int8_.data() + static_cast<std::size_t>(col_offset) * stride_;
+        weights.scales = scales_.data() + col_offset;
+    } else if (format_ == WeightFormat::FP16 || format_ == WeightFormat::BF16){
+        weights.half = half_.data() + static_cast<std::size_t>(col_offset) * stride_;
+    } else {
+        weights.q4 = q4_.data() + static_cast<std::size_t>(col_offset) * stride_ / 2;
+        weights.group_scales = group_scales_.data() + col_offset * groups_per_channel;
+        weights.group_zeros = group_zeros_.data() + col_offset * groups_per_channel;
+    }
+
+    const int seq_len = static_cast<int>(x.rows());
+    for (int t0 = 0; t0 < seq_len; t0 += kTokenBlock){
+        int tokens = std::min(kTokenBlock, seq_len - t0);
+        for (int t = 0; t < tokens; ++t){
+            Eigen::Map<Eigen::RowVectorXf>(block.data() + static_cast<std::size_t>(t) * stride_, in_features_) = x.row(t0 + t);
+        }
+        kernels[tokens - 1](block.data(), weights, cols, y.data() + t0, static_cast<int>(y.outerStride()));
+    }
+}
+
+
+Eigen::MatrixXf QuantizedMatrix::dequantize() const{
+    Eigen::MatrixXf W(in_features_, out_features_);
+    for (int o = 0; o < out_features_; ++o){
+        dequantize_channel(o, W.col(o).data());
+    }
+    return W;
+}
+
+
+void QuantizedMatrix::dequantize_channel(int channel, float* out) const{
+    const std::size_t base = static_cast<std::size_t>(channel) * stride_;
+    if (format_ == WeightFormat::INT8){
+        const int8_t* row = int8_.data() + base;
+        const float scale = scales_[channel];
+        for (int k = 0; k < in_features_; ++k){
+            out[k] = scale * static_cast<float>(row[k]);
+        }
+        return;
+    }
+    if (format_ == WeightFormat::BF16){
+        bf16_to_float(half_.data() + base, out, in_features_);
+        return;
+    }
+    if (format_ == WeightFormat::FP16){
+        const uint16_t* row = half_.data() + base;
+        for (int k = 0; k < in_features_; ++k){
+            out[k] = fp16_to_float(row[k]);
+        }
+        return;
+    }
+
+    const std::size_t first_group = base / kGroupSize;
+    for (int k = 0; k < in_features_; ++k){
+        const std::size_t group = first_group + k / kGroupSize;
+        const int i = k % kGroupSize;
+        uint8_t byte = q4_[group * kGroupSize / 2 + i % (kGroupSize / 2)];
+        int code = i < kGroupSize / 2 ? (byte & 0xF) : (byte >> 4);
+        out[k] = fp16_to_float(group_scales_[group]) * static_cast<float>(code - group_zeros_[group]);
+    }
+}
+
+
+const void* QuantizedMatrix::channel_data(int channel) const{
+    const std::size_t base = static_cast<std::size_t>(channel) * stride_;
+    switch (format_){
+        case WeightFormat::INT8:
+            return int8_.data() + base;
+        case WeightFormat::FP16:
+        case WeightFormat::BF16:
+            return half_.data() + base;
+        default:
+            return q4_.data() + base / 2;
+    }
+}
+
+
+std::size_t QuantizedMatrix::channel_bytes() const{
+    switch (format_){
+        case WeightFormat::INT8:
+            return stride_;
+        case WeightFormat::FP16:
+        case WeightFormat::BF16:
+            return stride_ * sizeof(uint16_t);
+        default:
+            return stride_ / 2;
+    }
+}
+
+
+std::size_t QuantizedMatrix::bytes() const{
+    return int8_.size() * sizeof(int8_t) + scales_.size() * sizeof(float)
+        + q4_.size() * sizeof(uint8_t) + group_scales_.size() * sizeof(uint16_t)
+        + group_zeros_.size() * sizeof(uint8_t) + half_.size() * sizeof(uint16_t);
+}
+
+} // namespace transformer
@@ -0,0 +1,230 @@
+#include "scheduler.hpp"
+#include "thread_pool.hpp"
+#include <algorithm>
+#include <stdexcept>
+
+namespace transformer {
+
+namespace {
+
+double elapsed_ms(std::chrono::steady_clock::time_point since){
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - since).count();
+}
+
+// Slice of one sequence's tokens scheduled in the current step
+struct WorkItem {
+    int seq;   // Index into running_
+    int start; // First token position
+    int count;
+};
+
+} // namespace
+
+
+InferenceScheduler::InferenceScheduler(TokenEmbedding& embedding, PositionalEncoding& positions,
+                                       MultiHeadAttention& attention, FeedForward& feed_forward,
+                                       LayerNorm& norm, const SchedulerConfig& config)
+    : embedding_(embedding),
+      positions_(positions),
+      attention_(attention),
+      feed_forward_(feed_forward),
+      norm_(norm),
+      config_(config),
+      cache_(attention.get_d_model(), config.page_size, config.num_pages, config.kv_storage){
+    if (config.max_batch_tokens <= 0 || config.max_prefill_tokens <= 0 || config.max_running <= 0){
+        throw std::invalid_argument("Scheduler token budgets and max_running must be positive");
+    }
+    if (embedding.get_embedding_dim() != attention.get_d_model()){
+        throw std::invalid_argument("Embedding width must match the attention layer");
+    }
+}
+
+
+int InferenceScheduler::submit(const std::vector<int>& prompt, int max_new_tokens){
+    return submit(prompt, max_new_tokens, Clock::now());
+}
+
+
+int InferenceScheduler::submit(const std::vector<int>& prompt, int max_new_tokens, Clock::time_point arrival){
+    if (prompt.empty() || max_new_tokens <= 0){
+        throw std::invalid_argument("Request needs a non-empty prompt and max_new_tokens > 0");
+    }
+    int vocab_size = embedding_.get_vocab_size();
+    for (int token : prompt){
+        if (token < 0 || token >= vocab_size){
+            throw std::out_of_range("Token index out of range");
+        }
+    }
+    int total = static_cast<int>(prompt.size()) + max_new_tokens;
+    if (total > positions_.get_max_seq_len()){
+        throw std::invalid_argument("Prompt plus max_new_tokens exceeds the maximum sequence length");
+    }
+    if (pages_for(total) > config_.num_pages){
+        throw std::invalid_argument("Request does not fit in the KV cache");
+    }
+
+    Sequence seq;
+    seq.id = next_id_++;
+    seq.tokens = prompt;
+    seq.tokens.reserve(total);
+    seq.prompt_len = static_cast<int>(prompt.size());
+    seq.max_new_tokens = max_new_tokens;
+    seq.arrival = arrival;
+    waiting_.push_back(std::move(seq));
+    return waiting_.back().id;
+}
+
+
+bool InferenceScheduler::admit_next(){
+    if (waiting_.empty() || num_running() >= config_.max_running){
+        return false;
+    }
+    //Reserve pages for the whole generation up front so a running sequence never runs out mid-decode
+    Sequence& next = waiting_.front();
+    int pages = pages_for(next.prompt_len + next.max_new_tokens);
+    if (reserved_pages_ + pages > config_.num_pages){
+        return false;
+    }
+    next.reserved_pages = pages;
+    next.cache_seq = cache_.create_sequence();
+    reserved_pages_ += pages;
+    running_.push_back(std::move(next));
+    waiting_.pop_front();
+    return true;
+}
+
+
+int InferenceScheduler::step(){
+    std::vector<WorkItem> work;
+    int budget = config_.max_batch_tokens;
+
+    //Decode phase: one token for every sequence that has finished its prompt
+    for (int i = 0; i < num_running() && budget > 0; ++i){
+        const Sequence& seq = running_[i];
+        if (seq.processed >= seq.prompt_len){
+            work.push_back({i, seq.processed, 1});
+            --budget;
+        }
+    }
+
+    //Prefill phase: continue chunked prompts first, then admit new requests into what is left
+    int prefill_budget = std::min(budget, config_.max_prefill_tokens);
+    for (int i = 0; i < num_running() && prefill_budget > 0; ++i){
+        const Sequence& seq = running_[i];
+        if (seq.processed < seq.prompt_len){
+            int count = std::min(seq.prompt_len - seq.processed, prefill_budget);
+            work.push_back({i, seq.processed, count});
+            prefill_budget -= count;
+        }
+    }
+    //Continuous batching admits while this step has prefill budget left. Static batching
+    //fills the whole batch (up to max_running) once the previous one has drained; prompts
+    //past this step's budget are prefilled in chunks over the next steps
+    bool may_admit = config_.continuous_batching || running_.empty();
+    bool fill_batch = !config_.continuous_batching;
+    while (may_admit && (prefill_budget > 0 || fill_batch) && admit_next()){
+        int count = std::min(running_.back().prompt_len, prefill_budget);
+        if (count > 0){
+            work.push_back({num_running() - 1, 0, count});
+            prefill_budget -= count;
+        }
+    }
+
+    if (work.empty()){
+        return 0;
+    }
+
+    //Pack every scheduled token into one batch
+    std::vector<int> ids;
+    RaggedBatch batch;
+    batch.offsets.reserve(work.size() + 1);
+    batch.offsets.push_back(0);
+    std::vector<int> cache_seqs;
+    cache_seqs.reserve(work.size());
+    for (const auto& item : work){
+        const Sequence& seq = running_[item.seq];
+        ids.insert(ids.end(), seq.tokens.begin() + item.start, seq.tokens.begin() + item.start + item.count);
+        batch.offsets.push_back(batch.offsets.back() + item.count);
+        cache_seqs.push_back(seq.cache_seq);
+    }
+
+    batch.tokens = embedding_.forward(ids);
+    for (size_t i = 0; i < work.size(); ++i){
+        positions_.add_into(batch.tokens.middleRows(batch.offsets[i], work[i].count), work[i].start);
+    }
+
+    int total = batch.total_tokens();
+    Eigen::MatrixXf hidden = batch.tokens;
+    hidden += attention_.forward_incremental_batch(batch, cache_, cache_seqs).tokens;
+    Eigen::MatrixXf ff_hidden(std::min(total, feed_forward_.rows_per_block() * get_num_threads()), feed_forward_.get_hidden_width());
+    Eigen::MatrixXf output(total, hidden.cols());
+    feed_forward_.infer(hidden, output, ff_hidden);
+    norm_.add_infer(output, hidden, output);
+
+    //Sequences whose last scheduled token is their newest token produce the next one
+    std::vector<int> sampled;
+    for (size_t i = 0; i < work.size(); ++i){
+        Sequence& seq = running_[work[i].seq];
+        seq.processed += work[i].count;
+        if (seq.processed == static_cast<int>(seq.tokens.size())){
+            sampled.push_back(static_cast<int>(i));
+        }
+    }
+
+    if (!sampled.empty()){
+        Eigen::MatrixXf last(sampled.size(), output.cols());
+        for (size_t j = 0; j < sampled.size(); ++j){
+            last.row(j) = output.row(batch.offsets[sampled[j] + 1] - 1);
+        }
+        Eigen::MatrixXf logits(last.rows(), embedding_.get_vocab_size());
+        embedding_.project_into(last, logits);
+
+        for (size_t j = 0; j < sampled.size(); ++j){
+            Sequence& seq = running_[work[sampled[j]].seq];
+            Eigen::Index token;
+            logits.row(j).maxCoeff(&token);
+            seq.tokens.push_back(static_cast<int>(token));
+            if (seq.time_to_first_token_ms < 0.0){
+                seq.time_to_first_token_ms = elapsed_ms(seq.arrival);
+            }
+        }
+    }
+
+    //Retire finished sequences so their pages are free for the next step's admissions
+    auto finished = [this](const Sequence& seq){
+        int generated = static_cast<int>(seq.tokens.size()) - seq.prompt_len;
+        return generated >= seq.max_new_tokens ||
+               (generated > 0 && seq.tokens.back() == config_.eos_token);
+    };
+    for (auto& seq : running_){
+        if (finished(seq)){
+            cache_.free_sequence(seq.cache_seq);
+            reserved_pages_ -= seq.reserved_pages;
+            completed_.push_back({seq.id,
+                                  std::vector<int>(seq.tokens.begin() + seq.prompt_len, seq.tokens.end()),
+                                  seq.time_to_first_token_ms,
+                                  elapsed_ms(seq.arrival)});
+        }
+    }
+    running_.erase(std::remove_if(running_.begin(), running_.end(), finished), running_.end());
+
+    return total;
+}
+
+
+void InferenceScheduler::run_until_idle(){
+    while (!idle()){
+        if (step() == 0){
+            throw std::runtime_error("Scheduler cannot make progress with the current limits");
+        }
+    }
+}
+
+
+std::vector<CompletedRequest> InferenceScheduler::take_completed(){
+    std::vector<CompletedRequest> done;
+    done.swap(completed_);
+    return done;
+}
+
+} // namespace transformer
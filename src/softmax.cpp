@@ -0,0 +1,317 @@
+#include "softmax.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define TRANSFORMER_X86_KERNELS 1
+#endif
+
+namespace transformer {
+
+namespace {
+
+// Range limits and Cephes expf coefficients shared by every implementation
+constexpr float kExpLo = -87.0f;
+constexpr float kExpHi = 88.0f;
+constexpr float kLog2e = 1.44269504088896341f;
+constexpr float kLn2Hi = 0.693359375f;
+constexpr float kLn2Lo = -2.12194440e-4f;
+constexpr float kP0 = 1.9875691500e-4f;
+constexpr float kP1 = 1.3981999507e-3f;
+constexpr float kP2 = 8.3334519073e-3f;
+constexpr float kP3 = 4.1665795894e-2f;
+constexpr float kP4 = 1.6666665459e-1f;
+constexpr float kP5 = 5.0000001201e-1f;
+
+
+// Scalar implementations, also used for the tails of the vector loops
+
+float exp_scalar(float x){
+    if (!(x >= kExpLo)){
+        return std::isnan(x) ? x : 0.0f;
+    }
+    x = std::min(x, kExpHi);
+
+    float fx = std::nearbyint(x * kLog2e);
+    float r = x - fx * kLn2Hi - fx * kLn2Lo;
+
+    float p = kP0;
+    p = p * r + kP1;
+    p = p * r + kP2;
+    p = p * r + kP3;
+    p = p * r + kP4;
+    p = p * r + kP5;
+    float y = p * r * r + r + 1.0f;
+
+    int32_t bits = (static_cast<int32_t>(fx) + 127) << 23;
+    float pow2n;
+    std::memcpy(&pow2n, &bits, sizeof(pow2n));
+    return y * pow2n;
+}
+
+float max_scalar(const float* x, int n){
+    float m = -std::numeric_limits<float>::infinity();
+    for (int i = 0; i < n; ++i){
+        m = std::max(m, x[i]);
+    }
+    return m;
+}
+
+float exp_shift_sum_scalar(float* x, int n, float shift, float scale){
+    float sum = 0.0f;
+    for (int i = 0; i < n; ++i){
+        x[i] = exp_scalar((x[i] - shift) * scale);
+        sum += x[i];
+    }
+    return sum;
+}
+
+void scale_scalar(float* x, int n, float factor){
+    for (int i = 0; i < n; ++i){
+        x[i] *= factor;
+    }
+}
+
+
+#ifdef TRANSFORMER_X86_KERNELS
+
+// AVX2 + FMA
+
+__attribute__((target("avx2,fma")))
+inline __m256 exp_avx2(__m256 x){
+    const __m256 lo = _mm256_set1_ps(kExpLo);
+    __m256 underflow = _mm256_cmp_ps(x, lo, _CMP_LT_OQ);
+    x = _mm256_max_ps(_mm256_min_ps(x, _mm256_set1_ps(kExpHi)), lo);
+
+    __m256 fx = _mm256_round_ps(_mm256_mul_ps(x, _mm256_set1_ps(kLog2e)),
+                                _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    __m256 r = _mm256_fnmadd_ps(fx, _mm256_set1_ps(kLn2Hi), x);
+    r = _mm256_fnmadd_ps(fx, _mm256_set1_ps(kLn2Lo), r);
+
+    __m256 p = _mm256_set1_ps(kP0);
+    p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(kP1));
+    p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(kP2));
+    p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(kP3));
+    p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(kP4));
+    p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(kP5));
+    __m256 y = _mm256_fmadd_ps(_mm256_mul_ps(p, r), r, _mm256_add_ps(r, _mm256_set1_ps(1.0f)));
+
+    __m256i bits = _mm256_slli_epi32(_mm256_add_epi32(_mm256_cvtps_epi32(fx), _mm256_set1_epi32(127)), 23);
+    y = _mm256_mul_ps(y, _mm256_castsi256_ps(bits));
+    return _mm256_andnot_ps(underflow, y);
+}
+
+__attribute__((target("avx2,fma")))
+inline float hmax_avx2(__m256 v){
+    __m128 m = _mm_max_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    m = _mm_max_ps(m, _mm_movehl_ps(m, m));
+    m = _mm_max_ss(m, _mm_shuffle_ps(m, m, 1));
+    return _mm_cvtss_f32(m);
+}
+
+__attribute__((target("avx2,fma")))
+inline float hsum_avx2(__m256 v){
+    __m128 s = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+    s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+    return _mm_cvtss_f32(s);
+}
+
+__attribute__((target("avx2,fma")))
+float max_avx2(const float* x, int n){
+    __m256 m = _mm256_set1_ps(-std::numeric_limits<float>::infinity());
+    int i = 0;
+    for (; i + 8 <= n; i += 8){
+        m = _mm256_max_ps(m, _mm256_loadu_ps(x + i));
+    }
+    return std::max(hmax_avx2(m), max_scalar(x + i, n - i));
+}
+
+__attribute__((target("avx2,fma")))
+float exp_shift_sum_avx2(float* x, int n, float shift, float scale){
+    const __m256 vshift = _mm256_set1_ps(shift);
+    const __m256 vscale = _mm256_set1_ps(scale);
+    __m256 sum = _mm256_setzero_ps();
+    int i = 0;
+    for (; i + 8 <= n; i += 8){
+        __m256 e = exp_avx2(_mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(x + i), vshift), vscale));
+        _mm256_storeu_ps(x + i, e);
+        sum = _mm256_add_ps(sum, e);
+    }
+    return hsum_avx2(sum) + exp_shift_sum_scalar(x + i, n - i, shift, scale);
+}
+
+__attribute__((target("avx2,fma")))
+void scale_avx2(float* x, int n, float factor){
+    const __m256 f = _mm256_set1_ps(factor);
+    int i = 0;
+    for (; i + 8 <= n; i += 8){
+        _mm256_storeu_ps(x + i, _mm256_mul_ps(_mm256_loadu_ps(x + i), f));
+    }
+    scale_scalar(x + i, n - i, factor);
+}
+
+
+// AVX-512F, tails handled with masked loads and stores
+
+__attribute__((target("avx512f")))
+inline __m512 exp_avx512(__m512 x){
+    const __m512 lo = _mm512_set1_ps(kExpLo);
+    __mmask16 keep = _mm512_cmp_ps_mask(x, lo, _CMP_GE_OQ);
+    x = _mm512_max_ps(_mm512_min_ps(x, _mm512_set1_ps(kExpHi)), lo);
+
+    __m512 fx = _mm512_roundscale_ps(_mm512_mul_ps(x, _mm512_set1_ps(kLog2e)),
+                                     _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    __m512 r = _mm512_fnmadd_ps(fx, _mm512_set1_ps(kLn2Hi), x);
+    r = _mm512_fnmadd_ps(fx, _mm512_set1_ps(kLn2Lo), r);
+
+    __m512 p = _mm512_set1_ps(kP0);
+    p = _mm512_fmadd_ps(p, r, _mm512_set1_ps(kP1));
+    p = _mm512_fmadd_ps(p, r, _mm512_set1_ps(kP2));
+    p = _mm512_fmadd_ps(p, r, _mm512_set1_ps(kP3));
+    p = _mm512_fmadd_ps(p, r, _mm512_set1_ps(kP4));
+    p = _mm512_fmadd_ps(p, r, _mm512_set1_ps(kP5));
+    __m512 y = _mm512_fmadd_ps(_mm512_mul_ps(p, r), r, _mm512_add_ps(r, _mm512_set1_ps(1.0f)));
+
+    __m512i bits = _mm512_slli_epi32(_mm512_add_epi32(_mm512_cvtps_epi32(fx), _mm512_set1_epi32(127)), 23);
+    return _mm512_maskz_mul_ps(keep, y, _mm512_castsi512_ps(bits));
+}
+
+__attribute__((target("avx512f")))
+float max_avx512(const float* x, int n){
+    const __m512 neg_inf = _mm512_set1_ps(-std::numeric_limits<float>::infinity());
+    __m512 m = neg_inf;
+    int i = 0;
+    for (; i + 16 <= n; i += 16){
+        m = _mm512_max_ps(m, _mm512_loadu_ps(x + i));
+    }
+    if (i < n){
+        __mmask16 tail = static_cast<__mmask16>((1u << (n - i)) - 1);
+        m = _mm512_max_ps(m, _mm512_mask_loadu_ps(neg_inf, tail, x + i));
+    }
+    return _mm512_reduce_max_ps(m);
+}
+
+__attribute__((target("avx512f")))
+float exp_shift_sum_avx512(float* x, int n, float shift, float scale){
+    const __m512 vshift = _mm512_set1_ps(shift);
+    const __m512 vscale = _mm512_set1_ps(scale);
+    __m512 sum = _mm512_setzero_ps();
+    int i = 0;
+    for (; i + 16 <= n; i += 16){
+        __m512 e = exp_avx512(_mm512_mul_ps(_mm512_sub_ps(_mm512_loadu_ps(x + i), vshift), vscale));
+        _mm512_storeu_ps(x + i, e);
+        sum = _mm512_add_ps(sum, e);
+    }
+    if (i < n){
+        __mmask16 tail = static_cast<__mmask16>((1u << (n - i)) - 1);
+        __m512 v = _mm512_maskz_loadu_ps(tail, x + i);
+        __m512 e = _mm512_maskz_mov_ps(tail, exp_avx512(_mm512_mul_ps(_mm512_sub_ps(v, vshift), vscale)));
+        _mm512_mask_storeu_ps(x + i, tail, e);
+        sum = _mm512_add_ps(sum, e);
+    }
+    return _mm512_reduce_add_ps(sum);
+}
+
+__attribute__((target("avx512f")))
+void scale_avx512(float* x, int n, float factor){
+    const __m512 f = _mm512_set1_ps(factor);
+    int i = 0;
+    for (; i + 16 <= n; i += 16){
+        _mm512_storeu_ps(x + i, _mm512_mul_ps(_mm512_loadu_ps(x + i), f));
+    }
+    if (i < n){
+        __mmask16 tail = static_cast<__mmask16>((1u << (n - i)) - 1);
+        _mm512_mask_storeu_ps(x + i, tail, _mm512_mul_ps(_mm512_maskz_loadu_ps(tail, x + i), f));
+    }
+}
+
+#endif // TRANSFORMER_X86_KERNELS
+
+
+struct SoftmaxKernels {
+    float (*max)(const float*, int);
+    float (*exp_shift_sum)(float*, int, float, float);
+    void (*scale)(float*, int, float);
+};
+
+const SoftmaxKernels& kernels_for(SimdLevel level){
+    static const SoftmaxKernels scalar{max_scalar, exp_shift_sum_scalar, scale_scalar};
+#ifdef TRANSFORMER_X86_KERNELS
+    static const SoftmaxKernels avx2{max_avx2, exp_shift_sum_avx2, scale_avx2};
+    static const SoftmaxKernels avx512{max_avx512, exp_shift_sum_avx512, scale_avx512};
+#endif
+
+    if (!simd_level_supported(level)){
+        throw std::invalid_argument("SIMD level not supported by this CPU");
+    }
+    switch (level){
+#ifdef TRANSFORMER_X86_KERNELS
+        case SimdLevel::AVX2:
+            return avx2;
+        case SimdLevel::AVX512:
+            return avx512;
+#endif
+        default:
+            return scalar;
+    }
+}
+
+const SoftmaxKernels& detected_kernels(){
+    static const SoftmaxKernels& kernels = kernels_for(simd_level());
+    return kernels;
+}
+
+void softmax_with(const SoftmaxKernels& kernels, float* x, int n, float scale){
+    float max_val = kernels.max(x, n);
+    if (max_val == -std::numeric_limits<float>::infinity()){
+        std::fill(x, x + n, 0.0f);
+        return;
+    }
+    float sum = kernels.exp_shift_sum(x, n, max_val, scale);
+    kernels.scale(x, n, 1.0f / sum);
+}
+
+} // namespace
+
+
+float fast_exp(float x){
+    return exp_scalar(x);
+}
+
+
+float max_value(const float* x, int n){
+    return detected_kernels().max(x, n);
+}
+
+
+float max_value(const float* x, int n, SimdLevel level){
+    return kernels_for(level).max(x, n);
+}
+
+
+float exp_shift_sum(float* x, int n, float shift, float scale){
+    return detected_kernels().exp_shift_sum(x, n, shift, scale);
+}
+
+
+float exp_shift_sum(float* x, int n, float shift, float scale, SimdLevel level){
+    return kernels_for(level).exp_shift_sum(x, n, shift, scale);
+}
+
+
+void softmax_inplace(float* x, int n, float scale){
+    softmax_with(detected_kernels(), x, n, scale);
+}
+
+
+void softmax_inplace(float* x, int n, float scale, SimdLevel level){
+    softmax_with(kernels_for(level), x, n, scale);
+}
+
+} // namespace transformer
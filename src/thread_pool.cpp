@@ -0,0 +1,486 @@
+#include "thread_pool.hpp"
+#include <Eigen/Core>
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdint>
+#include <dirent.h>
+#include <exception>
+#include <fstream>
+#include <sched.h>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <pthread.h>
+
+namespace transformer {
+
+namespace {
+
+thread_local bool t_in_parallel_region = false;
+
+// Sleeping threads wake at least this often to re-check their condition
+constexpr std::chrono::milliseconds kWaitSlice(100);
+
+// Sets the region flag for the current thread and restores it on exit
+class RegionGuard {
+    private:
+        bool previous_;
+
+    public:
+        RegionGuard() : previous_(t_in_parallel_region) {t_in_parallel_region = true;}
+        ~RegionGuard() {t_in_parallel_region = previous_;}
+};
+
+// A thread's share of the iteration space, packed as [begin, end) offsets in one word
+// so the owner and thieves can both move its bounds with a single compare-and-swap
+struct alignas(64) SlotRange {
+    std::atomic<uint64_t> bounds;
+};
+
+uint64_t pack(uint32_t begin, uint32_t end){
+    return static_cast<uint64_t>(end) << 32 | begin;
+}
+
+uint32_t range_begin(uint64_t bounds) {return static_cast<uint32_t>(bounds);}
+uint32_t range_end(uint64_t bounds) {return static_cast<uint32_t>(bounds >> 32);}
+
+// Per-caller slot ranges, grown once and reused so a parallel_for does not allocate
+SlotRange* slot_ranges(int slots){
+    thread_local std::unique_ptr<SlotRange[]> ranges;
+    thread_local int capacity = 0;
+    if (capacity < slots){
+        ranges.reset(new SlotRange[slots]);
+        capacity = slots;
+    }
+    return ranges.get();
+}
+
+// "0-3,8-11" -> {0, 1, 2, 3, 8, 9, 10, 11}
+std::vector<int> parse_cpu_list(const std::string& list){
+    std::vector<int> cpus;
+    std::stringstream stream(list);
+    std::string part;
+    while (std::getline(stream, part, ',')){
+        if (part.empty() || part == "\n"){
+            continue;
+        }
+        std::size_t dash = part.find('-');
+        int first = std::stoi(part.substr(0, dash));
+        int last = dash == std::string::npos ? first : std::stoi(part.substr(dash + 1));
+        for (int cpu = first; cpu <= last; ++cpu){
+            cpus.push_back(cpu);
+        }
+    }
+    return cpus;
+}
+
+std::vector<int> allowed_cpus(){
+    std::vector<int> cpus;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) == 0){
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu){
+            if (CPU_ISSET(cpu, &set)){
+                cpus.push_back(cpu);
+            }
+        }
+    }
+    return cpus;
+}
+
+/**
+ * @brief Usable cores ordered NUMA node by node
+ * Consecutive workers land on the same node, so a pool smaller than the machine stays
+ * on one node's memory controller and L3. Without NUMA information the order is the
+ * affinity mask's.
+ */
+std::vector<int> numa_cpu_order(){
+    std::vector<int> allowed = allowed_cpus();
+    std::vector<int> nodes;
+    if (DIR* dir = opendir("/sys/devices/system/node")){
+        while (dirent* entry = readdir(dir)){
+            std::string name = entry->d_name;
+            if (name.size() > 4 && name.compare(0, 4, "node") == 0 &&
+                std::all_of(name.begin() + 4, name.end(), ::isdigit)){
+                nodes.push_back(std::stoi(name.substr(4)));
+            }
+        }
+        closedir(dir);
+    }
+    std::sort(nodes.begin(), nodes.end());
+
+    std::vector<int> order;
+    for (int node : nodes){
+        std::ifstream file("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+        std::string list;
+        std::getline(file, list);
+        for (int cpu : parse_cpu_list(list)){
+            bool usable = std::find(allowed.begin(), allowed.end(), cpu) != allowed.end();
+            if (usable && std::find(order.begin(), order.end(), cpu) == order.end()){
+                order.push_back(cpu);
+            }
+        }
+    }
+    for (int cpu : allowed){
+        if (std::find(order.begin(), order.end(), cpu) == order.end()){
+            order.push_back(cpu);
+        }
+    }
+    return order;
+}
+
+int default_thread_count(){
+    int cpus = static_cast<int>(allowed_cpus().size());
+    if (cpus == 0){
+        cpus = static_cast<int>(std::thread::hardware_concurrency());
+    }
+    return std::max(cpus, 1);
+}
+
+} // namespace
+
+
+struct ThreadPool::Job {
+    void* callable;
+    ChunkFn call;
+    int begin;
+    uint32_t grain;
+    int slots;
+    SlotRange* ranges;
+    bool each_thread = false;       // One call per slot on distinct threads (for_each_thread)
+    std::atomic<int> arrived{0};    // Slots done with their call, when each_thread
+
+    int next_slot = 1;              // Guarded by the pool mutex; slot 0 is the caller
+    std::atomic<int> remaining{0};  // Indices not finished yet
+    std::atomic<int> active{0};     // Workers still touching the job
+
+    std::atomic<bool> failed{false};
+    std::exception_ptr error;
+    std::mutex error_mutex;
+
+    std::mutex done_mutex;
+    std::condition_variable done;
+
+    // Next chunk from the front of the slot's own range
+    bool take(int slot, uint32_t& chunk_begin, uint32_t& chunk_end){
+        std::atomic<uint64_t>& bounds = ranges[slot].bounds;
+        uint64_t current = bounds.load(std::memory_order_acquire);
+        for (;;){
+            uint32_t b = range_begin(current);
+            uint32_t e = range_end(current);
+            if (b >= e){
+                return false;
+            }
+            uint32_t next = std::min(b + grain, e);
+            if (bounds.compare_exchange_weak(current, pack(next, e), std::memory_order_acq_rel)){
+                chunk_begin = b;
+                chunk_end = next;
+                return true;
+            }
+        }
+    }
+
+    // Move the back half of the fullest other range into the slot's own (empty) range
+    bool steal(int slot){
+        for (;;){
+            int victim = -1;
+            uint64_t observed = 0;
+            uint32_t most = 0;
+            for (int i = 1; i < slots; ++i){
+                int candidate = (slot + i) % slots;
+                uint64_t bounds = ranges[candidate].bounds.load(std::memory_order_acquire);
+                uint32_t left = range_end(bounds) - std::min(range_begin(bounds), range_end(bounds));
+                if (left > most){
+                    most = left;
+                    victim = candidate;
+                    observed = bounds;
+                }
+            }
+            if (victim < 0){
+                return false;
+            }
+
+            uint32_t b = range_begin(observed);
+            uint32_t e = range_end(observed);
+            // Whole grains only, and at least one, so a thief never splits below grain
+            uint32_t chunks = (most + grain - 1) / grain;
+            uint32_t stolen = std::min(most, (chunks + 1) / 2 * grain);
+            if (ranges[victim].bounds.compare_exchange_strong(observed, pack(b, e - stolen),
+                                                              std::memory_order_acq_rel)){
+                ranges[slot].bounds.store(pack(e - stolen, e), std::memory_order_release);
+                return true;
+            }
+        }
+    }
+
+    void execute(uint32_t chunk_begin, uint32_t chunk_end, int slot){
+        if (!failed.load(std::memory_order_relaxed)){
+            try {
+                call(callable, begin + static_cast<int>(chunk_begin), begin + static_cast<int>(chunk_end), slot);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(error_mutex);
+                if (!error){
+                    error = std::current_exception();
+                }
+                failed.store(true, std::memory_order_relaxed);
+            }
+        }
+        int count = static_cast<int>(chunk_end - chunk_begin);
+        if (remaining.fetch_sub(count, std::memory_order_acq_rel) == count){
+            std::lock_guard<std::mutex> lock(done_mutex);
+            done.notify_all();
+        }
+    }
+
+    void participate(int slot){
+        RegionGuard region;
+        if (each_thread){
+            execute(static_cast<uint32_t>(slot), static_cast<uint32_t>(slot) + 1, slot);
+            // Stay busy until every slot has run, so this thread cannot pick up another one
+            arrived.fetch_add(1, std::memory_order_acq_rel);
+            while (arrived.load(std::memory_order_acquire) < slots){
+                std::this_thread::yield();
+            }
+            return;
+        }
+        uint32_t chunk_begin, chunk_end;
+        do {
+            while (take(slot, chunk_begin, chunk_end)){
+                execute(chunk_begin, chunk_end, slot);
+            }
+        } while (steal(slot));
+    }
+};
+
+
+ThreadPool::ThreadPool(const ThreadPoolOptions& options){
+    if (options.num_threads < 0){
+        throw std::invalid_argument("num_threads must be non-negative");
+    }
+    int threads = options.num_threads == 0 ? default_thread_count() : options.num_threads;
+
+    // The pool is the only source of parallelism; a multi-threaded Eigen GEMM inside a
+    // chunk would multiply the thread count
+    Eigen::setNbThreads(1);
+
+    std::vector<int> cpus;
+    if (options.pin_threads){
+        cpus = numa_cpu_order();
+    }
+
+    jobs_.reserve(16);
+    workers_.reserve(threads - 1);
+    for (int worker = 0; worker < threads - 1; ++worker){
+        workers_.emplace_back(&ThreadPool::worker_loop, this, worker);
+        if (!cpus.empty()){
+            // Slot 0 is the caller, so worker i gets the core after it
+            int cpu = cpus[(worker + 1) % cpus.size()];
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(cpu, &set);
+            if (pthread_setaffinity_np(workers_.back().native_handle(), sizeof(set), &set) == 0){
+                pinned_cpus_.push_back(cpu);
+            }
+        }
+    }
+    if (pinned_cpus_.size() != workers_.size()){
+        pinned_cpus_.clear();
+    }
+}
+
+
+ThreadPool::~ThreadPool(){
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    wake_.notify_all();
+    for (std::thread& worker : workers_){
+        worker.join();
+    }
+}
+
+
+bool ThreadPool::in_parallel_region(){
+    return t_in_parallel_region;
+}
+
+
+void ThreadPool::run(int begin, int end, int grain, void* callable, ChunkFn call){
+    if (end <= begin){
+        return;
+    }
+    const int count = end - begin;
+    grain = std::max(grain, 1);
+
+    const int chunks = (count + grain - 1) / grain;
+    const int slots = std::min(size(), chunks);
+    if (slots <= 1 || t_in_parallel_region){
+        RegionGuard region;
+        call(callable, begin, end, 0);
+        return;
+    }
+
+    Job job;
+    job.callable = callable;
+    job.call = call;
+    job.begin = begin;
+    job.grain = static_cast<uint32_t>(grain);
+    job.slots = slots;
+    job.ranges = slot_ranges(slots);
+    job.remaining.store(count, std::memory_order_relaxed);
+
+    // Even split in whole grains; stealing evens out whatever the split gets wrong
+    for (int slot = 0; slot < slots; ++slot){
+        uint32_t first = static_cast<uint32_t>(std::min<long long>(static_cast<long long>(chunks) * slot / slots * grain, count));
+        uint32_t last = static_cast<uint32_t>(std::min<long long>(static_cast<long long>(chunks) * (slot + 1) / slots * grain, count));
+        job.ranges[slot].bounds.store(pack(first, last), std::memory_order_relaxed);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        jobs_.push_back(&job);
+    }
+    if (slots == 2){
+        wake_.notify_one();
+    } else {
+        wake_.notify_all();
+    }
+
+    job.participate(0);
+
+    {
+        std::unique_lock<std::mutex> lock(job.done_mutex);
+        while (!job.done.wait_for(lock, kWaitSlice, [&]{return job.remaining.load(std::memory_order_acquire) == 0;})){
+        }
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = std::find(jobs_.begin(), jobs_.end(), &job);
+        if (it != jobs_.end()){
+            jobs_.erase(it);
+        }
+    }
+    // Workers that joined may still be leaving participate(); the job lives on this stack
+    while (job.active.load(std::memory_order_acquire) != 0){
+        std::this_thread::yield();
+    }
+
+    if (job.error){
+        std::rethrow_exception(job.error);
+    }
+}
+
+
+void ThreadPool::run_each(void* callable, ChunkFn call){
+    const int slots = size();
+    if (slots <= 1 || t_in_parallel_region){
+        RegionGuard region;
+        call(callable, 0, 1, 0);
+        return;
+    }
+
+    std::lock_guard<std::mutex> each_lock(each_mutex_);
+    Job job;
+    job.callable = callable;
+    job.call = call;
+    job.begin = 0;
+    job.grain = 1;
+    job.slots = slots;
+    job.ranges = nullptr;
+    job.each_thread = true;
+    job.remaining.store(slots, std::memory_order_relaxed);
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        jobs_.push_back(&job);
+    }
+    wake_.notify_all();
+
+    job.participate(0);
+
+    // Every slot has arrived, so workers only have to leave participate()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = std::find(jobs_.begin(), jobs_.end(), &job);
+        if (it != jobs_.end()){
+            jobs_.erase(it);
+        }
+    }
+    while (job.active.load(std::memory_order_acquire) != 0){
+        std::this_thread::yield();
+    }
+
+    if (job.error){
+        std::rethrow_exception(job.error);
+    }
+}
+
+
+void ThreadPool::worker_loop(int /*worker*/){
+    for (;;){
+        Job* job = nullptr;
+        int slot = 0;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            while (!wake_.wait_for(lock, kWaitSlice, [&]{return stop_ || !jobs_.empty();})){
+            }
+            if (stop_){
+                return;
+            }
+            job = jobs_.front();
+            slot = job->next_slot++;
+            if (job->next_slot >= job->slots){
+                jobs_.erase(jobs_.begin());
+            }
+            job->active.fetch_add(1, std::memory_order_relaxed);
+        }
+        job->participate(slot);
+        job->active.fetch_sub(1, std::memory_order_release);
+    }
+}
+
+
+namespace {
+
+std::mutex g_pool_mutex;
+std::atomic<ThreadPool*> g_pool{nullptr};
+
+} // namespace
+
+
+ThreadPool& thread_pool(){
+    ThreadPool* pool = g_pool.load(std::memory_order_acquire);
+    if (pool){
+        return *pool;
+    }
+    std::lock_guard<std::mutex> lock(g_pool_mutex);
+    pool = g_pool.load(std::memory_order_relaxed);
+    if (!pool){
+        pool = new ThreadPool();
+        g_pool.store(pool, std::memory_order_release);
+    }
+    return *pool;
+}
+
+
+void set_thread_pool_options(const ThreadPoolOptions& options){
+    std::lock_guard<std::mutex> lock(g_pool_mutex);
+    ThreadPool* replacement = new ThreadPool(options);
+    delete g_pool.exchange(replacement, std::memory_order_acq_rel);
+}
+
+
+void set_num_threads(int num_threads){
+    ThreadPoolOptions options;
+    options.num_threads = num_threads;
+    set_thread_pool_options(options);
+}
+
+
+int get_num_threads(){
+    return thread_pool().size();
+}
+
+} // namespace transformer
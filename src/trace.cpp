@@ -0,0 +1,391 @@
+#include "trace.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+
+namespace transformer {
+
+namespace {
+
+// Counters are written only by their owning thread, so a plain load and store is enough;
+// the atomics just let an exporter read them while that thread keeps recording
+void bump(std::atomic<uint64_t>& counter, uint64_t delta){
+    counter.store(counter.load(std::memory_order_relaxed) + delta, std::memory_order_relaxed);
+}
+
+struct StageCounters {
+    std::atomic<uint64_t> count{0};
+    std::atomic<uint64_t> total_ns{0};
+    std::atomic<uint64_t> max_ns{0};
+    std::array<std::atomic<uint64_t>, LatencyHistogram::kBuckets> buckets{};
+};
+
+// One recorded interval, the stage packed into the low bits of the duration. sequence is
+// the event's index + 1 once written and kWriting while the owner rewrites the slot, so an
+// exporter can tell a complete event from one being overwritten under it
+struct TraceEvent {
+    static constexpr uint64_t kWriting = 0;
+    std::atomic<uint64_t> sequence{kWriting};
+    std::atomic<uint64_t> start_ns{0};
+    std::atomic<uint64_t> duration_stage{0};
+};
+
+constexpr int kStageBits = 8;
+static_assert(kMaxTraceStages <= 1 << kStageBits, "Stage ids must fit in the event's stage bits");
+
+// Everything one thread has recorded. Only the owner writes. A thread's log goes back to
+// the registry's free list when the thread exits and the next new thread takes it over,
+// so memory follows the number of live threads and exited threads' intervals still
+// reach the exports
+struct ThreadLog {
+    int id;
+    std::array<std::atomic<StageCounters*>, kMaxTraceStages> stages{};
+    std::unique_ptr<TraceEvent[]> events{new TraceEvent[kTraceEventsPerThread]};
+    std::atomic<uint64_t> events_written{0};
+
+    explicit ThreadLog(int thread_id) : id(thread_id) {}
+    ~ThreadLog(){
+        for (auto& stage : stages){
+            delete stage.load();
+        }
+    }
+
+    StageCounters& counters(int stage){
+        StageCounters* counters = stages[stage].load(std::memory_order_relaxed);
+        if (!counters){
+            counters = new StageCounters();
+            stages[stage].store(counters, std::memory_order_release);
+        }
+        return *counters;
+    }
+};
+
+struct Registry {
+    std::mutex mutex;
+    std::array<const char*, kMaxTraceStages> names{};
+    std::atomic<int> num_stages{0};
+    std::vector<std::unique_ptr<ThreadLog>> threads;
+    std::vector<ThreadLog*> free_logs; // Logs of exited threads, ready for reuse
+    uint64_t epoch_ns = trace_now_ns();
+};
+
+// Never destroyed, so threads still recording during static destruction stay safe
+Registry& registry(){
+    static Registry* instance = new Registry();
+    return *instance;
+}
+
+// The calling thread's hold on a log, handed back to the free list at thread exit
+class LogLease {
+    private:
+        ThreadLog* log_ = nullptr;
+
+    public:
+        ~LogLease(){
+            if (log_){
+                Registry& reg = registry();
+                std::lock_guard<std::mutex> lock(reg.mutex);
+                reg.free_logs.push_back(log_);
+            }
+        }
+
+        ThreadLog& get(){
+            if (!log_){
+                Registry& reg = registry();
+                std::lock_guard<std::mutex> lock(reg.mutex);
+                if (!reg.free_logs.empty()){
+                    log_ = reg.free_logs.back();
+                    reg.free_logs.pop_back();
+                } else {
+                    reg.threads.push_back(std::make_unique<ThreadLog>(static_cast<int>(reg.threads.size())));
+                    log_ = reg.threads.back().get();
+                }
+            }
+            return *log_;
+        }
+};
+
+ThreadLog& local_log(){
+    thread_local LogLease lease;
+    return lease.get();
+}
+
+double to_us(uint64_t ns){
+    return static_cast<double>(ns) / 1000.0;
+}
+
+void write_json_string(std::ostream& out, const char* text){
+    out << '"';
+    for (const char* c = text; *c; ++c){
+        if (*c == '"' || *c == '\\'){
+            out << '\\';
+        }
+        out << *c;
+    }
+    out << '"';
+}
+
+} // namespace
+
+
+int LatencyHistogram::bucket_of(uint64_t ns){
+    if (ns < static_cast<uint64_t>(kSubBuckets)){
+        return static_cast<int>(ns);
+    }
+    int exponent = 63;
+    while (!(ns >> exponent)){
+        --exponent;
+    }
+    if (exponent >= kMaxExponent){
+        return kBuckets - 1;
+    }
+    int sub = static_cast<int>(ns >> (exponent - kSubBucketBits)) & (kSubBuckets - 1);
+    return (exponent - kSubBucketBits + 1) * kSubBuckets + sub;
+}
+
+
+uint64_t LatencyHistogram::bucket_lower(int bucket){
+    if (bucket < kSubBuckets){
+        return static_cast<uint64_t>(bucket);
+    }
+    int exponent = bucket / kSubBuckets + kSubBucketBits - 1;
+    uint64_t sub = static_cast<uint64_t>(bucket % kSubBuckets);
+    return (kSubBuckets + sub) << (exponent - kSubBucketBits);
+}
+
+
+uint64_t LatencyHistogram::bucket_upper(int bucket){
+    if (bucket < kSubBuckets){
+        return static_cast<uint64_t>(bucket);
+    }
+    int exponent = bucket / kSubBuckets + kSubBucketBits - 1;
+    return bucket_lower(bucket) + (uint64_t(1) << (exponent - kSubBucketBits)) - 1;
+}
+
+
+void LatencyHistogram::record(uint64_t ns){
+    ++counts_[bucket_of(ns)];
+    add_totals(1, ns, ns);
+}
+
+
+void LatencyHistogram::add_totals(uint64_t count, uint64_t total_ns, uint64_t max_ns){
+    count_ += count;
+    total_ns_ += total_ns;
+    max_ns_ = std::max(max_ns_, max_ns);
+}
+
+
+void LatencyHistogram::merge(const LatencyHistogram& other){
+    for (int b = 0; b < kBuckets; ++b){
+        counts_[b] += other.counts_[b];
+    }
+    add_totals(other.count_, other.total_ns_, other.max_ns_);
+}
+
+
+uint64_t LatencyHistogram::percentile_ns(double p) const{
+    uint64_t total = 0;
+    for (uint64_t c : counts_){
+        total += c;
+    }
+    if (total == 0){
+        return 0;
+    }
+    double rank = std::clamp(p, 0.0, 1.0) * static_cast<double>(total);
+    uint64_t target = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(rank)));
+    uint64_t seen = 0;
+    for (int b = 0; b < kBuckets; ++b){
+        seen += counts_[b];
+        if (seen >= target){
+            return std::min(bucket_upper(b), max_ns_);
+        }
+    }
+    return max_ns_;
+}
+
+
+int trace_stage_id(const char* name){
+    Registry& reg = registry();
+    std::lock_guard<std::mutex> lock(reg.mutex);
+    int count = reg.num_stages.load(std::memory_order_relaxed);
+    for (int i = 0; i < count; ++i){
+        if (std::strcmp(reg.names[i], name) == 0){
+            return i;
+        }
+    }
+    if (count == kMaxTraceStages){
+        throw std::logic_error("Too many trace stages");
+    }
+    reg.names[count] = name;
+    reg.num_stages.store(count + 1, std::memory_order_release);
+    return count;
+}
+
+
+uint64_t trace_now_ns(){
+    auto now = std::chrono::steady_clock::now().time_since_epoch();
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(now).count());
+}
+
+
+void trace_record(int stage, uint64_t start_ns, uint64_t end_ns){
+    ThreadLog& log = local_log();
+    StageCounters& counters = log.counters(stage);
+    uint64_t duration = end_ns - start_ns;
+
+    bump(counters.count, 1);
+    bump(counters.total_ns, duration);
+    bump(counters.buckets[LatencyHistogram::bucket_of(duration)], 1);
+    if (duration > counters.max_ns.load(std::memory_order_relaxed)){
+        counters.max_ns.store(duration, std::memory_order_relaxed);
+    }
+
+    // Sequence-lock write: mark the slot, fill it, then publish its index
+    uint64_t written = log.events_written.load(std::memory_order_relaxed);
+    TraceEvent& event = log.events[written % kTraceEventsPerThread];
+    event.sequence.store(TraceEvent::kWriting, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    event.start_ns.store(start_ns, std::memory_order_relaxed);
+    event.duration_stage.store(duration << kStageBits | static_cast<uint64_t>(stage), std::memory_order_relaxed);
+    event.sequence.store(written + 1, std::memory_order_release);
+    log.events_written.store(written + 1, std::memory_order_release);
+}
+
+
+std::vector<TraceStageSummary> trace_summary(){
+    Registry& reg = registry();
+    std::lock_guard<std::mutex> lock(reg.mutex);
+    int num_stages = reg.num_stages.load(std::memory_order_acquire);
+
+    std::vector<TraceStageSummary> summary(num_stages);
+    for (int s = 0; s < num_stages; ++s){
+        summary[s].name = reg.names[s];
+        for (const auto& log : reg.threads){
+            const StageCounters* counters = log->stages[s].load(std::memory_order_acquire);
+            if (!counters){
+                continue;
+            }
+            LatencyHistogram& latency = summary[s].latency;
+            for (int b = 0; b < LatencyHistogram::kBuckets; ++b){
+                latency.add_bucket(b, counters->buckets[b].load(std::memory_order_relaxed));
+            }
+            latency.add_totals(counters->count.load(std::memory_order_relaxed),
+                               counters->total_ns.load(std::memory_order_relaxed),
+                               counters->max_ns.load(std::memory_order_relaxed));
+        }
+    }
+    return summary;
+}
+
+
+void write_trace_summary(std::ostream& out){
+    std::vector<TraceStageSummary> stages = trace_summary();
+    std::stable_sort(stages.begin(), stages.end(), [](const TraceStageSummary& a, const TraceStageSummary& b){
+        return a.latency.total_ns() > b.latency.total_ns();
+    });
+
+    std::ios_base::fmtflags flags = out.flags();
+    std::streamsize precision = out.precision();
+    out << std::left << std::setw(32) << "stage" << std::right
+        << std::setw(10) << "calls" << std::setw(12) << "total ms" << std::setw(11) << "mean us"
+        << std::setw(11) << "p50 us" << std::setw(11) << "p90 us" << std::setw(11) << "p99 us"
+        << std::setw(11) << "max us" << '\n';
+    out << std::fixed << std::setprecision(3);
+    for (const auto& stage : stages){
+        const LatencyHistogram& latency = stage.latency;
+        if (latency.count() == 0){
+            continue;
+        }
+        out << std::left << std::setw(32) << stage.name << std::right
+            << std::setw(10) << latency.count()
+            << std::setw(12) << static_cast<double>(latency.total_ns()) / 1e6
+            << std::setw(11) << latency.mean_ns() / 1000.0
+            << std::setw(11) << to_us(latency.percentile_ns(0.50))
+            << std::setw(11) << to_us(latency.percentile_ns(0.90))
+            << std::setw(11) << to_us(latency.percentile_ns(0.99))
+            << std::setw(11) << to_us(latency.max_ns()) << '\n';
+    }
+    out.flags(flags);
+    out.precision(precision);
+}
+
+
+void write_chrome_trace(std::ostream& out){
+    Registry& reg = registry();
+    std::lock_guard<std::mutex> lock(reg.mutex);
+    int num_stages = reg.num_stages.load(std::memory_order_acquire);
+
+    std::ios_base::fmtflags flags = out.flags();
+    std::streamsize precision = out.precision();
+    out << std::fixed << std::setprecision(3);
+    out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+    bool first = true;
+    auto separator = [&]{
+        out << (first ? "\n" : ",\n");
+        first = false;
+    };
+
+    for (const auto& log : reg.threads){
+        separator();
+        out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << log->id
+            << ",\"args\":{\"name\":\"thread " << log->id << "\"}}";
+
+        uint64_t written = log->events_written.load(std::memory_order_acquire);
+        uint64_t begin = written > static_cast<uint64_t>(kTraceEventsPerThread) ? written - kTraceEventsPerThread : 0;
+        for (uint64_t i = begin; i < written; ++i){
+            // Skip a slot the owner is rewriting or has moved past since written was read
+            const TraceEvent& event = log->events[i % kTraceEventsPerThread];
+            if (event.sequence.load(std::memory_order_acquire) != i + 1){
+                continue;
+            }
+            uint64_t start = event.start_ns.load(std::memory_order_relaxed);
+            uint64_t packed = event.duration_stage.load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (event.sequence.load(std::memory_order_relaxed) != i + 1){
+                continue;
+            }
+            int stage = static_cast<int>(packed & ((uint64_t(1) << kStageBits) - 1));
+            if (stage >= num_stages || start < reg.epoch_ns){
+                continue;
+            }
+            separator();
+            out << "{\"name\":";
+            write_json_string(out, reg.names[stage]);
+            out << ",\"cat\":\"transformer\",\"ph\":\"X\",\"pid\":1,\"tid\":" << log->id
+                << ",\"ts\":" << to_us(start - reg.epoch_ns) << ",\"dur\":" << to_us(packed >> kStageBits) << '}';
+        }
+    }
+    out << "\n]}\n";
+    out.flags(flags);
+    out.precision(precision);
+}
+
+
+void reset_trace(){
+    Registry& reg = registry();
+    std::lock_guard<std::mutex> lock(reg.mutex);
+    for (const auto& log : reg.threads){
+        for (auto& stage : log->stages){
+            StageCounters* counters = stage.load(std::memory_order_acquire);
+            if (!counters){
+                continue;
+            }
+            counters->count.store(0, std::memory_order_relaxed);
+            counters->total_ns.store(0, std::memory_order_relaxed);
+            counters->max_ns.store(0, std::memory_order_relaxed);
+            for (auto& bucket : counters->buckets){
+                bucket.store(0, std::memory_order_relaxed);
+            }
+        }
+        log->events_written.store(0, std::memory_order_release);
+    }
+}
+
+} // namespace transformer
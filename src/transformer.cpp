@@ -0,0 +1,232 @@
+#include "transformer.hpp"
+#include "thread_pool.hpp"
+#include <stdexcept>
+
+namespace transformer {
+
+Transformer::Transformer(int src_vocab_size, int tgt_vocab_size, int d_model, int num_heads,
+                         int d_ff, int num_layers, int max_seq_len, Activation activation)
+    : d_model_(d_model),
+      num_heads_(num_heads),
+      d_ff_(d_ff),
+      activation_(activation),
+      src_embedding_(src_vocab_size, d_model),
+      tgt_embedding_(tgt_vocab_size, d_model),
+      positional_(max_seq_len, d_model){
+    if (num_layers <= 0){
+        throw std::invalid_argument("Transformer needs at least one layer");
+    }
+    encoder_.reserve(num_layers);
+    decoder_.reserve(num_layers);
+    for (int i = 0; i < num_layers; ++i){
+        encoder_.emplace_back(d_model, num_heads, d_ff, activation);
+        decoder_.emplace_back(d_model, num_heads, d_ff, activation);
+    }
+}
+
+
+namespace {
+
+// Layout of the "config" tensor
+enum ConfigField {
+    kSrcVocab, kTgtVocab, kDModel, kNumHeads, kDFF, kNumLayers, kMaxSeqLen, kActivation, kConfigFields
+};
+
+std::string encoder_prefix(int layer){
+    return "encoder." + std::to_string(layer) + ".";
+}
+
+std::string decoder_prefix(int layer){
+    return "decoder." + std::to_string(layer) + ".";
+}
+
+const std::vector<int64_t>& checked_config(const std::vector<int64_t>& config){
+    if (config.size() != kConfigFields || config[kNumLayers] <= 0){
+        throw std::invalid_argument("Checkpoint config does not describe a Transformer");
+    }
+    return config;
+}
+
+} // namespace
+
+
+Transformer::Transformer(const std::string& path) : Transformer(Checkpoint::open(path)){}
+
+
+Transformer::Transformer(const std::shared_ptr<const Checkpoint>& checkpoint)
+    : Transformer(checkpoint, checked_config(checkpoint->int64s("config"))){}
+
+
+Transformer::Transformer(const std::shared_ptr<const Checkpoint>& checkpoint, const std::vector<int64_t>& config)
+    : d_model_(static_cast<int>(config[kDModel])),
+      num_heads_(static_cast<int>(config[kNumHeads])),
+      d_ff_(static_cast<int>(config[kDFF])),
+      activation_(static_cast<Activation>(config[kActivation])),
+      src_embedding_(checkpoint, "src_embedding."),
+      tgt_embedding_(checkpoint, "tgt_embedding."),
+      positional_(static_cast<int>(config[kMaxSeqLen]), d_model_){
+    int num_layers = static_cast<int>(config[kNumLayers]);
+    encoder_.reserve(num_layers);
+    decoder_.reserve(num_layers);
+    for (int i = 0; i < num_layers; ++i){
+        encoder_.emplace_back(num_heads_, checkpoint, encoder_prefix(i), activation_);
+        decoder_.emplace_back(num_heads_, checkpoint, decoder_prefix(i), activation_);
+    }
+
+    // Dimensions the tensors do not pin down on their own
+    if (src_embedding_.get_vocab_size() != config[kSrcVocab] ||
+        tgt_embedding_.get_vocab_size() != config[kTgtVocab] ||
+        src_embedding_.get_embedding_dim() != d_model_ ||
+        encoder_[0].get_feed_forward().get_d_ff() != d_ff_){
+        throw std::invalid_argument("Checkpoint tensors do not match its config");
+    }
+}
+
+
+void Transformer::save(const std::string& path) const{
+    CheckpointWriter writer(path);
+    writer.add_int64("config", {
+        src_embedding_.get_vocab_size(),
+        tgt_embedding_.get_vocab_size(),
+        d_model_, num_heads_, d_ff_,
+        static_cast<int64_t>(encoder_.size()),
+        positional_.get_max_seq_len(),
+        static_cast<int64_t>(activation_)
+    });
+    src_embedding_.save(writer, "src_embedding.");
+    tgt_embedding_.save(writer, "tgt_embedding.");
+    for (std::size_t i = 0; i < encoder_.size(); ++i){
+        encoder_[i].save(writer, encoder_prefix(static_cast<int>(i)));
+        decoder_[i].save(writer, decoder_prefix(static_cast<int>(i)));
+    }
+    writer.finish();
+}
+
+
+void Transformer::reserve(int max_tokens){
+    reserve(context_, max_tokens);
+}
+
+
+void Transformer::reserve(TransformerContext& context, int max_tokens) const{
+    reserve_encoder(context, max_tokens);
+    reserve_decoder(context, max_tokens);
+    thread_pool().for_each_thread([&](int){
+        for (const auto& layer : encoder_){
+            layer.reserve_thread(max_tokens);
+        }
+        for (const auto& layer : decoder_){
+            layer.reserve_thread(max_tokens);
+        }
+        tgt_embedding_.reserve_thread(max_tokens);
+    });
+}
+
+
+void Transformer::reserve_encoder(TransformerContext& context, int max_tokens) const{
+    for (const auto& layer : encoder_){
+        layer.reserve(context.layers, max_tokens);
+    }
+    if (max_tokens <= context.encoder_buffers[0].rows()){
+        return;
+    }
+    for (auto& buffer : context.encoder_buffers){
+        buffer.resize(max_tokens, d_model_);
+    }
+    //Growing the buffers discards the previous encoder output
+    context.memory_len = 0;
+}
+
+
+void Transformer::reserve_decoder(TransformerContext& context, int max_tokens) const{
+    for (const auto& layer : decoder_){
+        layer.reserve(context.layers, max_tokens);
+    }
+    if (max_tokens <= context.decoder_buffers[0].rows()){
+        return;
+    }
+    for (auto& buffer : context.decoder_buffers){
+        buffer.resize(max_tokens, d_model_);
+    }
+}
+
+
+Eigen::Ref<const Eigen::MatrixXf> Transformer::encode(const std::vector<int>& src_tokens,
+                                                      const AttentionMask& src_mask){
+    return encode(src_tokens, context_, src_mask);
+}
+
+
+Eigen::Ref<const Eigen::MatrixXf> Transformer::encode(const std::vector<int>& src_tokens, TransformerContext& context,
+                                                      const AttentionMask& src_mask) const{
+    int seq_len = static_cast<int>(src_tokens.size());
+    reserve_encoder(context, seq_len);
+
+    auto input = context.encoder_buffers[0].topRows(seq_len);
+    src_embedding_.forward_into(src_tokens, input);
+    positional_.add_into(input);
+
+    int current = 0;
+    for (const auto& layer : encoder_){
+        layer.forward_into(context.encoder_buffers[current].topRows(seq_len),
+                           context.encoder_buffers[1 - current].topRows(seq_len), src_mask, context.layers);
+        current = 1 - current;
+    }
+
+    context.memory_buffer = current;
+    context.memory_len = seq_len;
+    return context.encoder_buffers[current].topRows(seq_len);
+}
+
+
+Eigen::Ref<const Eigen::MatrixXf> Transformer::decode(const std::vector<int>& tgt_tokens,
+                                                      const AttentionMask& memory_mask){
+    return decode(tgt_tokens, context_, memory_mask);
+}
+
+
+Eigen::Ref<const Eigen::MatrixXf> Transformer::decode(const std::vector<int>& tgt_tokens, TransformerContext& context,
+                                                      const AttentionMask& memory_mask) const{
+    if (context.memory_len == 0){
+        throw std::logic_error("decode needs the output of a previous encode call");
+    }
+    int seq_len = static_cast<int>(tgt_tokens.size());
+    reserve_decoder(context, seq_len);
+    auto memory = context.encoder_buffers[context.memory_buffer].topRows(context.memory_len);
+
+    auto input = context.decoder_buffers[0].topRows(seq_len);
+    tgt_embedding_.forward_into(tgt_tokens, input);
+    positional_.add_into(input);
+
+    int current = 0;
+    for (const auto& layer : decoder_){
+        layer.forward_into(context.decoder_buffers[current].topRows(seq_len),
+                           memory, context.decoder_buffers[1 - current].topRows(seq_len),
+                           AttentionMask::causal_mask(), memory_mask, context.layers);
+        current = 1 - current;
+    }
+    return context.decoder_buffers[current].topRows(seq_len);
+}
+
+
+void Transformer::forward_into(const std::vector<int>& src_tokens, const std::vector<int>& tgt_tokens,
+                               Eigen::Ref<Eigen::MatrixXf> logits){
+    forward_into(src_tokens, tgt_tokens, logits, context_);
+}
+
+
+void Transformer::forward_into(const std::vector<int>& src_tokens, const std::vector<int>& tgt_tokens,
+                               Eigen::Ref<Eigen::MatrixXf> logits, TransformerContext& context) const{
+    encode(src_tokens, context);
+    Eigen::Ref<const Eigen::MatrixXf> hidden = decode(tgt_tokens, context);
+    tgt_embedding_.project_into(hidden, logits);
+}
+
+
+Eigen::MatrixXf Transformer::forward(const std::vector<int>& src_tokens, const std::vector<int>& tgt_tokens){
+    Eigen::MatrixXf logits(tgt_tokens.size(), tgt_embedding_.get_vocab_size());
+    forward_into(src_tokens, tgt_tokens, logits);
+    return logits;
+}
+
+} // namespace transformer
@@ -0,0 +1,202 @@
+#include "transformer_block.hpp"
+#include "thread_pool.hpp"
+#include <algorithm>
+#include <stdexcept>
+
+namespace transformer {
+
+namespace {
+
+// Grow a context buffer to at least rows rows of width cols; buffers never shrink
+void grow(Eigen::MatrixXf& buffer, int rows, int cols){
+    if (buffer.cols() != cols || buffer.rows() < rows){
+        buffer.resize(rows, cols);
+    }
+}
+
+// Streamed feed-forward scratch: one row block per thread, never more rows than the input
+void grow_ff_hidden(Eigen::MatrixXf& buffer, const FeedForward& feed_forward, int max_tokens){
+    grow(buffer, std::min(max_tokens, feed_forward.rows_per_block() * get_num_threads()),
+         feed_forward.get_hidden_width());
+}
+
+} // namespace
+
+
+EncoderBlock::EncoderBlock(int d_model, int num_heads, int d_ff, Activation activation)
+    : d_model_(d_model),
+      self_attention_(num_heads, d_model),
+      feed_forward_(d_model, d_ff, activation),
+      norm1_(d_model),
+      norm2_(d_model){}
+
+
+EncoderBlock::EncoderBlock(int num_heads, const std::shared_ptr<const Checkpoint>& checkpoint,
+                           const std::string& prefix, Activation activation)
+    : self_attention_(num_heads, checkpoint, prefix + "self_attention."),
+      feed_forward_(checkpoint, prefix + "feed_forward.", activation),
+      norm1_(checkpoint, prefix + "norm1."),
+      norm2_(checkpoint, prefix + "norm2."){
+    d_model_ = self_attention_.get_d_model();
+}
+
+
+void EncoderBlock::save(CheckpointWriter& writer, const std::string& prefix) const{
+    self_attention_.save(writer, prefix + "self_attention.");
+    feed_forward_.save(writer, prefix + "feed_forward.");
+    norm1_.save(writer, prefix + "norm1.");
+    norm2_.save(writer, prefix + "norm2.");
+}
+
+
+void EncoderBlock::reserve(int max_tokens){
+    reserve(context_, max_tokens);
+}
+
+
+void EncoderBlock::reserve(BlockContext& context, int max_tokens) const{
+    grow(context.sublayer_out, max_tokens, d_model_);
+    grow(context.hidden1, max_tokens, d_model_);
+    grow_ff_hidden(context.ff_hidden, feed_forward_, max_tokens);
+    self_attention_.reserve(context.attention, max_tokens, max_tokens);
+}
+
+
+void EncoderBlock::reserve_thread(int max_tokens) const{
+    self_attention_.reserve_thread(max_tokens, max_tokens);
+    feed_forward_.reserve_thread(max_tokens);
+}
+
+
+void EncoderBlock::forward_into(const Eigen::Ref<const Eigen::MatrixXf>& x,
+                                Eigen::Ref<Eigen::MatrixXf> output,
+                                const AttentionMask& mask){
+    forward_into(x, output, mask, context_);
+}
+
+
+void EncoderBlock::forward_into(const Eigen::Ref<const Eigen::MatrixXf>& x,
+                                Eigen::Ref<Eigen::MatrixXf> output,
+                                const AttentionMask& mask,
+                                BlockContext& context) const{
+    if (x.cols() != d_model_ || output.rows() != x.rows() || output.cols() != d_model_){
+        throw std::invalid_argument("EncoderBlock input and output must have shape (seq_len, d_model)");
+    }
+    int seq_len = x.rows();
+    reserve(context, seq_len);
+    auto sublayer_out = context.sublayer_out.topRows(seq_len);
+    auto hidden = context.hidden1.topRows(seq_len);
+
+    self_attention_.forward_into(x, x, x, mask, sublayer_out, context.attention);
+    norm1_.add_infer(x, sublayer_out, hidden);
+
+    feed_forward_.infer(hidden, sublayer_out, context.ff_hidden);
+    norm2_.add_infer(hidden, sublayer_out, output);
+}
+
+
+Eigen::MatrixXf EncoderBlock::forward(const Eigen::MatrixXf& x, const AttentionMask& mask){
+    Eigen::MatrixXf output(x.rows(), d_model_);
+    forward_into(x, output, mask);
+    return output;
+}
+
+
+DecoderBlock::DecoderBlock(int d_model, int num_heads, int d_ff, Activation activation)
+    : d_model_(d_model),
+      self_attention_(num_heads, d_model),
+      cross_attention_(num_heads, d_model),
+      feed_forward_(d_model, d_ff, activation),
+      norm1_(d_model),
+      norm2_(d_model),
+      norm3_(d_model){}
+
+
+DecoderBlock::DecoderBlock(int num_heads, const std::shared_ptr<const Checkpoint>& checkpoint,
+                           const std::string& prefix, Activation activation)
+    : self_attention_(num_heads, checkpoint, prefix + "self_attention."),
+      cross_attention_(num_heads, checkpoint, prefix + "cross_attention."),
+      feed_forward_(checkpoint, prefix + "feed_forward.", activation),
+      norm1_(checkpoint, prefix + "norm1."),
+      norm2_(checkpoint, prefix + "norm2."),
+      norm3_(checkpoint, prefix + "norm3."){
+    d_model_ = self_attention_.get_d_model();
+}
+
+
+void DecoderBlock::save(CheckpointWriter& writer, const std::string& prefix) const{
+    self_attention_.save(writer, prefix + "self_attention.");
+    cross_attention_.save(writer, prefix + "cross_attention.");
+    feed_forward_.save(writer, prefix + "feed_forward.");
+    norm1_.save(writer, prefix + "norm1.");
+    norm2_.save(writer, prefix + "norm2.");
+    norm3_.save(writer, prefix + "norm3.");
+}
+
+
+void DecoderBlock::reserve(int max_tokens){
+    reserve(context_, max_tokens);
+}
+
+
+void DecoderBlock::reserve(BlockContext& context, int max_tokens) const{
+    grow(context.sublayer_out, max_tokens, d_model_);
+    grow(context.hidden1, max_tokens, d_model_);
+    grow(context.hidden2, max_tokens, d_model_);
+    grow_ff_hidden(context.ff_hidden, feed_forward_, max_tokens);
+    self_attention_.reserve(context.attention, max_tokens, max_tokens);
+    cross_attention_.reserve(context.attention, max_tokens, max_tokens);
+}
+
+
+void DecoderBlock::reserve_thread(int max_tokens) const{
+    self_attention_.reserve_thread(max_tokens, max_tokens);
+    cross_attention_.reserve_thread(max_tokens, max_tokens);
+    feed_forward_.reserve_thread(max_tokens);
+}
+
+
+void DecoderBlock::forward_into(const Eigen::Ref<const Eigen::MatrixXf>& x,
+                                const Eigen::Ref<const Eigen::MatrixXf>& memory,
+                                Eigen::Ref<Eigen::MatrixXf> output,
+                                const AttentionMask& self_mask,
+                                const AttentionMask& memory_mask){
+    forward_into(x, memory, output, self_mask, memory_mask, context_);
+}
+
+
+void DecoderBlock::forward_into(const Eigen::Ref<const Eigen::MatrixXf>& x,
+                                const Eigen::Ref<const Eigen::MatrixXf>& memory,
+                                Eigen::Ref<Eigen::MatrixXf> output,
+                                const AttentionMask& self_mask,
+                                const AttentionMask& memory_mask,
+                                BlockContext& context) const{
+    if (x.cols() != d_model_ || memory.cols() != d_model_ ||
+        output.rows() != x.rows() || output.cols() != d_model_){
+        throw std::invalid_argument("DecoderBlock inputs and output must have d_model columns");
+    }
+    int seq_len = x.rows();
+    reserve(context, seq_len);
+    auto sublayer_out = context.sublayer_out.topRows(seq_len);
+    auto hidden1 = context.hidden1.topRows(seq_len);
+    auto hidden2 = context.hidden2.topRows(seq_len);
+
+    self_attention_.forward_into(x, x, x, self_mask, sublayer_out, context.attention);
+    norm1_.add_infer(x, sublayer_out, hidden1);
+
+    cross_attention_.forward_into(hidden1, memory, memory, memory_mask, sublayer_out, context.attention);
+    norm2_.add_infer(hidden1, sublayer_out, hidden2);
+
+    feed_forward_.infer(hidden2, sublayer_out, context.ff_hidden);
+    norm3_.add_infer(hidden2, sublayer_out, output);
+}
+
+
+Eigen::MatrixXf DecoderBlock::forward(const Eigen::MatrixXf& x, const Eigen::MatrixXf& memory,
+                                      const AttentionMask& self_mask, const AttentionMask& memory_mask){
+    Eigen::MatrixXf output(x.rows(), d_model_);
+    forward_into(x, memory, output, self_mask, memory_mask);
+    return output;
+}
+
+} // namespace transformer
@@ -0,0 +1,45 @@
+#include "allocation_counter.hpp"
+#include <atomic>
+#include <cstddef>
+
+// Count at the malloc level: these definitions interpose on the C library's for the whole
+// process that links them
+extern "C" {
+void* __libc_malloc(std::size_t size);
+void* __libc_calloc(std::size_t count, std::size_t size);
+void* __libc_realloc(void* p, std::size_t size);
+void* __libc_memalign(std::size_t alignment, std::size_t size);
+void __libc_free(void* p);
+}
+
+namespace {
+
+std::atomic<long> allocations{0};
+
+void count_allocation(){
+    allocations.fetch_add(1, std::memory_order_relaxed);
+}
+
+} // namespace
+
+extern "C" {
+void* malloc(std::size_t size){count_allocation(); return __libc_malloc(size);}
+void* calloc(std::size_t count, std::size_t size){count_allocation(); return __libc_calloc(count, size);}
+void* realloc(void* p, std::size_t size){count_allocation(); return __libc_realloc(p, size);}
+void* memalign(std::size_t alignment, std::size_t size){count_allocation(); return __libc_memalign(alignment, size);}
+void* aligned_alloc(std::size_t alignment, std::size_t size){count_allocation(); return __libc_memalign(alignment, size);}
+int posix_memalign(void** p, std::size_t alignment, std::size_t size){
+    count_allocation();
+    *p = __libc_memalign(alignment, size);
+    return *p ? 0 : 12; // ENOMEM
+}
+void free(void* p){__libc_free(p);}
+}
+
+namespace support {
+
+long allocation_count(){
+    return allocations.load(std::memory_order_relaxed);
+}
+
+} // namespace support
@@ -0,0 +1,13 @@
+#pragma once
+
+namespace support {
+
+/**
+ * @brief Heap allocations made by the whole process so far, on any thread
+ * Linking allocation_counter interposes malloc and friends on the C library's, since
+ * Eigen does not allocate through operator new. Take the difference across the code
+ * being measured.
+ */
+long allocation_count();
+
+} // namespace support
@@ -0,0 +1,173 @@
+#include <gtest/gtest.h>
+#include "allocation_counter.hpp"
+#include "thread_pool.hpp"
+#include "trace.hpp"
+#include "transformer.hpp"
+#include <cstdint>
+#include <numeric>
+#include <vector>
+
+namespace {
+
+// Heap allocations made by fn on this or any other thread
+template <typename Fn>
+long count_allocations(Fn&& fn){
+    long before = support::allocation_count();
+    fn();
+    return support::allocation_count() - before;
+}
+
+// Trace builds give a thread its event log and a stage its counters on first record;
+// record every stage id once on every pool thread so those one-off buffers are not counted
+void touch_trace_logs(){
+    if (transformer::kTracingEnabled){
+        transformer::thread_pool().for_each_thread([](int){
+            uint64_t now = transformer::trace_now_ns();
+            for (int stage = 0; stage < transformer::kMaxTraceStages; ++stage){
+                transformer::trace_record(stage, now, now);
+            }
+        });
+        transformer::reset_trace();
+    }
+}
+
+} // namespace
+
+TEST(AllocationTest, TransformerForwardTest) {
+    transformer::Transformer model(50, 60, 32, 4, 64, 2, 64);
+    std::vector<int> src(40), tgt(24);
+    std::iota(src.begin(), src.end(), 0);
+    std::iota(tgt.begin(), tgt.end(), 3);
+    Eigen::MatrixXf logits(tgt.size(), 60);
+    transformer::TransformerContext context;
+    touch_trace_logs();
+    model.reserve(context, 40);
+    model.forward_into(src, tgt, logits, context);
+
+    EXPECT_EQ(count_allocations([&]{model.forward_into(src, tgt, logits, context);}), 0);
+    EXPECT_GT(count_allocations([&]{model.forward(src, tgt);}), 0);
+
+    // Every pool thread sizes its own scratch, so whichever thread serves a head later fits
+    transformer::set_num_threads(4);
+    touch_trace_logs();
+    model.reserve(context, 40);
+    model.forward_into(src, tgt, logits, context);
+    EXPECT_EQ(count_allocations([&]{model.forward_into(src, tgt, logits, context);}), 0);
+    model.get_encoder_layer(0).get_self_attention().set_attention_kernel(transformer::AttentionKernel::Tiled, 8);
+    model.reserve(context, 40);
+    model.forward_into(src, tgt, logits, context);
+    EXPECT_EQ(count_allocations([&]{model.forward_into(src, tgt, logits, context);}), 0);
+    transformer::set_num_threads(0);
+}
+
+TEST(AllocationTest, WideModelTest) {
+    // From d_model of a few hundred Eigen would heap-allocate its GEMM packing panels
+    transformer::Transformer model(50, 60, 512, 8, 1024, 1, 64);
+    std::vector<int> src(40), tgt(24);
+    std::iota(src.begin(), src.end(), 0);
+    std::iota(tgt.begin(), tgt.end(), 3);
+    Eigen::MatrixXf logits(tgt.size(), 60);
+    transformer::TransformerContext context;
+    touch_trace_logs();
+    model.reserve(context, 40);
+    model.forward_into(src, tgt, logits, context);
+
+    EXPECT_EQ(count_allocations([&]{model.forward_into(src, tgt, logits, context);}), 0);
+}
+
+TEST(AllocationTest, AttentionKernelsTest) {
+    // Varying lengths reuse the workspaces once the longest call has been seen
+    const int d_model = 32;
+    transformer::MultiHeadAttention attention(4, d_model);
+    attention.set_rotary_embedding(true);
+    transformer::AttentionContext context;
+    Eigen::MatrixXf long_input = Eigen::MatrixXf::Random(90, d_model);
+    Eigen::MatrixXf short_input = Eigen::MatrixXf::Random(20, d_model);
+    Eigen::MatrixXf long_out(90, d_model), short_out(20, d_model);
+    auto causal = transformer::AttentionMask::causal_mask();
+
+    auto run = [&]{
+        attention.forward_into(long_input, long_input, long_input, causal, long_out, context);
+        attention.forward_into(short_input, short_input, short_input, causal, short_out, context);
+        attention.forward_into(short_input, long_input, long_input, transformer::AttentionMask(), short_out, context);
+    };
+    auto reserve = [&]{
+        attention.reserve(context, 90, 90);
+        transformer::thread_pool().for_each_thread([&](int){attention.reserve_thread(90, 90);});
+    };
+    touch_trace_logs();
+    reserve();
+    run();
+    EXPECT_EQ(count_allocations(run), 0);
+    attention.set_attention_kernel(transformer::AttentionKernel::Tiled, 16);
+    reserve();
+    run();
+    EXPECT_EQ(count_allocations(run), 0);
+
+    // bf16 pages are widened into the kernel workspace
+    transformer::PagedKVCache cache(d_model, 8, 16, transformer::KVStorage::BF16);
+    int seq = cache.create_sequence();
+    cache.append(seq, long_input.topRows(40), short_input.topRows(20).replicate(2, 1));
+    transformer::ScaledDotProductAttention kernel(d_model / 4);
+    Eigen::MatrixXf queries = long_input.bottomRows(3);
+    Eigen::MatrixXf paged_out(3, d_model);
+    // Run once on every thread, so each one's workspace holds a widened page
+    transformer::thread_pool().for_each_thread([&](int){kernel.forward_paged(queries, cache, seq, 4, paged_out);});
+    EXPECT_EQ(count_allocations([&]{kernel.forward_paged(queries, cache, seq, 4, paged_out);}), 0);
+}
+
+TEST(AllocationTest, GatedFeedForwardTest) {
+    // The cached hidden layer keeps its gated width, so repeated calls reuse it
+    transformer::FeedForward layer(32, 64, transformer::Activation::SwiGLU);
+    Eigen::MatrixXf input = Eigen::MatrixXf::Random(40, 32);
+    Eigen::MatrixXf output(40, 32);
+    touch_trace_logs();
+    transformer::thread_pool().for_each_thread([&](int){layer.reserve_thread(40);});
+    layer.forward_into(input, output);
+
+    EXPECT_EQ(count_allocations([&]{layer.forward_into(input, output);}), 0);
+    EXPECT_EQ(layer.get_last_hidden().cols(), 64);
+}
+
+TEST(AllocationTest, QuantizedTransformerTest) {
+    // Quantized projections gather their token rows into a per-thread workspace
+    transformer::Transformer model(50, 60, 32, 4, 64, 2, 64);
+    for (int i = 0; i < model.get_num_layers(); ++i){
+        auto& encoder = model.get_encoder_layer(i);
+        auto& decoder = model.get_decoder_layer(i);
+        encoder.get_self_attention().quantize_weights(transformer::WeightFormat::INT8);
+        encoder.get_feed_forward().quantize_weights(transformer::WeightFormat::Q4);
+        decoder.get_self_attention().quantize_weights(transformer::WeightFormat::BF16);
+        decoder.get_cross_attention().quantize_weights(transformer::WeightFormat::Q4_ZP);
+        decoder.get_feed_forward().quantize_weights(transformer::WeightFormat::FP16);
+    }
+    std::vector<int> src(40), tgt(24);
+    std::iota(src.begin(), src.end(), 0);
+    std::iota(tgt.begin(), tgt.end(), 3);
+    Eigen::MatrixXf logits(tgt.size(), 60);
+    transformer::TransformerContext context;
+    touch_trace_logs();
+    model.reserve(context, 40);
+    model.forward_into(src, tgt, logits, context);
+
+    EXPECT_EQ(count_allocations([&]{model.forward_into(src, tgt, logits, context);}), 0);
+}
+
+TEST(AllocationTest, QuantizedEmbeddingTest) {
+    transformer::TokenEmbedding embedding(100, 64);
+    embedding.quantize_weights(transformer::WeightFormat::INT8);
+    std::vector<int> many(48), few = {3, 3, 7};
+    std::iota(many.begin(), many.end(), 10);
+    Eigen::MatrixXf many_out(many.size(), 64), few_out(few.size(), 64);
+
+    Eigen::MatrixXf hidden = Eigen::MatrixXf::Random(few.size(), 64);
+    Eigen::MatrixXf logits(few.size(), 100);
+
+    auto run = [&]{
+        embedding.forward_into(many, many_out);
+        embedding.forward_into(few, few_out);
+        embedding.project_into(hidden, logits);
+    };
+    run();
+    EXPECT_EQ(count_allocations(run), 0);
+}
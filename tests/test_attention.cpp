@@ -3,6 +3,7 @@
 #include <vector>
 #include <cmath>
 #include <memory>
+#include <limits>
 
 class ScaledDotProductAttentionTest : public ::testing::Test {
 protected:
@@ -145,6 +146,139 @@ TEST_F(ScaledDotProductAttentionTest, RandomInputTest) {
     }
 }
 
+TEST_F(ScaledDotProductAttentionTest, CausalMatchesExplicitMaskTest) {
+    // Long enough to span several causal row blocks
+    int len = 150;
+    Eigen::MatrixXf Q = Eigen::MatrixXf::Random(len, d_k);
+    Eigen::MatrixXf K = Eigen::MatrixXf::Random(len, d_k);
+    Eigen::MatrixXf V = Eigen::MatrixXf::Random(len, d_v);
+
+    transformer::BoolArrayXXb allowed(len, len);
+    for (int i = 0; i < len; ++i) {
+        for (int j = 0; j < len; ++j) {
+            allowed(i, j) = j <= i;
+        }
+    }
+
+    Eigen::MatrixXf causal(len, d_v);
+    Eigen::MatrixXf dense(len, d_v);
+    attention->forward_heads(Q, K, V, 1, causal, transformer::AttentionMask::causal_mask());
+    attention->forward_heads(Q, K, V, 1, dense, transformer::AttentionMask::from_boolean(allowed));
+
+    EXPECT_TRUE(causal.isApprox(dense, 1e-5f));
+
+    // The first query can only see the first key
+    for (int j = 0; j < d_v; ++j) {
+        EXPECT_NEAR(causal(0, j), V(0, j), 1e-6);
+    }
+}
+
+TEST_F(ScaledDotProductAttentionTest, CausalWithPastContextTest) {
+    // Three new queries attending over seven cached keys plus themselves
+    int q_len = 3;
+    int kv_len = 10;
+    Eigen::MatrixXf Q = Eigen::MatrixXf::Random(q_len, d_k);
+    Eigen::MatrixXf K = Eigen::MatrixXf::Random(kv_len, d_k);
+    Eigen::MatrixXf V = Eigen::MatrixXf::Random(kv_len, d_v);
+
+    transformer::AttentionMask explicit_mask;
+    explicit_mask.additive = Eigen::MatrixXf::Zero(q_len, kv_len);
+    for (int i = 0; i < q_len; ++i) {
+        for (int j = kv_len - q_len + i + 1; j < kv_len; ++j) {
+            explicit_mask.additive(i, j) = -std::numeric_limits<float>::infinity();
+        }
+    }
+
+    Eigen::MatrixXf causal(q_len, d_v);
+    Eigen::MatrixXf dense(q_len, d_v);
+    attention->forward_heads(Q, K, V, 1, causal, transformer::AttentionMask::causal_mask());
+    attention->forward_heads(Q, K, V, 1, dense, explicit_mask);
+
+    EXPECT_TRUE(causal.isApprox(dense, 1e-5f));
+}
+
+TEST_F(ScaledDotProductAttentionTest, KeyPaddingMaskTest) {
+    Eigen::MatrixXf Q = Eigen::MatrixXf::Random(seq_len, d_k);
+    Eigen::MatrixXf K = Eigen::MatrixXf::Random(seq_len + 2, d_k);
+    Eigen::MatrixXf V = Eigen::MatrixXf::Random(seq_len + 2, d_v);
+
+    transformer::BoolArrayXb padded = transformer::BoolArrayXb::Constant(seq_len + 2, false);
+    padded.tail(2).setConstant(true);
+
+    Eigen::MatrixXf masked(seq_len, d_v);
+    Eigen::MatrixXf trimmed(seq_len, d_v);
+    attention->forward_heads(Q, K, V, 1, masked, transformer::AttentionMask::from_key_padding(padded));
+    attention->forward_heads(Q, K.topRows(seq_len), V.topRows(seq_len), 1, trimmed);
+
+    // Padded keys must behave exactly as if they were absent
+    EXPECT_TRUE(masked.isApprox(trimmed, 1e-5f));
+}
+
+TEST_F(ScaledDotProductAttentionTest, MaskShapeMismatchTest) {
+    Eigen::MatrixXf Q = Eigen::MatrixXf::Random(seq_len, d_k);
+    Eigen::MatrixXf out(seq_len, d_v);
+
+    transformer::AttentionMask mask;
+    mask.additive = Eigen::MatrixXf::Zero(seq_len + 1, seq_len);
+    EXPECT_THROW(attention->forward_heads(Q, Q, Q, 1, out, mask), std::invalid_argument);
+}
+
+TEST_F(ScaledDotProductAttentionTest, TiledKernelMatchesStandardTest) {
+    // Uneven lengths so the last query block and the last key tile are partial
+    int q_len = 77;
+    int kv_len = 133;
+    int num_heads = 2;
+    Eigen::MatrixXf Q = Eigen::MatrixXf::Random(q_len, num_heads * d_k) * 3.0f;
+    Eigen::MatrixXf K = Eigen::MatrixXf::Random(kv_len, num_heads * d_k) * 3.0f;
+    Eigen::MatrixXf V = Eigen::MatrixXf::Random(kv_len, num_heads * d_v);
+
+    transformer::BoolArrayXb padded = transformer::BoolArrayXb::Constant(kv_len, false);
+    padded.segment(20, 30).setConstant(true);
+
+    transformer::AttentionMask additive;
+    additive.additive = Eigen::MatrixXf::Random(q_len, kv_len);
+
+    std::vector<transformer::AttentionMask> masks = {
+        transformer::AttentionMask(),
+        transformer::AttentionMask::causal_mask(),
+        transformer::AttentionMask::from_key_padding(padded),
+        additive,
+    };
+
+    transformer::ScaledDotProductAttention standard(d_k);
+    Eigen::MatrixXf expected(q_len, num_heads * d_v);
+    Eigen::MatrixXf result(q_len, num_heads * d_v);
+
+    for (const auto& mask : masks) {
+        standard.forward_heads(Q, K, V, num_heads, expected, mask);
+
+        for (int tile_size : {16, 50, 0}) {
+            transformer::ScaledDotProductAttention tiled(d_k);
+            tiled.set_kernel(transformer::AttentionKernel::Tiled, tile_size);
+            tiled.forward_heads(Q, K, V, num_heads, result, mask);
+
+            for (int i = 0; i < q_len; ++i) {
+                for (int j = 0; j < num_heads * d_v; ++j) {
+                    EXPECT_NEAR(result(i, j), expected(i, j), 1e-5) << "tile_size " << tile_size;
+                }
+            }
+        }
+    }
+}
+
+TEST_F(ScaledDotProductAttentionTest, TileSizeTest) {
+    attention->set_kernel(transformer::AttentionKernel::Tiled, 32);
+    EXPECT_EQ(attention->get_kernel(), transformer::AttentionKernel::Tiled);
+    EXPECT_EQ(attention->tile_size_for(64, 64), 32);
+
+    attention->set_kernel(transformer::AttentionKernel::Tiled);
+    int tile = attention->tile_size_for(64, 64);
+    EXPECT_GE(tile, 16);
+    EXPECT_EQ(tile % 16, 0);
+
+    EXPECT_THROW(attention->set_kernel(transformer::AttentionKernel::Tiled, -1), std::invalid_argument);
+}
+
 int main(int argc, char **argv) {
     ::testing::InitGoogleTest(&argc, argv);
     return RUN_ALL_TESTS();
@@ -0,0 +1,108 @@
+#include <gtest/gtest.h>
+#include "batch.hpp"
+#include "embedding.hpp"
+#include "attention.hpp"
+#include "feed_forward.hpp"
+#include "layer_norm.hpp"
+#include <vector>
+#include <memory>
+
+class RaggedBatchTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        d_model = 8;
+        lengths = {3, 1, 6, 0, 4};
+        for (int len : lengths) {
+            sequences.push_back(Eigen::MatrixXf::Random(len, d_model));
+        }
+        batch = transformer::RaggedBatch::pack(sequences);
+    }
+
+    int d_model;
+    std::vector<int> lengths;
+    std::vector<Eigen::MatrixXf> sequences;
+    transformer::RaggedBatch batch;
+};
+
+TEST_F(RaggedBatchTest, PackTest) {
+    EXPECT_EQ(batch.num_sequences(), 5);
+    EXPECT_EQ(batch.total_tokens(), 14);
+    EXPECT_EQ(batch.offsets, (std::vector<int>{0, 3, 4, 10, 10, 14}));
+    for (int i = 0; i < batch.num_sequences(); ++i) {
+        EXPECT_EQ(batch.length(i), lengths[i]);
+        EXPECT_TRUE(batch.sequence(i).isApprox(sequences[i]));
+    }
+    EXPECT_NO_THROW(batch.validate());
+}
+
+TEST_F(RaggedBatchTest, InvalidOffsetsTest) {
+    transformer::RaggedBatch bad = batch;
+    bad.offsets[2] = 2;
+    EXPECT_THROW(bad.validate(), std::invalid_argument);
+
+    bad = batch;
+    bad.offsets.back() = 13;
+    EXPECT_THROW(bad.validate(), std::invalid_argument);
+}
+
+TEST_F(RaggedBatchTest, EmbeddingBatchTest) {
+    transformer::TokenEmbedding embedding(20, d_model);
+    std::vector<std::vector<int>> tokens = {{1, 2, 3}, {4}, {5, 6, 7, 8}};
+
+    auto result = embedding.forward_batch(tokens);
+    EXPECT_EQ(result.offsets, (std::vector<int>{0, 3, 4, 8}));
+    for (size_t i = 0; i < tokens.size(); ++i) {
+        EXPECT_TRUE(result.sequence(i).isApprox(embedding.forward(tokens[i])));
+    }
+
+    EXPECT_THROW(embedding.forward_batch({{1}, {25}}), std::out_of_range);
+}
+
+TEST_F(RaggedBatchTest, PositionalEncodingRestartsPerSequenceTest) {
+    transformer::PositionalEncoding encoding(10, d_model);
+    auto result = encoding.forward_batch(batch);
+
+    for (int i = 0; i < batch.num_sequences(); ++i) {
+        EXPECT_TRUE(result.sequence(i).isApprox(encoding.forward(sequences[i])));
+    }
+
+    transformer::PositionalEncoding short_encoding(5, d_model);
+    EXPECT_THROW(short_encoding.forward_batch(batch), std::out_of_range);
+}
+
+TEST_F(RaggedBatchTest, AttentionStaysWithinSequenceTest) {
+    transformer::MultiHeadAttention attention(2, d_model);
+
+    for (bool causal : {false, true}) {
+        auto result = attention.forward_batch(batch, causal);
+        ASSERT_EQ(result.total_tokens(), batch.total_tokens());
+
+        transformer::AttentionMask mask = causal ? transformer::AttentionMask::causal_mask()
+                                                 : transformer::AttentionMask();
+        for (int i = 0; i < batch.num_sequences(); ++i) {
+            if (lengths[i] == 0) {
+                continue;
+            }
+            auto expected = attention.forward(sequences[i], sequences[i], sequences[i], mask);
+            EXPECT_TRUE(result.sequence(i).isApprox(expected, 1e-5f)) << "sequence " << i;
+        }
+    }
+}
+
+TEST_F(RaggedBatchTest, PositionWiseLayersTest) {
+    transformer::FeedForward feed_forward(d_model, 16);
+    transformer::LayerNorm layer_norm(d_model);
+
+    auto ff_result = feed_forward.forward_batch(batch);
+    auto ln_result = layer_norm.forward_batch(batch);
+    EXPECT_EQ(ff_result.offsets, batch.offsets);
+    EXPECT_EQ(ln_result.offsets, batch.offsets);
+
+    for (int i = 0; i < batch.num_sequences(); ++i) {
+        if (lengths[i] == 0) {
+            continue;
+        }
+        EXPECT_TRUE(ff_result.sequence(i).isApprox(feed_forward.forward(sequences[i]), 1e-5f));
+        EXPECT_TRUE(ln_result.sequence(i).isApprox(layer_norm.forward(sequences[i]), 1e-5f));
+    }
+}
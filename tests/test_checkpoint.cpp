@@ -0,0 +1,172 @@
+#include <gtest/gtest.h>
+#include "checkpoint.hpp"
+#include "transformer.hpp"
+#include <cstdio>
+#include <fstream>
+#include <unistd.h>
+
+class CheckpointTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        path = "checkpoint_test_" + std::to_string(::getpid()) + ".bin";
+    }
+
+    void TearDown() override {
+        std::remove(path.c_str());
+    }
+
+    std::string path;
+};
+
+TEST_F(CheckpointTest, RoundTripTest) {
+    Eigen::MatrixXf matrix = Eigen::MatrixXf::Random(7, 5);
+    Eigen::VectorXf vector = Eigen::VectorXf::Random(9);
+    {
+        transformer::CheckpointWriter writer(path);
+        writer.add_matrix("matrix", matrix);
+        writer.add_vector("vector", vector);
+        writer.add_matrix("block", matrix.block(1, 1, 3, 2));
+        writer.add_int64("ints", {4, -2, 1LL << 40});
+        EXPECT_THROW(writer.add_vector("vector", vector), std::invalid_argument);
+        writer.finish();
+    }
+
+    auto checkpoint = transformer::Checkpoint::open(path);
+    EXPECT_EQ(checkpoint->version(), transformer::Checkpoint::kVersion);
+    EXPECT_EQ(checkpoint->names().size(), 4u);
+
+    float* data = checkpoint->floats("matrix", 7, 5);
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(data) % transformer::Checkpoint::kAlignment, 0u);
+    EXPECT_TRUE(Eigen::Map<Eigen::MatrixXf>(data, 7, 5).isApprox(matrix));
+    EXPECT_TRUE(Eigen::Map<Eigen::VectorXf>(checkpoint->floats("vector", 9, 1), 9).isApprox(vector));
+    EXPECT_TRUE(Eigen::Map<Eigen::MatrixXf>(checkpoint->floats("block", 3, 2), 3, 2).isApprox(matrix.block(1, 1, 3, 2)));
+    EXPECT_EQ(checkpoint->int64s("ints"), (std::vector<int64_t>{4, -2, 1LL << 40}));
+
+    EXPECT_THROW(checkpoint->floats("matrix", 5, 7), std::invalid_argument);
+    EXPECT_THROW(checkpoint->tensor("missing"), std::out_of_range);
+}
+
+TEST_F(CheckpointTest, InvalidFileTest) {
+    EXPECT_THROW(transformer::Checkpoint::open(path), std::runtime_error);
+
+    std::ofstream(path, std::ios::binary) << std::string(128, 'x');
+    EXPECT_THROW(transformer::Checkpoint::open(path), std::runtime_error);
+}
+
+TEST_F(CheckpointTest, VersionOneEmbeddingTest) {
+    // Version 1 stored the table as (vocab_size, embedding_dim); it is transposed on load
+    Eigen::MatrixXf table = Eigen::MatrixXf::Random(12, 8);
+    {
+        transformer::CheckpointWriter writer(path);
+        writer.add_matrix("emb.embedding", table);
+        writer.finish();
+    }
+    auto set_version = [&](uint32_t version){
+        std::fstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+        file.seekp(8);
+        file.write(reinterpret_cast<const char*>(&version), sizeof(version));
+    };
+    set_version(1);
+
+    auto checkpoint = transformer::Checkpoint::open(path);
+    EXPECT_EQ(checkpoint->version(), 1u);
+    transformer::TokenEmbedding embedding(checkpoint, "emb.");
+    EXPECT_EQ(embedding.get_vocab_size(), 12);
+    EXPECT_EQ(embedding.get_embedding_dim(), 8);
+    EXPECT_FALSE(embedding.get_embedding_matrix().is_view());
+    EXPECT_TRUE(embedding.get_embedding_matrix().isApprox(table));
+    checkpoint.reset();
+
+    set_version(transformer::Checkpoint::kVersion + 1);
+    EXPECT_THROW(transformer::Checkpoint::open(path), std::runtime_error);
+    set_version(0);
+    EXPECT_THROW(transformer::Checkpoint::open(path), std::runtime_error);
+}
+
+TEST_F(CheckpointTest, OverflowingShapeTest) {
+    {
+        transformer::CheckpointWriter writer(path);
+        writer.add_matrix("m", Eigen::MatrixXf::Random(2, 2));
+        writer.finish();
+    }
+    // rows * cols * 4 wraps to 0 in 64 bits, which must not pass for an empty tensor
+    uint64_t directory_offset = 0;
+    {
+        std::ifstream file(path, std::ios::binary);
+        file.seekg(16);
+        file.read(reinterpret_cast<char*>(&directory_offset), sizeof(directory_offset));
+    }
+    std::fstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+    int64_t rows = int64_t(1) << 62, cols = 4;
+    uint64_t bytes = 0;
+    // Entry: name length, "m", type, rank, then rows, cols, offset and bytes
+    file.seekp(static_cast<std::streamoff>(directory_offset) + 4 + 1 + 4 + 4);
+    file.write(reinterpret_cast<const char*>(&rows), sizeof(rows));
+    file.write(reinterpret_cast<const char*>(&cols), sizeof(cols));
+    file.seekp(8, std::ios::cur);
+    file.write(reinterpret_cast<const char*>(&bytes), sizeof(bytes));
+    file.close();
+    EXPECT_THROW(transformer::Checkpoint::open(path), std::runtime_error);
+}
+
+TEST_F(CheckpointTest, ZeroHeadsCheckpointTest) {
+    transformer::MultiHeadAttention attention(2, 8);
+    {
+        transformer::CheckpointWriter writer(path);
+        attention.save(writer, "mha.");
+        writer.finish();
+    }
+    auto checkpoint = transformer::Checkpoint::open(path);
+    EXPECT_THROW(transformer::MultiHeadAttention(0, checkpoint, "mha."), std::invalid_argument);
+    EXPECT_THROW(transformer::MultiHeadAttention(3, checkpoint, "mha."), std::invalid_argument);
+}
+
+TEST_F(CheckpointTest, WeightsViewCheckpointTest) {
+    transformer::FeedForward layer(8, 16, transformer::Activation::SwiGLU);
+    {
+        transformer::CheckpointWriter writer(path);
+        layer.save(writer, "ff.");
+        writer.finish();
+    }
+
+    auto checkpoint = transformer::Checkpoint::open(path);
+    transformer::FeedForward loaded(checkpoint, "ff.", transformer::Activation::SwiGLU);
+    EXPECT_TRUE(loaded.get_W1().is_view());
+    EXPECT_EQ(loaded.get_W1().data(), checkpoint->floats("ff.W1", 8, 32));
+
+    Eigen::MatrixXf x = Eigen::MatrixXf::Random(5, 8);
+    EXPECT_TRUE(loaded.forward(x).isApprox(layer.forward(x)));
+
+    // In-place updates write private pages; the file and a second mapping are unchanged
+    Eigen::MatrixXf d_W1 = Eigen::MatrixXf::Constant(8, 32, 0.5f);
+    loaded.update_parameters(d_W1, Eigen::VectorXf::Zero(32), Eigen::MatrixXf::Zero(16, 8), Eigen::VectorXf::Zero(8));
+    EXPECT_TRUE(loaded.get_W1().isApprox(layer.get_W1() - d_W1));
+    transformer::FeedForward reloaded(transformer::Checkpoint::open(path), "ff.", transformer::Activation::SwiGLU);
+    EXPECT_TRUE(reloaded.get_W1().isApprox(layer.get_W1()));
+
+    // Copies own their weights; the views keep the mapping alive after the handle is gone
+    transformer::FeedForward copy = loaded;
+    EXPECT_FALSE(copy.get_W1().is_view());
+    checkpoint.reset();
+    EXPECT_TRUE(copy.get_W1().isApprox(loaded.get_W1()));
+
+    transformer::FeedForward wrong(16, 16);
+    EXPECT_THROW(wrong.load(transformer::Checkpoint::open(path), "ff."), std::invalid_argument);
+}
+
+TEST_F(CheckpointTest, TransformerRoundTripTest) {
+    transformer::Transformer model(30, 40, 16, 4, 32, 2, 24, transformer::Activation::GELU_Tanh);
+    model.save(path);
+
+    transformer::Transformer loaded(path);
+    EXPECT_EQ(loaded.get_num_layers(), 2);
+    EXPECT_EQ(loaded.get_d_model(), 16);
+    EXPECT_EQ(loaded.get_decoder_layer(1).get_feed_forward().get_activation(), transformer::Activation::GELU_Tanh);
+
+    std::vector<int> src = {1, 5, 7, 2, 9};
+    std::vector<int> tgt = {3, 4, 8};
+    EXPECT_TRUE(loaded.forward(src, tgt).isApprox(model.forward(src, tgt), 1e-5f));
+
+    model.get_encoder_layer(0).get_feed_forward().quantize_weights(transformer::WeightFormat::INT8);
+    EXPECT_THROW(model.save(path), std::logic_error);
+}
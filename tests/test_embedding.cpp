@@ -1,9 +1,12 @@
 
 #include <gtest/gtest.h>
 #include "embedding.hpp"
+#include "checkpoint.hpp"
 #include <vector>
 #include <cmath>
+#include <cstdio>
 #include <memory> 
+#include <unistd.h>
 
 class TokenEmbeddingTest : public ::testing::Test {
 protected:
@@ -49,6 +52,81 @@ TEST_F(TokenEmbeddingTest, OutOfRangeTest) {
     EXPECT_THROW(embedding->forward(invalid_indices), std::out_of_range);
 }
 
+TEST_F(TokenEmbeddingTest, GatherDuplicatesTest) {
+    std::vector<int> ids = {7, 3, 7, 99, 0, 3, 7, 42, 42, 1, 2, 5, 8, 13, 21, 34, 55, 89};
+    Eigen::MatrixXf gathered(ids.size(), embedding_dim);
+    embedding->gather(ids.data(), static_cast<int>(ids.size()), gathered);
+
+    const auto& matrix = embedding->get_embedding_matrix();
+    for (std::size_t i = 0; i < ids.size(); ++i) {
+        EXPECT_EQ(gathered.row(i), matrix.row(ids[i]));
+    }
+
+    Eigen::MatrixXf wrong(ids.size() - 1, embedding_dim);
+    EXPECT_THROW(embedding->gather(ids.data(), static_cast<int>(ids.size()), wrong), std::invalid_argument);
+    int negative = -1;
+    Eigen::MatrixXf one(1, embedding_dim);
+    EXPECT_THROW(embedding->gather(&negative, 1, one), std::out_of_range);
+}
+
+TEST_F(TokenEmbeddingTest, ForwardBatchTest) {
+    std::vector<std::vector<int>> sequences = {{4, 5, 4}, {}, {5, 9}};
+    auto batch = embedding->forward_batch(sequences);
+    EXPECT_EQ(batch.offsets, (std::vector<int>{0, 3, 3, 5}));
+    EXPECT_EQ(batch.sequence(0), embedding->forward(sequences[0]));
+    EXPECT_EQ(batch.sequence(2), embedding->forward(sequences[2]));
+}
+
+TEST(TokenEmbeddingQuantizedTest, QuantizedTableTest) {
+    // Quantized channels are padded, so use a width where the byte saving shows
+    const int vocab_size = 300;
+    const int embedding_dim = 64;
+    transformer::TokenEmbedding embedding(vocab_size, embedding_dim);
+    std::vector<int> ids = {3, 17, 3, 64, 299, 0, 17};
+    Eigen::MatrixXf reference = embedding.forward(ids);
+    Eigen::MatrixXf hidden = Eigen::MatrixXf::Random(4, embedding_dim);
+    Eigen::MatrixXf reference_logits = hidden * embedding.get_embedding_matrix().transpose();
+
+    for (auto format : {transformer::WeightFormat::INT8, transformer::WeightFormat::BF16}) {
+        transformer::TokenEmbedding quantized = embedding;
+        quantized.quantize_weights(format);
+        EXPECT_EQ(quantized.get_weight_format(), format);
+        EXPECT_LT(quantized.weight_bytes(), embedding.weight_bytes());
+        EXPECT_THROW(quantized.quantize_weights(transformer::WeightFormat::Q4), std::logic_error);
+
+        Eigen::MatrixXf gathered = quantized.forward(ids);
+        EXPECT_LT((gathered - reference).cwiseAbs().maxCoeff(), 0.01f);
+        EXPECT_EQ(gathered.row(0), gathered.row(2));
+
+        Eigen::MatrixXf logits(hidden.rows(), vocab_size);
+        quantized.project_into(hidden, logits);
+        EXPECT_LT((logits - reference_logits).cwiseAbs().maxCoeff(), 0.05f);
+    }
+}
+
+TEST_F(TokenEmbeddingTest, CheckpointTableTest) {
+    std::string path = "embedding_test_" + std::to_string(::getpid()) + ".bin";
+    {
+        transformer::CheckpointWriter writer(path);
+        embedding->save(writer, "emb.");
+        writer.finish();
+    }
+    transformer::TokenEmbedding mapped(transformer::Checkpoint::open(path), "emb.");
+    std::remove(path.c_str());
+
+    EXPECT_EQ(mapped.get_vocab_size(), vocab_size);
+    EXPECT_EQ(mapped.get_embedding_dim(), embedding_dim);
+    EXPECT_TRUE(mapped.get_embedding_matrix().is_view());
+
+    std::vector<int> ids = {9, 2, 9, 77};
+    EXPECT_EQ(mapped.forward(ids), embedding->forward(ids));
+
+    Eigen::MatrixXf hidden = Eigen::MatrixXf::Random(2, embedding_dim);
+    Eigen::MatrixXf logits(2, vocab_size);
+    mapped.project_into(hidden, logits);
+    EXPECT_TRUE(logits.isApprox(hidden * embedding->get_embedding_matrix().transpose()));
+}
+
 class PositionalEncodingTest : public ::testing::Test {
 protected:
     void SetUp() override {
@@ -119,6 +197,92 @@ TEST_F(PositionalEncodingTest, DifferentSequencesHaveDifferentEmbeddings) {
     EXPECT_NE(encoding_matrix.row(1), encoding_matrix.row(2));
 }
 
+TEST_F(PositionalEncodingTest, OnDemandMatchesTableTest) {
+    transformer::PositionalEncoding on_demand(max_seq_len, embedding_dim, transformer::EncodingTable::OnDemand);
+    EXPECT_THROW(on_demand.get_pos_encoding(), std::logic_error);
+    EXPECT_EQ(on_demand.get_max_seq_len(), max_seq_len);
+
+    const Eigen::MatrixXf& table = pos_encoding->get_pos_encoding();
+    Eigen::MatrixXf x = Eigen::MatrixXf::Random(7, embedding_dim);
+    for (int start : {0, 1, 50, max_seq_len - 7}) {
+        Eigen::MatrixXf expected = x + table.middleRows(start, 7);
+        Eigen::MatrixXf from_table = x;
+        pos_encoding->add_into(from_table, start);
+        Eigen::MatrixXf generated = x;
+        on_demand.add_into(generated, start);
+        EXPECT_TRUE(from_table.isApprox(expected));
+        EXPECT_LT((generated - expected).cwiseAbs().maxCoeff(), 1e-6f) << "start " << start;
+    }
+    EXPECT_THROW(on_demand.add_into(x, max_seq_len - 6), std::out_of_range);
+    EXPECT_THROW(on_demand.add_into(x, -1), std::out_of_range);
+}
+
+TEST(PositionalEncodingLongTest, RecurrenceStaysAccurateTest) {
+    // Far positions must not inherit rounding from the recurrence
+    const int max_seq_len = 5000;
+    const int embedding_dim = 16;
+    transformer::PositionalEncoding encoding(max_seq_len, embedding_dim);
+    const Eigen::MatrixXf& table = encoding.get_pos_encoding();
+    for (int pos : {255, 256, 1000, 4999}) {
+        for (int i = 0; i < embedding_dim; ++i) {
+            double angle = pos * std::pow(10000.0, -2.0 * i / embedding_dim);
+            double expected = i % 2 == 0 ? std::sin(angle) : std::cos(angle);
+            EXPECT_NEAR(table(pos, i), expected, 1e-6) << "pos " << pos << " dim " << i;
+        }
+    }
+}
+
+TEST(RotaryEmbeddingTest, MatchesDirectRotationTest) {
+    const int head_dim = 8;
+    const int num_heads = 3;
+    const int start = 5;
+    transformer::RotaryEmbedding rotary(head_dim);
+    Eigen::MatrixXf x = Eigen::MatrixXf::Random(37, num_heads * head_dim);
+    Eigen::MatrixXf rotated = x;
+    rotary.rotate(rotated, num_heads, start);
+
+    for (int r = 0; r < x.rows(); ++r) {
+        for (int h = 0; h < num_heads; ++h) {
+            for (int i = 0; i < head_dim / 2; ++i) {
+                double angle = (start + r) * std::pow(10000.0, -2.0 * i / head_dim);
+                float a = x(r, h * head_dim + i);
+                float b = x(r, h * head_dim + head_dim / 2 + i);
+                EXPECT_NEAR(rotated(r, h * head_dim + i), a * std::cos(angle) - b * std::sin(angle), 1e-5);
+                EXPECT_NEAR(rotated(r, h * head_dim + head_dim / 2 + i), a * std::sin(angle) + b * std::cos(angle), 1e-5);
+            }
+        }
+    }
+
+    for (auto level : {transformer::SimdLevel::Scalar, transformer::SimdLevel::AVX2, transformer::SimdLevel::AVX512}) {
+        if (!transformer::simd_level_supported(level)) {
+            continue;
+        }
+        Eigen::MatrixXf with_level = x;
+        rotary.rotate(with_level, num_heads, start, level);
+        EXPECT_TRUE(with_level.isApprox(rotated, 1e-6f));
+    }
+
+    EXPECT_THROW(transformer::RotaryEmbedding(7), std::invalid_argument);
+    EXPECT_THROW(rotary.rotate(x, num_heads + 1, 0), std::invalid_argument);
+}
+
+TEST(RotaryEmbeddingTest, ScoresDependOnDistanceOnlyTest) {
+    const int head_dim = 16;
+    transformer::RotaryEmbedding rotary(head_dim);
+    Eigen::MatrixXf q = Eigen::MatrixXf::Random(1, head_dim);
+    Eigen::MatrixXf k = Eigen::MatrixXf::Random(1, head_dim);
+
+    auto score = [&](int q_pos, int k_pos) {
+        Eigen::MatrixXf rq = q;
+        Eigen::MatrixXf rk = k;
+        rotary.rotate(rq, 1, q_pos);
+        rotary.rotate(rk, 1, k_pos);
+        return rq.row(0).dot(rk.row(0));
+    };
+    EXPECT_NEAR(score(3, 1), score(103, 101), 1e-4);
+    EXPECT_NEAR(score(7, 7), q.row(0).dot(k.row(0)), 1e-4);
+}
+
 int main(int argc, char **argv) {
     ::testing::InitGoogleTest(&argc, argv);
     return RUN_ALL_TESTS();
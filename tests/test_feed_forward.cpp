@@ -165,3 +165,79 @@ TEST_F(FeedForwardTest, NormalizationTest) {
     }
 }
 
+
+TEST_F(FeedForwardTest, InferMatchesForwardTest) {
+    Eigen::MatrixXf input = Eigen::MatrixXf::Random(5, d_model);
+    Eigen::MatrixXf expected = feed_forward->forward(input);
+    Eigen::MatrixXf cached_input = feed_forward->get_last_input();
+
+    const transformer::FeedForward& layer = *feed_forward;
+    Eigen::MatrixXf output(5, d_model);
+    Eigen::MatrixXf hidden(5, d_ff);
+    layer.infer(Eigen::MatrixXf::Random(3, d_model), output.topRows(3), hidden.topRows(3));
+    layer.infer(input, output, hidden);
+
+    EXPECT_TRUE(output.isApprox(expected));
+    // The inference path must leave the training caches alone
+    EXPECT_TRUE(feed_forward->get_last_input().isApprox(cached_input));
+
+    Eigen::MatrixXf small_hidden(5, d_ff - 1);
+    EXPECT_THROW(layer.infer(input, output, small_hidden), std::invalid_argument);
+}
+
+TEST_F(FeedForwardTest, ActivationsMatchReferenceTest) {
+    using transformer::Activation;
+    const float kPi = 3.14159265358979f;
+    auto gelu_tanh = [&](float v) {
+        return 0.5f * v * (1.0f + std::tanh(std::sqrt(2.0f / kPi) * (v + 0.044715f * v * v * v)));
+    };
+
+    for (Activation activation : {Activation::ReLU, Activation::GELU_Tanh, Activation::GELU_Erf,
+                                  Activation::SwiGLU, Activation::GeGLU}) {
+        transformer::FeedForward layer(d_model, d_ff, activation);
+        int width = layer.get_hidden_width();
+        ASSERT_EQ(layer.get_W1().cols(), width);
+
+        // Non-zero biases so the fused epilogue is exercised
+        Eigen::VectorXf b1 = Eigen::VectorXf::Random(width);
+        Eigen::VectorXf b2 = Eigen::VectorXf::Random(d_model);
+        layer.update_parameters(Eigen::MatrixXf::Zero(d_model, width), -b1,
+                                Eigen::MatrixXf::Zero(d_ff, d_model), -b2);
+
+        Eigen::MatrixXf input = Eigen::MatrixXf::Random(3, d_model) * 2.0f;
+        Eigen::MatrixXf pre = (input * layer.get_W1()).rowwise() + layer.get_b1().transpose();
+        Eigen::MatrixXf hidden(3, d_ff);
+        for (int i = 0; i < 3; ++i) {
+            for (int j = 0; j < d_ff; ++j) {
+                float v = pre(i, j);
+                switch (activation) {
+                    case Activation::ReLU: hidden(i, j) = std::max(v, 0.0f); break;
+                    case Activation::GELU_Tanh: hidden(i, j) = gelu_tanh(v); break;
+                    case Activation::GELU_Erf: hidden(i, j) = 0.5f * v * (1.0f + std::erf(v / std::sqrt(2.0f))); break;
+                    case Activation::SwiGLU: hidden(i, j) = v / (1.0f + std::exp(-v)) * pre(i, d_ff + j); break;
+                    case Activation::GeGLU: hidden(i, j) = gelu_tanh(v) * pre(i, d_ff + j); break;
+                }
+            }
+        }
+        Eigen::MatrixXf expected = (hidden * layer.get_W2()).rowwise() + layer.get_b2().transpose();
+
+        Eigen::MatrixXf output = layer.forward(input);
+        EXPECT_TRUE(output.isApprox(expected, 1e-5f)) << "activation " << static_cast<int>(activation);
+        EXPECT_TRUE(layer.get_last_hidden().isApprox(hidden, 1e-5f));
+    }
+}
+
+TEST_F(FeedForwardTest, RowBlockedInferTest) {
+    transformer::FeedForward layer(d_model, d_ff, transformer::Activation::SwiGLU);
+    Eigen::MatrixXf input = Eigen::MatrixXf::Random(37, d_model);
+    Eigen::MatrixXf expected = layer.forward(input);
+
+    // 37 rows through a 5-row scratch: seven full blocks and a partial one
+    Eigen::MatrixXf hidden(5, layer.get_hidden_width());
+    Eigen::MatrixXf output(37, d_model);
+    layer.infer(input, output, hidden);
+    EXPECT_TRUE(output.isApprox(expected, 1e-5f));
+
+    EXPECT_GE(layer.rows_per_block(), 16);
+    EXPECT_EQ(layer.rows_per_block() % 16, 0);
+}
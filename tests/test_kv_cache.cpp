@@ -0,0 +1,61 @@
+#include <gtest/gtest.h>
+#include "kv_cache.hpp"
+#include <memory>
+
+class KVCacheTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        d_model = 8;
+        cache = std::make_unique<transformer::KVCache>(d_model, 2);
+    }
+
+    int d_model;
+    std::unique_ptr<transformer::KVCache> cache;
+};
+
+TEST_F(KVCacheTest, ConstructorTest) {
+    EXPECT_EQ(cache->length(), 0);
+    EXPECT_EQ(cache->capacity(), 2);
+    EXPECT_EQ(cache->get_d_model(), d_model);
+    EXPECT_THROW(transformer::KVCache(0), std::invalid_argument);
+}
+
+TEST_F(KVCacheTest, AppendAndGrowTest) {
+    Eigen::MatrixXf k1 = Eigen::MatrixXf::Random(1, d_model);
+    Eigen::MatrixXf v1 = Eigen::MatrixXf::Random(1, d_model);
+    Eigen::MatrixXf k2 = Eigen::MatrixXf::Random(4, d_model);
+    Eigen::MatrixXf v2 = Eigen::MatrixXf::Random(4, d_model);
+
+    cache->append(k1, v1);
+    cache->append(k2, v2);
+
+    // Growing past capacity must keep earlier tokens intact
+    EXPECT_EQ(cache->length(), 5);
+    EXPECT_GE(cache->capacity(), 5);
+    EXPECT_EQ(cache->keys().rows(), 5);
+    EXPECT_TRUE(cache->keys().topRows(1).isApprox(k1));
+    EXPECT_TRUE(cache->values().topRows(1).isApprox(v1));
+    EXPECT_TRUE(cache->keys().bottomRows(4).isApprox(k2));
+    EXPECT_TRUE(cache->values().bottomRows(4).isApprox(v2));
+}
+
+TEST_F(KVCacheTest, TruncateAndClearTest) {
+    Eigen::MatrixXf k = Eigen::MatrixXf::Random(3, d_model);
+    cache->append(k, k);
+
+    cache->truncate(1);
+    EXPECT_EQ(cache->length(), 1);
+    EXPECT_TRUE(cache->keys().isApprox(k.topRows(1)));
+    EXPECT_THROW(cache->truncate(2), std::out_of_range);
+
+    int capacity = cache->capacity();
+    cache->clear();
+    EXPECT_EQ(cache->length(), 0);
+    EXPECT_EQ(cache->capacity(), capacity);
+}
+
+TEST_F(KVCacheTest, ShapeMismatchTest) {
+    Eigen::MatrixXf k = Eigen::MatrixXf::Random(2, d_model + 1);
+    Eigen::MatrixXf v = Eigen::MatrixXf::Random(2, d_model + 1);
+    EXPECT_THROW(cache->append(k, v), std::invalid_argument);
+}
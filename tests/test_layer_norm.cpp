@@ -58,5 +58,68 @@ TEST_F(LayerNormTest, EpsilonTest){
     }
 }
 
+TEST_F(LayerNormTest, InferMatchesForwardTest) {
+    Eigen::MatrixXf input = Eigen::MatrixXf::Random(6, d_model);
+    Eigen::MatrixXf residual = Eigen::MatrixXf::Random(6, d_model);
+    Eigen::MatrixXf expected = layer_norm->forward(input + residual);
+
+    const transformer::LayerNorm& layer = *layer_norm;
+    Eigen::MatrixXf output(6, d_model);
+    layer.add_infer(input, residual, output);
+    EXPECT_TRUE(output.isApprox(expected, 1e-5f));
+
+    // In place, output aliasing the input
+    Eigen::MatrixXf in_place = input + residual;
+    layer.infer(in_place, in_place);
+    EXPECT_TRUE(in_place.isApprox(expected, 1e-5f));
+
+    EXPECT_EQ(layer_norm->get_last_input().rows(), 6);
+    EXPECT_TRUE(layer_norm->get_last_input().isApprox(input + residual));
+}
+
+TEST_F(LayerNormTest, BlockedKernelMatchesReferenceTest) {
+    // 150 tokens span several token blocks; a large offset stresses the variance computation
+    int d = 48;
+    transformer::LayerNorm layer(d, 1e-5f);
+    Eigen::MatrixXf input = (Eigen::MatrixXf::Random(150, d).array() + 1000.0f).matrix();
+
+    Eigen::MatrixXf output(150, d);
+    layer.infer(input, output);
+
+    Eigen::MatrixXd x = input.cast<double>();
+    for (int i = 0; i < x.rows(); ++i) {
+        double mean = x.row(i).mean();
+        double variance = (x.row(i).array() - mean).square().mean();
+        Eigen::RowVectorXd expected = (x.row(i).array() - mean) / std::sqrt(variance + 1e-5);
+        EXPECT_TRUE(output.row(i).cast<double>().isApprox(expected, 1e-3)) << "row " << i;
+    }
+
+    layer.forward(input);
+    EXPECT_NEAR(layer.get_last_mean()(149), x.row(149).mean(), 1e-2);
+}
+
+TEST(RMSNormTest, NormalizationTest) {
+    int d = 12;
+    transformer::RMSNorm norm(d);
+    Eigen::VectorXf gamma_step = Eigen::VectorXf::Random(d);
+    norm.update_parameters(gamma_step);
 
+    Eigen::MatrixXf input = Eigen::MatrixXf::Random(70, d);
+    Eigen::MatrixXf residual = Eigen::MatrixXf::Random(70, d);
+    Eigen::MatrixXf sum = input + residual;
 
+    Eigen::MatrixXf expected(70, d);
+    for (int i = 0; i < sum.rows(); ++i) {
+        float rms = std::sqrt(sum.row(i).squaredNorm() / d + norm.get_epsilon());
+        expected.row(i) = (sum.row(i) / rms).cwiseProduct(norm.get_gamma().transpose());
+    }
+
+    EXPECT_TRUE(norm.forward(sum).isApprox(expected, 1e-5f));
+
+    Eigen::MatrixXf output = input;
+    norm.add_infer(output, residual, output);
+    EXPECT_TRUE(output.isApprox(expected, 1e-5f));
+
+    Eigen::MatrixXf wrong(3, d);
+    EXPECT_THROW(norm.infer(input, wrong), std::invalid_argument);
+}
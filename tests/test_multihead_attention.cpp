@@ -4,6 +4,7 @@
 #include <vector>
 #include <cmath>
 #include <memory>
+#include <limits>
 
 class MultiHeadAttentionTest : public ::testing::Test {
 protected:
@@ -29,6 +30,8 @@ TEST_F(MultiHeadAttentionTest, ConstructorTest) {
 TEST_F(MultiHeadAttentionTest, InvalidDimensionTest) {
     // Test that constructor throws when d_model not divisible by num_heads
     EXPECT_THROW(transformer::MultiHeadAttention(3, 8), std::invalid_argument);
+    EXPECT_THROW(transformer::MultiHeadAttention(0, 8), std::invalid_argument);
+    EXPECT_THROW(transformer::MultiHeadAttention(-2, 8), std::invalid_argument);
 }
 
 TEST_F(MultiHeadAttentionTest, BasicForwardTest) {
@@ -83,7 +86,300 @@ TEST_F(MultiHeadAttentionTest, DifferentInputsTest) {
     EXPECT_FALSE(result1.isApprox(result2, 1e-6));
 }
 
+TEST_F(MultiHeadAttentionTest, PerHeadMatchesNaiveReferenceTest) {
+    // Compare against a straightforward per-head implementation built from the weights
+    transformer::MultiHeadAttention mha(4, 16);
+    int q_len = 5;
+    int kv_len = 7;
+    int d_k = 16 / 4;
+
+    Eigen::MatrixXf query(q_len, 16);
+    Eigen::MatrixXf memory(kv_len, 16);
+    query.setRandom();
+    memory.setRandom();
+
+    auto result = mha.forward(query, memory, memory);
+
+    Eigen::MatrixXf Q = query * mha.get_W_q().transpose();
+    Eigen::MatrixXf K = memory * mha.get_W_k().transpose();
+    Eigen::MatrixXf V = memory * mha.get_W_v().transpose();
+
+    Eigen::MatrixXf concatenated(q_len, 16);
+    for (int head = 0; head < 4; ++head) {
+        Eigen::MatrixXf Qh = Q.block(0, head * d_k, q_len, d_k);
+        Eigen::MatrixXf Kh = K.block(0, head * d_k, kv_len, d_k);
+        Eigen::MatrixXf Vh = V.block(0, head * d_k, kv_len, d_k);
+
+        Eigen::MatrixXf scores = Qh * Kh.transpose() / std::sqrt(static_cast<float>(d_k));
+        for (int i = 0; i < q_len; ++i) {
+            float max_val = scores.row(i).maxCoeff();
+            float sum = 0.0f;
+            for (int j = 0; j < kv_len; ++j) {
+                scores(i, j) = std::exp(scores(i, j) - max_val);
+                sum += scores(i, j);
+            }
+            scores.row(i) /= sum;
+        }
+        concatenated.block(0, head * d_k, q_len, d_k) = scores * Vh;
+    }
+    Eigen::MatrixXf expected = concatenated * mha.get_W_o().transpose();
+
+    ASSERT_EQ(result.rows(), q_len);
+    ASSERT_EQ(result.cols(), 16);
+    for (int i = 0; i < q_len; ++i) {
+        for (int j = 0; j < 16; ++j) {
+            EXPECT_NEAR(result(i, j), expected(i, j), 1e-5);
+        }
+    }
+}
+
+TEST_F(MultiHeadAttentionTest, HeadsDoNotAttendAcrossEachOtherTest) {
+    // Changing one head's slice of the values must only change that head's output slice
+    transformer::ScaledDotProductAttention sdpa(d_model / num_heads);
+    int d_k = d_model / num_heads;
+
+    Eigen::MatrixXf Q(seq_len, d_model);
+    Eigen::MatrixXf K(seq_len, d_model);
+    Eigen::MatrixXf V(seq_len, d_model);
+    Q.setRandom();
+    K.setRandom();
+    V.setRandom();
+
+    Eigen::MatrixXf out1(seq_len, d_model);
+    sdpa.forward_heads(Q, K, V, num_heads, out1);
+
+    V.block(0, d_k, seq_len, d_k).setConstant(42.0f);
+    Eigen::MatrixXf out2(seq_len, d_model);
+    sdpa.forward_heads(Q, K, V, num_heads, out2);
+
+    EXPECT_TRUE(out1.leftCols(d_k).isApprox(out2.leftCols(d_k)));
+    for (int i = 0; i < seq_len; ++i) {
+        for (int j = d_k; j < d_model; ++j) {
+            EXPECT_NEAR(out2(i, j), 42.0f, 1e-4);
+        }
+    }
+}
+
+TEST_F(MultiHeadAttentionTest, FusedSelfAttentionMatchesSeparateProjectionsTest) {
+    // The fused [Q | K | V] GEMM must agree with projecting each input on its own
+    Eigen::MatrixXf input(seq_len, d_model);
+    input.setRandom();
+    Eigen::MatrixXf key_copy = input;
+    Eigen::MatrixXf value_copy = input;
+
+    auto fused = attention->forward(input, input, input);
+    auto shared_kv = attention->forward(input, key_copy, key_copy);
+    auto separate = attention->forward(input, key_copy, value_copy);
+
+    EXPECT_EQ(attention->get_W_qkv().rows(), d_model);
+    EXPECT_EQ(attention->get_W_qkv().cols(), 3 * d_model);
+    EXPECT_TRUE(fused.isApprox(shared_kv, 1e-5f));
+    EXPECT_TRUE(fused.isApprox(separate, 1e-5f));
+}
+
+TEST_F(MultiHeadAttentionTest, CausalMaskIgnoresFutureTokensTest) {
+    // With a causal mask, earlier outputs must not change when later tokens are appended
+    Eigen::MatrixXf input(6, d_model);
+    input.setRandom();
+    Eigen::MatrixXf prefix = input.topRows(4);
+
+    auto full = attention->forward(input, input, input, transformer::AttentionMask::causal_mask());
+    auto partial = attention->forward(prefix, prefix, prefix, transformer::AttentionMask::causal_mask());
+
+    EXPECT_TRUE(full.topRows(4).isApprox(partial, 1e-5f));
+}
+
+TEST_F(MultiHeadAttentionTest, AdditiveMaskParameterIsAppliedTest) {
+    // Blocking every key except the first makes every query produce the same output
+    Eigen::MatrixXf input(seq_len, d_model);
+    input.setRandom();
+
+    Eigen::MatrixXf mask = Eigen::MatrixXf::Constant(seq_len, seq_len, -std::numeric_limits<float>::infinity());
+    mask.col(0).setZero();
+
+    auto result = attention->forward(input, input, input, mask);
+    for (int i = 1; i < seq_len; ++i) {
+        EXPECT_TRUE(result.row(i).isApprox(result.row(0), 1e-5f));
+    }
+
+    auto unmasked = attention->forward(input, input, input);
+    EXPECT_FALSE(result.isApprox(unmasked, 1e-5f));
+}
+
+TEST_F(MultiHeadAttentionTest, TiledKernelMatchesStandardTest) {
+    Eigen::MatrixXf input(40, d_model);
+    input.setRandom();
+
+    auto standard = attention->forward(input, input, input, transformer::AttentionMask::causal_mask());
+    attention->set_attention_kernel(transformer::AttentionKernel::Tiled, 16);
+    auto tiled = attention->forward(input, input, input, transformer::AttentionMask::causal_mask());
+
+    EXPECT_TRUE(tiled.isApprox(standard, 1e-5f));
+}
+
+TEST_F(MultiHeadAttentionTest, IncrementalDecodingMatchesFullForwardTest) {
+    // A prompt chunk followed by single-token steps must reproduce the full causal pass
+    int total = 9;
+    Eigen::MatrixXf input(total, d_model);
+    input.setRandom();
+
+    auto expected = attention->forward(input, input, input, transformer::AttentionMask::causal_mask());
+
+    transformer::KVCache cache(d_model, 4);
+    Eigen::MatrixXf prompt = input.topRows(4);
+    auto prefill = attention->forward_incremental(prompt, cache);
+    EXPECT_TRUE(prefill.isApprox(expected.topRows(4), 1e-5f));
+
+    for (int t = 4; t < total; ++t) {
+        Eigen::MatrixXf token = input.row(t);
+        auto step = attention->forward_incremental(token, cache);
+        ASSERT_EQ(step.rows(), 1);
+        EXPECT_TRUE(step.isApprox(expected.row(t), 1e-5f)) << "step " << t;
+    }
+    EXPECT_EQ(cache.length(), total);
+}
+
+TEST_F(MultiHeadAttentionTest, IncrementalCacheWidthMismatchTest) {
+    transformer::KVCache cache(d_model * 2);
+    Eigen::MatrixXf token = Eigen::MatrixXf::Random(1, d_model);
+    EXPECT_THROW(attention->forward_incremental(token, cache), std::invalid_argument);
+}
+
+TEST_F(MultiHeadAttentionTest, PagedDecodingMatchesContiguousCacheTest) {
+    // Pages of 4 tokens so the sequence spans several pages, including a partial one
+    int total = 11;
+    Eigen::MatrixXf input(total, d_model);
+    input.setRandom();
+
+    transformer::KVCache contiguous(d_model);
+    transformer::PagedKVCache paged(d_model, 4, 16);
+    int seq = paged.create_sequence();
+
+    Eigen::MatrixXf prompt = input.topRows(5);
+    auto expected_prefill = attention->forward_incremental(prompt, contiguous);
+    auto paged_prefill = attention->forward_incremental(prompt, paged, seq);
+    EXPECT_TRUE(paged_prefill.isApprox(expected_prefill, 1e-5f));
+
+    for (int t = 5; t < total; ++t) {
+        Eigen::MatrixXf token = input.row(t);
+        auto expected = attention->forward_incremental(token, contiguous);
+        auto result = attention->forward_incremental(token, paged, seq);
+        EXPECT_TRUE(result.isApprox(expected, 1e-5f)) << "step " << t;
+    }
+}
+
+TEST_F(MultiHeadAttentionTest, Bf16PagedDecodingTest) {
+    // Keys and values rounded to bf16 keep outputs within bf16 precision of the fp32 cache
+    Eigen::MatrixXf input(9, d_model);
+    input.setRandom();
+
+    transformer::PagedKVCache fp32(d_model, 4, 16);
+    transformer::PagedKVCache bf16(d_model, 4, 16, transformer::KVStorage::BF16);
+    int seq_fp32 = fp32.create_sequence();
+    int seq_bf16 = bf16.create_sequence();
+
+    for (int t = 0; t < input.rows(); ++t) {
+        Eigen::MatrixXf token = input.row(t);
+        auto expected = attention->forward_incremental(token, fp32, seq_fp32);
+        auto result = attention->forward_incremental(token, bf16, seq_bf16);
+        EXPECT_TRUE(result.isApprox(expected, 2e-2f)) << "step " << t;
+    }
+}
+
+TEST_F(MultiHeadAttentionTest, ForkedSequencesDivergeIndependentlyTest) {
+    // Two continuations of a shared prompt must match running each one from scratch
+    Eigen::MatrixXf prompt(6, d_model);
+    Eigen::MatrixXf token_a(1, d_model);
+    Eigen::MatrixXf token_b(1, d_model);
+    prompt.setRandom();
+    token_a.setRandom();
+    token_b.setRandom();
+
+    transformer::PagedKVCache paged(d_model, 4, 16);
+    int seq_a = paged.create_sequence();
+    attention->forward_incremental(prompt, paged, seq_a);
+    int seq_b = paged.fork_sequence(seq_a);
+
+    auto result_a = attention->forward_incremental(token_a, paged, seq_a);
+    // The caller-buffer overload writes the same result
+    transformer::AttentionContext context;
+    Eigen::MatrixXf result_b(1, d_model);
+    attention->forward_incremental_into(token_b, paged, seq_b, result_b, context);
+
+    Eigen::MatrixXf full_a(7, d_model);
+    Eigen::MatrixXf full_b(7, d_model);
+    full_a << prompt, token_a;
+    full_b << prompt, token_b;
+    auto expected_a = attention->forward(full_a, full_a, full_a, transformer::AttentionMask::causal_mask());
+    auto expected_b = attention->forward(full_b, full_b, full_b, transformer::AttentionMask::causal_mask());
+
+    EXPECT_TRUE(result_a.isApprox(expected_a.bottomRows(1), 1e-5f));
+    EXPECT_TRUE(result_b.isApprox(expected_b.bottomRows(1), 1e-5f));
+}
+
+TEST_F(MultiHeadAttentionTest, RotaryDecodingMatchesFullForwardTest) {
+    // Rotated keys are cached, so decode positions must continue from the cached length
+    attention->set_rotary_embedding(true);
+    EXPECT_TRUE(attention->uses_rotary_embedding());
+    int total = 10;
+    Eigen::MatrixXf input = Eigen::MatrixXf::Random(total, d_model);
+    auto expected = attention->forward(input, input, input, transformer::AttentionMask::causal_mask());
+
+    attention->set_rotary_embedding(false);
+    auto unrotated = attention->forward(input, input, input, transformer::AttentionMask::causal_mask());
+    EXPECT_FALSE(unrotated.bottomRows(total - 1).isApprox(expected.bottomRows(total - 1), 1e-3f));
+    attention->set_rotary_embedding(true);
+
+    transformer::KVCache contiguous(d_model);
+    transformer::PagedKVCache paged(d_model, 4, 16);
+    int seq = paged.create_sequence();
+    Eigen::MatrixXf prompt = input.topRows(3);
+    EXPECT_TRUE(attention->forward_incremental(prompt, contiguous).isApprox(expected.topRows(3), 1e-5f));
+    EXPECT_TRUE(attention->forward_incremental(prompt, paged, seq).isApprox(expected.topRows(3), 1e-5f));
+    for (int t = 3; t < total; ++t) {
+        Eigen::MatrixXf token = input.row(t);
+        EXPECT_TRUE(attention->forward_incremental(token, contiguous).isApprox(expected.row(t), 1e-5f)) << "step " << t;
+        EXPECT_TRUE(attention->forward_incremental(token, paged, seq).isApprox(expected.row(t), 1e-5f)) << "step " << t;
+    }
+
+    // Positions restart at every packed sequence
+    transformer::RaggedBatch batch;
+    batch.tokens.resize(total + 4, d_model);
+    batch.tokens << input.topRows(4), input;
+    batch.offsets = {0, 4, total + 4};
+    auto packed = attention->forward_batch(batch, true);
+    EXPECT_TRUE(packed.sequence(0).isApprox(expected.topRows(4), 1e-5f));
+    EXPECT_TRUE(packed.sequence(1).isApprox(expected, 1e-5f));
+
+    transformer::MultiHeadAttention odd_heads(2, 6);
+    EXPECT_THROW(odd_heads.set_rotary_embedding(true), std::invalid_argument);
+}
+
+TEST_F(MultiHeadAttentionTest, CallerContextMatchesOwnContextTest) {
+    Eigen::MatrixXf x = Eigen::MatrixXf::Random(6, d_model);
+    Eigen::MatrixXf memory = Eigen::MatrixXf::Random(4, d_model);
+    auto causal = transformer::AttentionMask::causal_mask();
+    Eigen::MatrixXf self_expected = attention->forward(x, x, x, causal);
+    Eigen::MatrixXf cross_expected = attention->forward(x, memory, memory);
+
+    const transformer::MultiHeadAttention& shared = *attention;
+    transformer::AttentionContext context;
+    Eigen::MatrixXf out(6, d_model);
+    shared.forward_into(x, x, x, causal, out, context);
+    EXPECT_TRUE(out.isApprox(self_expected, 1e-6f));
+    shared.forward_into(x, memory, memory, transformer::AttentionMask(), out, context);
+    EXPECT_TRUE(out.isApprox(cross_expected, 1e-6f));
+
+    transformer::KVCache cache(d_model, 4);
+    Eigen::MatrixXf prefill = shared.forward_incremental(x.topRows(4), cache, context);
+    EXPECT_TRUE(prefill.isApprox(self_expected.topRows(4), 1e-5f));
+    for (int t = 4; t < 6; ++t) {
+        Eigen::MatrixXf step = shared.forward_incremental(x.row(t), cache, context);
+        EXPECT_TRUE(step.isApprox(self_expected.row(t), 1e-5f)) << "step " << t;
+    }
+}
+
 int main(int argc, char **argv) {
     ::testing::InitGoogleTest(&argc, argv);
     return RUN_ALL_TESTS();
-}
\ No newline at end of file
+}
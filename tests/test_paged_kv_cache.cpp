@@ -0,0 +1,137 @@
+#include <gtest/gtest.h>
+#include "paged_kv_cache.hpp"
+#include <memory>
+
+class PagedKVCacheTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        d_model = 4;
+        page_size = 4;
+        num_pages = 8;
+        cache = std::make_unique<transformer::PagedKVCache>(d_model, page_size, num_pages);
+    }
+
+    // Gather a sequence's keys back into one matrix through its page table
+    Eigen::MatrixXf gather_keys(int seq) {
+        int length = cache->length(seq);
+        Eigen::MatrixXf keys(length, d_model);
+        const auto& pages = cache->page_table(seq);
+        for (size_t i = 0; i < pages.size(); ++i) {
+            int count = cache->tokens_in_page(seq, static_cast<int>(i));
+            keys.middleRows(i * page_size, count) = cache->page_keys(pages[i]).topRows(count);
+        }
+        return keys;
+    }
+
+    int d_model;
+    int page_size;
+    int num_pages;
+    std::unique_ptr<transformer::PagedKVCache> cache;
+};
+
+TEST_F(PagedKVCacheTest, ConstructorTest) {
+    EXPECT_EQ(cache->num_free_pages(), num_pages);
+    EXPECT_EQ(cache->page_size(), page_size);
+    EXPECT_THROW(transformer::PagedKVCache(4, 0, 8), std::invalid_argument);
+}
+
+TEST_F(PagedKVCacheTest, PagesGrowWithTokensTest) {
+    int seq = cache->create_sequence();
+    Eigen::MatrixXf keys = Eigen::MatrixXf::Random(6, d_model);
+    Eigen::MatrixXf values = Eigen::MatrixXf::Random(6, d_model);
+
+    cache->append(seq, keys.topRows(1), values.topRows(1));
+    EXPECT_EQ(cache->page_table(seq).size(), 1u);
+
+    cache->append(seq, keys.bottomRows(5), values.bottomRows(5));
+    EXPECT_EQ(cache->length(seq), 6);
+    EXPECT_EQ(cache->page_table(seq).size(), 2u);
+    EXPECT_EQ(cache->num_free_pages(), num_pages - 2);
+    EXPECT_EQ(cache->tokens_in_page(seq, 1), 2);
+    EXPECT_TRUE(gather_keys(seq).isApprox(keys));
+
+    const auto& pages = cache->page_table(seq);
+    EXPECT_TRUE(cache->page_values(pages[1]).topRows(2).isApprox(values.bottomRows(2)));
+}
+
+TEST_F(PagedKVCacheTest, FreeSequenceReturnsPagesTest) {
+    int seq = cache->create_sequence();
+    Eigen::MatrixXf keys = Eigen::MatrixXf::Random(9, d_model);
+    cache->append(seq, keys, keys);
+    EXPECT_EQ(cache->num_free_pages(), num_pages - 3);
+
+    cache->free_sequence(seq);
+    EXPECT_EQ(cache->num_free_pages(), num_pages);
+    EXPECT_THROW(cache->length(seq), std::out_of_range);
+}
+
+TEST_F(PagedKVCacheTest, ForkSharesPagesCopyOnWriteTest) {
+    int parent = cache->create_sequence();
+    Eigen::MatrixXf prefix = Eigen::MatrixXf::Random(6, d_model);
+    cache->append(parent, prefix, prefix);
+
+    int child = cache->fork_sequence(parent);
+    EXPECT_EQ(cache->length(child), 6);
+    EXPECT_EQ(cache->num_free_pages(), num_pages - 2);
+    EXPECT_EQ(cache->page_table(child), cache->page_table(parent));
+    EXPECT_EQ(cache->ref_count(cache->page_table(parent)[0]), 2);
+
+    // Appending to the child copies only the shared partial page
+    Eigen::MatrixXf child_token = Eigen::MatrixXf::Constant(1, d_model, 7.0f);
+    EXPECT_EQ(cache->pages_needed(child, 1), 1);
+    cache->append(child, child_token, child_token);
+
+    EXPECT_EQ(cache->page_table(child)[0], cache->page_table(parent)[0]);
+    EXPECT_NE(cache->page_table(child)[1], cache->page_table(parent)[1]);
+    EXPECT_EQ(cache->num_free_pages(), num_pages - 3);
+
+    Eigen::MatrixXf expected_child(7, d_model);
+    expected_child << prefix, child_token;
+    EXPECT_TRUE(gather_keys(child).isApprox(expected_child));
+    EXPECT_TRUE(gather_keys(parent).isApprox(prefix));
+
+    cache->free_sequence(parent);
+    EXPECT_EQ(cache->ref_count(cache->page_table(child)[0]), 1);
+    EXPECT_EQ(cache->num_free_pages(), num_pages - 2);
+}
+
+TEST_F(PagedKVCacheTest, Bf16StorageTest) {
+    transformer::PagedKVCache bf16(d_model, page_size, num_pages, transformer::KVStorage::BF16);
+    EXPECT_EQ(bf16.arena_bytes() * 2, cache->arena_bytes());
+
+    int parent = bf16.create_sequence();
+    Eigen::MatrixXf keys = Eigen::MatrixXf::Random(6, d_model);
+    Eigen::MatrixXf values = Eigen::MatrixXf::Random(6, d_model);
+    bf16.append(parent, keys, values);
+    int child = bf16.fork_sequence(parent);
+    Eigen::MatrixXf token = Eigen::MatrixXf::Constant(1, d_model, 0.5f);
+    bf16.append(child, token, token);
+
+    const auto& pages = bf16.page_table(child);
+    Eigen::MatrixXf page_k(3, 2);
+    Eigen::MatrixXf page_v(3, 2);
+    bf16.load_page(pages[1], 3, 1, 2, page_k, page_v);
+    EXPECT_TRUE(page_k.topRows(2).isApprox(keys.block(4, 1, 2, 2), 1e-2f));
+    EXPECT_TRUE(page_v.topRows(2).isApprox(values.block(4, 1, 2, 2), 1e-2f));
+    EXPECT_TRUE(page_k.row(2).isConstant(0.5f));
+
+    // The parent's page is untouched by the child's copy-on-write append
+    Eigen::MatrixXf parent_k(2, d_model);
+    Eigen::MatrixXf parent_v(2, d_model);
+    bf16.load_page(bf16.page_table(parent)[1], 2, 0, d_model, parent_k, parent_v);
+    EXPECT_TRUE(parent_k.isApprox(keys.bottomRows(2), 1e-2f));
+    EXPECT_THROW(bf16.load_page(pages[1], 3, 3, 2, page_k, page_v), std::out_of_range);
+    EXPECT_THROW(bf16.page_keys(pages[0]), std::logic_error);
+}
+
+TEST_F(PagedKVCacheTest, OutOfPagesTest) {
+    int seq = cache->create_sequence();
+    Eigen::MatrixXf keys = Eigen::MatrixXf::Random(num_pages * page_size, d_model);
+    cache->append(seq, keys, keys);
+    EXPECT_EQ(cache->num_free_pages(), 0);
+
+    // A failed append must leave the sequence untouched
+    Eigen::MatrixXf extra = Eigen::MatrixXf::Random(1, d_model);
+    EXPECT_THROW(cache->append(seq, extra, extra), std::runtime_error);
+    EXPECT_EQ(cache->length(seq), num_pages * page_size);
+}
@@ -0,0 +1,242 @@
+#include <gtest/gtest.h>
+#include "quantization.hpp"
+#include "attention.hpp"
+#include "feed_forward.hpp"
+
+namespace {
+
+float relative_error(const Eigen::MatrixXf& actual, const Eigen::MatrixXf& expected) {
+    return (actual - expected).norm() / expected.norm();
+}
+
+} // namespace
+
+class QuantizationTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        W = Eigen::MatrixXf::Random(100, 40);
+        W.col(7).setZero();
+    }
+
+    Eigen::MatrixXf W;
+};
+
+TEST_F(QuantizationTest, Int8RoundTripTest) {
+    transformer::QuantizedMatrix q(W, transformer::WeightFormat::INT8);
+    EXPECT_EQ(q.rows(), 100);
+    EXPECT_EQ(q.cols(), 40);
+
+    Eigen::MatrixXf restored = q.dequantize();
+    for (int o = 0; o < W.cols(); ++o) {
+        float half_step = W.col(o).cwiseAbs().maxCoeff() / 127.0f / 2.0f;
+        EXPECT_LE((restored.col(o) - W.col(o)).cwiseAbs().maxCoeff(), half_step * 1.001f + 1e-7f);
+    }
+    EXPECT_TRUE(restored.col(7).isZero());
+}
+
+TEST_F(QuantizationTest, MatmulMatchesDequantizedTest) {
+    transformer::QuantizedMatrix q(W, transformer::WeightFormat::INT8);
+    Eigen::MatrixXf reference_weights = q.dequantize();
+
+    for (auto level : {transformer::SimdLevel::Scalar, transformer::SimdLevel::AVX2, transformer::SimdLevel::AVX512}) {
+        if (!transformer::simd_level_supported(level)) {
+            continue;
+        }
+        // 1 to 19 tokens covers single tokens, full blocks and partial blocks
+        for (int seq_len : {1, 3, 8, 19}) {
+            Eigen::MatrixXf x = Eigen::MatrixXf::Random(seq_len, 100);
+            Eigen::MatrixXf y(seq_len, 40);
+            q.matmul(x, y, 0, -1, level);
+            EXPECT_TRUE(y.isApprox(x * reference_weights, 1e-5f)) << "level " << static_cast<int>(level);
+
+            Eigen::MatrixXf part(seq_len, 15);
+            q.matmul(x, part, 20, 15, level);
+            EXPECT_TRUE(part.isApprox(x * reference_weights.middleCols(20, 15), 1e-5f));
+        }
+    }
+}
+
+TEST_F(QuantizationTest, Fp16ConversionTest) {
+    for (float value : {0.0f, -0.0f, 1.0f, -2.5f, 0.1f, 65504.0f, 6.1035156e-05f, 5.9604645e-08f, 1e-3f}) {
+        float restored = transformer::fp16_to_float(transformer::float_to_fp16(value));
+        EXPECT_NEAR(restored, value, std::abs(value) * 4.9e-4f + 3e-8f) << value;
+    }
+    EXPECT_EQ(transformer::float_to_fp16(1.0f), 0x3c00);
+    EXPECT_EQ(transformer::float_to_fp16(-2.0f), 0xc000);
+    // 1 + 2^-11 is halfway between 1 and the next half, ties round to even
+    EXPECT_EQ(transformer::float_to_fp16(1.00048828125f), 0x3c00);
+    EXPECT_EQ(transformer::float_to_fp16(1e6f), 0x7c00);
+    EXPECT_TRUE(std::isinf(transformer::fp16_to_float(0x7c00)));
+}
+
+TEST_F(QuantizationTest, Bf16ConversionTest) {
+    EXPECT_EQ(transformer::float_to_bf16(1.0f), 0x3f80);
+    EXPECT_EQ(transformer::float_to_bf16(-2.0f), 0xc000);
+    // 1 + 2^-8 is halfway between 1 and the next bf16, ties round to even
+    EXPECT_EQ(transformer::float_to_bf16(1.00390625f), 0x3f80);
+    EXPECT_EQ(transformer::float_to_bf16(1.01171875f), 0x3f82);
+    EXPECT_TRUE(std::isnan(transformer::bf16_to_float(transformer::float_to_bf16(std::nanf("")))));
+
+    // The bulk conversion (AVX-512 BF16 when present) agrees with the scalar one
+    Eigen::VectorXf values = Eigen::VectorXf::Random(37) * 100.0f;
+    std::vector<uint16_t> packed(values.size());
+    std::vector<float> restored(values.size());
+    transformer::float_to_bf16(values.data(), packed.data(), values.size());
+    transformer::bf16_to_float(packed.data(), restored.data(), packed.size());
+    for (int i = 0; i < values.size(); ++i) {
+        EXPECT_EQ(packed[i], transformer::float_to_bf16(values[i]));
+        EXPECT_NEAR(restored[i], values[i], std::abs(values[i]) / 256.0f);
+    }
+}
+
+TEST_F(QuantizationTest, HalfMatmulMatchesDequantizedTest) {
+    for (auto format : {transformer::WeightFormat::FP16, transformer::WeightFormat::BF16}) {
+        transformer::QuantizedMatrix q(W, format);
+        Eigen::MatrixXf reference_weights = q.dequantize();
+        float tolerance = format == transformer::WeightFormat::FP16 ? 1e-3f : 8e-3f;
+        EXPECT_TRUE(reference_weights.isApprox(W, tolerance));
+        EXPECT_EQ(q.bytes(), 40u * 128u * sizeof(uint16_t));
+
+        for (auto level : {transformer::SimdLevel::Scalar, transformer::SimdLevel::AVX2, transformer::SimdLevel::AVX512}) {
+            if (!transformer::simd_level_supported(level)) {
+                continue;
+            }
+            for (int seq_len : {1, 3, 8, 19}) {
+                Eigen::MatrixXf x = Eigen::MatrixXf::Random(seq_len, 100);
+                Eigen::MatrixXf y(seq_len, 40);
+                q.matmul(x, y, 0, -1, level);
+                EXPECT_TRUE(y.isApprox(x * reference_weights, 1e-5f)) << "level " << static_cast<int>(level);
+
+                Eigen::MatrixXf part(seq_len, 15);
+                q.matmul(x, part, 20, 15, level);
+                EXPECT_TRUE(part.isApprox(x * reference_weights.middleCols(20, 15), 1e-5f));
+            }
+        }
+    }
+}
+
+TEST_F(QuantizationTest, Q4RoundTripTest) {
+    for (auto format : {transformer::WeightFormat::Q4, transformer::WeightFormat::Q4_ZP}) {
+        transformer::QuantizedMatrix q(W, format);
+        Eigen::MatrixXf restored = q.dequantize();
+        for (int o = 0; o < W.cols(); ++o) {
+            for (int k0 = 0; k0 < W.rows(); k0 += 32) {
+                auto group = W.col(o).segment(k0, std::min<int>(32, W.rows() - k0));
+                float range = format == transformer::WeightFormat::Q4
+                    ? group.cwiseAbs().maxCoeff() * 2.0f / 14.0f
+                    : (std::max(0.0f, group.maxCoeff()) - std::min(0.0f, group.minCoeff())) / 15.0f;
+                // Half a step, widened for the fp16 scale and a clamped extreme code
+                auto error = (restored.col(o).segment(k0, group.size()) - group).cwiseAbs().maxCoeff();
+                EXPECT_LE(error, range * 0.51f + 1e-6f);
+            }
+        }
+        EXPECT_TRUE(restored.col(7).isZero());
+        EXPECT_LT(q.bytes(), W.size() * sizeof(float) / 5);
+    }
+}
+
+TEST_F(QuantizationTest, Q4MatmulMatchesDequantizedTest) {
+    for (auto format : {transformer::WeightFormat::Q4, transformer::WeightFormat::Q4_ZP}) {
+        transformer::QuantizedMatrix q(W, format);
+        Eigen::MatrixXf reference_weights = q.dequantize();
+
+        for (auto level : {transformer::SimdLevel::Scalar, transformer::SimdLevel::AVX2, transformer::SimdLevel::AVX512}) {
+            if (!transformer::simd_level_supported(level)) {
+                continue;
+            }
+            for (int seq_len : {1, 3, 8, 19}) {
+                Eigen::MatrixXf x = Eigen::MatrixXf::Random(seq_len, 100);
+                Eigen::MatrixXf y(seq_len, 40);
+                q.matmul(x, y, 0, -1, level);
+                EXPECT_TRUE(y.isApprox(x * reference_weights, 1e-5f)) << "level " << static_cast<int>(level);
+
+                Eigen::MatrixXf part(seq_len, 15);
+                q.matmul(x, part, 20, 15, level);
+                EXPECT_TRUE(part.isApprox(x * reference_weights.middleCols(20, 15), 1e-5f));
+            }
+        }
+    }
+}
+
+TEST_F(QuantizationTest, InvalidArgumentsTest) {
+    EXPECT_THROW(transformer::QuantizedMatrix(W, transformer::WeightFormat::FP32), std::invalid_argument);
+
+    transformer::QuantizedMatrix q(W, transformer::WeightFormat::INT8);
+    Eigen::MatrixXf x = Eigen::MatrixXf::Random(2, 99);
+    Eigen::MatrixXf y(2, 40);
+    EXPECT_THROW(q.matmul(x, y), std::invalid_argument);
+    Eigen::MatrixXf x_ok = Eigen::MatrixXf::Random(2, 100);
+    EXPECT_THROW(q.matmul(x_ok, y, 10, 40), std::out_of_range);
+}
+
+// Per-channel int8 weights keep layer outputs within 2% (relative Frobenius error) of fp32
+TEST_F(QuantizationTest, FeedForwardAccuracyTest) {
+    transformer::FeedForward layer(64, 256, transformer::Activation::SwiGLU);
+    Eigen::MatrixXf x = Eigen::MatrixXf::Random(10, 64);
+    Eigen::MatrixXf expected = layer.forward(x);
+    std::size_t fp32_bytes = layer.weight_bytes();
+
+    layer.quantize_weights(transformer::WeightFormat::INT8);
+    EXPECT_EQ(layer.get_weight_format(), transformer::WeightFormat::INT8);
+    EXPECT_LT(relative_error(layer.forward(x), expected), 2e-2f);
+    EXPECT_LT(layer.weight_bytes(), fp32_bytes * 3 / 10);
+
+    EXPECT_THROW(layer.update_parameters(Eigen::MatrixXf(), Eigen::VectorXf(), Eigen::MatrixXf(), Eigen::VectorXf()),
+                 std::logic_error);
+}
+
+TEST_F(QuantizationTest, MultiHeadAttentionAccuracyTest) {
+    transformer::MultiHeadAttention attention(4, 64);
+    Eigen::MatrixXf x = Eigen::MatrixXf::Random(12, 64);
+    Eigen::MatrixXf memory = Eigen::MatrixXf::Random(7, 64);
+    Eigen::MatrixXf self_expected = attention.forward(x, x, x, transformer::AttentionMask::causal_mask());
+    Eigen::MatrixXf cross_expected = attention.forward(x, memory, memory);
+
+    attention.quantize_weights(transformer::WeightFormat::INT8);
+    EXPECT_LT(relative_error(attention.forward(x, x, x, transformer::AttentionMask::causal_mask()), self_expected), 2e-2f);
+    EXPECT_LT(relative_error(attention.forward(x, memory, memory), cross_expected), 2e-2f);
+    // The float weights are gone, so the per-projection getters come back empty
+    EXPECT_EQ(attention.get_W_q().size(), 0);
+    EXPECT_EQ(attention.get_W_k().size(), 0);
+    EXPECT_EQ(attention.get_W_v().size(), 0);
+
+    attention.initialize_weights();
+    EXPECT_EQ(attention.get_weight_format(), transformer::WeightFormat::FP32);
+    EXPECT_EQ(attention.get_W_qkv().cols(), 3 * 64);
+    EXPECT_EQ(attention.get_W_v().rows(), 64);
+    EXPECT_EQ(attention.get_W_v().cols(), 64);
+}
+
+// 4-bit groups lose more precision than int8; outputs stay within 20% of fp32
+TEST_F(QuantizationTest, Q4FeedForwardAccuracyTest) {
+    for (auto format : {transformer::WeightFormat::Q4, transformer::WeightFormat::Q4_ZP}) {
+        transformer::FeedForward layer(64, 256, transformer::Activation::SwiGLU);
+        Eigen::MatrixXf x = Eigen::MatrixXf::Random(10, 64);
+        Eigen::MatrixXf expected = layer.forward(x);
+        std::size_t fp32_bytes = layer.weight_bytes();
+
+        layer.quantize_weights(format);
+        EXPECT_LT(relative_error(layer.forward(x), expected), 0.2f);
+        EXPECT_LT(layer.weight_bytes(), fp32_bytes * 2 / 10);
+    }
+}
+
+TEST_F(QuantizationTest, Q4MultiHeadAttentionAccuracyTest) {
+    transformer::MultiHeadAttention attention(4, 64);
+    Eigen::MatrixXf x = Eigen::MatrixXf::Random(12, 64);
+    Eigen::MatrixXf expected = attention.forward(x, x, x, transformer::AttentionMask::causal_mask());
+
+    attention.quantize_weights(transformer::WeightFormat::Q4_ZP);
+    EXPECT_LT(relative_error(attention.forward(x, x, x, transformer::AttentionMask::causal_mask()), expected), 0.2f);
+}
+
+TEST_F(QuantizationTest, Bf16FeedForwardAccuracyTest) {
+    transformer::FeedForward layer(64, 256, transformer::Activation::GELU_Tanh);
+    Eigen::MatrixXf x = Eigen::MatrixXf::Random(10, 64);
+    Eigen::MatrixXf expected = layer.forward(x);
+    std::size_t fp32_bytes = layer.weight_bytes();
+
+    layer.quantize_weights(transformer::WeightFormat::BF16);
+    EXPECT_LT(relative_error(layer.forward(x), expected), 1e-2f);
+    EXPECT_LT(layer.weight_bytes(), fp32_bytes * 6 / 10);
+}
@@ -0,0 +1,171 @@
+#include <gtest/gtest.h>
+#include "scheduler.hpp"
+#include <chrono>
+#include <vector>
+
+class InferenceSchedulerTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        vocab_size = 50;
+        d_model = 16;
+        max_seq_len = 64;
+    }
+
+    // Greedy decode of one request alone, recomputing the whole sequence every token
+    std::vector<int> reference_generate(std::vector<int> tokens, int max_new_tokens) {
+        std::vector<int> generated;
+        for (int t = 0; t < max_new_tokens; ++t) {
+            Eigen::MatrixXf x = positions.forward(embedding.forward(tokens));
+            Eigen::MatrixXf h = x + attention.forward(x, x, x, transformer::AttentionMask::causal_mask());
+            h += feed_forward.forward(h);
+            Eigen::MatrixXf y = norm.forward(h);
+            Eigen::RowVectorXf logits = y.bottomRows(1) * embedding.get_embedding_matrix().transpose();
+            Eigen::Index next;
+            logits.maxCoeff(&next);
+            tokens.push_back(static_cast<int>(next));
+            generated.push_back(static_cast<int>(next));
+        }
+        return generated;
+    }
+
+    int vocab_size;
+    int d_model;
+    int max_seq_len;
+    transformer::TokenEmbedding embedding{50, 16};
+    transformer::PositionalEncoding positions{64, 16};
+    transformer::MultiHeadAttention attention{4, 16};
+    transformer::FeedForward feed_forward{16, 32};
+    transformer::LayerNorm norm{16};
+};
+
+TEST_F(InferenceSchedulerTest, MatchesSequentialGreedyDecodeTest) {
+    std::vector<std::vector<int>> prompts = {{1, 2, 3, 4, 5, 6, 7}, {9}, {10, 11, 12, 13, 14, 15, 16, 17, 18, 19, 20}};
+    std::vector<int> max_new = {5, 8, 3};
+
+    //Small budgets force chunked prefill interleaved with decode steps
+    transformer::SchedulerConfig config;
+    config.max_batch_tokens = 6;
+    config.max_prefill_tokens = 4;
+    config.page_size = 4;
+    config.num_pages = 32;
+    transformer::InferenceScheduler scheduler(embedding, positions, attention, feed_forward, norm, config);
+
+    std::vector<int> ids;
+    ids.push_back(scheduler.submit(prompts[0], max_new[0]));
+    scheduler.step();
+    ids.push_back(scheduler.submit(prompts[1], max_new[1]));
+    scheduler.step();
+    ids.push_back(scheduler.submit(prompts[2], max_new[2]));
+    scheduler.run_until_idle();
+
+    auto completed = scheduler.take_completed();
+    ASSERT_EQ(completed.size(), 3u);
+    for (const auto& request : completed) {
+        int i = static_cast<int>(std::find(ids.begin(), ids.end(), request.id) - ids.begin());
+        ASSERT_LT(i, 3);
+        EXPECT_EQ(request.output_tokens, reference_generate(prompts[i], max_new[i])) << "request " << i;
+        EXPECT_GE(request.time_to_first_token_ms, 0.0);
+        EXPECT_GE(request.latency_ms, request.time_to_first_token_ms);
+    }
+    EXPECT_TRUE(scheduler.idle());
+    EXPECT_EQ(scheduler.get_cache().num_free_pages(), config.num_pages);
+}
+
+TEST_F(InferenceSchedulerTest, TokenBudgetTest) {
+    transformer::SchedulerConfig config;
+    config.max_batch_tokens = 8;
+    config.max_prefill_tokens = 8;
+    transformer::InferenceScheduler scheduler(embedding, positions, attention, feed_forward, norm, config);
+
+    for (int i = 0; i < 4; ++i) {
+        scheduler.submit(std::vector<int>(5, i + 1), 4);
+    }
+    while (!scheduler.idle()) {
+        int processed = scheduler.step();
+        EXPECT_GT(processed, 0);
+        EXPECT_LE(processed, config.max_batch_tokens);
+    }
+    EXPECT_EQ(scheduler.take_completed().size(), 4u);
+}
+
+TEST_F(InferenceSchedulerTest, AdmissionLimitedByCacheTest) {
+    transformer::SchedulerConfig config;
+    config.page_size = 4;
+    config.num_pages = 4; // Room for one 12-token request at a time
+    transformer::InferenceScheduler scheduler(embedding, positions, attention, feed_forward, norm, config);
+
+    scheduler.submit(std::vector<int>(8, 1), 4);
+    scheduler.submit(std::vector<int>(8, 2), 4);
+    scheduler.step();
+    EXPECT_EQ(scheduler.num_running(), 1);
+    EXPECT_EQ(scheduler.num_waiting(), 1);
+
+    scheduler.run_until_idle();
+    EXPECT_EQ(scheduler.take_completed().size(), 2u);
+}
+
+TEST_F(InferenceSchedulerTest, StaticBatchingWaitsForDrainTest) {
+    transformer::SchedulerConfig config;
+    config.continuous_batching = false;
+    transformer::InferenceScheduler scheduler(embedding, positions, attention, feed_forward, norm, config);
+
+    scheduler.submit({1, 2, 3}, 6);
+    scheduler.step();
+    scheduler.submit({4, 5}, 2);
+    scheduler.step();
+    EXPECT_EQ(scheduler.num_running(), 1);
+    EXPECT_EQ(scheduler.num_waiting(), 1);
+
+    scheduler.run_until_idle();
+    EXPECT_EQ(scheduler.take_completed().size(), 2u);
+}
+
+TEST_F(InferenceSchedulerTest, StaticBatchingFillsBatchTest) {
+    // Four 3-token prompts against a 4-token prefill budget: all are admitted at once and
+    // the prompts that do not fit are prefilled in chunks over the next steps
+    transformer::SchedulerConfig config;
+    config.continuous_batching = false;
+    config.max_prefill_tokens = 4;
+    config.max_running = 3;
+    transformer::InferenceScheduler scheduler(embedding, positions, attention, feed_forward, norm, config);
+
+    for (int i = 0; i < 4; ++i){
+        scheduler.submit({1 + i, 2, 3}, 2);
+    }
+    EXPECT_EQ(scheduler.step(), 4);
+    EXPECT_EQ(scheduler.num_running(), 3);
+    EXPECT_EQ(scheduler.num_waiting(), 1);
+
+    scheduler.run_until_idle();
+    auto completed = scheduler.take_completed();
+    ASSERT_EQ(completed.size(), 4u);
+    for (const auto& done : completed){
+        EXPECT_EQ(done.output_tokens, reference_generate({1 + done.id, 2, 3}, 2));
+    }
+}
+
+TEST_F(InferenceSchedulerTest, ArrivalTimeCountsTowardsTTFTTest) {
+    // A request that arrived 50 ms before it was submitted has waited at least that long
+    transformer::InferenceScheduler scheduler(embedding, positions, attention, feed_forward, norm);
+    auto arrival = transformer::InferenceScheduler::Clock::now() - std::chrono::milliseconds(50);
+    scheduler.submit({1, 2, 3}, 2, arrival);
+    scheduler.submit({4, 5}, 2);
+
+    scheduler.run_until_idle();
+    auto completed = scheduler.take_completed();
+    ASSERT_EQ(completed.size(), 2u);
+    for (const auto& done : completed){
+        if (done.id == 0){
+            EXPECT_GE(done.time_to_first_token_ms, 50.0);
+            EXPECT_GE(done.latency_ms, done.time_to_first_token_ms);
+        }
+    }
+}
+
+TEST_F(InferenceSchedulerTest, InvalidRequestTest) {
+    transformer::InferenceScheduler scheduler(embedding, positions, attention, feed_forward, norm);
+    EXPECT_THROW(scheduler.submit({}, 4), std::invalid_argument);
+    EXPECT_THROW(scheduler.submit({1, 2}, 0), std::invalid_argument);
+    EXPECT_THROW(scheduler.submit({1, vocab_size}, 4), std::out_of_range);
+    EXPECT_THROW(scheduler.submit(std::vector<int>(max_seq_len, 1), 1), std::invalid_argument);
+}
@@ -0,0 +1,127 @@
+#include <gtest/gtest.h>
+#include "softmax.hpp"
+#include <vector>
+#include <cmath>
+#include <limits>
+#include <random>
+
+class SoftmaxKernelTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        for (auto level : {transformer::SimdLevel::Scalar,
+                           transformer::SimdLevel::AVX2,
+                           transformer::SimdLevel::AVX512}) {
+            if (transformer::simd_level_supported(level)) {
+                levels.push_back(level);
+            }
+        }
+    }
+
+    // The original implementation: subtract the max, std::exp, divide by the sum
+    static std::vector<float> reference_softmax(const std::vector<float>& x, float scale) {
+        std::vector<float> result(x.size());
+        float max_val = -std::numeric_limits<float>::infinity();
+        for (float v : x) {
+            max_val = std::max(max_val, v);
+        }
+        double sum = 0.0;
+        for (size_t i = 0; i < x.size(); ++i) {
+            result[i] = std::exp((x[i] - max_val) * scale);
+            sum += result[i];
+        }
+        for (float& v : result) {
+            v = static_cast<float>(v / sum);
+        }
+        return result;
+    }
+
+    std::vector<transformer::SimdLevel> levels;
+};
+
+TEST_F(SoftmaxKernelTest, FastExpErrorBoundTest) {
+    // Documented bound: relative error below 2.5e-7 on [-87, 88]
+    float max_rel_error = 0.0f;
+    for (int i = 0; i <= 1000000; ++i) {
+        float x = -87.0f + 175.0f * i / 1000000.0f;
+        double expected = std::exp(static_cast<double>(x));
+        double rel = std::abs(transformer::fast_exp(x) - expected) / expected;
+        max_rel_error = std::max(max_rel_error, static_cast<float>(rel));
+    }
+    EXPECT_LT(max_rel_error, 2.5e-7f);
+
+    EXPECT_EQ(transformer::fast_exp(-std::numeric_limits<float>::infinity()), 0.0f);
+    EXPECT_EQ(transformer::fast_exp(-100.0f), 0.0f);
+}
+
+TEST_F(SoftmaxKernelTest, MatchesReferenceTest) {
+    std::mt19937 gen(42);
+    std::uniform_real_distribution<float> dist(-20.0f, 20.0f);
+
+    // Lengths chosen to hit full vectors, partial tails and tail-only rows
+    for (int n : {1, 5, 8, 15, 16, 17, 33, 100, 1000}) {
+        std::vector<float> x(n);
+        for (float& v : x) {
+            v = dist(gen);
+        }
+        auto expected = reference_softmax(x, 0.125f);
+
+        for (auto level : levels) {
+            std::vector<float> result = x;
+            transformer::softmax_inplace(result.data(), n, 0.125f, level);
+
+            float sum = 0.0f;
+            for (int i = 0; i < n; ++i) {
+                EXPECT_NEAR(result[i], expected[i], 1e-6f + 1e-5f * expected[i]) << "n " << n;
+                sum += result[i];
+            }
+            EXPECT_NEAR(sum, 1.0f, 1e-5f);
+        }
+    }
+}
+
+TEST_F(SoftmaxKernelTest, MaskedEntriesTest) {
+    const float neg_inf = -std::numeric_limits<float>::infinity();
+    std::vector<float> x(37, neg_inf);
+    x[3] = 1.0f;
+    x[20] = 1.0f;
+
+    for (auto level : levels) {
+        std::vector<float> result = x;
+        transformer::softmax_inplace(result.data(), 37, 1.0f, level);
+        for (int i = 0; i < 37; ++i) {
+            EXPECT_FLOAT_EQ(result[i], (i == 3 || i == 20) ? 0.5f : 0.0f);
+        }
+
+        // A fully masked row attends to nothing
+        std::vector<float> masked(37, neg_inf);
+        transformer::softmax_inplace(masked.data(), 37, 1.0f, level);
+        for (float v : masked) {
+            EXPECT_EQ(v, 0.0f);
+        }
+    }
+}
+
+TEST_F(SoftmaxKernelTest, NoDenormalsTest) {
+    // Very negative shifted scores must flush to exactly zero
+    std::vector<float> x = {0.0f, -1000.0f, -88.0f, -90.0f, -200.0f, -87.5f, -95.0f, -120.0f, -300.0f};
+    for (auto level : levels) {
+        std::vector<float> result = x;
+        transformer::exp_shift_sum(result.data(), static_cast<int>(result.size()), 0.0f, 1.0f, level);
+        EXPECT_FLOAT_EQ(result[0], 1.0f);
+        for (size_t i = 1; i < result.size(); ++i) {
+            EXPECT_TRUE(result[i] == 0.0f || std::isnormal(result[i]));
+        }
+    }
+}
+
+TEST_F(SoftmaxKernelTest, MaxValueTest) {
+    std::vector<float> x(45);
+    for (int i = 0; i < 45; ++i) {
+        x[i] = static_cast<float>(i % 7);
+    }
+    x[44] = 10.0f;
+    for (auto level : levels) {
+        EXPECT_FLOAT_EQ(transformer::max_value(x.data(), 45, level), 10.0f);
+        EXPECT_FLOAT_EQ(transformer::max_value(x.data(), 3, level), 2.0f);
+    }
+}
@@ -0,0 +1,198 @@
+#include <gtest/gtest.h>
+#include "thread_pool.hpp"
+#include "attention.hpp"
+#include "feed_forward.hpp"
+#include "layer_norm.hpp"
+#include <atomic>
+#include <set>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+TEST(ThreadPoolTest, ParallelForCoversRangeTest) {
+    transformer::ThreadPool pool(transformer::ThreadPoolOptions{4, false});
+    EXPECT_EQ(pool.size(), 4);
+
+    for (int grain : {1, 3, 64, 1000}){
+        std::vector<std::atomic<int>> visits(997);
+        std::atomic<int> max_slot{0};
+        pool.parallel_for(5, 1002, grain, [&](int begin, int end, int slot){
+            for (int i = begin; i < end; ++i){
+                visits[i - 5].fetch_add(1);
+            }
+            int seen = max_slot.load();
+            while (slot > seen && !max_slot.compare_exchange_weak(seen, slot)){
+            }
+        });
+        for (const auto& count : visits){
+            EXPECT_EQ(count.load(), 1);
+        }
+        int chunks = (997 + grain - 1) / grain;
+        EXPECT_LT(max_slot.load(), std::min(pool.size(), chunks));
+    }
+
+    bool called = false;
+    pool.parallel_for(3, 3, 1, [&](int, int, int){called = true;});
+    EXPECT_FALSE(called);
+}
+
+TEST(ThreadPoolTest, SlotsAreExclusiveTest) {
+    transformer::ThreadPool pool(transformer::ThreadPoolOptions{4, false});
+    std::vector<std::atomic<int>> in_use(pool.size());
+    std::atomic<int> collisions{0};
+
+    pool.parallel_for(0, 400, 1, [&](int, int, int slot){
+        if (in_use[slot].fetch_add(1) != 0){
+            ++collisions;
+        }
+        std::this_thread::yield();
+        in_use[slot].fetch_sub(1);
+    });
+    EXPECT_EQ(collisions.load(), 0);
+}
+
+TEST(ThreadPoolTest, ExceptionTest) {
+    transformer::ThreadPool pool(transformer::ThreadPoolOptions{3, false});
+    EXPECT_THROW(pool.parallel_for(0, 100, 1, [](int begin, int, int){
+        if (begin == 42){
+            throw std::runtime_error("chunk failed");
+        }
+    }), std::runtime_error);
+
+    // The pool is still usable afterwards
+    std::atomic<int> sum{0};
+    pool.parallel_for(0, 100, 7, [&](int begin, int end, int){sum += end - begin;});
+    EXPECT_EQ(sum.load(), 100);
+}
+
+TEST(ThreadPoolTest, NestedParallelForRunsInlineTest) {
+    transformer::ThreadPool pool(transformer::ThreadPoolOptions{4, false});
+    EXPECT_FALSE(transformer::ThreadPool::in_parallel_region());
+
+    std::atomic<int> inner_calls{0};
+    std::atomic<int> inner_total{0};
+    pool.parallel_for(0, 8, 1, [&](int, int, int){
+        EXPECT_TRUE(transformer::ThreadPool::in_parallel_region());
+        pool.parallel_for(0, 50, 1, [&](int begin, int end, int slot){
+            EXPECT_EQ(slot, 0);
+            ++inner_calls;
+            inner_total += end - begin;
+        });
+    });
+    EXPECT_EQ(inner_calls.load(), 8);
+    EXPECT_EQ(inner_total.load(), 400);
+    EXPECT_FALSE(transformer::ThreadPool::in_parallel_region());
+}
+
+TEST(ThreadPoolTest, ForEachThreadTest) {
+    transformer::ThreadPool pool(transformer::ThreadPoolOptions{4, false});
+    for (int repeat = 0; repeat < 20; ++repeat){
+        std::vector<std::thread::id> ids(pool.size());
+        std::vector<int> calls(pool.size(), 0);
+        pool.for_each_thread([&](int slot){
+            EXPECT_TRUE(transformer::ThreadPool::in_parallel_region());
+            ids[slot] = std::this_thread::get_id();
+            ++calls[slot];
+        });
+        // Every slot ran once, each on its own thread, the caller as slot 0
+        EXPECT_EQ(calls, std::vector<int>(pool.size(), 1));
+        EXPECT_EQ(ids[0], std::this_thread::get_id());
+        EXPECT_EQ(std::set<std::thread::id>(ids.begin(), ids.end()).size(), ids.size());
+    }
+
+    int inner_calls = 0;
+    pool.parallel_for(0, 1, 1, [&](int, int, int){
+        pool.for_each_thread([&](int slot){
+            EXPECT_EQ(slot, 0);
+            ++inner_calls;
+        });
+    });
+    EXPECT_EQ(inner_calls, 1);
+    EXPECT_THROW(pool.for_each_thread([](int slot){
+        if (slot == 2){
+            throw std::runtime_error("slot failed");
+        }
+    }), std::runtime_error);
+}
+
+TEST(ThreadPoolTest, ConcurrentCallersTest) {
+    transformer::ThreadPool pool(transformer::ThreadPoolOptions{4, false});
+    std::vector<long long> sums(4, 0);
+    std::vector<std::thread> callers;
+    for (int t = 0; t < 4; ++t){
+        callers.emplace_back([&, t]{
+            for (int repeat = 0; repeat < 50; ++repeat){
+                std::atomic<long long> sum{0};
+                pool.parallel_for(0, 1000, 16, [&](int begin, int end, int){
+                    for (int i = begin; i < end; ++i){
+                        sum += i;
+                    }
+                });
+                sums[t] += sum.load();
+            }
+        });
+    }
+    for (auto& caller : callers){
+        caller.join();
+    }
+    for (long long sum : sums){
+        EXPECT_EQ(sum, 50LL * 999 * 1000 / 2);
+    }
+}
+
+TEST(ThreadPoolTest, PinnedPoolTest) {
+    transformer::ThreadPool pool(transformer::ThreadPoolOptions{2, true});
+    // Pinning can be refused (restricted affinity); then no cores are reported
+    EXPECT_TRUE(pool.pinned_cpus().empty() || pool.pinned_cpus().size() == 1u);
+    std::atomic<int> sum{0};
+    pool.parallel_for(0, 10, 1, [&](int begin, int end, int){sum += end - begin;});
+    EXPECT_EQ(sum.load(), 10);
+
+    EXPECT_THROW(transformer::ThreadPool(transformer::ThreadPoolOptions{-1, false}), std::invalid_argument);
+}
+
+TEST(ThreadPoolTest, LayersMatchSingleThreadedTest) {
+    const int d_model = 32;
+    const int num_heads = 4;
+    transformer::MultiHeadAttention attention(num_heads, d_model);
+    transformer::FeedForward feed_forward(d_model, 64, transformer::Activation::GELU_Tanh);
+    transformer::LayerNorm norm(d_model);
+
+    Eigen::MatrixXf x = Eigen::MatrixXf::Random(200, d_model);
+    Eigen::MatrixXf memory = Eigen::MatrixXf::Random(70, d_model);
+    transformer::RaggedBatch batch;
+    batch.tokens = Eigen::MatrixXf::Random(90, d_model);
+    batch.offsets = {0, 10, 45, 46, 90};
+
+    auto run = [&](std::vector<Eigen::MatrixXf>& results){
+        results.push_back(attention.forward(x, x, x, transformer::AttentionMask::causal_mask()));
+        results.push_back(attention.forward(x, memory, memory));
+        results.push_back(attention.forward_batch(batch, true).tokens);
+        results.push_back(feed_forward.forward(x));
+        Eigen::MatrixXf streamed(x.rows(), d_model);
+        Eigen::MatrixXf hidden(48, feed_forward.get_hidden_width());
+        feed_forward.infer(x, streamed, hidden);
+        results.push_back(streamed);
+        results.push_back(norm.forward(x));
+
+        transformer::PagedKVCache cache(d_model, 8, 64);
+        std::vector<int> seqs = {cache.create_sequence(), cache.create_sequence(), cache.create_sequence()};
+        for (int step = 0; step < 3; ++step){
+            results.push_back(attention.forward_incremental_batch(batch, cache, {seqs[0], seqs[1], seqs[2], cache.create_sequence()}).tokens);
+        }
+    };
+
+    int previous = transformer::get_num_threads();
+    std::vector<Eigen::MatrixXf> serial, parallel;
+    transformer::set_num_threads(1);
+    run(serial);
+    transformer::set_num_threads(4);
+    EXPECT_EQ(transformer::get_num_threads(), 4);
+    run(parallel);
+    transformer::set_num_threads(previous);
+
+    ASSERT_EQ(serial.size(), parallel.size());
+    for (std::size_t i = 0; i < serial.size(); ++i){
+        EXPECT_TRUE(parallel[i].isApprox(serial[i], 1e-5f)) << "result " << i;
+    }
+}
@@ -0,0 +1,224 @@
+#include <gtest/gtest.h>
+#include "trace.hpp"
+#include "transformer.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace transformer;
+
+namespace {
+
+const TraceStageSummary* find_stage(const std::vector<TraceStageSummary>& stages, const std::string& name){
+    auto it = std::find_if(stages.begin(), stages.end(), [&](const TraceStageSummary& s){return s.name == name;});
+    return it == stages.end() ? nullptr : &*it;
+}
+
+} // namespace
+
+
+TEST(LatencyHistogramTest, BucketsTileTheRangeTest){
+    for (int b = 0; b + 1 < LatencyHistogram::kBuckets; ++b){
+        ASSERT_EQ(LatencyHistogram::bucket_upper(b) + 1, LatencyHistogram::bucket_lower(b + 1)) << "bucket " << b;
+    }
+    for (uint64_t value : {0ull, 7ull, 8ull, 1000ull, 123456789ull, 1ull << 40}){
+        int b = LatencyHistogram::bucket_of(value);
+        EXPECT_LE(LatencyHistogram::bucket_lower(b), value);
+        EXPECT_GE(LatencyHistogram::bucket_upper(b), value);
+        // Log-linear buckets keep the relative width at 1/8 or below
+        EXPECT_LE(LatencyHistogram::bucket_upper(b) - LatencyHistogram::bucket_lower(b), value / 8);
+    }
+    EXPECT_EQ(LatencyHistogram::bucket_of(~0ull), LatencyHistogram::kBuckets - 1);
+}
+
+
+TEST(LatencyHistogramTest, PercentilesTest){
+    LatencyHistogram histogram;
+    EXPECT_EQ(histogram.percentile_ns(0.5), 0u);
+    for (uint64_t us = 1; us <= 1000; ++us){
+        histogram.record(us * 1000);
+    }
+
+    EXPECT_EQ(histogram.count(), 1000u);
+    EXPECT_EQ(histogram.max_ns(), 1000000u);
+    EXPECT_NEAR(histogram.mean_ns(), 500500.0, 1e-6);
+    EXPECT_NEAR(static_cast<double>(histogram.percentile_ns(0.5)), 500000.0, 500000.0 * 0.125);
+    EXPECT_NEAR(static_cast<double>(histogram.percentile_ns(0.99)), 990000.0, 990000.0 * 0.125);
+    EXPECT_EQ(histogram.percentile_ns(1.0), 1000000u);
+
+    LatencyHistogram other;
+    other.record(5000000);
+    histogram.merge(other);
+    EXPECT_EQ(histogram.count(), 1001u);
+    EXPECT_EQ(histogram.percentile_ns(1.0), 5000000u);
+}
+
+
+TEST(TraceTest, RecordsFromManyThreadsTest){
+    reset_trace();
+    int stage = trace_stage_id("test.threads");
+    EXPECT_EQ(trace_stage_id("test.threads"), stage);
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t){
+        threads.emplace_back([stage]{
+            for (int i = 0; i < 100; ++i){
+                TraceScope scope(stage);
+            }
+        });
+    }
+    for (auto& thread : threads){
+        thread.join();
+    }
+
+    // Logs outlive their threads, so all 400 intervals are still there
+    const TraceStageSummary* summary = find_stage(trace_summary(), "test.threads");
+    ASSERT_NE(summary, nullptr);
+    EXPECT_EQ(summary->latency.count(), 400u);
+
+    reset_trace();
+    summary = find_stage(trace_summary(), "test.threads");
+    ASSERT_NE(summary, nullptr);
+    EXPECT_EQ(summary->latency.count(), 0u);
+}
+
+
+TEST(TraceTest, ExitedThreadLogsAreReusedTest){
+    reset_trace();
+    int stage = trace_stage_id("test.churn");
+    auto count_threads = []{
+        std::ostringstream trace;
+        write_chrome_trace(trace);
+        std::string json = trace.str();
+        std::size_t count = 0;
+        for (std::size_t at = json.find("\"thread_name\""); at != std::string::npos; at = json.find("\"thread_name\"", at + 1)){
+            ++count;
+        }
+        return count;
+    };
+
+    auto record_on_new_thread = [stage]{
+        std::thread([stage]{TraceScope scope(stage);}).join();
+    };
+    record_on_new_thread();
+    std::size_t threads = count_threads();
+    for (int i = 0; i < 32; ++i){
+        record_on_new_thread();
+    }
+    // One thread at a time, so every one of them takes over the same log
+    EXPECT_EQ(count_threads(), threads);
+
+    const TraceStageSummary* summary = find_stage(trace_summary(), "test.churn");
+    ASSERT_NE(summary, nullptr);
+    EXPECT_EQ(summary->latency.count(), 33u);
+}
+
+
+TEST(TraceTest, ExportSkipsSlotsBeingWrittenTest){
+    reset_trace();
+    int stage = trace_stage_id("test.torn");
+    // Event k starts k us after base and lasts k ns, so any start paired with another
+    // event's duration breaks ts - 1000 * dur being the same for every event
+    const uint64_t base = trace_now_ns();
+    std::atomic<bool> done{false};
+    std::thread writer([&]{
+        for (uint64_t k = 0; k < 20 * static_cast<uint64_t>(kTraceEventsPerThread); ++k){
+            trace_record(stage, base + 1000 * k, base + 1001 * k);
+        }
+        done = true;
+    });
+
+    int checked = 0;
+    int torn = 0;
+    while (!done || checked == 0){
+        std::ostringstream trace;
+        write_chrome_trace(trace);
+        std::string json = trace.str();
+        const std::string name = "\"name\":\"test.torn\"";
+        bool have_offset = false;
+        double offset = 0.0;
+        for (std::size_t at = json.find(name); at != std::string::npos; at = json.find(name, at + 1)){
+            double ts = std::stod(json.substr(json.find("\"ts\":", at) + 5));
+            double dur = std::stod(json.substr(json.find("\"dur\":", at) + 6));
+            double event_offset = ts - 1000.0 * dur;
+            if (!have_offset){
+                offset = event_offset;
+                have_offset = true;
+            }
+            torn += std::abs(event_offset - offset) > 0.5;
+            ++checked;
+        }
+    }
+    writer.join();
+    EXPECT_GT(checked, 0);
+    EXPECT_EQ(torn, 0);
+}
+
+
+TEST(TraceTest, ExportsTest){
+    reset_trace();
+    int outer = trace_stage_id("test.outer");
+    int inner = trace_stage_id("test.inner");
+    uint64_t start = trace_now_ns();
+    trace_record(inner, start + 1000, start + 3000);
+    trace_record(outer, start, start + 5000);
+
+    std::ostringstream trace;
+    write_chrome_trace(trace);
+    std::string json = trace.str();
+    EXPECT_NE(json.find("\"traceEvents\""), std::string::npos);
+    EXPECT_NE(json.find("\"name\":\"test.outer\""), std::string::npos);
+    EXPECT_NE(json.find("\"name\":\"test.inner\""), std::string::npos);
+    EXPECT_NE(json.find("\"dur\":5.000"), std::string::npos);
+    EXPECT_EQ(std::count(json.begin(), json.end(), '{'), std::count(json.begin(), json.end(), '}'));
+
+    std::ostringstream summary;
+    write_trace_summary(summary);
+    std::string text = summary.str();
+    // Sorted by total time, so the outer stage comes first
+    ASSERT_NE(text.find("test.outer"), std::string::npos);
+    EXPECT_LT(text.find("test.outer"), text.find("test.inner"));
+}
+
+
+TEST(TraceTest, LayerStagesTest){
+    reset_trace();
+    MultiHeadAttention attention(4, 32);
+    FeedForward feed_forward(32, 64);
+    LayerNorm norm(32);
+    TokenEmbedding embedding(50, 32);
+
+    Eigen::MatrixXf x = embedding.forward({1, 2, 3, 4, 5, 6});
+    Eigen::MatrixXf attended = attention.forward(x, x, x, AttentionMask::causal_mask());
+    Eigen::MatrixXf normed = norm.forward(attended);
+    feed_forward.forward(normed);
+
+    std::vector<TraceStageSummary> stages = trace_summary();
+    const std::vector<std::string> expected = {
+        "embedding.gather", "attention.forward", "attention.qkv_projection", "attention.heads",
+        "attention.scores", "attention.softmax", "attention.weighted_sum", "attention.output_projection",
+        "layer_norm.forward", "feed_forward.forward", "feed_forward.up_projection",
+        "feed_forward.activation", "feed_forward.down_projection"};
+    for (const std::string& name : expected){
+        const TraceStageSummary* stage = find_stage(stages, name);
+        if (kTracingEnabled){
+            ASSERT_NE(stage, nullptr) << name;
+            EXPECT_GT(stage->latency.count(), 0u) << name;
+        } else {
+            // The scopes compile away, so no layer stage is ever registered
+            EXPECT_EQ(stage, nullptr) << name;
+        }
+    }
+
+    if (kTracingEnabled){
+        // One score block per head
+        EXPECT_EQ(find_stage(stages, "attention.scores")->latency.count(), 4u);
+        EXPECT_EQ(find_stage(stages, "attention.forward")->latency.count(), 1u);
+    }
+}
@@ -0,0 +1,96 @@
+#include <gtest/gtest.h>
+#include "transformer.hpp"
+#include <memory>
+#include <thread>
+#include <vector>
+
+class TransformerTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        model = std::make_unique<transformer::Transformer>(30, 40, 16, 4, 32, 2, 32);
+    }
+
+    std::unique_ptr<transformer::Transformer> model;
+};
+
+TEST_F(TransformerTest, MatchesLayerByLayerTest) {
+    std::vector<int> src = {1, 5, 7, 2, 9};
+    std::vector<int> tgt = {3, 4, 8};
+
+    Eigen::MatrixXf logits = model->forward(src, tgt);
+    ASSERT_EQ(logits.rows(), 3);
+    ASSERT_EQ(logits.cols(), 40);
+
+    const auto& positions = model->get_positional_encoding();
+    Eigen::MatrixXf memory = model->get_src_embedding().get_embedding_matrix()(src, Eigen::all)
+                             + positions.get_pos_encoding().topRows(src.size());
+    for (int i = 0; i < model->get_num_layers(); ++i) {
+        memory = model->get_encoder_layer(i).forward(memory);
+    }
+    Eigen::MatrixXf hidden = model->get_tgt_embedding().get_embedding_matrix()(tgt, Eigen::all)
+                             + positions.get_pos_encoding().topRows(tgt.size());
+    for (int i = 0; i < model->get_num_layers(); ++i) {
+        hidden = model->get_decoder_layer(i).forward(hidden, memory);
+    }
+    Eigen::MatrixXf expected = hidden * model->get_tgt_embedding().get_embedding_matrix().transpose();
+
+    EXPECT_TRUE(logits.isApprox(expected, 1e-4f));
+}
+
+TEST_F(TransformerTest, RepeatedCallsTest) {
+    std::vector<int> src = {1, 2, 3, 4};
+    std::vector<int> tgt = {5, 6};
+
+    Eigen::MatrixXf first = model->forward(src, tgt);
+    model->forward({1, 2, 3, 4, 5, 6, 7, 8, 9}, {1, 2, 3, 4, 5, 6, 7});
+    Eigen::MatrixXf again = model->forward(src, tgt);
+
+    EXPECT_TRUE(first.isApprox(again, 1e-6f));
+}
+
+TEST_F(TransformerTest, DecodeNeedsEncodeTest) {
+    EXPECT_THROW(model->decode({1, 2}), std::logic_error);
+}
+
+TEST_F(TransformerTest, SequenceTooLongTest) {
+    std::vector<int> src(33, 1);
+    EXPECT_THROW(model->encode(src), std::out_of_range);
+}
+
+TEST_F(TransformerTest, SharedModelAcrossThreadsTest) {
+    // One immutable model, one context per thread: results match single-threaded calls
+    std::shared_ptr<const transformer::Transformer> shared = std::move(model);
+    const int num_callers = 4;
+    std::vector<std::vector<int>> sources, targets;
+    std::vector<Eigen::MatrixXf> expected;
+    transformer::TransformerContext serial;
+    for (int t = 0; t < num_callers; ++t) {
+        sources.push_back(std::vector<int>(3 + 2 * t, t + 1));
+        sources.back()[0] = 7;
+        targets.push_back({2 + t, 9, 11 - t, 20});
+        targets.back().resize(2 + t, 5);
+        expected.emplace_back(targets.back().size(), 40);
+        shared->forward_into(sources.back(), targets.back(), expected.back(), serial);
+    }
+
+    std::vector<int> mismatches(num_callers, 0);
+    std::vector<std::thread> callers;
+    for (int t = 0; t < num_callers; ++t) {
+        callers.emplace_back([&, t] {
+            transformer::TransformerContext context;
+            Eigen::MatrixXf logits(targets[t].size(), 40);
+            for (int repeat = 0; repeat < 20; ++repeat) {
+                shared->forward_into(sources[t], targets[t], logits, context);
+                if (!logits.isApprox(expected[t], 1e-5f)) {
+                    ++mismatches[t];
+                }
+            }
+        });
+    }
+    for (auto& caller : callers) {
+        caller.join();
+    }
+    for (int t = 0; t < num_callers; ++t) {
+        EXPECT_EQ(mismatches[t], 0) << "caller " << t;
+    }
+}
@@ -0,0 +1,77 @@
+#include <gtest/gtest.h>
+#include "transformer_block.hpp"
+
+class TransformerBlockTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        d_model = 16;
+        num_heads = 4;
+        d_ff = 32;
+    }
+
+    int d_model;
+    int num_heads;
+    int d_ff;
+};
+
+TEST_F(TransformerBlockTest, EncoderMatchesSublayersTest) {
+    transformer::EncoderBlock block(d_model, num_heads, d_ff);
+    Eigen::MatrixXf x = Eigen::MatrixXf::Random(7, d_model);
+
+    Eigen::MatrixXf output = block.forward(x);
+
+    Eigen::MatrixXf attention = block.get_self_attention().forward(x, x, x);
+    Eigen::MatrixXf hidden = block.get_norm1().forward(x + attention);
+    Eigen::MatrixXf ff = block.get_feed_forward().forward(hidden);
+    Eigen::MatrixXf expected = block.get_norm2().forward(hidden + ff);
+
+    EXPECT_TRUE(output.isApprox(expected, 1e-5f));
+}
+
+TEST_F(TransformerBlockTest, DecoderMatchesSublayersTest) {
+    transformer::DecoderBlock block(d_model, num_heads, d_ff);
+    Eigen::MatrixXf x = Eigen::MatrixXf::Random(5, d_model);
+    Eigen::MatrixXf memory = Eigen::MatrixXf::Random(9, d_model);
+
+    Eigen::MatrixXf output = block.forward(x, memory);
+
+    auto causal = transformer::AttentionMask::causal_mask();
+    Eigen::MatrixXf self = block.get_self_attention().forward(x, x, x, causal);
+    Eigen::MatrixXf hidden1 = block.get_norm1().forward(x + self);
+    Eigen::MatrixXf cross = block.get_cross_attention().forward(hidden1, memory, memory);
+    Eigen::MatrixXf hidden2 = block.get_norm2().forward(hidden1 + cross);
+    Eigen::MatrixXf ff = block.get_feed_forward().forward(hidden2);
+    Eigen::MatrixXf expected = block.get_norm3().forward(hidden2 + ff);
+
+    EXPECT_TRUE(output.isApprox(expected, 1e-5f));
+}
+
+TEST_F(TransformerBlockTest, DecoderIsCausalTest) {
+    transformer::DecoderBlock block(d_model, num_heads, d_ff);
+    Eigen::MatrixXf x = Eigen::MatrixXf::Random(6, d_model);
+    Eigen::MatrixXf memory = Eigen::MatrixXf::Random(4, d_model);
+
+    Eigen::MatrixXf full = block.forward(x, memory);
+    Eigen::MatrixXf prefix = block.forward(x.topRows(3), memory);
+
+    EXPECT_TRUE(full.topRows(3).isApprox(prefix, 1e-5f));
+}
+
+TEST_F(TransformerBlockTest, BufferReuseAcrossLengthsTest) {
+    transformer::EncoderBlock block(d_model, num_heads, d_ff);
+    Eigen::MatrixXf short_x = Eigen::MatrixXf::Random(3, d_model);
+    Eigen::MatrixXf long_x = Eigen::MatrixXf::Random(10, d_model);
+
+    Eigen::MatrixXf first = block.forward(short_x);
+    block.forward(long_x);
+    Eigen::MatrixXf again = block.forward(short_x);
+
+    EXPECT_TRUE(first.isApprox(again, 1e-6f));
+}
+
+TEST_F(TransformerBlockTest, ShapeMismatchTest) {
+    transformer::EncoderBlock block(d_model, num_heads, d_ff);
+    Eigen::MatrixXf x = Eigen::MatrixXf::Random(4, d_model);
+    Eigen::MatrixXf output(3, d_model);
+    EXPECT_THROW(block.forward_into(x, output), std::invalid_argument);
+}